@@ -1,17 +1,23 @@
 #include "DebtSimplifier.h"
+#include <algorithm>
 #include <cmath>
+#include <future>
+#include <latch>
+#include <map>
+#include <memory_resource>
+#include <thread>
 
-std::pair<
-    std::vector<std::pair<long long, long long>>,
-    std::vector<std::pair<long long, long long>>
-> DebtSimplifier::computeBalances(
-    const std::vector<PaymentGroup>& paymentGroups,
+namespace {
+
+// Signed balance per user in target-currency minor units (positive = is owed money)
+template<typename BalanceMap>
+void accumulateBalances(
+    BalanceMap& balances,
+    std::span<const PaymentGroup> paymentGroups,
     const std::unordered_map<std::string, double>& exchangeRates,
     const std::string& targetCurrency)
 {
     double targetMinorPerMajor = MoneyAmount::minorUnitsPerMajor(targetCurrency);
-
-    std::unordered_map<long long, double> balances;
     for (const auto& group : paymentGroups) {
         for (const auto& record : group.records) {
             double srcMinorPerMajor = MoneyAmount::minorUnitsPerMajor(record.amount.currency());
@@ -21,9 +27,14 @@ std::pair<
             balances[record.from_user_id] += amountMinor;
         }
     }
+}
 
-    std::vector<std::pair<long long, long long>> creditors;
-    std::vector<std::pair<long long, long long>> debtors;
+template<typename BalanceMap>
+void splitBalances(
+    const BalanceMap& balances,
+    std::vector<std::pair<long long, long long>>& creditors,
+    std::vector<std::pair<long long, long long>>& debtors)
+{
     for (const auto& [userId, balance] : balances) {
         long long rounded = static_cast<long long>(std::round(balance));
         if (rounded > 0) {
@@ -32,7 +43,35 @@ std::pair<
             debtors.push_back({userId, -rounded});
         }
     }
-    return {creditors, debtors};
+}
+
+// Per-chunk scratch space reused across the trips of a batch: the arena backs the
+// balance map being built, the vectors keep their capacity. solve() allocates on its own.
+struct BatchScratch {
+    static constexpr std::size_t ARENA_BYTES = 64 * 1024;
+
+    BatchScratch() : buffer(std::make_unique<std::byte[]>(ARENA_BYTES)), arena(buffer.get(), ARENA_BYTES) {}
+
+    std::unique_ptr<std::byte[]> buffer;
+    std::pmr::monotonic_buffer_resource arena;
+    std::vector<std::pair<long long, long long>> creditors;
+    std::vector<std::pair<long long, long long>> debtors;
+};
+
+} // namespace
+
+CurrencyBalances DebtSimplifier::computeNetBalances(const std::vector<PaymentGroup>& paymentGroups) {
+    CurrencyBalances netBalances;
+    for (const auto& group : paymentGroups) {
+        // Payer paid total_amount
+        netBalances[group.payer_user_id][group.total_amount.currency()] += group.total_amount.minorAmount();
+
+        // Each record recipient "received" (owes) amount
+        for (const auto& record : group.records) {
+            netBalances[record.to_user_id][record.amount.currency()] -= record.amount.minorAmount();
+        }
+    }
+    return netBalances;
 }
 
 std::vector<SimplifiedPayment> DebtSimplifier::simplifyDebts(
@@ -40,6 +79,109 @@ std::vector<SimplifiedPayment> DebtSimplifier::simplifyDebts(
     const std::unordered_map<std::string, double>& exchangeRates,
     const std::string& targetCurrency)
 {
-    auto [creditors, debtors] = computeBalances(paymentGroups, exchangeRates, targetCurrency);
-    return solve(std::move(creditors), std::move(debtors), targetCurrency);
+    std::unordered_map<long long, double> balances;
+    accumulateBalances(balances, paymentGroups, exchangeRates, targetCurrency);
+
+    std::vector<std::pair<long long, long long>> creditors;
+    std::vector<std::pair<long long, long long>> debtors;
+    splitBalances(balances, creditors, debtors);
+    return solve(creditors, debtors, targetCurrency);
+}
+
+std::vector<SimplifiedPayment> DebtSimplifier::settle(
+    const std::unordered_map<long long, long long>& balances,
+    const std::string& currency)
+{
+    std::vector<std::pair<long long, long long>> creditors;
+    std::vector<std::pair<long long, long long>> debtors;
+    for (const auto& [userId, balance] : balances) {
+        if (balance > 0) {
+            creditors.push_back({userId, balance});
+        } else if (balance < 0) {
+            debtors.push_back({userId, -balance});
+        }
+    }
+    return solve(creditors, debtors, currency);
+}
+
+std::vector<SimplifiedPayment> DebtSimplifier::simplifyDebtsPerCurrency(const CurrencyBalances& netBalances) {
+    std::map<std::string, std::unordered_map<long long, long long>> byCurrency;
+    for (const auto& [userId, perCurrency] : netBalances) {
+        for (const auto& [currency, amount] : perCurrency) {
+            if (amount != 0) {
+                byCurrency[currency][userId] = amount;
+            }
+        }
+    }
+
+    std::vector<std::future<std::vector<SimplifiedPayment>>> pending;
+    pending.reserve(byCurrency.size());
+    for (const auto& [currency, balances] : byCurrency) {
+        // Solvers keep no state between calls, so currencies can be solved concurrently
+        auto policy = byCurrency.size() > 1 ? std::launch::async : std::launch::deferred;
+        pending.push_back(std::async(policy, [this, &currency, &balances] {
+            return settle(balances, currency);
+        }));
+    }
+
+    std::vector<SimplifiedPayment> result;
+    for (auto& future : pending) {
+        auto payments = future.get();
+        result.insert(result.end(), payments.begin(), payments.end());
+    }
+    return result;
+}
+
+std::vector<TripSettlementResult> DebtSimplifier::simplifyBatch(
+    std::span<const TripSettlementInput> trips,
+    const SettlementExecutor& executor,
+    std::size_t maxParallelism)
+{
+    std::vector<TripSettlementResult> results(trips.size());
+    if (trips.empty()) return results;
+
+    if (maxParallelism == 0) {
+        maxParallelism = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::size_t chunkCount = std::min(maxParallelism, trips.size());
+    std::size_t chunkSize = (trips.size() + chunkCount - 1) / chunkCount;
+    chunkCount = (trips.size() + chunkSize - 1) / chunkSize;
+
+    std::latch done(static_cast<std::ptrdiff_t>(chunkCount));
+    auto runChunk = [this, trips, &results, &done](std::size_t begin, std::size_t end) {
+        BatchScratch scratch;
+        for (std::size_t i = begin; i < end; ++i) {
+            const auto& trip = trips[i];
+            auto& result = results[i];
+            result.trip_id = trip.trip_id;
+            try {
+                {
+                    std::pmr::unordered_map<long long, double> balances(&scratch.arena);
+                    accumulateBalances(balances, trip.paymentGroups, *trip.exchangeRates, trip.targetCurrency);
+                    scratch.creditors.clear();
+                    scratch.debtors.clear();
+                    splitBalances(balances, scratch.creditors, scratch.debtors);
+                }
+                // The balance map is gone; hand its memory back for the next trip
+                scratch.arena.release();
+                result.payments = solve(scratch.creditors, scratch.debtors, trip.targetCurrency);
+            } catch (const std::exception& e) {
+                scratch.arena.release();
+                result.payments.clear();
+                result.error = e.what();
+            }
+        }
+        done.count_down();
+    };
+
+    for (std::size_t begin = 0; begin < trips.size(); begin += chunkSize) {
+        std::size_t end = std::min(begin + chunkSize, trips.size());
+        std::function<void()> task = [&runChunk, begin, end] { runChunk(begin, end); };
+        if (!executor || !executor(task)) {
+            task();
+        }
+    }
+
+    done.wait();
+    return results;
 }
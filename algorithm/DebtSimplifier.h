@@ -3,6 +3,9 @@
 
 #include "../repository/PaymentRepository.h"
 #include "../utils/MoneyAmount.h"
+#include <cstddef>
+#include <functional>
+#include <span>
 #include <unordered_map>
 #include <vector>
 #include <string>
@@ -13,29 +16,63 @@ struct SimplifiedPayment {
     MoneyAmount amount;
 };
 
+// userId -> currency -> signed minor units (positive = is owed money)
+using CurrencyBalances = std::unordered_map<long long, std::unordered_map<std::string, long long>>;
+
+struct TripSettlementInput {
+    long long trip_id;
+    std::span<const PaymentGroup> paymentGroups;
+    const std::unordered_map<std::string, double>* exchangeRates;
+    std::string targetCurrency;
+};
+
+struct TripSettlementResult {
+    long long trip_id;
+    std::vector<SimplifiedPayment> payments;
+    std::string error;  // non-empty if the trip could not be settled, e.g. a missing exchange rate
+};
+
+// Runs a task, returning false if it was not accepted; bot::ThreadPool::submit fits.
+// Rejected tasks are run on the calling thread instead.
+using SettlementExecutor = std::function<bool(std::function<void()>)>;
+
 class DebtSimplifier {
 public:
     virtual ~DebtSimplifier() = default;
 
+    static CurrencyBalances computeNetBalances(const std::vector<PaymentGroup>& paymentGroups);
+
     std::vector<SimplifiedPayment> simplifyDebts(
         const std::vector<PaymentGroup>& paymentGroups,
         const std::unordered_map<std::string, double>& exchangeRates,
         const std::string& targetCurrency);
 
+    // Settle already-converted balances (userId -> signed minor units in currency,
+    // positive = is owed money). Zero balances are ignored.
+    std::vector<SimplifiedPayment> settle(
+        const std::unordered_map<long long, long long>& balances,
+        const std::string& currency);
+
+    // Settle every currency on its own without conversion, one solver run per currency
+    // in parallel. Payments are grouped by currency in alphabetical order.
+    std::vector<SimplifiedPayment> simplifyDebtsPerCurrency(const CurrencyBalances& netBalances);
+
+    // Settle many trips in one call. Trips are split into at most maxParallelism chunks
+    // (default: hardware concurrency) run on the executor. Within a chunk, each trip's
+    // balance map lives in one reused arena and the creditor/debtor lists are reused;
+    // the solver's own working state and each trip's result are still allocated per
+    // trip. Blocks until all chunks are done, so it must not be called from a worker
+    // of the executor it is given.
+    std::vector<TripSettlementResult> simplifyBatch(
+        std::span<const TripSettlementInput> trips,
+        const SettlementExecutor& executor,
+        std::size_t maxParallelism = 0);
+
 protected:
     virtual std::vector<SimplifiedPayment> solve(
-        std::vector<std::pair<long long, long long>> creditors,
-        std::vector<std::pair<long long, long long>> debtors,
+        const std::vector<std::pair<long long, long long>>& creditors,
+        const std::vector<std::pair<long long, long long>>& debtors,
         const std::string& targetCurrency) = 0;
-
-private:
-    static std::pair<
-        std::vector<std::pair<long long, long long>>,
-        std::vector<std::pair<long long, long long>>
-    > computeBalances(
-        const std::vector<PaymentGroup>& paymentGroups,
-        const std::unordered_map<std::string, double>& exchangeRates,
-        const std::string& targetCurrency);
 };
 
 #endif //FRIENDS_TRIP_BOT_DEBTSIMPLIFIER_H
@@ -3,8 +3,8 @@
 #include <algorithm>
 
 std::vector<SimplifiedPayment> GreedyDebtSimplifier::solve(
-    std::vector<std::pair<long long, long long>> creditors,
-    std::vector<std::pair<long long, long long>> debtors,
+    const std::vector<std::pair<long long, long long>>& creditors,
+    const std::vector<std::pair<long long, long long>>& debtors,
     const std::string& targetCurrency)
 {
     // Max-heap: (balance, userId)
@@ -53,8 +53,8 @@ void MinTransactionsSimplifier::dfs(
 }
 
 std::vector<SimplifiedPayment> MinTransactionsSimplifier::solve(
-    std::vector<std::pair<long long, long long>> creditors,
-    std::vector<std::pair<long long, long long>> debtors,
+    const std::vector<std::pair<long long, long long>>& creditors,
+    const std::vector<std::pair<long long, long long>>& debtors,
     const std::string& targetCurrency)
 {
     std::vector<std::pair<long long, long long>> balances;
@@ -6,8 +6,8 @@
 class MinTransactionsSimplifier : public DebtSimplifier {
 protected:
     std::vector<SimplifiedPayment> solve(
-        std::vector<std::pair<long long, long long>> creditors,
-        std::vector<std::pair<long long, long long>> debtors,
+        const std::vector<std::pair<long long, long long>>& creditors,
+        const std::vector<std::pair<long long, long long>>& debtors,
         const std::string& targetCurrency) override;
 
 private:
@@ -0,0 +1,280 @@
+#include "SettlementEngine.h"
+#include <cmath>
+#include <set>
+
+uint64_t SettlementEngine::beginLoad(long long tripId) {
+    auto state = getOrCreate(tripId);
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->epoch + anyTripEpoch_.load();
+}
+
+bool SettlementEngine::load(long long tripId, const std::vector<PaymentGroup>& paymentGroups, uint64_t epoch) {
+    auto state = getOrCreate(tripId);
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->loaded) return true;
+    // Both epochs only grow, so any write begun since beginLoad() changes the sum
+    if (state->pendingWrites > 0 || anyTripPendingWrites_.load() > 0) return false;
+    if (state->epoch + anyTripEpoch_.load() != epoch) return false;
+
+    state->balances.clear();
+    state->paymentGroupCount = 0;
+    for (const auto& group : paymentGroups) {
+        addGroup(*state, group, 1);
+    }
+    state->hasSolution = false;
+    state->loaded = true;
+    return true;
+}
+
+bool SettlementEngine::isLoaded(long long tripId) const {
+    auto state = find(tripId);
+    if (!state) return false;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->loaded;
+}
+
+void SettlementEngine::evict(long long tripId) {
+    auto state = find(tripId);
+    if (!state) return;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    clear(*state);
+}
+
+void SettlementEngine::evictAll() {
+    std::vector<long long> tripIds;
+    trips_.for_each([&tripIds](const auto& kv) { tripIds.push_back(kv.first); });
+    for (long long tripId : tripIds) {
+        evict(tripId);
+    }
+}
+
+SettlementEngine::PendingWrite SettlementEngine::beginWrite(long long tripId) {
+    // No getOrCreate(): a trip nobody has loaded needs no state to keep in step
+    auto state = find(tripId);
+    if (state) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->pendingWrites++;
+        state->epoch++;
+    }
+    return PendingWrite(this, tripId, std::move(state));
+}
+
+SettlementEngine::PendingWrite SettlementEngine::beginWrite() {
+    anyTripPendingWrites_++;
+    anyTripEpoch_++;
+    return PendingWrite(this, std::nullopt, nullptr);
+}
+
+void SettlementEngine::applyPaymentGroup(const PaymentGroup& group) {
+    beginWrite(group.trip_id).apply(group);
+}
+
+void SettlementEngine::revertPaymentGroup(const PaymentGroup& group) {
+    beginWrite(group.trip_id).revert(group);
+}
+
+SettlementEngine::PendingWrite::PendingWrite(SettlementEngine* engine, std::optional<long long> tripId,
+                                             std::shared_ptr<TripState> state)
+    : engine_(engine), tripId_(tripId), state_(std::move(state)) {}
+
+SettlementEngine::PendingWrite::PendingWrite(PendingWrite&& other) noexcept
+    : engine_(other.engine_), tripId_(other.tripId_), state_(std::move(other.state_)), unchanged_(other.unchanged_) {
+    other.engine_ = nullptr;
+}
+
+SettlementEngine::PendingWrite::~PendingWrite() {
+    finish(nullptr, 0);
+}
+
+void SettlementEngine::PendingWrite::apply(const PaymentGroup& group) {
+    finish(&group, 1);
+}
+
+void SettlementEngine::PendingWrite::revert(const PaymentGroup& group) {
+    finish(&group, -1);
+}
+
+void SettlementEngine::PendingWrite::unchanged() {
+    unchanged_ = true;
+    finish(nullptr, 0);
+}
+
+void SettlementEngine::PendingWrite::finish(const PaymentGroup* group, long long sign) {
+    if (!engine_) return;
+    if (!tripId_) {
+        finishAnyTrip(group, sign);
+        return;
+    }
+    SettlementEngine* engine = engine_;
+    engine_ = nullptr;
+
+    if (!state_) {
+        if (unchanged_) return;
+        // The trip had no state when the write began, so a load may have started and
+        // finished since, from history with or without this write
+        if (auto state = engine->find(*tripId_)) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            clear(*state);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->pendingWrites--;
+    if (unchanged_) {
+        state_->epoch++;
+        return;
+    }
+    if (!group) {
+        clear(*state_);
+        return;
+    }
+    // Loads are refused while the write is pending, so a loaded trip was loaded before
+    // it began and does not include it yet
+    state_->epoch++;
+    if (state_->loaded) addGroup(*state_, *group, sign);
+}
+
+void SettlementEngine::PendingWrite::finishAnyTrip(const PaymentGroup* group, long long sign) {
+    SettlementEngine* engine = engine_;
+    engine_ = nullptr;
+
+    if (group) {
+        // As for a trip's own writes: no trip can have loaded while this was pending
+        if (auto state = engine->find(group->trip_id)) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->epoch++;
+            if (state->loaded) addGroup(*state, *group, sign);
+        }
+    } else if (!unchanged_) {
+        // Whatever trip the write touched, it may have landed
+        engine->evictAll();
+    }
+    engine->anyTripEpoch_++;
+    engine->anyTripPendingWrites_--;
+}
+
+void SettlementEngine::clear(TripState& state) {
+    // Bump the epoch so that a load racing with the eviction is discarded
+    state.loaded = false;
+    state.epoch++;
+    state.balances.clear();
+    state.paymentGroupCount = 0;
+    state.hasSolution = false;
+    state.solution.clear();
+    state.solvedBalances.clear();
+}
+
+void SettlementEngine::addGroup(TripState& state, const PaymentGroup& group, long long sign) {
+    for (const auto& record : group.records) {
+        long long amount = sign * record.amount.minorAmount();
+        state.balances[record.from_user_id][record.amount.currency()] += amount;
+        state.balances[record.to_user_id][record.amount.currency()] -= amount;
+    }
+    if (sign > 0) {
+        state.paymentGroupCount++;
+    } else if (state.paymentGroupCount > 0) {
+        state.paymentGroupCount--;
+    }
+}
+
+std::optional<SettlementSummary> SettlementEngine::summary(long long tripId) const {
+    auto state = find(tripId);
+    if (!state) return std::nullopt;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (!state->loaded) return std::nullopt;
+
+    std::set<std::string> currencies;
+    for (const auto& [userId, perCurrency] : state->balances) {
+        for (const auto& [currency, amount] : perCurrency) {
+            currencies.insert(currency);
+        }
+    }
+    return SettlementSummary{
+        state->paymentGroupCount,
+        state->balances.size(),
+        std::vector<std::string>(currencies.begin(), currencies.end())
+    };
+}
+
+std::optional<std::vector<SimplifiedPayment>> SettlementEngine::simplify(
+    long long tripId,
+    DebtSimplifier& simplifier,
+    const std::unordered_map<std::string, double>& exchangeRates,
+    const std::string& targetCurrency)
+{
+    auto state = find(tripId);
+    if (!state) return std::nullopt;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (!state->loaded) return std::nullopt;
+
+    // Convert per-currency balances into the target currency
+    double targetMinorPerMajor = MoneyAmount::minorUnitsPerMajor(targetCurrency);
+    std::unordered_map<long long, long long> converted;
+    for (const auto& [userId, perCurrency] : state->balances) {
+        double balance = 0;
+        for (const auto& [currency, amount] : perCurrency) {
+            if (amount == 0) continue;
+            // E.g. a payment in a new currency recorded after the rates were collected
+            auto rate = exchangeRates.find(currency);
+            if (rate == exchangeRates.end()) return std::nullopt;
+            double srcMinorPerMajor = MoneyAmount::minorUnitsPerMajor(currency);
+            balance += amount * rate->second * targetMinorPerMajor / srcMinorPerMajor;
+        }
+        long long rounded = static_cast<long long>(std::round(balance));
+        if (rounded != 0) {
+            converted[userId] = rounded;
+        }
+    }
+
+    // The plan depends only on the converted balances, so it is reused until one moves
+    if (state->hasSolution
+        && state->solvedCurrency == targetCurrency
+        && state->solvedRates == exchangeRates
+        && state->solvedBalances == converted) {
+        return state->solution;
+    }
+
+    auto result = simplifier.settle(converted, targetCurrency);
+
+    state->hasSolution = true;
+    state->solvedCurrency = targetCurrency;
+    state->solvedRates = exchangeRates;
+    state->solvedBalances = std::move(converted);
+    state->solution = result;
+    return result;
+}
+
+std::optional<std::vector<SimplifiedPayment>> SettlementEngine::simplifyPerCurrency(
+    long long tripId,
+    DebtSimplifier& simplifier)
+{
+    auto state = find(tripId);
+    if (!state) return std::nullopt;
+    CurrencyBalances balances;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (!state->loaded) return std::nullopt;
+        balances = state->balances;
+    }
+    return simplifier.simplifyDebtsPerCurrency(balances);
+}
+
+std::shared_ptr<SettlementEngine::TripState> SettlementEngine::getOrCreate(long long tripId) {
+    std::shared_ptr<TripState> state;
+    trips_.lazy_emplace_l(tripId,
+        [&state](const auto& kv) { state = kv.second; },
+        [&state, tripId](const auto& ctor) {
+            state = std::make_shared<TripState>();
+            ctor(tripId, state);
+        });
+    return state;
+}
+
+std::shared_ptr<SettlementEngine::TripState> SettlementEngine::find(long long tripId) const {
+    std::shared_ptr<TripState> state;
+    trips_.if_contains(tripId, [&state](const auto& kv) {
+        state = kv.second;
+    });
+    return state;
+}
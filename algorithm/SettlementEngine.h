@@ -0,0 +1,139 @@
+#ifndef FRIENDS_TRIP_BOT_SETTLEMENTENGINE_H
+#define FRIENDS_TRIP_BOT_SETTLEMENTENGINE_H
+
+#include "DebtSimplifier.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <parallel_hashmap/phmap.h>
+
+struct SettlementSummary {
+    std::size_t paymentGroupCount;
+    std::size_t participantCount;
+    std::vector<std::string> currencies;
+};
+
+// Per-trip in-memory settlement state. Balances are kept per user and currency and
+// updated with the delta of every created or undone payment group, so /simplify no
+// longer rebuilds them from the full payment history. The last solution is cached and
+// reused until the converted balances it settles change.
+class SettlementEngine {
+private:
+    struct TripState;
+
+public:
+    // A payment write in flight for one trip, from just before its transaction commits
+    // until the delta is applied. While any is open, loads of the trip are discarded:
+    // the history they read may or may not include the write, so installing it and then
+    // applying the delta could count the payment twice. Destroyed without apply() or
+    // revert() (the commit failed or threw), it evicts the trip, since the write may
+    // have landed anyway.
+    class PendingWrite {
+    public:
+        PendingWrite(PendingWrite&& other) noexcept;
+        PendingWrite& operator=(PendingWrite&&) = delete;
+        ~PendingWrite();
+
+        // Call once the transaction has committed
+        void apply(const PaymentGroup& group);
+        void revert(const PaymentGroup& group);
+        // Call if the transaction committed without writing a payment group
+        void unchanged();
+
+    private:
+        friend class SettlementEngine;
+        PendingWrite(SettlementEngine* engine, std::optional<long long> tripId, std::shared_ptr<TripState> state);
+        void finish(const PaymentGroup* group, long long sign);
+        void finishAnyTrip(const PaymentGroup* group, long long sign);
+
+        SettlementEngine* engine_;
+        // Unset if the trip was not known when the write began
+        std::optional<long long> tripId_;
+        // Null if the trip had no state when the write began
+        std::shared_ptr<TripState> state_;
+        bool unchanged_ = false;
+    };
+
+    // Call before reading a trip's payment history; pass the result to load()
+    uint64_t beginLoad(long long tripId);
+
+    // Installs the trip's state from its full history. Returns false (and installs
+    // nothing) if a payment was written for the trip since beginLoad(), or a write is
+    // still pending.
+    bool load(long long tripId, const std::vector<PaymentGroup>& paymentGroups, uint64_t epoch);
+
+    bool isLoaded(long long tripId) const;
+    void evict(long long tripId);
+    void evictAll();
+
+    // Call before committing a payment group's insert or delete. Deltas are applied to
+    // loaded trips only; a trip with no state gets none, it is built on its next load.
+    PendingWrite beginWrite(long long tripId);
+    // For a write that learns its trip only from the statement itself, such as deleting
+    // the active trip's last payment: loads of every trip are discarded until it is done
+    PendingWrite beginWrite();
+
+    // Shorthand for beginWrite(group.trip_id).apply(group), for callers with no
+    // transaction to order against
+    void applyPaymentGroup(const PaymentGroup& group);
+    void revertPaymentGroup(const PaymentGroup& group);
+
+    std::optional<SettlementSummary> summary(long long tripId) const;
+
+    // std::nullopt if the trip is not loaded or a currency with a balance has no rate
+    std::optional<std::vector<SimplifiedPayment>> simplify(
+        long long tripId,
+        DebtSimplifier& simplifier,
+        const std::unordered_map<std::string, double>& exchangeRates,
+        const std::string& targetCurrency);
+
+    std::optional<std::vector<SimplifiedPayment>> simplifyPerCurrency(
+        long long tripId,
+        DebtSimplifier& simplifier);
+
+private:
+    struct TripState {
+        mutable std::mutex mutex;
+        bool loaded = false;
+        uint64_t epoch = 0;
+        std::size_t pendingWrites = 0;
+        std::size_t paymentGroupCount = 0;
+        CurrencyBalances balances;
+
+        // Last solution and the converted balances it settles
+        bool hasSolution = false;
+        std::string solvedCurrency;
+        std::unordered_map<std::string, double> solvedRates;
+        std::unordered_map<long long, long long> solvedBalances;
+        std::vector<SimplifiedPayment> solution;
+    };
+
+    std::shared_ptr<TripState> getOrCreate(long long tripId);
+    std::shared_ptr<TripState> find(long long tripId) const;
+    static void clear(TripState& state);
+    static void addGroup(TripState& state, const PaymentGroup& group, long long sign);
+
+    // Writes begun without a trip id, counted across all trips. The epoch is added to
+    // each trip's own, so a load overlapping such a write sees its epoch change.
+    std::atomic<uint64_t> anyTripEpoch_{0};
+    std::atomic<std::size_t> anyTripPendingWrites_{0};
+
+    phmap::parallel_flat_hash_map<
+        long long,
+        std::shared_ptr<TripState>,
+        phmap::priv::hash_default_hash<long long>,
+        phmap::priv::hash_default_eq<long long>,
+        std::allocator<std::pair<const long long, std::shared_ptr<TripState>>>,
+        4,
+        std::mutex
+    > trips_;
+};
+
+#endif //FRIENDS_TRIP_BOT_SETTLEMENTENGINE_H
@@ -0,0 +1,105 @@
+#ifndef FRIENDS_TRIP_BOT_BENCHUTIL_H
+#define FRIENDS_TRIP_BOT_BENCHUTIL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Shared helpers for the standalone benchmark executables. Exactly one translation
+// unit per executable must define BENCH_COUNT_ALLOCATIONS before including this header
+// to install the counting global operator new/delete.
+
+namespace bench {
+
+inline std::atomic<std::size_t>& allocationCount() {
+    static std::atomic<std::size_t> count{0};
+    return count;
+}
+
+inline std::atomic<std::size_t>& allocatedBytes() {
+    static std::atomic<std::size_t> bytes{0};
+    return bytes;
+}
+
+struct AllocationSnapshot {
+    std::size_t count;
+    std::size_t bytes;
+
+    static AllocationSnapshot now() {
+        return {allocationCount().load(std::memory_order_relaxed),
+                allocatedBytes().load(std::memory_order_relaxed)};
+    }
+
+    AllocationSnapshot since(const AllocationSnapshot& start) const {
+        return {count - start.count, bytes - start.bytes};
+    }
+};
+
+class Stopwatch {
+public:
+    Stopwatch() : start_(std::chrono::steady_clock::now()) {}
+
+    double elapsedNs() const {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Keeps the optimiser from discarding a computed value
+template<typename T>
+inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+} // namespace bench
+
+#ifdef BENCH_COUNT_ALLOCATIONS
+// Every form of plain and array new/delete is replaced, all going through the same two
+// functions, so whichever pair the compiler emits matches. They are kept out of line:
+// GCC otherwise sees free() on a pointer from operator new and warns
+// (-Wmismatched-new-delete).
+namespace bench {
+
+[[gnu::noinline]] inline void* countedAllocate(std::size_t size) {
+    allocationCount().fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes().fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] inline void countedRelease(void* p) noexcept {
+    std::free(p);
+}
+
+} // namespace bench
+
+void* operator new(std::size_t size) {
+    return bench::countedAllocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return bench::countedAllocate(size);
+}
+
+void operator delete(void* p) noexcept {
+    bench::countedRelease(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    bench::countedRelease(p);
+}
+
+void operator delete[](void* p) noexcept {
+    bench::countedRelease(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    bench::countedRelease(p);
+}
+#endif
+
+#endif //FRIENDS_TRIP_BOT_BENCHUTIL_H
@@ -0,0 +1,368 @@
+#include "FakeBotApi.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <spdlog/spdlog.h>
+
+namespace bench {
+
+using json = nlohmann::json;
+
+namespace {
+
+void writeAll(int fd, const std::string& data) {
+    std::size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return;
+        }
+        written += static_cast<std::size_t>(n);
+    }
+}
+
+const char* statusText(int status) {
+    switch (status) {
+        case 200: return "200 OK";
+        case 400: return "400 Bad Request";
+        case 401: return "401 Unauthorized";
+        case 404: return "404 Not Found";
+        case 429: return "429 Too Many Requests";
+        default: return "500 Internal Server Error";
+    }
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+std::string urlDecode(std::string_view in) {
+    std::string out;
+    out.reserve(in.size());
+    for (std::size_t i = 0; i < in.size(); ++i) {
+        if (in[i] == '+') {
+            out += ' ';
+        } else if (in[i] == '%' && i + 2 < in.size() && hexValue(in[i + 1]) >= 0 && hexValue(in[i + 2]) >= 0) {
+            out += static_cast<char>(hexValue(in[i + 1]) * 16 + hexValue(in[i + 2]));
+            i += 2;
+        } else {
+            out += in[i];
+        }
+    }
+    return out;
+}
+
+std::map<std::string, std::string> parseQuery(std::string_view query) {
+    std::map<std::string, std::string> params;
+    while (!query.empty()) {
+        std::size_t amp = query.find('&');
+        std::string_view pair = query.substr(0, amp);
+        std::size_t eq = pair.find('=');
+        if (eq != std::string_view::npos) {
+            params[urlDecode(pair.substr(0, eq))] = urlDecode(pair.substr(eq + 1));
+        } else if (!pair.empty()) {
+            params[urlDecode(pair)] = "";
+        }
+        if (amp == std::string_view::npos) break;
+        query.remove_prefix(amp + 1);
+    }
+    return params;
+}
+
+json error(int code, const std::string& description) {
+    return {{"ok", false}, {"error_code", code}, {"description", description}};
+}
+
+json message(long long chatId, long long messageId, const std::string& text) {
+    return {
+        {"message_id", messageId},
+        {"date", std::chrono::duration_cast<std::chrono::seconds>(
+                     std::chrono::system_clock::now().time_since_epoch()).count()},
+        {"chat", {{"id", chatId}, {"type", chatId < 0 ? "group" : "private"}}},
+        {"text", text},
+    };
+}
+
+} // namespace
+
+FakeBotApi::FakeBotApi(std::string token, FakeBotApiOptions options, Listener listener)
+    : token_(std::move(token)), options_(std::move(options)), listener_(std::move(listener)) {}
+
+FakeBotApi::~FakeBotApi() {
+    stop();
+}
+
+bool FakeBotApi::start() {
+    listenFd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd_ < 0) {
+        spdlog::error("Fake Bot API: socket() failed: {}", std::strerror(errno));
+        return false;
+    }
+    int reuse = 1;
+    ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(options_.port));
+    socklen_t addrLen = sizeof(addr);
+    if (::inet_pton(AF_INET, options_.bindAddress.c_str(), &addr.sin_addr) != 1
+        || ::bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+        || ::listen(listenFd_, 128) != 0
+        || ::getsockname(listenFd_, reinterpret_cast<sockaddr*>(&addr), &addrLen) != 0) {
+        spdlog::error("Fake Bot API: cannot listen on {}:{}: {}", options_.bindAddress, options_.port,
+                      std::strerror(errno));
+        ::close(listenFd_);
+        listenFd_ = -1;
+        return false;
+    }
+    port_ = ntohs(addr.sin_port);
+    // Every thread polls the same socket; the ones that lose the race to accept get
+    // EAGAIN instead of blocking
+    ::fcntl(listenFd_, F_SETFL, ::fcntl(listenFd_, F_GETFL) | O_NONBLOCK);
+
+    running_ = true;
+    std::random_device seeds;
+    for (int i = 0; i < std::max(options_.threads, 2); ++i) {
+        threads_.emplace_back(&FakeBotApi::serveLoop, this, seeds());
+    }
+    spdlog::info("Fake Bot API listening on {}", baseUrl());
+    return true;
+}
+
+void FakeBotApi::stop() {
+    if (running_.exchange(false)) {
+        {
+            // Taken so a long poll between its check and its wait still sees the change
+            std::lock_guard<std::mutex> lock(updatesMutex_);
+        }
+        updatesReady_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+        threads_.clear();
+    }
+    if (listenFd_ >= 0) {
+        ::close(listenFd_);
+        listenFd_ = -1;
+    }
+}
+
+std::string FakeBotApi::baseUrl() const {
+    return "http://" + options_.bindAddress + ":" + std::to_string(port_);
+}
+
+long long FakeBotApi::pushUpdate(json update) {
+    std::vector<json> updates;
+    updates.push_back(std::move(update));
+    return pushUpdates(std::move(updates));
+}
+
+long long FakeBotApi::pushUpdates(std::vector<json> updates) {
+    long long id = 0;
+    {
+        std::lock_guard<std::mutex> lock(updatesMutex_);
+        for (auto& update : updates) {
+            id = nextUpdateId_++;
+            update["update_id"] = id;
+            updates_.emplace_back(id, std::move(update));
+        }
+    }
+    updatesReady_.notify_all();
+    return id;
+}
+
+std::size_t FakeBotApi::pendingUpdates() const {
+    std::lock_guard<std::mutex> lock(updatesMutex_);
+    return updates_.size();
+}
+
+std::chrono::steady_clock::time_point FakeBotApi::lastOutboundAt() const {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    return lastOutboundAt_;
+}
+
+FakeBotApi::Stats FakeBotApi::stats() const {
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        stats.calls = calls_;
+        stats.rateLimited = rateLimited_;
+    }
+    std::lock_guard<std::mutex> lock(updatesMutex_);
+    stats.updatesServed = updatesServed_;
+    return stats;
+}
+
+void FakeBotApi::serveLoop(unsigned seed) {
+    std::mt19937 rng(seed);
+    while (running_) {
+        // Wakes every 200ms to notice stop()
+        pollfd pfd{listenFd_, POLLIN, 0};
+        if (::poll(&pfd, 1, 200) <= 0) continue;
+
+        int fd = ::accept(listenFd_, nullptr, nullptr);
+        if (fd < 0) continue;
+        handleConnection(fd, rng);
+        ::close(fd);
+    }
+}
+
+void FakeBotApi::handleConnection(int fd, std::mt19937& rng) {
+    // Every call is a GET with its parameters in the query string, so the headers
+    // are read and dropped
+    std::string request;
+    char buffer[4096];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 65536) {
+        pollfd pfd{fd, POLLIN, 0};
+        if (::poll(&pfd, 1, 2000) <= 0) return;
+        ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) return;
+        request.append(buffer, static_cast<std::size_t>(n));
+    }
+
+    // GET /bot<token>/<method>?<query> HTTP/1.1
+    std::string requestLine = request.substr(0, request.find("\r\n"));
+    std::size_t pathStart = requestLine.find(' ');
+    std::size_t pathEnd = requestLine.rfind(' ');
+    std::string target = pathStart != std::string::npos && pathEnd > pathStart
+        ? requestLine.substr(pathStart + 1, pathEnd - pathStart - 1) : "";
+    std::string prefix = "/bot" + token_ + "/";
+
+    Response response;
+    if (target.rfind(prefix, 0) != 0) {
+        response = {401, error(401, "Unauthorized")};
+    } else {
+        std::string_view rest(target);
+        rest.remove_prefix(prefix.size());
+        std::size_t queryStart = rest.find('?');
+        std::string method(rest.substr(0, queryStart));
+        auto params = queryStart == std::string_view::npos
+            ? std::map<std::string, std::string>{} : parseQuery(rest.substr(queryStart + 1));
+        count(method);
+        try {
+            response = dispatch(method, params, rng);
+        } catch (const std::exception& e) {
+            response = {400, error(400, std::string("Bad Request: ") + e.what())};
+        }
+    }
+
+    auto delay = options_.latency;
+    if (options_.latencyJitter.count() > 0) {
+        std::uniform_int_distribution<long long> jitter(0, options_.latencyJitter.count());
+        delay += std::chrono::milliseconds(jitter(rng));
+    }
+    if (delay.count() > 0) {
+        std::this_thread::sleep_for(delay);
+    }
+
+    std::string body = response.body.dump();
+    std::string head = std::string("HTTP/1.1 ") + statusText(response.status) + "\r\n"
+                     + "Content-Type: application/json\r\n"
+                     + "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    if (response.status == 429) {
+        head += "Retry-After: " + std::to_string(options_.retryAfterSeconds) + "\r\n";
+    }
+    writeAll(fd, head + "Connection: close\r\n\r\n" + body);
+}
+
+FakeBotApi::Response FakeBotApi::dispatch(const std::string& method, const std::map<std::string, std::string>& params,
+                                          std::mt19937& rng) {
+    auto param = [&params](const char* name) -> const std::string& {
+        auto it = params.find(name);
+        if (it == params.end()) throw std::invalid_argument(std::string(name) + " is empty");
+        return it->second;
+    };
+
+    if (method == "getUpdates") {
+        return getUpdates(params);
+    }
+    if (method == "getChat") {
+        long long chatId = std::stoll(param("chat_id"));
+        return {200, {{"ok", true}, {"result", {{"id", chatId}, {"title", "Chat " + std::to_string(chatId)},
+                                                {"type", chatId < 0 ? "group" : "private"}}}}};
+    }
+    if (method != "sendMessage" && method != "editMessageText" && method != "answerCallbackQuery") {
+        return {404, error(404, "Not Found")};
+    }
+
+    if (options_.rateLimitProbability > 0
+        && std::uniform_real_distribution<double>(0.0, 1.0)(rng) < options_.rateLimitProbability) {
+        {
+            std::lock_guard<std::mutex> lock(statsMutex_);
+            ++rateLimited_;
+        }
+        json body = error(429, "Too Many Requests: retry after " + std::to_string(options_.retryAfterSeconds));
+        body["parameters"] = {{"retry_after", options_.retryAfterSeconds}};
+        return {429, body};
+    }
+
+    OutboundCall call;
+    call.method = method;
+    call.at = std::chrono::steady_clock::now();
+    json result = true;
+    if (method == "answerCallbackQuery") {
+        param("callback_query_id");
+        call.text = params.count("text") ? params.at("text") : "";
+    } else {
+        call.chatId = std::stoll(param("chat_id"));
+        call.text = param("text");
+        call.messageId = method == "sendMessage" ? nextMessageId_.fetch_add(1) : std::stoll(param("message_id"));
+        if (auto it = params.find("reply_markup"); it != params.end()) {
+            call.replyMarkup = json::parse(it->second);
+        }
+        result = message(call.chatId, call.messageId, call.text);
+    }
+
+    if (listener_) {
+        listener_(call);
+    }
+    return {200, {{"ok", true}, {"result", result}}};
+}
+
+FakeBotApi::Response FakeBotApi::getUpdates(const std::map<std::string, std::string>& params) {
+    auto number = [&params](const char* name, long long fallback) {
+        auto it = params.find(name);
+        return it == params.end() || it->second.empty() ? fallback : std::stoll(it->second);
+    };
+    long long offset = number("offset", 0);
+    long long timeout = number("timeout", 0);
+    long long limit = std::clamp(number("limit", 100), 1LL, 100LL);
+
+    std::unique_lock<std::mutex> lock(updatesMutex_);
+    // An offset confirms every update below it, as with Telegram
+    while (!updates_.empty() && updates_.front().first < offset) {
+        updates_.pop_front();
+    }
+    updatesReady_.wait_for(lock, std::chrono::seconds(timeout),
+                           [this] { return !updates_.empty() || !running_; });
+
+    json result = json::array();
+    for (const auto& [id, update] : updates_) {
+        if (static_cast<long long>(result.size()) == limit) break;
+        result.push_back(update);
+    }
+    updatesServed_ += result.size();
+    return {200, {{"ok", true}, {"result", result}}};
+}
+
+void FakeBotApi::count(const std::string& method) {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    ++calls_[method];
+    if (method != "getUpdates") {
+        lastOutboundAt_ = std::chrono::steady_clock::now();
+    }
+}
+
+} // namespace bench
@@ -0,0 +1,124 @@
+#ifndef FRIENDS_TRIP_BOT_FAKEBOTAPI_H
+#define FRIENDS_TRIP_BOT_FAKEBOTAPI_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace bench {
+
+struct FakeBotApiOptions {
+    std::string bindAddress = "127.0.0.1";
+    int port = 0;  // 0 picks a free port
+    int threads = 8;  // connections served at once; a getUpdates long poll holds one
+    // Added before every response, uniformly in [latency, latency + latencyJitter]
+    std::chrono::milliseconds latency{0};
+    std::chrono::milliseconds latencyJitter{0};
+    // Chance that a sendMessage/editMessageText/answerCallbackQuery is refused with 429
+    double rateLimitProbability = 0.0;
+    int retryAfterSeconds = 1;
+};
+
+// A call the bot made that a user would see, as accepted by the fake
+struct OutboundCall {
+    std::string method;
+    long long chatId = 0;
+    long long messageId = 0;  // assigned by sendMessage, or the one edited
+    std::string text;
+    nlohmann::json replyMarkup;  // null without a keyboard
+    std::chrono::steady_clock::time_point at;  // when the request arrived
+};
+
+// Local stand-in for the Telegram Bot API, enough of it for Bot: getUpdates serves
+// whatever pushUpdate() queued, sendMessage/editMessageText/answerCallbackQuery/getChat
+// are accepted and reported to the listener. Speaks plain HTTP/1.1, one request per
+// connection, which is all libcurl's easy interface uses.
+class FakeBotApi {
+public:
+    using Listener = std::function<void(const OutboundCall&)>;
+
+    struct Stats {
+        std::map<std::string, uint64_t> calls;  // by method, including refused ones
+        uint64_t rateLimited;
+        uint64_t updatesServed;
+    };
+
+    // listener runs on the server's threads and must not block for long
+    FakeBotApi(std::string token, FakeBotApiOptions options, Listener listener);
+    ~FakeBotApi();
+
+    FakeBotApi(const FakeBotApi&) = delete;
+    FakeBotApi& operator=(const FakeBotApi&) = delete;
+
+    // False if the socket could not be bound
+    bool start();
+    // Ends pending long polls with an empty batch and joins the server threads
+    void stop();
+
+    // What to pass as the Bot's apiBaseUrl, e.g. http://127.0.0.1:40123
+    std::string baseUrl() const;
+
+    // Queues an update for getUpdates, assigning its update_id, which is returned.
+    // Updates stay queued until a getUpdates offset acknowledges them.
+    long long pushUpdate(nlohmann::json update);
+    // Queues updates so that one getUpdates returns them together (up to its limit).
+    // Returns the last update_id assigned, or 0 if updates is empty.
+    long long pushUpdates(std::vector<nlohmann::json> updates);
+
+    // Queued updates no getUpdates offset has acknowledged yet
+    std::size_t pendingUpdates() const;
+    // Arrival of the most recent call other than getUpdates; the epoch if none yet
+    std::chrono::steady_clock::time_point lastOutboundAt() const;
+
+    Stats stats() const;
+
+private:
+    struct Response {
+        int status;
+        nlohmann::json body;
+    };
+
+    void serveLoop(unsigned seed);
+    void handleConnection(int fd, std::mt19937& rng);
+    Response dispatch(const std::string& method, const std::map<std::string, std::string>& params,
+                      std::mt19937& rng);
+    Response getUpdates(const std::map<std::string, std::string>& params);
+    void count(const std::string& method);
+
+    std::string token_;
+    FakeBotApiOptions options_;
+    Listener listener_;
+    int listenFd_ = -1;
+    int port_ = 0;
+    std::atomic<bool> running_{false};
+    std::vector<std::thread> threads_;
+
+    mutable std::mutex updatesMutex_;
+    std::condition_variable updatesReady_;
+    std::deque<std::pair<long long, nlohmann::json>> updates_;
+    long long nextUpdateId_ = 1;
+    uint64_t updatesServed_ = 0;
+
+    std::atomic<long long> nextMessageId_{1};
+
+    mutable std::mutex statsMutex_;
+    std::map<std::string, uint64_t> calls_;
+    uint64_t rateLimited_ = 0;
+    std::chrono::steady_clock::time_point lastOutboundAt_{};
+};
+
+} // namespace bench
+
+#endif //FRIENDS_TRIP_BOT_FAKEBOTAPI_H
@@ -0,0 +1,302 @@
+// Repository round-trip benchmark against a real Postgres. Seeds a synthetic chat with
+// one trip, times the reads /list and /simplify do before their first message, then
+// deletes the seeded rows again. With --writes it also times the multi-statement writes
+// (registration, adding and undoing a payment) against the previous one-statement-per-
+// round-trip versions; run it through netem_latency.sh to see the effect of network RTT.
+//
+// Usage: bench_db [--users N] [--groups N] [--iterations N] [--writes]
+//
+// Connects with the same POSTGRES_* variables as the bot (a .env file is read too).
+// Prints one JSON document to stdout.
+
+#include "../algorithm/SettlementEngine.h"
+#include "../database/AsyncDatabase.h"
+#include "../database/DatabaseConfig.h"
+#include "../database/DatabaseManager.h"
+#include "../database/DatabaseSchema.h"
+#include "../repository/ChatCache.h"
+#include "../repository/PaymentRepository.h"
+#include "../repository/TripRepository.h"
+#include "../repository/TripSnapshotRepository.h"
+#include "../repository/UserRepository.h"
+#include "BenchUtil.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+using json = nlohmann::json;
+
+namespace {
+
+struct Fixture {
+    DatabaseManager& db;
+    ChatCache& chatCache;
+    SettlementEngine& settlementEngine;
+    UserRepository& userRepo;
+    TripRepository& tripRepo;
+    PaymentRepository& payRepo;
+    TripSnapshotRepository& snapshotRepo;
+    long long chatId;
+    long long threadId;
+    long long tripId;
+};
+
+// Registers users (which creates the default trip) and records random equal splits
+long long seed(UserRepository& userRepo, TripRepository& tripRepo, PaymentRepository& payRepo,
+               long long chatId, int users, int groups) {
+    for (int u = 1; u <= users; ++u) {
+        userRepo.registerUserWithDefaultTrip(User{u, chatId, 0, "user" + std::to_string(u), "", ""});
+    }
+    auto trip = tripRepo.getActiveTrip(chatId, 0);
+    if (!trip) return -1;
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> pickUser(1, users);
+    std::uniform_int_distribution<long long> pickAmount(100, 100000);
+    for (int g = 0; g < groups; ++g) {
+        PaymentGroup group{0, trip->trip_id, "group" + std::to_string(g), MoneyAmount("SGD", 0),
+                           pickUser(rng), {}, {}};
+        long long each = pickAmount(rng);
+        for (int u = 1; u <= users; ++u) {
+            group.records.push_back({0, 0, trip->trip_id, MoneyAmount("SGD", each), group.payer_user_id, u, {}});
+        }
+        group.total_amount = MoneyAmount("SGD", each * users);
+        payRepo.createPaymentGroup(group);
+    }
+    return trip->trip_id;
+}
+
+void cleanup(DatabaseManager& db, long long chatId) {
+    pqxx::work txn(*db.getConnection());
+    txn.exec("DELETE FROM chats WHERE chat_id = $1", pqxx::params{chatId});
+    txn.exec("DELETE FROM trips WHERE chat_id = $1", pqxx::params{chatId});
+    txn.exec("DELETE FROM users WHERE chat_id = $1", pqxx::params{chatId});
+    txn.commit();
+}
+
+// The statement-per-round-trip implementations the repositories used before, kept
+// for comparison
+void legacyRegisterUser(DatabaseManager& db, const User& user) {
+    pqxx::work txn(*db.getConnection());
+    txn.exec("INSERT INTO users (user_id, chat_id, thread_id, name) VALUES ($1, $2, $3, $4) "
+             "ON CONFLICT (user_id, chat_id, thread_id) DO NOTHING",
+             pqxx::params{user.user_id, user.chat_id, user.thread_id, user.name});
+    pqxx::result tripRes = txn.exec("SELECT trip_id FROM trips WHERE chat_id = $1 AND thread_id = $2 LIMIT 1",
+                                    pqxx::params{user.chat_id, user.thread_id});
+    if (tripRes.empty()) {
+        pqxx::result newTripRes = txn.exec(
+            "INSERT INTO trips (chat_id, thread_id, name) VALUES ($1, $2, 'default') RETURNING trip_id",
+            pqxx::params{user.chat_id, user.thread_id});
+        txn.exec("INSERT INTO chats (chat_id, thread_id, active_trip_id) VALUES ($1, $2, $3) "
+                 "ON CONFLICT (chat_id, thread_id) DO UPDATE SET active_trip_id = EXCLUDED.active_trip_id "
+                 "WHERE chats.active_trip_id IS NULL",
+                 pqxx::params{user.chat_id, user.thread_id, newTripRes[0][0].as<long long>()});
+    }
+    txn.commit();
+}
+
+void legacyCreatePaymentGroup(DatabaseManager& db, const PaymentGroup& group) {
+    pqxx::work txn(*db.getConnection());
+    pqxx::result groupRes = txn.exec(
+        "INSERT INTO payment_groups (trip_id, name, total_amount, currency, payer_user_id) VALUES ($1, $2, $3, $4, $5) RETURNING group_id",
+        pqxx::params{group.trip_id, group.name, group.total_amount.minorAmount(), group.total_amount.currency(), group.payer_user_id});
+    long long groupId = groupRes[0][0].as<long long>();
+    for (const auto& rec : group.records) {
+        txn.exec("INSERT INTO payment_records (group_id, trip_id, amount, currency, from_user_id, to_user_id) VALUES ($1, $2, $3, $4, $5, $6)",
+                 pqxx::params{groupId, group.trip_id, rec.amount.minorAmount(), rec.amount.currency(), rec.from_user_id, rec.to_user_id});
+    }
+    txn.commit();
+}
+
+void legacyDeleteLastPaymentGroup(DatabaseManager& db, long long tripId) {
+    pqxx::work txn(*db.getConnection());
+    pqxx::result groupRes = txn.exec(
+        "SELECT group_id, trip_id, name, total_amount, currency, payer_user_id, gmt_created "
+        "FROM payment_groups WHERE trip_id = $1 ORDER BY gmt_created DESC LIMIT 1",
+        pqxx::params{tripId});
+    if (groupRes.empty()) return;
+    long long groupId = groupRes[0]["group_id"].as<long long>();
+    pqxx::result recordRes = txn.exec(
+        "SELECT record_id, group_id, trip_id, amount, currency, from_user_id, to_user_id, gmt_created "
+        "FROM payment_records WHERE group_id = $1 ORDER BY gmt_created DESC",
+        pqxx::params{groupId});
+    bench::doNotOptimize(recordRes.size());
+    txn.exec("DELETE FROM payment_records WHERE group_id = $1", pqxx::params{groupId});
+    txn.exec("DELETE FROM payment_groups WHERE group_id = $1", pqxx::params{groupId});
+    txn.commit();
+}
+
+PaymentGroup makeEqualSplit(long long tripId, int users, long long each) {
+    PaymentGroup group{0, tripId, "bench", MoneyAmount("SGD", each * users), 1, {}, {}};
+    for (int u = 1; u <= users; ++u) {
+        group.records.push_back({0, 0, tripId, MoneyAmount("SGD", each), 1, u, {}});
+    }
+    return group;
+}
+
+json measure(const std::string& name, int iterations, const std::function<void()>& prepare,
+             const std::function<void()>& fn) {
+    std::vector<double> samples;
+    samples.reserve(iterations);
+    fn();  // warm-up: plans, connection buffers
+    for (int i = 0; i < iterations; ++i) {
+        prepare();
+        bench::Stopwatch watch;
+        fn();
+        samples.push_back(watch.elapsedNs() / 1e6);
+    }
+    std::sort(samples.begin(), samples.end());
+    double total = 0;
+    for (double s : samples) total += s;
+    return {
+        {"name", name},
+        {"iterations", iterations},
+        {"mean_ms", total / samples.size()},
+        {"p50_ms", samples[samples.size() / 2]},
+        {"p95_ms", samples[std::min(samples.size() - 1, samples.size() * 95 / 100)]},
+    };
+}
+
+// Each scenario is the set of reads a conversation does before its first message
+json runScenarios(Fixture& f, int iterations) {
+    json results = json::array();
+    auto cold = [&f] { f.chatCache.clear(); f.settlementEngine.evictAll(); };
+    auto warm = [] {};
+
+    results.push_back(measure("list_separate_queries", iterations, cold, [&f] {
+        auto trip = f.tripRepo.getActiveTrip(f.chatId, f.threadId);
+        bench::doNotOptimize(f.payRepo.getAllPaymentGroups(trip->trip_id).size());
+        bench::doNotOptimize(f.userRepo.getUsersByChatAndThread(f.chatId, f.threadId).size());
+    }));
+    results.push_back(measure("list_snapshot", iterations, cold, [&f] {
+        bench::doNotOptimize(f.snapshotRepo.load(f.chatId, f.threadId)->paymentGroups.size());
+    }));
+    results.push_back(measure("simplify_cold_snapshot", iterations, cold, [&f] {
+        auto trip = f.tripRepo.getActiveTrip(f.chatId, f.threadId);
+        uint64_t epoch = f.settlementEngine.beginLoad(trip->trip_id);
+        auto snapshot = f.snapshotRepo.load(f.chatId, f.threadId);
+        f.settlementEngine.load(trip->trip_id, snapshot->paymentGroups, epoch);
+    }));
+    results.push_back(measure("simplify_warm_cached", iterations, warm, [&f] {
+        auto trip = f.tripRepo.getActiveTrip(f.chatId, f.threadId);
+        bench::doNotOptimize(f.settlementEngine.isLoaded(trip->trip_id));
+        bench::doNotOptimize(f.userRepo.getUsersByChatAndThread(f.chatId, f.threadId).size());
+    }));
+    return results;
+}
+
+// Each write scenario runs against a scratch chat (or the seeded trip) and leaves the
+// seeded data as it found it
+json runWriteScenarios(Fixture& f, int users, int iterations) {
+    json results = json::array();
+    long long scratchChatId = f.chatId - 1;
+    long long nextUserId = 1;
+    auto freshChat = [&f, scratchChatId] { cleanup(f.db, scratchChatId); };
+    auto none = [] {};
+
+    // The first member of a new chat takes the trip-creating branch
+    results.push_back(measure("register_first_user_serial", iterations, freshChat, [&] {
+        legacyRegisterUser(f.db, User{nextUserId++, scratchChatId, 0, "bench", "", ""});
+    }));
+    results.push_back(measure("register_first_user_cte", iterations, freshChat, [&] {
+        f.userRepo.registerUserWithDefaultTrip(User{nextUserId++, scratchChatId, 0, "bench", "", ""});
+    }));
+    cleanup(f.db, scratchChatId);
+
+    // Adding and undoing a payment are measured in pairs so the trip stays the same size
+    PaymentGroup group = makeEqualSplit(f.tripId, users, 1000);
+    results.push_back(measure("create_payment_serial", iterations, none, [&] {
+        legacyCreatePaymentGroup(f.db, group);
+    }));
+    results.push_back(measure("delete_last_payment_serial", iterations,
+                              [&] { legacyCreatePaymentGroup(f.db, group); },
+                              [&] { legacyDeleteLastPaymentGroup(f.db, f.tripId); }));
+    results.push_back(measure("create_payment_single_statement", iterations, none, [&] {
+        f.payRepo.createPaymentGroup(group);
+    }));
+    results.push_back(measure("delete_last_payment_single_statement", iterations,
+                              [&] { f.payRepo.createPaymentGroup(group); },
+                              [&] { f.payRepo.deleteLastPaymentGroup(f.tripId); }));
+    return results;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int users = 8;
+    int groups = 200;
+    int iterations = 50;
+    bool writes = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--users") users = std::max(2, std::stoi(next()));
+        else if (arg == "--groups") groups = std::max(1, std::stoi(next()));
+        else if (arg == "--iterations") iterations = std::max(1, std::stoi(next()));
+        else if (arg == "--writes") writes = true;
+        else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    DatabaseConfig::loadEnv(".env");
+    std::string dbConnString = DatabaseConfig::buildConnString();
+    if (dbConnString.empty()) {
+        std::cerr << "Error: Database environment variables not fully set." << std::endl;
+        return 1;
+    }
+
+    spdlog::set_level(spdlog::level::warn);
+    DatabaseManager db(dbConnString);
+    db.connect();
+    if (!db.getConnection() || !db.getConnection()->is_open()) return 1;
+    DatabaseSchema::createTables(db);
+
+    ChatCache chatCache;
+    SettlementEngine settlementEngine;
+    UserRepository userRepo(db, chatCache);
+    TripRepository tripRepo(db, chatCache);
+    PaymentRepository payRepo(db, settlementEngine);
+    AsyncDatabase asyncDb(dbConnString, 1, nullptr);
+    TripSnapshotRepository snapshotRepo(db, asyncDb);
+
+    // A chat id no real Telegram chat uses, unique per run
+    long long chatId = -9'000'000'000'000LL - getpid();
+    long long tripId = seed(userRepo, tripRepo, payRepo, chatId, users, groups);
+    if (tripId < 0) {
+        std::cerr << "Error: seeding failed" << std::endl;
+        cleanup(db, chatId);
+        return 1;
+    }
+
+    Fixture fixture{db, chatCache, settlementEngine, userRepo, tripRepo, payRepo, snapshotRepo, chatId, 0, tripId};
+    json output;
+    output["benchmark"] = "db";
+    output["users"] = users;
+    output["groups"] = groups;
+    output["results"] = runScenarios(fixture, iterations);
+    if (writes) {
+        output["writes"] = runWriteScenarios(fixture, users, iterations);
+    }
+
+    cleanup(db, chatId);
+    std::cout << output.dump(2) << std::endl;
+    return 0;
+}
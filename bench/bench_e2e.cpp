@@ -0,0 +1,511 @@
+// End-to-end load test: the whole bot runs against FakeBotApi and a real Postgres.
+// N groups of M users register, then take turns running /pay, /list and /simplify the
+// way a person would, answering each prompt once the bot's reply to the previous one
+// has arrived. Groups run concurrently; within a group one flow runs at a time, so
+// every reply in a group chat belongs to the update the group sent last.
+//
+// Reports update-to-reply latency (from the update being queued for getUpdates to the
+// first message the bot sends or edits in that chat) per kind of update, the time each
+// whole flow took, and throughput.
+//
+// Usage: bench_e2e [--groups N] [--users M] [--rounds R] [--latency-ms N] [--jitter-ms N]
+//                  [--rate-limit P] [--retry-after S] [--step-timeout-ms N]
+//
+// --latency-ms/--jitter-ms delay every Bot API response; --rate-limit refuses that
+// fraction of sendMessage/editMessageText/answerCallbackQuery calls with 429. The bot
+// does not retry those, so a refused reply shows up as a step timeout and the flow is
+// abandoned.
+//
+// Connects with the same POSTGRES_* variables as the bot (a .env file is read too). The
+// rows it creates use chat ids no real chat has and are deleted at the end.
+// Prints one JSON document to stdout.
+
+#include "../algorithm/SettlementEngine.h"
+#include "../bot/Bot.h"
+#include "../bot/Scheduler.h"
+#include "../database/AsyncDatabase.h"
+#include "../database/DatabaseConfig.h"
+#include "../database/DatabaseManager.h"
+#include "../database/DatabaseSchema.h"
+#include "../handlers/Handlers.h"
+#include "../repository/AsyncPaymentRepository.h"
+#include "../repository/CallbackRepository.h"
+#include "../repository/ChatCache.h"
+#include "../repository/PaymentRepository.h"
+#include "../repository/TripRepository.h"
+#include "../repository/TripSnapshotRepository.h"
+#include "../repository/UserRepository.h"
+#include "../service/PaymentService.h"
+#include "../service/UserService.h"
+#include "BenchUtil.h"
+#include "FakeBotApi.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+using json = nlohmann::json;
+
+namespace {
+
+void cleanup(DatabaseManager& db, long long chatId) {
+    pqxx::work txn(*db.getConnection());
+    txn.exec("DELETE FROM chats WHERE chat_id = $1", pqxx::params{chatId});
+    txn.exec("DELETE FROM trips WHERE chat_id = $1", pqxx::params{chatId});
+    txn.exec("DELETE FROM users WHERE chat_id = $1", pqxx::params{chatId});
+    txn.commit();
+}
+
+double millis(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+json summarize(std::vector<double> samples) {
+    if (samples.empty()) return {{"count", 0}};
+    std::sort(samples.begin(), samples.end());
+    double total = 0;
+    for (double s : samples) total += s;
+    auto percentile = [&samples](std::size_t p) {
+        return samples[std::min(samples.size() - 1, samples.size() * p / 100)];
+    };
+    return {
+        {"count", samples.size()},
+        {"mean_ms", total / samples.size()},
+        {"p50_ms", percentile(50)},
+        {"p90_ms", percentile(90)},
+        {"p99_ms", percentile(99)},
+        {"max_ms", samples.back()},
+    };
+}
+
+// Latency samples in milliseconds by name, shared by all groups
+class Samples {
+public:
+    void add(const std::string& name, double ms) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        samples_[name].push_back(ms);
+    }
+
+    json summary() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        json out = json::object();
+        for (auto& [name, samples] : samples_) {
+            out[name] = summarize(samples);
+        }
+        return out;
+    }
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, std::vector<double>> samples_;
+};
+
+// What the fake delivered for one group's chat and its members' private chats
+struct Inbox {
+    std::mutex mutex;
+    std::condition_variable arrived;
+    std::deque<bench::OutboundCall> calls;
+};
+
+struct SimUser {
+    long long id;
+    std::string name;
+};
+
+using Predicate = std::function<bool(const bench::OutboundCall&)>;
+
+// callback_data of the button labelled label, or of the first button if there is none
+// (a paged keyboard showing other users)
+std::optional<std::string> buttonData(const json& replyMarkup, const std::string& label) {
+    std::optional<std::string> first;
+    if (!replyMarkup.is_object()) return first;
+    for (const auto& row : replyMarkup.value("inline_keyboard", json::array())) {
+        for (const auto& button : row) {
+            if (!button.contains("callback_data")) continue;
+            if (button.value("text", "") == label) return button["callback_data"].get<std::string>();
+            if (!first) first = button["callback_data"].get<std::string>();
+        }
+    }
+    return first;
+}
+
+Predicate textStarts(std::string prefix) {
+    return [prefix = std::move(prefix)](const bench::OutboundCall& call) { return call.text.rfind(prefix, 0) == 0; };
+}
+
+Predicate textHas(std::string part) {
+    return [part = std::move(part)](const bench::OutboundCall& call) {
+        return call.text.find(part) != std::string::npos;
+    };
+}
+
+// One group chat and its members, driven from a single thread
+class GroupSession {
+public:
+    GroupSession(bench::FakeBotApi& api, Inbox& inbox, Samples& samples, long long chatId,
+                 std::vector<SimUser> users, std::chrono::milliseconds stepTimeout)
+        : api_(api), inbox_(inbox), samples_(samples), chatId_(chatId), users_(std::move(users)),
+          stepTimeout_(stepTimeout) {}
+
+    // Each member follows the Register button's deep link, as in UserService
+    void registerAll() {
+        for (const auto& user : users_) {
+            auto start = std::chrono::steady_clock::now();
+            auto joined = step("register", user.id,
+                               textUpdate(user, user.id, "/start register" + std::to_string(chatId_)),
+                               [this](const bench::OutboundCall& call) {
+                                   return call.chatId == chatId_ && call.text.find("joined the trip!") != std::string::npos;
+                               });
+            if (joined) {
+                samples_.add("registration", millis(joined->at - start));
+            }
+        }
+    }
+
+    // Members take turns; each turn is one flow from a fixed pay/list/pay/simplify cycle
+    void run(int rounds) {
+        enum class Flow { Pay, List, Simplify };
+        static constexpr Flow cycle[] = {Flow::Pay, Flow::List, Flow::Pay, Flow::Simplify};
+        static const char* names[] = {"pay", "list", "simplify"};
+
+        for (int round = 0; round < rounds; ++round) {
+            for (std::size_t i = 0; i < users_.size(); ++i) {
+                const SimUser& user = users_[i];
+                Flow flow = cycle[(round * users_.size() + i) % std::size(cycle)];
+                auto start = std::chrono::steady_clock::now();
+                bool completed = flow == Flow::Pay ? pay(user, users_[(i + 1) % users_.size()])
+                               : flow == Flow::List ? list(user)
+                               : simplify(user);
+                if (completed) {
+                    samples_.add(names[static_cast<int>(flow)], millis(std::chrono::steady_clock::now() - start));
+                    ++flowsCompleted_;
+                } else {
+                    ++flowsAbandoned_;
+                }
+            }
+        }
+    }
+
+    uint64_t updatesSent() const { return updatesSent_; }
+    uint64_t flowsCompleted() const { return flowsCompleted_; }
+    uint64_t flowsAbandoned() const { return flowsAbandoned_; }
+    uint64_t stepTimeouts() const { return stepTimeouts_; }
+
+private:
+    bool pay(const SimUser& user, const SimUser& recipient) {
+        auto prompt = step("command", chatId_, textUpdate(user, chatId_, "/pay"), textStarts("Enter a name"));
+        if (!prompt) return false;
+        auto currency = step("text", chatId_, textUpdate(user, chatId_, "Dinner " + std::to_string(nextMessageId_)),
+                             textStarts("Select currency:"));
+        if (!currency) return false;
+        auto amount = press(user, *currency, "SGD", textStarts("Enter the amount"));
+        if (!amount) return false;
+        auto payer = step("text", chatId_, textUpdate(user, chatId_, "12.50"), textStarts("Select the payer:"));
+        if (!payer) return false;
+        auto split = press(user, *payer, user.name, textStarts("How do you want to split"));
+        if (!split) return false;
+        auto recipients = press(user, *split, "Single Recipient", textStarts("Select the recipient:"));
+        if (!recipients) return false;
+        return press(user, *recipients, recipient.name, textHas("Payment recorded!")).has_value();
+    }
+
+    bool list(const SimUser& user) {
+        auto page = step("command", chatId_, textUpdate(user, chatId_, "/list"), textStarts("<b>Payments in"));
+        if (!page) return false;
+        return press(user, *page, "Close", textStarts("List closed.")).has_value();
+    }
+
+    bool simplify(const SimUser& user) {
+        auto prompt = step("command", chatId_, textUpdate(user, chatId_, "/simplify"),
+                           [](const bench::OutboundCall& call) {
+                               return call.text.rfind("Select the settlement currency:", 0) == 0
+                                   || call.text.rfind("No payments recorded yet.", 0) == 0;
+                           });
+        if (!prompt) return false;
+        if (prompt->text.rfind("No payments", 0) == 0) return true;
+
+        Predicate resultOrRate = [](const bench::OutboundCall& call) {
+            return call.text.find("Simplified Payments") != std::string::npos
+                || call.text.rfind("Enter exchange rate", 0) == 0;
+        };
+        auto next = press(user, *prompt, "SGD", resultOrRate);
+        // Only if other groups' currencies leaked in; every payment here is in SGD
+        while (next && next->text.rfind("Enter exchange rate", 0) == 0) {
+            next = step("text", chatId_, textUpdate(user, chatId_, "1"), resultOrRate);
+        }
+        return next.has_value();
+    }
+
+    // Presses the button labelled label on the message call sent or edited
+    std::optional<bench::OutboundCall> press(const SimUser& user, const bench::OutboundCall& call,
+                                             const std::string& label, const Predicate& done) {
+        auto data = buttonData(call.replyMarkup, label);
+        if (!data) return std::nullopt;
+
+        json update = {{"callback_query", {
+            {"id", std::to_string(chatId_) + ":" + std::to_string(nextMessageId_++)},
+            {"from", {{"id", user.id}, {"first_name", user.name}}},
+            {"message", {{"message_id", call.messageId}, {"chat", {{"id", call.chatId}}}}},
+            {"data", *data},
+        }}};
+        return step("callback", call.chatId, std::move(update), done);
+    }
+
+    json textUpdate(const SimUser& user, long long chatId, const std::string& text) {
+        return {{"message", {
+            {"message_id", nextMessageId_++},
+            {"chat", {{"id", chatId}}},
+            {"from", {{"id", user.id}, {"first_name", user.name}}},
+            {"text", text},
+        }}};
+    }
+
+    // Queues update and waits for a call matching done. The first call into chatId
+    // after that is recorded as the update's reply latency under kind.
+    std::optional<bench::OutboundCall> step(const std::string& kind, long long chatId, json update,
+                                            const Predicate& done) {
+        std::unique_lock<std::mutex> lock(inbox_.mutex);
+        // Leftovers of an abandoned flow, or DMs sent after a flow's last message
+        inbox_.calls.clear();
+        lock.unlock();
+
+        auto sentAt = std::chrono::steady_clock::now();
+        api_.pushUpdate(std::move(update));
+        ++updatesSent_;
+
+        auto deadline = sentAt + stepTimeout_;
+        bool replied = false;
+        lock.lock();
+        while (true) {
+            while (!inbox_.calls.empty()) {
+                bench::OutboundCall call = std::move(inbox_.calls.front());
+                inbox_.calls.pop_front();
+                if (!replied && call.chatId == chatId) {
+                    replied = true;
+                    samples_.add(kind, millis(call.at - sentAt));
+                }
+                if (done(call)) return call;
+            }
+            if (inbox_.arrived.wait_until(lock, deadline) == std::cv_status::timeout && inbox_.calls.empty()) {
+                ++stepTimeouts_;
+                return std::nullopt;
+            }
+        }
+    }
+
+    bench::FakeBotApi& api_;
+    Inbox& inbox_;
+    Samples& samples_;
+    long long chatId_;
+    std::vector<SimUser> users_;
+    std::chrono::milliseconds stepTimeout_;
+
+    long long nextMessageId_ = 1;
+    uint64_t updatesSent_ = 0;
+    uint64_t flowsCompleted_ = 0;
+    uint64_t flowsAbandoned_ = 0;
+    uint64_t stepTimeouts_ = 0;
+};
+
+// Runs fn for every session on its own thread and waits for all of them
+void forEachConcurrently(std::vector<std::unique_ptr<GroupSession>>& sessions,
+                         const std::function<void(GroupSession&)>& fn) {
+    std::vector<std::thread> threads;
+    threads.reserve(sessions.size());
+    for (auto& session : sessions) {
+        threads.emplace_back([&fn, &session] { fn(*session); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int groups = 10;
+    int users = 4;
+    int rounds = 5;
+    int stepTimeoutMs = 10000;
+    bench::FakeBotApiOptions apiOptions;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--groups") groups = std::clamp(std::stoi(next()), 1, 1000);
+        else if (arg == "--users") users = std::clamp(std::stoi(next()), 2, 100);
+        else if (arg == "--rounds") rounds = std::max(1, std::stoi(next()));
+        else if (arg == "--latency-ms") apiOptions.latency = std::chrono::milliseconds(std::max(0, std::stoi(next())));
+        else if (arg == "--jitter-ms") apiOptions.latencyJitter = std::chrono::milliseconds(std::max(0, std::stoi(next())));
+        else if (arg == "--rate-limit") apiOptions.rateLimitProbability = std::clamp(std::stod(next()), 0.0, 1.0);
+        else if (arg == "--retry-after") apiOptions.retryAfterSeconds = std::max(1, std::stoi(next()));
+        else if (arg == "--step-timeout-ms") stepTimeoutMs = std::max(100, std::stoi(next()));
+        else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    DatabaseConfig::loadEnv(".env");
+    std::string dbConnString = DatabaseConfig::buildConnString();
+    if (dbConnString.empty()) {
+        std::cerr << "Error: Database environment variables not fully set." << std::endl;
+        return 1;
+    }
+
+    spdlog::set_level(spdlog::level::warn);
+    DatabaseManager db(dbConnString);
+    db.connect();
+    if (!db.getConnection() || !db.getConnection()->is_open()) return 1;
+    DatabaseSchema::createTables(db);
+
+    // Chat and user ids no real Telegram chat or user has, unique per run
+    long long firstChatId = -9'100'000'000'000LL - getpid() * 1000LL;
+    long long firstUserId = 9'100'000'000'000LL + getpid() * 100000LL;
+
+    Samples samples;
+    std::vector<std::unique_ptr<Inbox>> inboxes;
+    // Filled before the fake starts and only read afterwards
+    std::unordered_map<long long, Inbox*> inboxByChat;
+    std::vector<std::vector<SimUser>> members(groups);
+    for (int g = 0; g < groups; ++g) {
+        inboxes.push_back(std::make_unique<Inbox>());
+        inboxByChat[firstChatId - g] = inboxes.back().get();
+        for (int u = 0; u < users; ++u) {
+            SimUser user{firstUserId + g * 100LL + u, "user" + std::to_string(u + 1)};
+            inboxByChat[user.id] = inboxes.back().get();
+            members[g].push_back(std::move(user));
+        }
+    }
+
+    const std::string token = "bench-token";
+    bench::FakeBotApi api(token, apiOptions, [&inboxByChat](const bench::OutboundCall& call) {
+        auto it = inboxByChat.find(call.chatId);
+        if (it == inboxByChat.end()) return;
+        {
+            std::lock_guard<std::mutex> lock(it->second->mutex);
+            it->second->calls.push_back(call);
+        }
+        it->second->arrived.notify_all();
+    });
+    if (!api.start()) return 1;
+
+    // The same object graph as main.cpp, minus the cross-process cache invalidation
+    SettlementEngine settlementEngine;
+    ChatCache chatCache;
+    UserRepository userRepo(db, chatCache);
+    PaymentRepository payRepo(db, settlementEngine);
+    TripRepository tripRepo(db, chatCache);
+    CallbackRepository callbackRepo(db);
+
+    bot::Scheduler scheduler;
+    bot::Bot bot(token, scheduler, api.baseUrl());
+    bot.setUsername("bench_bot");
+
+    AsyncDatabase asyncDb(dbConnString, 2, [&bot](std::function<void()> task) { return bot.tryPost(std::move(task)); });
+    asyncDb.start();
+    AsyncPaymentRepository asyncPayRepo(asyncDb, settlementEngine);
+    TripSnapshotRepository snapshotRepo(db, asyncDb);
+
+    UserService userService(userRepo, bot);
+    PaymentService paymentService(payRepo, asyncPayRepo, tripRepo, userRepo, callbackRepo, bot);
+    handlers::Services services{userService, paymentService, settlementEngine};
+    handlers::Repositories repos{userRepo, tripRepo, payRepo, snapshotRepo};
+    handlers::registerHandlers(bot, services, repos);
+
+    scheduler.startWorker();
+    std::thread botThread([&bot] { bot.start(); });
+
+    std::vector<std::unique_ptr<GroupSession>> sessions;
+    for (int g = 0; g < groups; ++g) {
+        sessions.push_back(std::make_unique<GroupSession>(api, *inboxes[g], samples, firstChatId - g,
+                                                          members[g], std::chrono::milliseconds(stepTimeoutMs)));
+    }
+
+    forEachConcurrently(sessions, [](GroupSession& session) { session.registerAll(); });
+    uint64_t registrationUpdates = 0;
+    for (const auto& session : sessions) registrationUpdates += session->updatesSent();
+
+    bench::Stopwatch watch;
+    forEachConcurrently(sessions, [rounds](GroupSession& session) { session.run(rounds); });
+    double seconds = watch.elapsedNs() / 1e9;
+
+    bot.stop();
+    // Ends the bot's pending long poll, so start() returns
+    api.stop();
+    botThread.join();
+    asyncDb.stop();
+    scheduler.stop();
+
+    uint64_t updates = 0, completed = 0, abandoned = 0, timeouts = 0;
+    for (const auto& session : sessions) {
+        updates += session->updatesSent();
+        completed += session->flowsCompleted();
+        abandoned += session->flowsAbandoned();
+        timeouts += session->stepTimeouts();
+    }
+    updates -= registrationUpdates;
+
+    for (int g = 0; g < groups; ++g) {
+        cleanup(db, firstChatId - g);
+    }
+
+    json latency = samples.summary();
+    json output;
+    output["benchmark"] = "e2e";
+    output["groups"] = groups;
+    output["users"] = users;
+    output["rounds"] = rounds;
+    output["api"] = {
+        {"latency_ms", apiOptions.latency.count()},
+        {"jitter_ms", apiOptions.latencyJitter.count()},
+        {"rate_limit", apiOptions.rateLimitProbability},
+    };
+    output["duration_s"] = seconds;
+    output["updates"] = updates;
+    output["flows_completed"] = completed;
+    output["flows_abandoned"] = abandoned;
+    output["step_timeouts"] = timeouts;
+    output["throughput"] = {
+        {"updates_per_s", updates / seconds},
+        {"flows_per_s", completed / seconds},
+    };
+    output["reply_latency"] = json::object();
+    output["flow_latency"] = json::object();
+    for (const char* kind : {"command", "text", "callback", "register"}) {
+        if (latency.contains(kind)) output["reply_latency"][kind] = latency[kind];
+    }
+    for (const char* flow : {"registration", "pay", "list", "simplify"}) {
+        if (latency.contains(flow)) output["flow_latency"][flow] = latency[flow];
+    }
+
+    auto apiStats = api.stats();
+    output["api_calls"] = apiStats.calls;
+    output["rate_limited"] = apiStats.rateLimited;
+
+    std::cout << output.dump(2) << std::endl;
+    return 0;
+}
@@ -0,0 +1,155 @@
+// Handler latency with logging off, synchronous and asynchronous. Each simulated
+// handler builds a payment summary, as createPaymentGroup does, and logs one info line
+// with its fields plus one debug line that the info level filters out:
+//
+//   sync   a subsystem logger created before logging::init(), writing and flushing
+//          each line on the calling thread, as the bot did before init()
+//   off    a logger created after init() with every level off; only the checks remain
+//   async  the production setup: logging::init()'s bounded queue drained by one
+//          thread, dropping the oldest line when full
+//
+// The loggers are the bot's own, writing to its console sink; stdout is pointed at the
+// log file while they run so the comparison is the cost paid on the handler's thread,
+// not the terminal's.
+//
+// Usage: bench_logging [--iterations N] [--threads N] [--path FILE]
+//
+// --iterations is per thread (default 50000) and --threads defaults to 4, the bot's
+// default worker count. The log file (default bench_logging.log) is removed afterwards.
+// Prints one JSON document to stdout.
+
+#include "BenchUtil.h"
+
+#include "../logging/Logging.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace {
+
+// The work a payment handler does besides logging, kept small so logging shows up
+std::string handle(spdlog::logger& logger, long long groupId) {
+    std::string summary = "Dinner at the night market";
+    summary += " paid by user ";
+    summary += std::to_string(groupId % 7);
+    for (int i = 0; i < 4; ++i) summary += ", share " + std::to_string(groupId * (i + 1) % 997);
+
+    logger.debug("Split computed: group_id={}, shares={}", groupId, 4);
+    logger.info("Created payment group: group_id={}, trip_id={}, name='{}', total_amount={} {}, payer_user_id={}, records={}",
+                groupId, groupId / 10, "Dinner at the night market", 12345, "SGD", groupId % 7, 4);
+    return summary;
+}
+
+json run(const std::string& mode, spdlog::logger& logger, int threads, int iterations) {
+    std::vector<std::vector<long long>> latencies(static_cast<std::size_t>(threads));
+    bench::Stopwatch watch;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            auto& samples = latencies[static_cast<std::size_t>(t)];
+            samples.reserve(static_cast<std::size_t>(iterations));
+            for (int i = 0; i < iterations; ++i) {
+                auto start = std::chrono::steady_clock::now();
+                bench::doNotOptimize(handle(logger, static_cast<long long>(t) * iterations + i));
+                samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    double ns = watch.elapsedNs();
+
+    std::vector<long long> all;
+    for (auto& samples : latencies) all.insert(all.end(), samples.begin(), samples.end());
+    std::sort(all.begin(), all.end());
+    auto at = [&](double q) { return all[std::min(all.size() - 1, static_cast<std::size_t>(q * all.size()))]; };
+    double sum = 0;
+    for (long long v : all) sum += static_cast<double>(v);
+
+    return {
+        {"mode", mode},
+        {"threads", threads},
+        {"calls", all.size()},
+        {"mean_ns", sum / static_cast<double>(all.size())},
+        {"p50_ns", at(0.50)},
+        {"p99_ns", at(0.99)},
+        {"p999_ns", at(0.999)},
+        {"max_ns", all.back()},
+        {"calls_per_second", static_cast<double>(all.size()) / (ns / 1e9)},
+    };
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int iterations = 50'000;
+    int threads = 4;
+    std::string path = "bench_logging.log";
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--iterations") iterations = std::max(1, std::stoi(next()));
+        else if (arg == "--threads") threads = std::max(1, std::stoi(next()));
+        else if (arg == "--path") path = next();
+        else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    int logFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (logFd < 0) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return 1;
+    }
+    std::fflush(stdout);
+    int stdoutFd = ::dup(STDOUT_FILENO);
+    ::dup2(logFd, STDOUT_FILENO);
+    ::close(logFd);
+
+    json output;
+    output["benchmark"] = "logging";
+    output["results"] = json::array();
+
+    // Before init(), so this one stays synchronous
+    output["results"].push_back(run("sync", logging::repo(), threads, iterations));
+
+    logging::init();
+    logging::setLevels("off");
+    output["results"].push_back(run("off", logging::service(), threads, iterations));
+
+    logging::setLevels("info");
+    uint64_t droppedBefore = logging::droppedMessages();
+    json result = run("async", logging::service(), threads, iterations);
+    result["dropped"] = logging::droppedMessages() - droppedBefore;
+    // Time for the writer thread to catch up once the handlers are done
+    bench::Stopwatch drain;
+    logging::shutdown();
+    result["drain_ms"] = drain.elapsedNs() / 1e6;
+    output["results"].push_back(result);
+
+    std::fflush(stdout);
+    ::dup2(stdoutFd, STDOUT_FILENO);
+    ::close(stdoutFd);
+    std::remove(path.c_str());
+    std::cout << output.dump(2) << std::endl;
+    return 0;
+}
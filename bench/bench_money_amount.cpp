@@ -0,0 +1,190 @@
+// MoneyAmount parse/format micro-benchmark, comparing the from_chars/to_chars paths
+// against the previous std::stod / std::ostringstream implementation.
+//
+// Usage: bench_money_amount [--iterations N] [--seed N] [--verify]
+//
+// Prints one JSON document to stdout with per-call cost and allocations per call.
+
+#define BENCH_COUNT_ALLOCATIONS
+#include "BenchUtil.h"
+
+#include "../utils/MoneyAmount.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace {
+
+// The implementations MoneyAmount used before the exact parser, kept for comparison
+long long legacyParseMinor(const std::string& input, const std::string& currency) {
+    try {
+        double amount = std::stod(input);
+        if (amount <= 0 || std::isinf(amount)) return -1;
+        return MoneyAmount::fromMajorUnits(currency, amount).minorAmount();
+    } catch (...) {
+        return -1;
+    }
+}
+
+std::string legacyFormat(const MoneyAmount& amount) {
+    std::ostringstream ss;
+    if (MoneyAmount::isZeroDecimal(amount.currencyView())) {
+        ss << amount.minorAmount() << " " << amount.currencyView();
+    } else {
+        double major = static_cast<double>(amount.minorAmount()) / 100.0;
+        ss << std::fixed << std::setprecision(2) << major << " " << amount.currencyView();
+    }
+    return ss.str();
+}
+
+struct Sample {
+    std::string text;
+    std::string currency;
+    MoneyAmount amount;
+};
+
+std::vector<Sample> makeSamples(std::size_t count, unsigned seed) {
+    static const std::vector<std::string> currencies = {"SGD", "USD", "EUR", "JPY", "KRW"};
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<long long> minor(1, 50'000'000);
+    std::uniform_int_distribution<std::size_t> pick(0, currencies.size() - 1);
+
+    std::vector<Sample> samples;
+    samples.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::string& currency = currencies[pick(rng)];
+        MoneyAmount amount(currency, minor(rng));
+        std::string text = amount.toHumanReadable();
+        text.resize(text.find(' '));
+        samples.push_back({text, currency, amount});
+    }
+    return samples;
+}
+
+template<typename Fn>
+json measure(const std::string& name, std::size_t calls, Fn&& fn) {
+    auto allocStart = bench::AllocationSnapshot::now();
+    bench::Stopwatch watch;
+    fn();
+    double ns = watch.elapsedNs();
+    auto allocs = bench::AllocationSnapshot::now().since(allocStart);
+    return {
+        {"name", name},
+        {"calls", calls},
+        {"ns_per_call", ns / static_cast<double>(calls)},
+        {"allocations_per_call", static_cast<double>(allocs.count) / static_cast<double>(calls)},
+    };
+}
+
+// Round-trips every sample and a few edge cases through the new parser and formatter
+int verify(const std::vector<Sample>& samples) {
+    int mismatches = 0;
+    for (const auto& sample : samples) {
+        auto parsed = MoneyAmount::parseAndValidateAmount(sample.text, sample.currency);
+        if (!parsed.success || parsed.amount.minorAmount() != sample.amount.minorAmount()
+            || sample.amount.toHumanReadable() != legacyFormat(sample.amount)) {
+            std::cerr << "Mismatch for " << sample.text << " " << sample.currency << std::endl;
+            ++mismatches;
+        }
+    }
+
+    struct Case { const char* text; const char* currency; bool success; long long minor; };
+    const Case cases[] = {
+        {"123", "USD", true, 12300}, {" 12.3 ", "USD", true, 1230}, {"0.005", "USD", true, 1},
+        {"0.004", "USD", false, 0}, {".5", "EUR", true, 50}, {"7.", "EUR", true, 700},
+        {"1234.5", "JPY", true, 1235}, {"1e3", "USD", false, 0}, {"12abc", "USD", false, 0},
+        {"-5", "USD", false, 0}, {"", "USD", false, 0}, {".", "USD", false, 0},
+        {"99999999999999999999", "USD", false, 0}, {"92233720368547758.07", "USD", true, 9223372036854775807LL},
+    };
+    for (const auto& c : cases) {
+        auto parsed = MoneyAmount::parseAndValidateAmount(c.text, c.currency);
+        if (parsed.success != c.success || (c.success && parsed.amount.minorAmount() != c.minor)) {
+            std::cerr << "Unexpected result for \"" << c.text << "\" " << c.currency << std::endl;
+            ++mismatches;
+        }
+    }
+    return mismatches;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int iterations = 200'000;
+    unsigned seed = 42;
+    bool verifyOnly = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--iterations") iterations = std::max(1, std::stoi(next()));
+        else if (arg == "--seed") seed = static_cast<unsigned>(std::stoul(next()));
+        else if (arg == "--verify") verifyOnly = true;
+        else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    auto samples = makeSamples(1024, seed);
+    if (verifyOnly) {
+        int mismatches = verify(samples);
+        std::cout << json{{"benchmark", "money_amount"}, {"mismatches", mismatches}}.dump(2) << std::endl;
+        return mismatches == 0 ? 0 : 1;
+    }
+
+    std::size_t calls = static_cast<std::size_t>(iterations);
+    auto sampleAt = [&samples](std::size_t i) -> const Sample& { return samples[i % samples.size()]; };
+
+    json output;
+    output["benchmark"] = "money_amount";
+    output["results"] = json::array();
+
+    output["results"].push_back(measure("parse_stod", calls, [&] {
+        for (std::size_t i = 0; i < calls; ++i) {
+            const auto& s = sampleAt(i);
+            bench::doNotOptimize(legacyParseMinor(s.text, s.currency));
+        }
+    }));
+    output["results"].push_back(measure("parse_from_chars", calls, [&] {
+        for (std::size_t i = 0; i < calls; ++i) {
+            const auto& s = sampleAt(i);
+            bench::doNotOptimize(MoneyAmount::parseAndValidateAmount(s.text, s.currency).amount);
+        }
+    }));
+    output["results"].push_back(measure("format_ostringstream", calls, [&] {
+        for (std::size_t i = 0; i < calls; ++i) {
+            bench::doNotOptimize(legacyFormat(sampleAt(i).amount).size());
+        }
+    }));
+    output["results"].push_back(measure("format_to_chars", calls, [&] {
+        std::array<char, MoneyAmount::MAX_CHARS> buffer;
+        for (std::size_t i = 0; i < calls; ++i) {
+            auto [end, ec] = sampleAt(i).amount.toChars(buffer.data(), buffer.data() + buffer.size());
+            bench::doNotOptimize(end);
+        }
+    }));
+    output["results"].push_back(measure("format_to_human_readable", calls, [&] {
+        for (std::size_t i = 0; i < calls; ++i) {
+            bench::doNotOptimize(sampleAt(i).amount.toHumanReadable().size());
+        }
+    }));
+
+    std::cout << output.dump(2) << std::endl;
+    return 0;
+}
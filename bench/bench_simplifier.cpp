@@ -0,0 +1,372 @@
+// Debt-simplifier benchmark over reproducible synthetic trips.
+//
+// Usage: bench_simplifier [--participants N] [--groups N] [--currencies N]
+//                         [--skew single-payer|pairwise|random] [--seed N]
+//                         [--iterations N] [--matrix] [--verify-incremental]
+//                         [--batch TRIPS] [--workers N]
+//
+// Prints one JSON document to stdout, e.g. for tracking regressions across commits.
+
+#define BENCH_COUNT_ALLOCATIONS
+#include "BenchUtil.h"
+
+#include "../algorithm/GreedyDebtSimplifier.h"
+#include "../algorithm/MinTransactionsSimplifier.h"
+#include "../algorithm/SettlementEngine.h"
+#include "../bot/ThreadPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace {
+
+enum class Skew { SinglePayer, Pairwise, Random };
+
+struct TripSpec {
+    int participants = 8;
+    int groups = 200;
+    int currencies = 1;
+    Skew skew = Skew::Random;
+    unsigned seed = 42;
+};
+
+struct SolverEntry {
+    std::string name;
+    std::function<std::unique_ptr<DebtSimplifier>()> make;
+    // Largest participant count the solver is run for (exhaustive solvers blow up)
+    int maxParticipants;
+};
+
+// Register new solvers here
+const std::vector<SolverEntry>& solvers() {
+    static const std::vector<SolverEntry> entries = {
+        {"greedy", [] { return std::make_unique<GreedyDebtSimplifier>(); }, 1 << 20},
+        {"min_transactions", [] { return std::make_unique<MinTransactionsSimplifier>(); }, 10},
+    };
+    return entries;
+}
+
+const std::vector<std::pair<std::string, double>>& currencyTable() {
+    static const std::vector<std::pair<std::string, double>> table = {
+        {"USD", 1.0}, {"EUR", 1.08}, {"JPY", 0.0067}, {"GBP", 1.27},
+        {"SGD", 0.74}, {"KRW", 0.00073}, {"AUD", 0.65}, {"MYR", 0.21},
+    };
+    return table;
+}
+
+const char* skewName(Skew skew) {
+    switch (skew) {
+        case Skew::SinglePayer: return "single-payer";
+        case Skew::Pairwise: return "pairwise";
+        case Skew::Random: return "random";
+    }
+    return "random";
+}
+
+bool parseSkew(const std::string& name, Skew& skew) {
+    if (name == "single-payer") { skew = Skew::SinglePayer; return true; }
+    if (name == "pairwise") { skew = Skew::Pairwise; return true; }
+    if (name == "random") { skew = Skew::Random; return true; }
+    return false;
+}
+
+PaymentGroup makeGroup(const TripSpec& spec, std::mt19937_64& rng, long long groupId) {
+    std::uniform_int_distribution<int> userDist(0, spec.participants - 1);
+    std::uniform_int_distribution<int> currencyDist(0, spec.currencies - 1);
+    std::uniform_int_distribution<long long> amountDist(100, 50000);
+
+    const auto& currency = currencyTable()[currencyDist(rng)].first;
+    long long payer = spec.skew == Skew::SinglePayer ? 0 : userDist(rng);
+
+    std::vector<long long> recipients;
+    if (spec.skew == Skew::Pairwise) {
+        long long other = userDist(rng);
+        if (other == payer) other = (other + 1) % spec.participants;
+        recipients.push_back(other);
+    } else {
+        std::uniform_int_distribution<int> countDist(1, spec.participants);
+        int count = countDist(rng);
+        std::vector<long long> everyone(spec.participants);
+        for (int i = 0; i < spec.participants; ++i) everyone[i] = i;
+        std::shuffle(everyone.begin(), everyone.end(), rng);
+        recipients.assign(everyone.begin(), everyone.begin() + count);
+    }
+
+    PaymentGroup group{groupId, 1, "bench", MoneyAmount(currency, 0), payer, {}, {}};
+    long long total = 0;
+    for (long long recipient : recipients) {
+        long long amount = amountDist(rng);
+        total += amount;
+        group.records.push_back({0, groupId, 1, MoneyAmount(currency, amount), payer, recipient, {}});
+    }
+    group.total_amount = MoneyAmount(currency, total);
+    return group;
+}
+
+std::vector<PaymentGroup> makeTrip(const TripSpec& spec) {
+    std::mt19937_64 rng(spec.seed);
+    std::vector<PaymentGroup> groups;
+    groups.reserve(spec.groups);
+    for (int i = 0; i < spec.groups; ++i) {
+        groups.push_back(makeGroup(spec, rng, i + 1));
+    }
+    return groups;
+}
+
+std::unordered_map<std::string, double> ratesFor(const TripSpec& spec) {
+    std::unordered_map<std::string, double> rates;
+    for (int i = 0; i < spec.currencies; ++i) {
+        rates[currencyTable()[i].first] = currencyTable()[i].second;
+    }
+    return rates;
+}
+
+json specJson(const TripSpec& spec) {
+    return {
+        {"participants", spec.participants},
+        {"groups", spec.groups},
+        {"currencies", spec.currencies},
+        {"skew", skewName(spec.skew)},
+        {"seed", spec.seed},
+    };
+}
+
+json runSolvers(const TripSpec& spec, int iterations) {
+    auto groups = makeTrip(spec);
+    auto rates = ratesFor(spec);
+    const std::string target = "USD";
+
+    json results = json::array();
+    for (const auto& entry : solvers()) {
+        json result = {{"solver", entry.name}, {"trip", specJson(spec)}};
+        if (spec.participants > entry.maxParticipants) {
+            result["skipped"] = true;
+            results.push_back(result);
+            continue;
+        }
+
+        auto simplifier = entry.make();
+        double totalNs = 0;
+        double bestNs = 0;
+        std::size_t transactions = 0;
+        auto allocStart = bench::AllocationSnapshot::now();
+        for (int i = 0; i < iterations; ++i) {
+            bench::Stopwatch watch;
+            auto payments = simplifier->simplifyDebts(groups, rates, target);
+            double ns = watch.elapsedNs();
+            bench::doNotOptimize(payments.data());
+            totalNs += ns;
+            bestNs = (i == 0) ? ns : std::min(bestNs, ns);
+            transactions = payments.size();
+        }
+        auto allocs = bench::AllocationSnapshot::now().since(allocStart);
+
+        result["iterations"] = iterations;
+        result["mean_ns"] = totalNs / iterations;
+        result["min_ns"] = bestNs;
+        result["allocations_per_run"] = static_cast<double>(allocs.count) / iterations;
+        result["allocated_bytes_per_run"] = static_cast<double>(allocs.bytes) / iterations;
+        result["transactions"] = transactions;
+        results.push_back(result);
+    }
+    return results;
+}
+
+// Applies random inserts and undos to a SettlementEngine and checks after every step
+// that its (possibly cached) solution settles the same balances as a full recompute.
+json verifyIncremental(const TripSpec& spec, int steps) {
+    std::mt19937_64 rng(spec.seed);
+    auto rates = ratesFor(spec);
+    const std::string target = "USD";
+    GreedyDebtSimplifier simplifier;
+    SettlementEngine engine;
+
+    std::vector<PaymentGroup> history;
+    engine.load(1, history, engine.beginLoad(1));
+
+    double engineNs = 0;
+    double fullNs = 0;
+    int mismatches = 0;
+    for (int step = 0; step < steps; ++step) {
+        if (!history.empty() && rng() % 4 == 0) {
+            engine.revertPaymentGroup(history.back());
+            history.pop_back();
+        } else {
+            history.push_back(makeGroup(spec, rng, step + 1));
+            engine.applyPaymentGroup(history.back());
+        }
+
+        bench::Stopwatch engineWatch;
+        auto incremental = *engine.simplify(1, simplifier, rates, target);
+        engineNs += engineWatch.elapsedNs();
+
+        bench::Stopwatch fullWatch;
+        auto full = simplifier.simplifyDebts(history, rates, target);
+        fullNs += fullWatch.elapsedNs();
+
+        // Both plans must leave every participant with the same residual balance
+        std::unordered_map<long long, long long> residual;
+        for (const auto& p : incremental) {
+            residual[p.from_user_id] += p.amount.minorAmount();
+            residual[p.to_user_id] -= p.amount.minorAmount();
+        }
+        for (const auto& p : full) {
+            residual[p.from_user_id] -= p.amount.minorAmount();
+            residual[p.to_user_id] += p.amount.minorAmount();
+        }
+        long long drift = 0;
+        for (const auto& [userId, amount] : residual) drift += std::llabs(amount);
+        // Per-user rounding of converted balances may differ by one minor unit each
+        if (drift > spec.participants) mismatches++;
+    }
+
+    return {
+        {"trip", specJson(spec)},
+        {"steps", steps},
+        {"mismatches", mismatches},
+        {"engine_mean_ns", engineNs / steps},
+        {"full_recompute_mean_ns", fullNs / steps},
+    };
+}
+
+// Settles many small trips one simplifyDebts() call at a time and through
+// simplifyBatch() on a bot::ThreadPool, reporting throughput for both.
+json runBatch(const TripSpec& spec, int tripCount, int workers) {
+    std::vector<std::vector<PaymentGroup>> tripGroups;
+    tripGroups.reserve(tripCount);
+    for (int i = 0; i < tripCount; ++i) {
+        TripSpec tripSpec = spec;
+        tripSpec.seed = spec.seed + i;
+        tripGroups.push_back(makeTrip(tripSpec));
+    }
+    auto rates = ratesFor(spec);
+    const std::string target = "USD";
+
+    std::vector<TripSettlementInput> inputs;
+    inputs.reserve(tripCount);
+    for (int i = 0; i < tripCount; ++i) {
+        inputs.push_back({i + 1, tripGroups[i], &rates, target});
+    }
+
+    GreedyDebtSimplifier simplifier;
+    json result = {{"trip", specJson(spec)}, {"trips", tripCount}, {"workers", workers}};
+
+    {
+        auto allocStart = bench::AllocationSnapshot::now();
+        bench::Stopwatch watch;
+        std::size_t transactions = 0;
+        for (const auto& groups : tripGroups) {
+            transactions += simplifier.simplifyDebts(groups, rates, target).size();
+        }
+        double ns = watch.elapsedNs();
+        auto allocs = bench::AllocationSnapshot::now().since(allocStart);
+        result["sequential"] = {
+            {"trips_per_second", tripCount / (ns / 1e9)},
+            {"allocations_per_trip", static_cast<double>(allocs.count) / tripCount},
+            {"transactions", transactions},
+        };
+    }
+
+    {
+        bot::ThreadPool pool(workers, static_cast<std::size_t>(workers) * 2);
+        SettlementExecutor executor = [&pool](std::function<void()> task) {
+            return pool.submit(std::move(task));
+        };
+        auto allocStart = bench::AllocationSnapshot::now();
+        bench::Stopwatch watch;
+        auto results = simplifier.simplifyBatch(inputs, executor, workers);
+        double ns = watch.elapsedNs();
+        auto allocs = bench::AllocationSnapshot::now().since(allocStart);
+        std::size_t transactions = 0;
+        for (const auto& r : results) transactions += r.payments.size();
+        result["batch"] = {
+            {"trips_per_second", tripCount / (ns / 1e9)},
+            {"allocations_per_trip", static_cast<double>(allocs.count) / tripCount},
+            {"transactions", transactions},
+        };
+    }
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    TripSpec spec;
+    int iterations = 20;
+    bool matrix = false;
+    bool verify = false;
+    int batchTrips = 0;
+    int workers = 4;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--participants") spec.participants = std::max(2, std::stoi(next()));
+        else if (arg == "--groups") spec.groups = std::max(1, std::stoi(next()));
+        else if (arg == "--currencies") spec.currencies = std::clamp(std::stoi(next()), 1, static_cast<int>(currencyTable().size()));
+        else if (arg == "--seed") spec.seed = static_cast<unsigned>(std::stoul(next()));
+        else if (arg == "--iterations") iterations = std::max(1, std::stoi(next()));
+        else if (arg == "--matrix") matrix = true;
+        else if (arg == "--verify-incremental") verify = true;
+        else if (arg == "--batch") batchTrips = std::max(1, std::stoi(next()));
+        else if (arg == "--workers") workers = std::max(1, std::stoi(next()));
+        else if (arg == "--skew") {
+            if (!parseSkew(next(), spec.skew)) {
+                std::cerr << "Unknown skew: " << argv[i] << std::endl;
+                return 2;
+            }
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    json output;
+    output["benchmark"] = "simplifier";
+    output["results"] = json::array();
+
+    if (matrix) {
+        for (int participants : {4, 8, 10, 32, 128}) {
+            for (Skew skew : {Skew::SinglePayer, Skew::Pairwise, Skew::Random}) {
+                for (int currencies : {1, 3}) {
+                    TripSpec s = spec;
+                    s.participants = participants;
+                    s.skew = skew;
+                    s.currencies = currencies;
+                    for (auto& r : runSolvers(s, iterations)) output["results"].push_back(r);
+                }
+            }
+        }
+    } else {
+        for (auto& r : runSolvers(spec, iterations)) output["results"].push_back(r);
+    }
+
+    if (batchTrips > 0) {
+        output["batch"] = runBatch(spec, batchTrips, workers);
+    }
+
+    int exitCode = 0;
+    if (verify) {
+        output["incremental"] = verifyIncremental(spec, spec.groups);
+        if (output["incremental"]["mismatches"].get<int>() != 0) exitCode = 1;
+    }
+
+    std::cout << output.dump(2) << std::endl;
+    return exitCode;
+}
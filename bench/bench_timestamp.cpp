@@ -0,0 +1,201 @@
+// Timestamp parse/format benchmark, comparing utils::parseTimestamp/formatTimestamp
+// against the previous sscanf + mktime / gmtime + strftime implementation, both on one
+// thread and with several threads decoding at once (mktime serialises on the tz lock).
+//
+// Usage: bench_timestamp [--iterations N] [--threads N] [--seed N] [--verify]
+//
+// Prints one JSON document to stdout.
+
+#define BENCH_COUNT_ALLOCATIONS
+#include "BenchUtil.h"
+
+#include "../utils/utils.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace {
+
+// The implementations utils.h used before, kept for comparison
+std::chrono::system_clock::time_point legacyParse(const char* timestampStr) {
+    int year, month, day, hour, minute, second;
+    if (std::sscanf(timestampStr, "%d-%d-%d %d:%d:%d", &year, &month, &day, &hour, &minute, &second) == 6) {
+        std::tm tm = {};
+        tm.tm_year = year - 1900;
+        tm.tm_mon = month - 1;
+        tm.tm_mday = day;
+        tm.tm_hour = hour;
+        tm.tm_min = minute;
+        tm.tm_sec = second;
+        tm.tm_isdst = -1;
+        return std::chrono::system_clock::from_time_t(std::mktime(&tm));
+    }
+    return std::chrono::system_clock::time_point{};
+}
+
+std::unique_ptr<char[]> legacyFormat(const std::chrono::system_clock::time_point& timestamp, int gmtOffsetHours) {
+    std::time_t t = std::chrono::system_clock::to_time_t(timestamp + std::chrono::hours(gmtOffsetHours));
+    std::tm* tm_ptr = std::gmtime(&t);
+    if (!tm_ptr) return nullptr;
+    auto buffer = std::make_unique<char[]>(64);
+    std::strftime(buffer.get(), 64, "%d %b %H:%M", tm_ptr);
+    return buffer;
+}
+
+// Postgres-style text timestamps, half of them with microseconds
+std::vector<std::string> makeTimestamps(std::size_t count, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<long long> seconds(946684800LL, 2524608000LL);  // 2000..2050
+    std::uniform_int_distribution<int> micros(0, 999999);
+
+    std::vector<std::string> result;
+    result.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        std::time_t t = static_cast<std::time_t>(seconds(rng));
+        std::tm tm{};
+        gmtime_r(&t, &tm);
+        char buffer[40];
+        std::size_t n = std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &tm);
+        if (i % 2 == 1) std::snprintf(buffer + n, sizeof(buffer) - n, ".%06d", micros(rng));
+        result.emplace_back(buffer);
+    }
+    return result;
+}
+
+json measure(const std::string& name, std::size_t calls, const std::function<void()>& fn) {
+    auto allocStart = bench::AllocationSnapshot::now();
+    bench::Stopwatch watch;
+    fn();
+    double ns = watch.elapsedNs();
+    auto allocs = bench::AllocationSnapshot::now().since(allocStart);
+    return {
+        {"name", name},
+        {"calls", calls},
+        {"ns_per_call", ns / static_cast<double>(calls)},
+        {"allocations_per_call", static_cast<double>(allocs.count) / static_cast<double>(calls)},
+    };
+}
+
+// Every thread decodes callsPerThread timestamps; reports aggregate throughput
+json contention(const std::string& name, int threads, std::size_t callsPerThread,
+                const std::vector<std::string>& samples,
+                std::chrono::system_clock::time_point (*parse)(const char*)) {
+    bench::Stopwatch watch;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            for (std::size_t i = 0; i < callsPerThread; ++i) {
+                bench::doNotOptimize(parse(samples[(i + t) % samples.size()].c_str()));
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    double ns = watch.elapsedNs();
+    std::size_t total = callsPerThread * static_cast<std::size_t>(threads);
+    return {
+        {"name", name},
+        {"threads", threads},
+        {"calls", total},
+        {"calls_per_second", static_cast<double>(total) / (ns / 1e9)},
+    };
+}
+
+std::chrono::system_clock::time_point newParse(const char* text) {
+    return utils::parseTimestamp(text);
+}
+
+int verify(const std::vector<std::string>& samples) {
+    // The legacy parser reads local time; compare against it in UTC only
+    setenv("TZ", "UTC", 1);
+    tzset();
+    int mismatches = 0;
+    for (const auto& sample : samples) {
+        auto parsed = utils::parseTimestamp(sample.c_str());
+        auto expected = legacyParse(sample.c_str());
+        if (std::chrono::floor<std::chrono::seconds>(parsed) != expected
+            || utils::formatTimestamp(parsed, 8).view() != legacyFormat(parsed, 8).get()) {
+            std::cerr << "Mismatch for " << sample << std::endl;
+            ++mismatches;
+        }
+    }
+    auto withOffset = utils::parseTimestamp("2024-02-29T23:30:00.5+08:00");
+    if (utils::formatTimestamp(withOffset, 8).view() != "29 Feb 23:30") ++mismatches;
+    if (utils::parseTimestamp("2024-13-01 00:00:00") != std::chrono::system_clock::time_point{}) ++mismatches;
+    if (utils::parseTimestamp("garbage") != std::chrono::system_clock::time_point{}) ++mismatches;
+    return mismatches;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int iterations = 200'000;
+    int threads = 4;
+    unsigned seed = 42;
+    bool verifyOnly = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--iterations") iterations = std::max(1, std::stoi(next()));
+        else if (arg == "--threads") threads = std::max(1, std::stoi(next()));
+        else if (arg == "--seed") seed = static_cast<unsigned>(std::stoul(next()));
+        else if (arg == "--verify") verifyOnly = true;
+        else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    auto samples = makeTimestamps(1024, seed);
+    if (verifyOnly) {
+        int mismatches = verify(samples);
+        std::cout << json{{"benchmark", "timestamp"}, {"mismatches", mismatches}}.dump(2) << std::endl;
+        return mismatches == 0 ? 0 : 1;
+    }
+
+    std::size_t calls = static_cast<std::size_t>(iterations);
+    std::vector<std::chrono::system_clock::time_point> points;
+    for (const auto& s : samples) points.push_back(utils::parseTimestamp(s.c_str()));
+
+    json output;
+    output["benchmark"] = "timestamp";
+    output["results"] = json::array();
+    output["results"].push_back(measure("parse_sscanf_mktime", calls, [&] {
+        for (std::size_t i = 0; i < calls; ++i) bench::doNotOptimize(legacyParse(samples[i % samples.size()].c_str()));
+    }));
+    output["results"].push_back(measure("parse_fixed_format", calls, [&] {
+        for (std::size_t i = 0; i < calls; ++i) bench::doNotOptimize(utils::parseTimestamp(samples[i % samples.size()].c_str()));
+    }));
+    output["results"].push_back(measure("format_strftime", calls, [&] {
+        for (std::size_t i = 0; i < calls; ++i) bench::doNotOptimize(legacyFormat(points[i % points.size()], 8).get());
+    }));
+    output["results"].push_back(measure("format_stack_buffer", calls, [&] {
+        for (std::size_t i = 0; i < calls; ++i) bench::doNotOptimize(utils::formatTimestamp(points[i % points.size()], 8).size);
+    }));
+
+    output["contention"] = json::array();
+    std::size_t perThread = std::max<std::size_t>(1, calls / static_cast<std::size_t>(threads));
+    output["contention"].push_back(contention("parse_sscanf_mktime", threads, perThread, samples, legacyParse));
+    output["contention"].push_back(contention("parse_fixed_format", threads, perThread, samples, newParse));
+
+    std::cout << output.dump(2) << std::endl;
+    return 0;
+}
@@ -0,0 +1,115 @@
+// Inline keyboard button payloads: encoding on every keyboard render, decoding on
+// every button press. Payloads mirror RecordPaymentConversation's buttons: user ids
+// (up to Telegram's 52-bit range), currency codes and fixed actions. The JSON codec
+// the conversations used before bot::CallbackData is kept for comparison.
+
+#include "../../bot/CallbackData.h"
+
+#include <cstdint>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+
+namespace {
+
+using json = nlohmann::json;
+
+// Step and either an id or a token, as the conversations render them
+struct Payload {
+    uint8_t step;
+    std::variant<long long, std::string> data;
+};
+
+const std::vector<Payload>& payloads() {
+    static const std::vector<Payload> samples = {
+        {3, 123456789LL},
+        {8, 7012345678LL},
+        {7, 4503599627370495LL},
+        {5, 987654321LL},
+        {1, std::string("SGD")},
+        {4, std::string("split_equally")},
+        {7, std::string("page_next")},
+        {5, std::string("done")},
+    };
+    return samples;
+}
+
+std::string legacyCreate(int targetStep, const std::string& data) {
+    json j;
+    j["targetStep"] = targetStep;
+    j["data"] = data;
+    return j.dump();
+}
+
+bool legacyParse(const std::string& jsonStr, int& targetStep, std::string& data) {
+    try {
+        auto j = json::parse(jsonStr);
+        targetStep = j["targetStep"].get<int>();
+        data = j["data"].get<std::string>();
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+std::string legacyText(const Payload& payload) {
+    if (auto* id = std::get_if<long long>(&payload.data)) return std::to_string(*id);
+    return std::get<std::string>(payload.data);
+}
+
+bot::CallbackData compact(const Payload& payload) {
+    if (auto* id = std::get_if<long long>(&payload.data)) return bot::CallbackData::id(payload.step, *id);
+    return bot::CallbackData::token(payload.step, std::get<std::string>(payload.data));
+}
+
+void BM_CallbackDataEncodeJson(benchmark::State& state) {
+    const auto& samples = payloads();
+    std::size_t i = 0;
+    for (auto _ : state) {
+        const auto& payload = samples[i++ % samples.size()];
+        benchmark::DoNotOptimize(legacyCreate(payload.step, legacyText(payload)));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CallbackDataEncodeJson);
+
+void BM_CallbackDataDecodeJson(benchmark::State& state) {
+    std::vector<std::string> encoded;
+    for (const auto& payload : payloads()) encoded.push_back(legacyCreate(payload.step, legacyText(payload)));
+    std::size_t i = 0;
+    int step;
+    std::string data;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(legacyParse(encoded[i++ % encoded.size()], step, data));
+        benchmark::DoNotOptimize(data);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CallbackDataDecodeJson);
+
+void BM_CallbackDataEncode(benchmark::State& state) {
+    std::vector<bot::CallbackData> samples;
+    for (const auto& payload : payloads()) samples.push_back(compact(payload));
+    std::size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(samples[i++ % samples.size()].encode());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CallbackDataEncode);
+
+void BM_CallbackDataDecode(benchmark::State& state) {
+    std::vector<std::string> encoded;
+    for (const auto& payload : payloads()) encoded.push_back(compact(payload).encode());
+    std::size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(bot::CallbackData::decode(encoded[i++ % encoded.size()]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CallbackDataDecode);
+
+} // namespace
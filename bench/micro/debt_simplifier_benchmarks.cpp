@@ -0,0 +1,75 @@
+// Both debt simplifiers over reproducible random trips: every expense paid by one
+// participant for a random subset, in one currency. MinTransactionsSimplifier is
+// exhaustive, so it only runs at the group sizes it is used for.
+
+#include "../../algorithm/GreedyDebtSimplifier.h"
+#include "../../algorithm/MinTransactionsSimplifier.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+std::vector<PaymentGroup> makeTrip(int participants, int groups) {
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<int> userDist(0, participants - 1);
+    std::uniform_int_distribution<int> countDist(1, participants);
+    std::uniform_int_distribution<long long> amountDist(100, 50000);
+
+    std::vector<PaymentGroup> trip;
+    for (int g = 0; g < groups; ++g) {
+        long long payer = userDist(rng);
+        std::vector<long long> everyone(participants);
+        for (int i = 0; i < participants; ++i) everyone[i] = i;
+        std::shuffle(everyone.begin(), everyone.end(), rng);
+
+        PaymentGroup group{g + 1, 1, "bench", MoneyAmount("USD", 0), payer, {}, {}};
+        long long total = 0;
+        for (int r = countDist(rng); r > 0; --r) {
+            long long amount = amountDist(rng);
+            total += amount;
+            group.records.push_back({0, g + 1, 1, MoneyAmount("USD", amount), payer, everyone[r - 1], {}});
+        }
+        group.total_amount = MoneyAmount("USD", total);
+        trip.push_back(std::move(group));
+    }
+    return trip;
+}
+
+template <typename Simplifier>
+void BM_SimplifyDebts(benchmark::State& state) {
+    auto trip = makeTrip(static_cast<int>(state.range(0)), 200);
+    std::unordered_map<std::string, double> rates = {{"USD", 1.0}};
+    Simplifier simplifier;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(simplifier.simplifyDebts(trip, rates, "USD"));
+    }
+    state.SetLabel(std::to_string(state.range(0)) + " participants");
+}
+BENCHMARK_TEMPLATE(BM_SimplifyDebts, GreedyDebtSimplifier)->Arg(4)->Arg(8)->Arg(16)->Arg(64);
+BENCHMARK_TEMPLATE(BM_SimplifyDebts, MinTransactionsSimplifier)->Arg(4)->Arg(6)->Arg(8);
+
+// The solver alone, on balances already netted per user
+template <typename Simplifier>
+void BM_Settle(benchmark::State& state) {
+    auto balances = DebtSimplifier::computeNetBalances(makeTrip(static_cast<int>(state.range(0)), 200));
+    std::unordered_map<long long, long long> usd;
+    for (const auto& [user, perCurrency] : balances) {
+        auto it = perCurrency.find("USD");
+        if (it != perCurrency.end()) usd[user] = it->second;
+    }
+    Simplifier simplifier;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(simplifier.settle(usd, "USD"));
+    }
+    state.SetLabel(std::to_string(state.range(0)) + " participants");
+}
+BENCHMARK_TEMPLATE(BM_Settle, GreedyDebtSimplifier)->Arg(4)->Arg(8)->Arg(16)->Arg(64);
+BENCHMARK_TEMPLATE(BM_Settle, MinTransactionsSimplifier)->Arg(4)->Arg(6)->Arg(8);
+
+} // namespace
@@ -0,0 +1,68 @@
+// MoneyAmount formatting and parsing of user-entered amounts, over two- and
+// zero-decimal currencies and the range of sizes people type
+
+#include "../../utils/MoneyAmount.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+const char* const kCurrencies[] = {"USD", "SGD", "EUR", "JPY", "KRW", "MYR"};
+
+std::vector<MoneyAmount> amounts() {
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<int> currency(0, 5);
+    std::uniform_int_distribution<int> digits(1, 9);
+    std::vector<MoneyAmount> result;
+    for (int i = 0; i < 1024; ++i) {
+        long long limit = 1;
+        for (int d = digits(rng); d > 0; --d) limit *= 10;
+        long long minor = std::uniform_int_distribution<long long>(-limit / 10, limit)(rng);
+        result.emplace_back(kCurrencies[currency(rng)], minor);
+    }
+    return result;
+}
+
+// What people type: integers, one or two decimals, extra decimals to round, padding
+struct TypedAmount {
+    std::string text;
+    std::string currency;
+};
+
+std::vector<TypedAmount> typedAmounts() {
+    static const std::vector<std::string> shapes = {
+        "12", "123", "4500", "12.5", "12.50", "1234.56", "0.99", " 88.8 ", "1234.567", "+20", "1e3", "abc",
+    };
+    std::vector<TypedAmount> result;
+    for (std::size_t i = 0; i < 1024; ++i) {
+        result.push_back({shapes[i % shapes.size()], kCurrencies[i % 6]});
+    }
+    return result;
+}
+
+void BM_MoneyAmountToHumanReadable(benchmark::State& state) {
+    auto samples = amounts();
+    std::size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(samples[i++ % samples.size()].toHumanReadable());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MoneyAmountToHumanReadable);
+
+void BM_MoneyAmountParseAndValidate(benchmark::State& state) {
+    auto samples = typedAmounts();
+    std::size_t i = 0;
+    for (auto _ : state) {
+        const auto& sample = samples[i++ % samples.size()];
+        benchmark::DoNotOptimize(MoneyAmount::parseAndValidateAmount(sample.text, sample.currency));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MoneyAmountParseAndValidate);
+
+} // namespace
@@ -0,0 +1,59 @@
+// utils::parseTimestamp / formatTimestamp over Postgres-style text timestamps, half
+// of them with microseconds, as pqxx returns them for timestamp columns
+
+#include "../../utils/utils.h"
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+const std::vector<std::string>& timestamps() {
+    static const std::vector<std::string> samples = [] {
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<long long> seconds(946684800LL, 2524608000LL);  // 2000..2050
+        std::uniform_int_distribution<int> micros(0, 999999);
+        std::vector<std::string> result;
+        for (int i = 0; i < 1024; ++i) {
+            std::time_t t = static_cast<std::time_t>(seconds(rng));
+            std::tm tm{};
+            gmtime_r(&t, &tm);
+            char buffer[40];
+            std::size_t n = std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &tm);
+            if (i % 2 == 1) std::snprintf(buffer + n, sizeof(buffer) - n, ".%06d", micros(rng));
+            result.emplace_back(buffer);
+        }
+        return result;
+    }();
+    return samples;
+}
+
+void BM_ParseTimestamp(benchmark::State& state) {
+    const auto& samples = timestamps();
+    std::size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(utils::parseTimestamp(samples[i++ % samples.size()].c_str()));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseTimestamp);
+
+void BM_FormatTimestamp(benchmark::State& state) {
+    std::vector<std::chrono::system_clock::time_point> points;
+    for (const auto& sample : timestamps()) points.push_back(utils::parseTimestamp(sample.c_str()));
+    std::size_t i = 0;
+    for (auto _ : state) {
+        auto text = utils::formatTimestamp(points[i++ % points.size()], 8);
+        benchmark::DoNotOptimize(text.data);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FormatTimestamp);
+
+} // namespace
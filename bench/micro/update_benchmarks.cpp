@@ -0,0 +1,73 @@
+// Decoding getUpdates results: bot::from_json for a single Update, and a whole
+// response body of mixed messages and button presses as Bot::getUpdates parses it
+
+#include "../../bot/TelegramTypes.h"
+
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+using json = nlohmann::json;
+
+json textMessage(long long updateId) {
+    return {
+        {"update_id", updateId},
+        {"message", {
+            {"message_id", 4021},
+            {"from", {{"id", 7012345678LL}, {"is_bot", false}, {"first_name", "Wei Ling"}, {"username", "weiling"}}},
+            {"chat", {{"id", -1001234567890LL}, {"title", "Hokkaido trip"}, {"type", "supergroup"}}},
+            {"date", 1718000000},
+            {"text", "Dinner at the night market"},
+        }},
+    };
+}
+
+json buttonPress(long long updateId) {
+    return {
+        {"update_id", updateId},
+        {"callback_query", {
+            {"id", "4382731982739812"},
+            {"from", {{"id", 7012345678LL}, {"is_bot", false}, {"first_name", "Wei Ling"}}},
+            {"message", {
+                {"message_id", 4022},
+                {"chat", {{"id", -1001234567890LL}, {"title", "Hokkaido trip"}, {"type", "supergroup"}}},
+                {"date", 1718000001},
+                {"text", "Who paid?"},
+            }},
+            {"chat_instance", "-3861094528471653"},
+            {"data", "EAOcnb-fNLrg"},
+        }},
+    };
+}
+
+void BM_UpdateFromJson(benchmark::State& state) {
+    json update = state.range(0) == 0 ? textMessage(1) : buttonPress(1);
+    for (auto _ : state) {
+        bot::Update parsed;
+        bot::from_json(update, parsed);
+        benchmark::DoNotOptimize(parsed);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(state.range(0) == 0 ? "message" : "callback_query");
+}
+BENCHMARK(BM_UpdateFromJson)->Arg(0)->Arg(1);
+
+// Body parse plus from_json for a batch of the given size, alternating kinds
+void BM_GetUpdatesResponseParse(benchmark::State& state) {
+    json response = {{"ok", true}, {"result", json::array()}};
+    for (long long i = 0; i < state.range(0); ++i) {
+        response["result"].push_back(i % 2 == 0 ? textMessage(1000 + i) : buttonPress(1000 + i));
+    }
+    std::string body = response.dump();
+    for (auto _ : state) {
+        auto parsed = json::parse(body).get<bot::GetUpdatesResponse>();
+        benchmark::DoNotOptimize(parsed);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(body.size()));
+}
+BENCHMARK(BM_GetUpdatesResponseParse)->Arg(1)->Arg(10)->Arg(100);
+
+} // namespace
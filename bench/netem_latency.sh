@@ -0,0 +1,32 @@
+#!/usr/bin/env bash
+# Runs bench_db --writes with an artificial packet delay on the loopback interface,
+# so a Postgres on localhost behaves like one across a network. Needs root (tc) and a
+# local Postgres reachable through the POSTGRES_* variables / .env.
+#
+# Usage: sudo bench/netem_latency.sh [BENCH_DB_BINARY] [DELAY_MS...]
+#   e.g. sudo bench/netem_latency.sh build/bench_db 0 1 5 20
+
+set -euo pipefail
+
+BENCH_DB="${1:-build/bench_db}"
+shift || true
+DELAYS=("$@")
+if [ ${#DELAYS[@]} -eq 0 ]; then
+    DELAYS=(0 1 5 20)
+fi
+
+cleanup() {
+    tc qdisc del dev lo root 2>/dev/null || true
+}
+trap cleanup EXIT
+
+for delay in "${DELAYS[@]}"; do
+    cleanup
+    if [ "$delay" != "0" ]; then
+        # Query and reply both cross lo, so the round trip costs twice this
+        tc qdisc add dev lo root netem delay "${delay}ms"
+    fi
+    echo "{\"one_way_delay_ms\": $delay, \"bench\":"
+    "$BENCH_DB" --writes --iterations 20 --groups 50
+    echo "}"
+done
@@ -0,0 +1,278 @@
+// Replays an update log recorded with RECORD_UPDATES_PATH through the bot, against
+// FakeBotApi and a scratch database, and reports where the time went:
+//
+//   parse     parsing each getUpdates response
+//   dispatch  routing an update and queueing it, including any wait for queue room
+//   queue     time a task waited for a worker
+//   handler   command, callback and conversation handlers on the workers
+//   outbound  Bot API calls other than getUpdates
+//
+// The figures come from the bot's own histograms, so percentiles are interpolated
+// within bucket bounds; they are for comparing runs of the same log, not absolutes.
+//
+// Usage: replay_updates --log PATH --database NAME [--speed N|max] [--latency-ms N]
+//                       [--jitter-ms N] [--settle-ms N]
+//
+// --speed 1 keeps the recorded gaps between batches and N shortens them N times; max
+// queues every batch at once. Batches the bot has not fetched yet merge, as they would
+// in production when it falls behind. The run ends once every update is fetched and no
+// Bot API call has arrived for --settle-ms (default 1000).
+//
+// --database names the scratch database; it replaces POSTGRES_DB, the other POSTGRES_*
+// variables (and .env) are used as by the bot. Replayed payments are written to it, so
+// never point it at the bot's own database; load a dump into it first for handlers to
+// see realistic trips. Prints one JSON document to stdout.
+
+#include "../algorithm/SettlementEngine.h"
+#include "../bot/Bot.h"
+#include "../bot/Scheduler.h"
+#include "../bot/UpdateRecorder.h"
+#include "../database/AsyncDatabase.h"
+#include "../database/DatabaseConfig.h"
+#include "../database/DatabaseManager.h"
+#include "../database/DatabaseSchema.h"
+#include "../handlers/Handlers.h"
+#include "../metrics/Metrics.h"
+#include "../repository/AsyncPaymentRepository.h"
+#include "../repository/CallbackRepository.h"
+#include "../repository/ChatCache.h"
+#include "../repository/PaymentRepository.h"
+#include "../repository/TripRepository.h"
+#include "../repository/TripSnapshotRepository.h"
+#include "../repository/UserRepository.h"
+#include "../service/PaymentService.h"
+#include "../service/UserService.h"
+#include "FakeBotApi.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+using json = nlohmann::json;
+
+namespace {
+
+// Several histogram series with the same bounds, added together
+class Distribution {
+public:
+    void add(const metrics::Histogram& histogram) {
+        if (bounds_.empty() && counts_.empty()) {
+            for (std::size_t i = 0; i < histogram.bucketCount(); ++i) bounds_.push_back(histogram.bound(i));
+            counts_.assign(bounds_.size() + 1, 0);
+        }
+        if (histogram.bucketCount() != bounds_.size()) return;
+        for (std::size_t i = 0; i <= bounds_.size(); ++i) counts_[i] += histogram.bucketValue(i);
+        sum_ += histogram.sum();
+    }
+
+    json summary() const {
+        uint64_t count = 0;
+        for (uint64_t c : counts_) count += c;
+        if (count == 0) return {{"count", 0}};
+        return {
+            {"count", count},
+            {"mean_ms", sum_ / count * 1000},
+            {"p50_ms", quantile(0.50, count) * 1000},
+            {"p90_ms", quantile(0.90, count) * 1000},
+            {"p99_ms", quantile(0.99, count) * 1000},
+        };
+    }
+
+private:
+    // Linear within the bucket the rank falls in; the overflow bucket reports its
+    // lower bound
+    double quantile(double q, uint64_t count) const {
+        double rank = q * count;
+        double cumulative = 0;
+        for (std::size_t i = 0; i < counts_.size(); ++i) {
+            if (counts_[i] == 0 || cumulative + counts_[i] < rank) {
+                cumulative += counts_[i];
+                continue;
+            }
+            double lower = i == 0 ? 0.0 : bounds_[i - 1];
+            if (i == bounds_.size()) return lower;
+            return lower + (bounds_[i] - lower) * (rank - cumulative) / counts_[i];
+        }
+        return bounds_.empty() ? 0.0 : bounds_.back();
+    }
+
+    std::vector<double> bounds_;
+    std::vector<uint64_t> counts_;
+    double sum_ = 0;
+};
+
+// The total for family, with a breakdown by label set if byLabels
+json stage(const std::string& family, const std::function<bool(const std::string&)>& include, bool byLabels) {
+    Distribution total;
+    json breakdown = json::object();
+    metrics::registry().visitHistograms(family, [&](const std::string& labels, const metrics::Histogram& histogram) {
+        if (!include(labels)) return;
+        total.add(histogram);
+        if (byLabels) {
+            Distribution one;
+            one.add(histogram);
+            breakdown[labels] = one.summary();
+        }
+    });
+    json result = total.summary();
+    if (byLabels) result["by_labels"] = breakdown;
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string logPath;
+    std::string database;
+    double speed = 1.0;  // 0 is max
+    int settleMs = 1000;
+    bench::FakeBotApiOptions apiOptions;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--log") logPath = next();
+        else if (arg == "--database") database = next();
+        else if (arg == "--speed") {
+            std::string value = next();
+            speed = value == "max" ? 0.0 : std::stod(value);
+            if (speed < 0) speed = 0;
+        }
+        else if (arg == "--latency-ms") apiOptions.latency = std::chrono::milliseconds(std::max(0, std::stoi(next())));
+        else if (arg == "--jitter-ms") apiOptions.latencyJitter = std::chrono::milliseconds(std::max(0, std::stoi(next())));
+        else if (arg == "--settle-ms") settleMs = std::max(100, std::stoi(next()));
+        else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        }
+    }
+    if (logPath.empty() || database.empty()) {
+        std::cerr << "Usage: replay_updates --log PATH --database NAME [--speed N|max]" << std::endl;
+        return 2;
+    }
+
+    // Read up front so disk reads do not pace the replay
+    bot::UpdateLogReader reader;
+    if (!reader.open(logPath)) {
+        std::cerr << "Error: " << logPath << " is not an update log." << std::endl;
+        return 1;
+    }
+    std::vector<std::pair<std::chrono::microseconds, std::vector<json>>> batches;
+    std::size_t updateCount = 0;
+    while (auto batch = reader.next()) {
+        try {
+            auto response = json::parse(batch->body);
+            std::vector<json> updates = response.value("result", json::array());
+            updateCount += updates.size();
+            batches.emplace_back(batch->offset, std::move(updates));
+        } catch (const std::exception& e) {
+            std::cerr << "Skipping unreadable batch: " << e.what() << std::endl;
+        }
+    }
+
+    DatabaseConfig::loadEnv(".env");
+    std::string dbConnString = DatabaseConfig::buildConnString(database);
+    if (dbConnString.empty()) {
+        std::cerr << "Error: Database environment variables not fully set." << std::endl;
+        return 1;
+    }
+
+    spdlog::set_level(spdlog::level::warn);
+    DatabaseManager db(dbConnString);
+    db.connect();
+    if (!db.getConnection() || !db.getConnection()->is_open()) return 1;
+    DatabaseSchema::createTables(db);
+
+    const std::string token = "replay-token";
+    bench::FakeBotApi api(token, apiOptions, nullptr);
+    if (!api.start()) return 1;
+
+    // The same object graph as main.cpp, minus the cross-process cache invalidation
+    SettlementEngine settlementEngine;
+    ChatCache chatCache;
+    UserRepository userRepo(db, chatCache);
+    PaymentRepository payRepo(db, settlementEngine);
+    TripRepository tripRepo(db, chatCache);
+    CallbackRepository callbackRepo(db);
+    callbackRepo.load();
+
+    bot::Scheduler scheduler;
+    bot::Bot bot(token, scheduler, api.baseUrl());
+    bot.setUsername("replay_bot");
+
+    AsyncDatabase asyncDb(dbConnString, 2, [&bot](std::function<void()> task) { return bot.tryPost(std::move(task)); });
+    asyncDb.start();
+    AsyncPaymentRepository asyncPayRepo(asyncDb, settlementEngine);
+    TripSnapshotRepository snapshotRepo(db, asyncDb);
+
+    UserService userService(userRepo, bot);
+    PaymentService paymentService(payRepo, asyncPayRepo, tripRepo, userRepo, callbackRepo, bot);
+    handlers::Services services{userService, paymentService, settlementEngine};
+    handlers::Repositories repos{userRepo, tripRepo, payRepo, snapshotRepo};
+    handlers::registerHandlers(bot, services, repos);
+
+    scheduler.startWorker();
+    std::thread botThread([&bot] { bot.start(); });
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto& [offset, updates] : batches) {
+        if (speed > 0) {
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double, std::micro>(offset.count() / speed)));
+        }
+        api.pushUpdates(std::move(updates));
+    }
+    auto lastPush = std::chrono::steady_clock::now();
+
+    auto settle = std::chrono::milliseconds(settleMs);
+    while (api.pendingUpdates() > 0 || std::chrono::steady_clock::now() - api.lastOutboundAt() < settle) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    double seconds = std::chrono::duration<double>(std::max(lastPush, api.lastOutboundAt()) - start).count();
+
+    bot.stop();
+    // Ends the bot's pending long poll, so start() returns
+    api.stop();
+    botThread.join();
+    asyncDb.stop();
+    scheduler.stop();
+
+    auto any = [](const std::string&) { return true; };
+    json output;
+    output["benchmark"] = "replay";
+    output["log"] = logPath;
+    output["speed"] = speed > 0 ? json(speed) : json("max");
+    output["batches"] = batches.size();
+    output["updates"] = updateCount;
+    output["recorded_span_s"] = batches.empty() ? 0.0 : batches.back().first.count() / 1e6;
+    output["duration_s"] = seconds;
+    output["updates_per_s"] = seconds > 0 ? updateCount / seconds : 0.0;
+    output["stages"] = {
+        {"parse", stage("telegram_get_updates_parse_duration_seconds", any, false)},
+        {"dispatch", stage("bot_dispatch_duration_seconds", any, false)},
+        {"queue", stage("thread_pool_queue_wait_seconds",
+                        [](const std::string& labels) { return labels == "pool=\"bot\""; }, false)},
+        {"handler", stage("bot_handler_duration_seconds", any, true)},
+        {"outbound", stage("telegram_api_request_duration_seconds",
+                           [](const std::string& labels) {
+                               return labels.find("method=\"getUpdates\"") == std::string::npos;
+                           }, true)},
+    };
+
+    std::cout << output.dump(2) << std::endl;
+    return 0;
+}
@@ -1,9 +1,13 @@
 #include "Bot.h"
+#include "../logging/Logging.h"
+#include "../tracing/Tracing.h"
+#include <algorithm>
+#include <array>
 #include <thread>
 #include <chrono>
+#include <string_view>
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
-#include <spdlog/spdlog.h>
 
 namespace bot {
 
@@ -15,21 +19,91 @@ static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* use
     return size * nmemb;
 }
 
+namespace {
+
+// telegram_api_request_duration_seconds by method and outcome. The outcomes are a
+// fixed set, so every series exists before the first call and recording only
+// picks one.
+class ApiCallMetrics {
+public:
+    explicit ApiCallMetrics(const std::string& method) {
+        const char* statuses[] = {"2xx", "4xx", "429", "5xx", "network_error"};
+        for (std::size_t i = 0; i < series_.size(); ++i) {
+            series_[i] = &metrics::registry().histogram("telegram_api_request_duration_seconds",
+                "Bot API call latency", {{"method", method}, {"status", statuses[i]}});
+        }
+    }
+
+    void record(CURL* curl, CURLcode res, std::chrono::steady_clock::time_point start) {
+        std::size_t index = 4;
+        if (res == CURLE_OK) {
+            long code = 0;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+            index = code == 429 ? 2 : code >= 500 ? 3 : code >= 400 ? 1 : 0;
+        }
+        series_[index]->observe(std::chrono::steady_clock::now() - start);
+    }
+
+private:
+    std::array<metrics::Histogram*, 5> series_{};
+};
+
+ApiCallMetrics& apiCallMetrics(std::string_view method) {
+    static ApiCallMetrics sendMessage("sendMessage");
+    static ApiCallMetrics editMessageText("editMessageText");
+    static ApiCallMetrics answerCallbackQuery("answerCallbackQuery");
+    static ApiCallMetrics getUpdates("getUpdates");
+    static ApiCallMetrics getChat("getChat");
+    static ApiCallMetrics other("other");
+    if (method == "sendMessage") return sendMessage;
+    if (method == "editMessageText") return editMessageText;
+    if (method == "answerCallbackQuery") return answerCallbackQuery;
+    if (method == "getUpdates") return getUpdates;
+    if (method == "getChat") return getChat;
+    return other;
+}
+
+} // namespace
+
 static constexpr std::size_t kDefaultWorkers = 4;
 static constexpr std::size_t kDefaultQueueSize = 32;
 
-Bot::Bot(const std::string& token, Scheduler& scheduler)
+Bot::Bot(const std::string& token, Scheduler& scheduler, const std::string& apiBaseUrl)
     : token(token), scheduler(scheduler),
-      baseUrl("https://api.telegram.org/bot" + token + "/"),
+      baseUrl(apiBaseUrl + "/bot" + token + "/"),
       running(false),
       lastUpdateId(0),
-      threadPool_(kDefaultWorkers, kDefaultQueueSize) {
+      conversationLatency_(handlerLatency("conversation")),
+      getUpdatesBatchSize_(metrics::registry().histogram("telegram_get_updates_batch_size",
+          "Updates returned per getUpdates call", {}, metrics::kSizeBuckets)),
+      getUpdatesParseLatency_(metrics::registry().histogram("telegram_get_updates_parse_duration_seconds",
+          "Time to parse a getUpdates response")),
+      dispatchLatency_(metrics::registry().histogram("bot_dispatch_duration_seconds",
+          "Time to route an update and queue it for a worker")),
+      idleEvictions_(metrics::registry().counter("bot_conversation_evictions_total",
+          "Conversations evicted", {{"reason", "idle"}})),
+      capEvictions_(metrics::registry().counter("bot_conversation_evictions_total",
+          "Conversations evicted", {{"reason", "cap"}})),
+      threadPool_(kDefaultWorkers, kDefaultQueueSize, "bot") {
     curl_global_init(CURL_GLOBAL_DEFAULT);
 
-    scheduler.registerTask([this] { sweepExpiredCallbacks(); }, true, 00, 00, 00);
+    metrics::registry().gaugeFunction("bot_live_conversations", "Conversations in progress",
+        [this] { return static_cast<double>(conversations.size()); });
+    metrics::registry().gaugeFunction("bot_conversation_bytes", "Approximate heap held by conversations",
+        [this] { return static_cast<double>(conversationStats().approximateBytes); });
+
+    scheduledTasks_.push_back(scheduler.scheduleEvery(std::chrono::seconds(1), [this] { expireIdleConversations(); }));
+    scheduledTasks_.push_back(scheduler.scheduleEvery(std::chrono::hours(1), [this] { logConversationStats(); }));
 }
 
 Bot::~Bot() {
+    // Both tasks capture this; wait out a firing already on the scheduler's pool
+    for (auto id : scheduledTasks_) {
+        scheduler.cancelAndWait(id);
+    }
+    // The samplers capture this
+    metrics::registry().gaugeFunction("bot_live_conversations", "", nullptr);
+    metrics::registry().gaugeFunction("bot_conversation_bytes", "", nullptr);
     stop();
     threadPool_.waitForDrain();
     curl_global_cleanup();
@@ -45,12 +119,21 @@ const std::string& Bot::getBotUsername() const {
 
 void Bot::start() {
     running = true;
-    spdlog::info("Bot started");
+    if (loadUpdateOffset_) {
+        // Everything below the checkpoint was dispatched before the restart
+        if (auto offset = loadUpdateOffset_()) {
+            lastUpdateId = checkpointedUpdateId_ = *offset;
+            logging::bot().info("Resuming updates from offset {}", lastUpdateId);
+        } else {
+            logging::bot().warn("Could not load the update offset; resuming from Telegram's");
+        }
+    }
+    logging::bot().info("Bot started");
     while (running) {
         try {
             poll();
         } catch (const std::exception& e) {
-            spdlog::error("Error in bot loop: {}", e.what());
+            logging::bot().error("Error in bot loop: {}", e.what());
             std::this_thread::sleep_for(std::chrono::seconds(5));
         }
     }
@@ -61,49 +144,191 @@ void Bot::stop() {
     threadPool_.shutdown();
 }
 
-std::string Bot::storeCallback(std::function<void()> callback, int expiryHours) {
-    std::string key = std::to_string(callbackCounter_.fetch_add(1));
-    StoredCallback entry{std::move(callback), std::chrono::steady_clock::now(), std::chrono::hours(expiryHours)};
-    callbacks_.insert_or_assign(key, std::move(entry));
-    return key;
+void Bot::registerConversation(std::unique_ptr<Conversation> conversation) {
+    if (!conversation) return;
+    long long chatId = conversation->getChatId();
+    long long userId = conversation->getUserId();
+    auto key = std::make_pair(chatId, userId);
+
+    auto entry = std::make_shared<ConversationEntry>();
+    entry->conversation = std::move(conversation);
+
+    // Touched before it is visible, so a pending eviction of the conversation it
+    // replaces cannot take it down too
+    auto overCap = touchConversation(key);
+    conversations.insert_or_assign(key, entry);
+    if (overCap) {
+        evictConversation(*overCap, false);
+    }
+
+    bool closedNow = false;
+    {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        // Aliases the entry, so holding it keeps the conversation alive
+        entry->conversation->start(std::shared_ptr<Conversation>(entry, entry->conversation.get()));
+        closedNow = entry->conversation->isClosed();
+    }
+    if (closedNow) {
+        conversations.erase_if(key, [this, &key, &entry](auto& kv) {
+            if (kv.second != entry) return false;
+            forgetConversation(key);
+            return true;
+        });
+    }
+}
+
+void Bot::setConversationLimits(std::chrono::seconds idleTimeout, std::size_t maxConversations) {
+    std::lock_guard<std::mutex> lock(lifecycleMutex_);
+    idleTimeout_ = idleTimeout;
+    maxConversations_ = std::max<std::size_t>(maxConversations, 1);
 }
 
-std::optional<std::function<void()>> Bot::fetchCallback(const std::string& key) {
-    std::optional<std::function<void()>> result;
-    callbacks_.erase_if(key, [&result](auto& kv) {
-        result = std::move(kv.second.callback);
+std::optional<Bot::ConversationKey> Bot::touchConversation(const ConversationKey& key) {
+    std::lock_guard<std::mutex> lock(lifecycleMutex_);
+    idleDeadlines_.schedule(key, std::chrono::steady_clock::now() + idleTimeout_);
+
+    auto it = recencyIndex_.find(key);
+    if (it != recencyIndex_.end()) {
+        recency_.splice(recency_.begin(), recency_, it->second);
+        return std::nullopt;
+    }
+    recency_.push_front(key);
+    recencyIndex_.emplace(key, recency_.begin());
+    if (recency_.size() <= maxConversations_) return std::nullopt;
+
+    ConversationKey victim = recency_.back();
+    recency_.pop_back();
+    recencyIndex_.erase(victim);
+    idleDeadlines_.cancel(victim);
+    return victim;
+}
+
+void Bot::forgetConversation(const ConversationKey& key) {
+    std::lock_guard<std::mutex> lock(lifecycleMutex_);
+    idleDeadlines_.cancel(key);
+    auto it = recencyIndex_.find(key);
+    if (it != recencyIndex_.end()) {
+        recency_.erase(it->second);
+        recencyIndex_.erase(it);
+    }
+}
+
+void Bot::expireIdleConversations() {
+    std::vector<ConversationKey> idle;
+    {
+        std::lock_guard<std::mutex> lock(lifecycleMutex_);
+        idle = idleDeadlines_.advance(std::chrono::steady_clock::now());
+        for (const auto& key : idle) {
+            auto it = recencyIndex_.find(key);
+            if (it != recencyIndex_.end()) {
+                recency_.erase(it->second);
+                recencyIndex_.erase(it);
+            }
+        }
+    }
+    for (const auto& key : idle) {
+        evictConversation(key, true);
+    }
+}
+
+void Bot::evictConversation(const ConversationKey& key, bool idle) {
+    std::shared_ptr<ConversationEntry> entry;
+    conversations.erase_if(key, [this, &key, &entry](auto& kv) {
+        // Touched again since it was picked (a new update or a replacement)
+        std::lock_guard<std::mutex> lock(lifecycleMutex_);
+        if (idleDeadlines_.contains(key)) return false;
+        entry = kv.second;
         return true;
     });
-    return result;
+    if (!entry) return;
+
+    (idle ? idleEvictions_ : capEvictions_).inc();
+    logging::bot().info("Evicting {} conversation chat_id={} user_id={}", idle ? "idle" : "least recently used",
+                        key.first, key.second);
+
+    // Waits out an update being handled; the conversation is destroyed with the last
+    // reference to the entry. The edit is made after the lock is released, so neither
+    // the conversation nor this (scheduler) thread waits on the Bot API.
+    std::optional<ExpiryEdit> edit;
+    {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if (!entry->conversation->isClosed()) {
+            edit = entry->conversation->expire();
+        }
+    }
+    if (edit) sendExpiryEdit(std::move(*edit));
 }
 
-void Bot::sweepExpiredCallbacks() {
-    auto now = std::chrono::steady_clock::now();
-    std::vector<std::string> expired;
-    callbacks_.for_each([&](auto& kv) {
-        if ((now - kv.second.storedAt) >= kv.second.expiry) {
-            expired.push_back(kv.first);
+void Bot::sendExpiryEdit(ExpiryEdit edit) {
+    auto send = [this, edit = std::move(edit)] { editMessage(edit.chatId, edit.messageId, edit.text); };
+    if (!tryPost(send)) {
+        send();
+    }
+}
+
+ConversationStats Bot::conversationStats() {
+    ConversationStats stats{conversations.size(), 0, idleEvictions_.value(), capEvictions_.value()};
+    conversations.for_each([&stats](const auto& kv) {
+        // Skip conversations mid-update rather than stall on them
+        std::unique_lock<std::mutex> lock(kv.second->mutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            stats.approximateBytes += kv.second->conversation->approximateBytes();
         }
     });
-    for (const auto& key : expired) {
-        callbacks_.erase(key);
-    }
-    if (!expired.empty()) {
-        spdlog::info("Swept {} expired callback(s)", expired.size());
-    } else {
-        spdlog::info("No expired callback(s)");
+    return stats;
+}
+
+void Bot::logConversationStats() {
+    auto stats = conversationStats();
+    logging::bot().info("Conversations: live={}, bytes={}, idle_evictions={}, cap_evictions={}",
+                        stats.live, stats.approximateBytes, stats.idleEvictions, stats.capEvictions);
+}
+
+void Bot::setUpdateOffsetStore(std::function<std::optional<long long>()> load, std::function<bool(long long)> save) {
+    loadUpdateOffset_ = std::move(load);
+    saveUpdateOffset_ = std::move(save);
+}
+
+void Bot::setUpdateRecorder(std::function<void(std::string_view)> record) {
+    recordUpdates_ = std::move(record);
+}
+
+bool Bot::alreadyDispatched(long long updateId) const {
+    // Only the recent window: getUpdates' offset already keeps older updates away, and
+    // ids below the checkpoint are legitimate again if Telegram resets the sequence
+    return recentUpdateIdSet_.count(updateId) > 0;
+}
+
+void Bot::rememberDispatched(long long updateId) {
+    if (!recentUpdateIdSet_.insert(updateId).second) return;
+    recentUpdateIds_.push_back(updateId);
+    if (recentUpdateIds_.size() > kRecentUpdateWindow) {
+        recentUpdateIdSet_.erase(recentUpdateIds_.front());
+        recentUpdateIds_.pop_front();
     }
 }
 
-void Bot::registerConversation(std::unique_ptr<Conversation> conversation) {
-    if (!conversation) return;
-    long long chatId = conversation->getChatId();
-    long long userId = conversation->getUserId();
+metrics::Histogram& Bot::handlerLatency(const std::string& handler) {
+    return metrics::registry().histogram("bot_handler_duration_seconds", "Handler run time on a worker",
+                                         {{"handler", handler}});
+}
 
-    auto entry = std::make_shared<ConversationEntry>();
-    entry->conversation = std::move(conversation);
+// A task posted while a sampled trace is current stays in that trace
+static std::function<void()> inCurrentTrace(std::function<void()> task) {
+    tracing::TraceContext trace = tracing::current();
+    if (!trace.sampled) return task;
+    return [trace, task = std::move(task)] {
+        tracing::ScopedContext scope(trace);
+        task();
+    };
+}
+
+bool Bot::post(std::function<void()> task) {
+    return threadPool_.submit(inCurrentTrace(std::move(task)));
+}
 
-    conversations.insert_or_assign({chatId, userId}, entry);
+bool Bot::tryPost(std::function<void()> task) {
+    return threadPool_.trySubmit(inCurrentTrace(std::move(task)));
 }
 
 long long Bot::sendMessage(long long chatId, const std::string& text, const InlineKeyboardMarkup* keyboard, const std::string& parseMode, const std::string& callbackType) {
@@ -146,9 +371,12 @@ long long Bot::sendMessage(long long chatId, const std::string& text, const Inli
             curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
             curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseBuffer);
 
+            auto start = std::chrono::steady_clock::now();
             CURLcode res = curl_easy_perform(curl);
+            apiCallMetrics("sendMessage").record(curl, res, start);
+            tracing::record("telegram", "sendMessage", start, std::chrono::steady_clock::now());
             if(res != CURLE_OK) {
-                 spdlog::error("curl_easy_perform() failed: {}", curl_easy_strerror(res));
+                 logging::bot().error("curl_easy_perform() failed: {}", curl_easy_strerror(res));
             } else {
                 try {
                     auto jsonResponse = json::parse(responseBuffer);
@@ -158,7 +386,7 @@ long long Bot::sendMessage(long long chatId, const std::string& text, const Inli
                         }
                     }
                 } catch (const std::exception& e) {
-                    spdlog::error("JSON parse error in sendMessage: {}", e.what());
+                    logging::bot().error("JSON parse error in sendMessage: {}", e.what());
                 }
             }
 
@@ -201,9 +429,12 @@ void Bot::editMessage(long long chatId, long long messageId, const std::string&
             curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
             curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseBuffer);
 
+            auto start = std::chrono::steady_clock::now();
             CURLcode res = curl_easy_perform(curl);
+            apiCallMetrics("editMessageText").record(curl, res, start);
+            tracing::record("telegram", "editMessageText", start, std::chrono::steady_clock::now());
             if(res != CURLE_OK) {
-                 spdlog::error("curl_easy_perform() failed: {}", curl_easy_strerror(res));
+                 logging::bot().error("curl_easy_perform() failed: {}", curl_easy_strerror(res));
             }
 
             curl_free(output);
@@ -234,9 +465,12 @@ void Bot::answerCallbackQuery(const std::string& callbackQueryId, const std::str
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseBuffer);
 
+        auto start = std::chrono::steady_clock::now();
         CURLcode res = curl_easy_perform(curl);
-        if(res != CURLE_OK) {
-             fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+        apiCallMetrics("answerCallbackQuery").record(curl, res, start);
+        tracing::record("telegram", "answerCallbackQuery", start, std::chrono::steady_clock::now());
+        if (res != CURLE_OK) {
+            logging::bot().error("curl_easy_perform() failed: {}", curl_easy_strerror(res));
         }
         curl_easy_cleanup(curl);
     }
@@ -251,7 +485,7 @@ Chat Bot::getChat(long long chatId) {
             jsonResponse["result"].get_to(chat);
         }
     } catch (const std::exception& e) {
-        spdlog::error("JSON parse error in getChat: {}", e.what());
+        logging::bot().error("JSON parse error in getChat: {}", e.what());
     }
     return chat;
 }
@@ -273,9 +507,12 @@ std::string Bot::makeRequest(const std::string& endpoint, const std::string& par
         curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
         curl_easy_setopt(curl, CURLOPT_TIMEOUT, 40L);
 
+        auto start = std::chrono::steady_clock::now();
         res = curl_easy_perform(curl);
+        apiCallMetrics(endpoint).record(curl, res, start);
+        tracing::record("telegram", endpoint, start, std::chrono::steady_clock::now());
         if (res != CURLE_OK) {
-            spdlog::error("curl_easy_perform() failed: {}", curl_easy_strerror(res));
+            logging::bot().error("curl_easy_perform() failed: {}", curl_easy_strerror(res));
         }
         curl_easy_cleanup(curl);
     }
@@ -284,10 +521,12 @@ std::string Bot::makeRequest(const std::string& endpoint, const std::string& par
 
 std::vector<Update> Bot::getUpdates() {
     std::string params = "offset=" + std::to_string(lastUpdateId) + "&timeout=30";
+    // Latency is recorded by makeRequest under method="getUpdates"
     std::string responseStr = makeRequest("getUpdates", params);
 
     std::vector<Update> updates;
 
+    auto parseStart = std::chrono::steady_clock::now();
     try {
         auto jsonResponse = json::parse(responseStr);
         if (jsonResponse.contains("ok") && jsonResponse["ok"].get<bool>()) {
@@ -300,17 +539,38 @@ std::vector<Update> Bot::getUpdates() {
             }
         }
     } catch (const std::exception& e) {
-        spdlog::error("JSON parse error: {}", e.what());
+        logging::bot().error("JSON parse error: {}", e.what());
     }
+    getUpdatesParseLatency_.observe(std::chrono::steady_clock::now() - parseStart);
 
+    if (recordUpdates_ && !updates.empty()) {
+        recordUpdates_(responseStr);
+    }
+    getUpdatesBatchSize_.observe(static_cast<double>(updates.size()));
     return updates;
 }
 
 void Bot::poll() {
     auto updates = getUpdates();
     if (updates.empty()) return;
+    auto fetchedAt = std::chrono::steady_clock::now();
 
     for (const Update& update : updates) {
+        if (alreadyDispatched(update.update_id)) {
+            logging::bot().warn("Skipping update {} that was already dispatched", update.update_id);
+            continue;
+        }
+        // Carried into the task; a sampled trace also covers the wait behind earlier
+        // updates of the batch, the queue wait and the handler
+        tracing::TraceContext trace = tracing::startTrace();
+        tracing::ScopedContext traceScope(trace);
+        tracing::record("bot", "batch_wait", fetchedAt, std::chrono::steady_clock::now());
+        tracing::Span dispatchSpan("bot", "dispatch");
+        std::string handlerName;
+
+        // Until the task is queued, including any wait for room in the queue
+        metrics::ScopedTimer dispatchTimer(dispatchLatency_);
+
         // Extract fields
         long long chatId = 0;
         long long userId = 0;
@@ -341,8 +601,13 @@ void Bot::poll() {
                 std::string command = (spacePos == std::string::npos) ? msg.text : msg.text.substr(0, spacePos);
                 size_t atPos = command.find('@');
                 if (atPos != std::string::npos) command = command.substr(0, atPos);
-                if (commandHandlers.find(command) != commandHandlers.end()) {
-                    task = [handler = commandHandlers[command], msg] { handler(msg); };
+                auto it = commandHandlers.find(command);
+                if (it != commandHandlers.end()) {
+                    task = [handler = it->second.handler, latency = it->second.latency, msg] {
+                        metrics::ScopedTimer timer(*latency);
+                        handler(msg);
+                    };
+                    if (trace.sampled) handlerName = it->first;
                     isCommand = true;
                 }
             }
@@ -357,11 +622,37 @@ void Bot::poll() {
                 entry = kv.second;
             });
 
+            // A coroutine conversation can finish after an outbound call rather than in
+            // handleUpdate; drop it here so this update goes to the normal handlers
+            if (entry) {
+                std::unique_lock<std::mutex> lock(entry->mutex, std::try_to_lock);
+                if (lock.owns_lock() && entry->conversation->isClosed()) {
+                    lock.unlock();
+                    conversations.erase_if(key, [this, &key, &entry](auto& kv) {
+                        if (kv.second != entry) return false;
+                        forgetConversation(key);
+                        return true;
+                    });
+                    entry.reset();
+                }
+            }
+
             if (entry) {
                 task = [this, update, key, entry]() {
+                    if (auto overCap = touchConversation(key)) {
+                        evictConversation(*overCap, false);
+                    }
+
                     bool closedNow = false;
                     {
-                        std::lock_guard<std::mutex> lock(entry->mutex);
+                        std::unique_lock<std::mutex> lock(entry->mutex, std::defer_lock);
+                        {
+                            // Held by an earlier update of the same conversation
+                            tracing::Span lockWait("bot", "conversation_lock");
+                            lock.lock();
+                        }
+                        // The handler only; the wait above is the conversation_lock span
+                        metrics::ScopedTimer timer(conversationLatency_);
                         if (!entry->conversation->isClosed()) {
                             entry->conversation->handleUpdate(update);
                             closedNow = entry->conversation->isClosed();
@@ -371,19 +662,26 @@ void Bot::poll() {
                     }
 
                     if (closedNow) {
-                        conversations.erase_if(key, [&entry](auto& kv) {
-                            return kv.second == entry;
+                        conversations.erase_if(key, [this, &key, &entry](auto& kv) {
+                            if (kv.second != entry) return false;
+                            forgetConversation(key);
+                            return true;
                         });
                     }
                 };
+                if (trace.sampled) handlerName = "conversation";
                 isConversation = true;
             }
         }
 
         // Handle Text Messages
         if (!isCommand && !isConversation && update.message.message_id != 0 && !msg.text.empty()) {
-            if (textHandler) {
-                task = [handler = textHandler, msg] { handler(msg); };
+            if (textHandler.handler) {
+                task = [handler = textHandler.handler, latency = textHandler.latency, msg] {
+                    metrics::ScopedTimer timer(*latency);
+                    handler(msg);
+                };
+                if (trace.sampled) handlerName = "text";
             }
         }
 
@@ -404,7 +702,11 @@ void Bot::poll() {
                     query.sender_name = update.callback_query.from.first_name;
                     query.data = rawData.substr(sep + 1);
                     query.message_text = update.callback_query.message.text;
-                    task = [handler = it->second, query] { handler(query); };
+                    task = [handler = it->second.handler, latency = it->second.latency, query] {
+                        metrics::ScopedTimer timer(*latency);
+                        handler(query);
+                    };
+                    if (trace.sampled) handlerName = "callback:" + type;
                 }
             }
         }
@@ -412,15 +714,32 @@ void Bot::poll() {
         // Submit to thread pool; blocks if queue is full.
         // If pool is shut down, stop processing — do not advance lastUpdateId.
         if (task) {
+            if (trace.sampled) {
+                task = [trace, name = std::move(handlerName), queuedAt = std::chrono::steady_clock::now(),
+                        task = std::move(task)] {
+                    tracing::ScopedContext scope(trace);
+                    tracing::record("bot", "queue_wait", queuedAt, std::chrono::steady_clock::now());
+                    tracing::Span span("handler", name);
+                    task();
+                };
+            }
             if (!threadPool_.submit(std::move(task))) {
                 return;
             }
         }
+        rememberDispatched(update.update_id);
     }
 
     // All updates in this batch were successfully submitted.
     // Advance lastUpdateId only now — prevents silent update loss.
     lastUpdateId = updates.back().update_id + 1;
+
+    // One checkpoint per batch, before the next getUpdates confirms it to Telegram. The
+    // offset may move backwards when Telegram resets update_id, so any change is saved;
+    // a failed save leaves the checkpoint behind so the next batch tries again.
+    if (saveUpdateOffset_ && lastUpdateId != checkpointedUpdateId_ && saveUpdateOffset_(lastUpdateId)) {
+        checkpointedUpdateId_ = lastUpdateId;
+    }
 }
 
 }
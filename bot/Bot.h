@@ -2,11 +2,16 @@
 #define BOT_H
 
 #include <string>
+#include <string_view>
 #include <functional>
 #include <chrono>
+#include <list>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <atomic>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <optional>
@@ -14,11 +19,13 @@
 
 #include <parallel_hashmap/phmap.h>
 
+#include "../metrics/Metrics.h"
 #include "Conversation.h"
 #include "InternalTypes.h"
 #include "Scheduler.h"
 #include "TelegramTypes.h"
 #include "ThreadPool.h"
+#include "TimerWheel.h"
 
 namespace bot {
 
@@ -26,9 +33,17 @@ using CommandHandler = std::function<void(const Message&)>;
 using TextHandler = std::function<void(const Message&)>;
 using CallbackHandler = std::function<void(const CallbackQuery&)>;
 
+struct ConversationStats {
+    std::size_t live;
+    std::size_t approximateBytes;  // conversations busy at the time are not counted
+    uint64_t idleEvictions;
+    uint64_t capEvictions;
+};
+
 class Bot {
 public:
-    explicit Bot(const std::string& token, Scheduler& scheduler);
+    // apiBaseUrl is scheme and host only, e.g. a local Bot API server or a test double
+    Bot(const std::string& token, Scheduler& scheduler, const std::string& apiBaseUrl = "https://api.telegram.org");
     ~Bot();
 
     void start();
@@ -39,29 +54,50 @@ public:
 
     template<typename F>
     void registerCommandHandler(std::string command, F&& handler) {
-        commandHandlers.insert_or_assign(std::move(command), std::forward<F>(handler));
+        metrics::Histogram& latency = handlerLatency(command);
+        commandHandlers.insert_or_assign(std::move(command), Timed<CommandHandler>{std::forward<F>(handler), &latency});
     }
 
     template<typename F>
     void registerTextHandler(F&& handler) {
-        textHandler = std::forward<F>(handler);
+        textHandler = Timed<TextHandler>{std::forward<F>(handler), &handlerLatency("text")};
     }
 
     template<typename F>
     void registerCallbackHandler(std::string type, F&& handler) {
-        callbackHandlers.insert_or_assign(std::move(type), std::forward<F>(handler));
+        metrics::Histogram& latency = handlerLatency("callback:" + type);
+        callbackHandlers.insert_or_assign(std::move(type), Timed<CallbackHandler>{std::forward<F>(handler), &latency});
     }
 
     void registerConversation(std::unique_ptr<Conversation> conversation);
 
+    // Where the getUpdates offset is checkpointed. start() resumes from load(); save()
+    // runs on the polling thread once per batch, after the batch is dispatched, and
+    // returns false if the offset was not stored (it is retried after the next batch).
+    void setUpdateOffsetStore(std::function<std::optional<long long>()> load, std::function<bool(long long)> save);
+
+    // Called on the polling thread with every getUpdates response body that carried
+    // updates, exactly as received (see UpdateRecorder)
+    void setUpdateRecorder(std::function<void(std::string_view)> record);
+
+    // Conversations untouched for idleTimeout are expired; past maxConversations the
+    // least recently used one is expired to make room
+    void setConversationLimits(std::chrono::seconds idleTimeout, std::size_t maxConversations);
+    ConversationStats conversationStats();
+    void logConversationStats();
+
+    // Runs task on a worker, waiting for room in the queue. Returns false once the bot
+    // is stopping.
+    bool post(std::function<void()> task);
+    // Non-blocking post, for code already on a worker and for the asynchronous
+    // database's continuations; false if the queue is full or the bot is stopping
+    bool tryPost(std::function<void()> task);
+
     long long sendMessage(long long chatId, const std::string& text, const InlineKeyboardMarkup* keyboard = nullptr, const std::string& parseMode = "", const std::string& callbackType = "");
     void editMessage(long long chatId, long long messageId, const std::string& text, const InlineKeyboardMarkup* keyboard = nullptr, const std::string& parseMode = "");
     void answerCallbackQuery(const std::string& callbackQueryId, const std::string& text = "", bool showAlert = false);
     Chat getChat(long long chatId);
 
-    std::string storeCallback(std::function<void()> callback, int expiryHours = 72);
-    std::optional<std::function<void()>> fetchCallback(const std::string& key);
-
 private:
     std::string token;
     std::string username;
@@ -69,47 +105,94 @@ private:
     std::atomic<bool> running;
     long long lastUpdateId;
 
+    std::function<std::optional<long long>()> loadUpdateOffset_;
+    std::function<bool(long long)> saveUpdateOffset_;
+    // Last offset the store accepted
+    long long checkpointedUpdateId_ = 0;
+
+    std::function<void(std::string_view)> recordUpdates_;
+
+    // Ids of recently dispatched updates, so a batch fetched again (e.g. after a partial
+    // dispatch) is not applied twice. Polling thread only.
+    static constexpr std::size_t kRecentUpdateWindow = 4096;
+    std::deque<long long> recentUpdateIds_;
+    std::unordered_set<long long> recentUpdateIdSet_;
+
     Scheduler& scheduler;
 
-    std::map<std::string, CommandHandler> commandHandlers;
-    TextHandler textHandler;
-    std::map<std::string, CallbackHandler> callbackHandlers;
+    // A handler and its bot_handler_duration_seconds series, looked up at registration
+    template<typename Handler>
+    struct Timed {
+        Handler handler;
+        metrics::Histogram* latency = nullptr;
+    };
+
+    static metrics::Histogram& handlerLatency(const std::string& handler);
+
+    std::map<std::string, Timed<CommandHandler>> commandHandlers;
+    Timed<TextHandler> textHandler;
+    std::map<std::string, Timed<CallbackHandler>> callbackHandlers;
+    metrics::Histogram& conversationLatency_;
+    metrics::Histogram& getUpdatesBatchSize_;
+    metrics::Histogram& getUpdatesParseLatency_;
+    metrics::Histogram& dispatchLatency_;
 
     struct ConversationEntry {
         std::mutex mutex;
         std::unique_ptr<Conversation> conversation;
     };
 
+    // Key: {chat_id, user_id}
+    using ConversationKey = std::pair<long long, long long>;
+
     struct PairHash {
-        size_t operator()(const std::pair<long long, long long>& p) const {
+        size_t operator()(const ConversationKey& p) const {
             size_t h1 = phmap::Hash<long long>{}(p.first);
             size_t h2 = phmap::Hash<long long>{}(p.second);
             return phmap::HashState::combine(0, h1, h2);
         }
     };
 
-    // Key: {chat_id, user_id}
+    // Submaps locked with std::mutex; the default NullMutex is not safe with
+    // the poll thread and workers both touching the map
     phmap::parallel_flat_hash_map<
-        std::pair<long long, long long>,
+        ConversationKey,
         std::shared_ptr<ConversationEntry>,
-        PairHash
+        PairHash,
+        phmap::priv::hash_default_eq<ConversationKey>,
+        std::allocator<std::pair<const ConversationKey, std::shared_ptr<ConversationEntry>>>,
+        4,
+        std::mutex
     > conversations;
 
-    struct StoredCallback {
-        std::function<void()> callback;
-        std::chrono::steady_clock::time_point storedAt;
-        std::chrono::hours expiry;
-    };
+    // Idle deadlines and recency of live conversations, guarded by lifecycleMutex_.
+    // Lock order: a conversations submap, then lifecycleMutex_.
+    std::mutex lifecycleMutex_;
+    std::chrono::seconds idleTimeout_{std::chrono::minutes(15)};
+    std::size_t maxConversations_ = 10000;
+    TimerWheel<ConversationKey, PairHash> idleDeadlines_{std::chrono::seconds(1), 1024};
+    std::list<ConversationKey> recency_;  // most recently used first
+    std::unordered_map<ConversationKey, std::list<ConversationKey>::iterator, PairHash> recencyIndex_;
+    metrics::Counter& idleEvictions_;
+    metrics::Counter& capEvictions_;
 
-    std::atomic<uint64_t> callbackCounter_{0};
-    phmap::parallel_flat_hash_map<std::string, StoredCallback> callbacks_;
+    std::vector<Scheduler::TaskId> scheduledTasks_;
 
     // Declared last: destroyed first, draining all in-flight tasks
     // before handler maps, conversations, and callbacks are destroyed.
     ThreadPool threadPool_;
 
     void poll();
-    void sweepExpiredCallbacks();
+    bool alreadyDispatched(long long updateId) const;
+    void rememberDispatched(long long updateId);
+    // Resets key's idle deadline and marks it most recently used. Returns the least
+    // recently used key if that pushed the count over the cap.
+    std::optional<ConversationKey> touchConversation(const ConversationKey& key);
+    void forgetConversation(const ConversationKey& key);
+    void expireIdleConversations();
+    void evictConversation(const ConversationKey& key, bool idle);
+    // Sends an evicted conversation's edit on a worker, or inline if the pool is full
+    void sendExpiryEdit(ExpiryEdit edit);
     std::vector<Update> getUpdates();
     std::string makeRequest(const std::string& endpoint, const std::string& params = "");
 };
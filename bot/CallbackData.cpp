@@ -0,0 +1,162 @@
+#include "CallbackData.h"
+#include <stdexcept>
+
+namespace bot {
+
+namespace {
+
+constexpr uint8_t kVersion = 1;
+constexpr uint8_t kKindId = 0;
+constexpr uint8_t kKindToken = 1;
+
+// Header, payload and checksum; the longest is a full-length token
+constexpr std::size_t kMaxBinaryLength = 2 + CallbackData::kMaxTokenLength + 2;
+static_assert((kMaxBinaryLength * 4 + 2) / 3 == CallbackData::kMaxEncodedLength);
+
+constexpr char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+constexpr std::array<int8_t, 256> makeDecodeTable() {
+    std::array<int8_t, 256> table{};
+    for (auto& entry : table) entry = -1;
+    for (int i = 0; i < 64; ++i) table[static_cast<unsigned char>(kAlphabet[i])] = static_cast<int8_t>(i);
+    return table;
+}
+
+constexpr std::array<int8_t, 256> kDecodeTable = makeDecodeTable();
+
+// Inputs are at most kMaxBinaryLength bytes, so the sums cannot overflow before the
+// final reduction
+uint16_t fletcher16(const uint8_t* data, std::size_t length) {
+    uint32_t sum1 = 0;
+    uint32_t sum2 = 0;
+    for (std::size_t i = 0; i < length; ++i) {
+        sum1 += data[i];
+        sum2 += sum1;
+    }
+    return static_cast<uint16_t>(sum2 % 255 << 8 | sum1 % 255);
+}
+
+// Unpadded; returns the number of characters written
+std::size_t toBase64Url(const uint8_t* in, std::size_t length, char* out) {
+    char* start = out;
+    std::size_t i = 0;
+    for (; i + 3 <= length; i += 3) {
+        uint32_t v = static_cast<uint32_t>(in[i]) << 16 | static_cast<uint32_t>(in[i + 1]) << 8 | in[i + 2];
+        *out++ = kAlphabet[v >> 18 & 63];
+        *out++ = kAlphabet[v >> 12 & 63];
+        *out++ = kAlphabet[v >> 6 & 63];
+        *out++ = kAlphabet[v & 63];
+    }
+    if (length - i == 1) {
+        uint32_t v = static_cast<uint32_t>(in[i]) << 16;
+        *out++ = kAlphabet[v >> 18 & 63];
+        *out++ = kAlphabet[v >> 12 & 63];
+    } else if (length - i == 2) {
+        uint32_t v = static_cast<uint32_t>(in[i]) << 16 | static_cast<uint32_t>(in[i + 1]) << 8;
+        *out++ = kAlphabet[v >> 18 & 63];
+        *out++ = kAlphabet[v >> 12 & 63];
+        *out++ = kAlphabet[v >> 6 & 63];
+    }
+    return static_cast<std::size_t>(out - start);
+}
+
+// Unpadded; returns the number of bytes written, or 0 if text is not base64url
+std::size_t fromBase64Url(std::string_view text, uint8_t* out) {
+    if (text.size() % 4 == 1) return 0;
+    uint8_t* start = out;
+    uint32_t bits = 0;
+    int bitCount = 0;
+    for (char c : text) {
+        int8_t value = kDecodeTable[static_cast<unsigned char>(c)];
+        if (value < 0) return 0;
+        bits = bits << 6 | static_cast<uint32_t>(value);
+        bitCount += 6;
+        if (bitCount >= 8) {
+            bitCount -= 8;
+            *out++ = static_cast<uint8_t>(bits >> bitCount);
+        }
+    }
+    return static_cast<std::size_t>(out - start);
+}
+
+} // namespace
+
+CallbackData CallbackData::id(uint8_t step, long long id) {
+    CallbackData data;
+    data.step_ = step;
+    data.id_ = id;
+    return data;
+}
+
+CallbackData CallbackData::token(uint8_t step, std::string_view token) {
+    if (token.size() > kMaxTokenLength) {
+        throw std::invalid_argument("callback token too long: " + std::string(token));
+    }
+    CallbackData data;
+    data.step_ = step;
+    data.isToken_ = true;
+    data.tokenLength_ = static_cast<uint8_t>(token.size());
+    token.copy(data.token_.data(), token.size());
+    return data;
+}
+
+std::string CallbackData::encode() const {
+    uint8_t binary[kMaxBinaryLength];
+    std::size_t length = 0;
+    binary[length++] = static_cast<uint8_t>(kVersion << 4 | (isToken_ ? kKindToken : kKindId));
+    binary[length++] = step_;
+    if (isToken_) {
+        for (uint8_t i = 0; i < tokenLength_; ++i) binary[length++] = static_cast<uint8_t>(token_[i]);
+    } else {
+        // Zigzag keeps negative ids (group chats) short too
+        uint64_t v = static_cast<uint64_t>(id_) << 1 ^ static_cast<uint64_t>(id_ >> 63);
+        do {
+            uint8_t byte = v & 0x7f;
+            v >>= 7;
+            binary[length++] = static_cast<uint8_t>(v ? byte | 0x80 : byte);
+        } while (v);
+    }
+    uint16_t checksum = fletcher16(binary, length);
+    binary[length++] = static_cast<uint8_t>(checksum >> 8);
+    binary[length++] = static_cast<uint8_t>(checksum);
+
+    char text[kMaxEncodedLength];
+    return std::string(text, toBase64Url(binary, length, text));
+}
+
+std::optional<CallbackData> CallbackData::decode(std::string_view text) {
+    if (text.size() > kMaxEncodedLength) return std::nullopt;
+    uint8_t binary[kMaxBinaryLength];
+    std::size_t length = fromBase64Url(text, binary);
+    if (length < 4) return std::nullopt;
+
+    std::size_t payloadEnd = length - 2;
+    uint16_t checksum = static_cast<uint16_t>(binary[payloadEnd] << 8 | binary[payloadEnd + 1]);
+    if (fletcher16(binary, payloadEnd) != checksum || binary[0] >> 4 != kVersion) return std::nullopt;
+
+    CallbackData data;
+    data.step_ = binary[1];
+    uint8_t kind = binary[0] & 0x0f;
+    if (kind == kKindToken) {
+        data.isToken_ = true;
+        data.tokenLength_ = static_cast<uint8_t>(payloadEnd - 2);
+        for (std::size_t i = 2; i < payloadEnd; ++i) data.token_[i - 2] = static_cast<char>(binary[i]);
+        return data;
+    }
+    if (kind != kKindId) return std::nullopt;
+
+    uint64_t v = 0;
+    int shift = 0;
+    std::size_t i = 2;
+    for (;; ++i) {
+        if (i == payloadEnd || shift > 63) return std::nullopt;
+        v |= static_cast<uint64_t>(binary[i] & 0x7f) << shift;
+        shift += 7;
+        if (!(binary[i] & 0x80)) break;
+    }
+    if (i + 1 != payloadEnd) return std::nullopt;
+    data.id_ = static_cast<long long>(v >> 1 ^ (0 - (v & 1)));
+    return data;
+}
+
+} // namespace bot
@@ -0,0 +1,59 @@
+#ifndef FRIENDS_TRIP_BOT_CALLBACKDATA_H
+#define FRIENDS_TRIP_BOT_CALLBACKDATA_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace bot {
+
+// callback_data for conversation buttons: the conversation step the button belongs to
+// plus either an id (user, trip) or a short token ("done", "page_next", a currency
+// code). Encoded as base64url of
+//
+//   1 byte   version (high nibble) and payload kind (low nibble)
+//   1 byte   step
+//   n bytes  zigzag varint id, or the token's bytes
+//   2 bytes  Fletcher-16 of the bytes before it
+//
+// so any id fits in 19 characters and the longest token in 38, well within Telegram's
+// 64 bytes even behind a callback type prefix. decode() rejects anything else, which
+// includes buttons rendered by an older encoding: they are treated like stale buttons.
+class CallbackData {
+public:
+    static constexpr std::size_t kMaxTokenLength = 24;
+    static constexpr std::size_t kMaxEncodedLength = 38;
+
+    // step is the conversation's own state enum, cast to an integer
+    static CallbackData id(uint8_t step, long long id);
+    // Tokens are fixed strings from the code; longer than kMaxTokenLength throws
+    // std::invalid_argument
+    static CallbackData token(uint8_t step, std::string_view token);
+
+    // std::nullopt if text is not valid callback data
+    static std::optional<CallbackData> decode(std::string_view text);
+    std::string encode() const;
+
+    uint8_t step() const { return step_; }
+    bool isId() const { return !isToken_; }
+    // 0 for a token
+    long long id() const { return id_; }
+    // Empty for an id
+    std::string_view token() const { return {token_.data(), tokenLength_}; }
+
+private:
+    CallbackData() = default;
+
+    uint8_t step_ = 0;
+    bool isToken_ = false;
+    uint8_t tokenLength_ = 0;
+    long long id_ = 0;
+    std::array<char, kMaxTokenLength> token_{};
+};
+
+} // namespace bot
+
+#endif //FRIENDS_TRIP_BOT_CALLBACKDATA_H
@@ -1,8 +1,12 @@
 #ifndef FRIENDS_TRIP_BOT_CONVERSATION_H
 #define FRIENDS_TRIP_BOT_CONVERSATION_H
 
+#include <cstddef>
 #include <functional>
 #include <map>
+#include <memory>
+#include <optional>
+#include <string>
 #include "InternalTypes.h"
 #include "TelegramTypes.h"
 
@@ -12,14 +16,34 @@ using ConversationHandler = std::function<void(const bot::Update&)>;
 
 class Bot;
 
+// The text an evicted conversation's active message is edited to
+struct ExpiryEdit {
+    long long chatId;
+    long long messageId;
+    std::string text;
+};
+
 class Conversation {
 public:
     explicit Conversation(long long chat_id, long long thread_id, long long user_id, Bot& bot);
     virtual ~Conversation() = default;
 
+    // Called once by the bot right after registration, under the conversation's lock.
+    // self stays lockable for as long as the bot keeps the conversation.
+    virtual void start(std::weak_ptr<Conversation> self) {}
+
     virtual void handleUpdate(const bot::Update& update) = 0;
     virtual bool isClosed() const = 0;
 
+    // Called by the bot, under the conversation's lock, when it evicts the conversation
+    // for idling too long or to make room. Mark the conversation closed and return the
+    // edit for its active message, if any: the bot sends it on a worker once the lock
+    // is released. The conversation is destroyed afterwards.
+    virtual std::optional<ExpiryEdit> expire() { return std::nullopt; }
+
+    // Heap held by the conversation's state, for the live-conversation gauge
+    virtual std::size_t approximateBytes() const { return 0; }
+
     long long getChatId() const;
     long long getThreadId() const;
     long long getUserId() const;
@@ -0,0 +1,159 @@
+#include "CoroutineConversation.h"
+#include "../logging/Logging.h"
+#include "Bot.h"
+
+namespace bot {
+
+void ConversationTask::promise_type::unhandled_exception() {
+    try {
+        throw;
+    } catch (const std::exception& e) {
+        logging::bot().error("Conversation coroutine threw: {}", e.what());
+    } catch (...) {
+        logging::bot().error("Conversation coroutine threw an unknown exception");
+    }
+}
+
+CoroutineConversation::~CoroutineConversation() {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (!state_->handle) return;
+    if (state_->waiting == detail::CoroutineState::Waiting::Io) {
+        // The pending completion owns the frame now and destroys it instead of resuming
+        state_->abandoned = true;
+        return;
+    }
+    state_->handle.destroy();
+    state_->handle = {};
+}
+
+void CoroutineConversation::start(std::weak_ptr<Conversation> self) {
+    self_ = std::move(self);
+    auto handle = run().release();
+    handle.promise().state = state_;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->handle = handle;
+    }
+    resume(state_);
+}
+
+void CoroutineConversation::handleUpdate(const Update& update) {
+    bool resumeNow = false;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (state_->waiting == detail::CoroutineState::Waiting::Update) {
+            state_->delivered = update;
+            state_->waiting = detail::CoroutineState::Waiting::Nothing;
+            resumeNow = true;
+        } else {
+            // Not started yet or mid outbound call; picked up by the next nextUpdate()
+            state_->inbox.push_back(update);
+        }
+    }
+    if (resumeNow) resume(state_);
+}
+
+bool CoroutineConversation::isClosed() const {
+    return state_->done.load();
+}
+
+bool CoroutineConversation::UpdateAwaiter::await_suspend(std::coroutine_handle<>) {
+    std::lock_guard<std::mutex> lock(state_.mutex);
+    if (!state_.inbox.empty()) {
+        state_.delivered = std::move(state_.inbox.front());
+        state_.inbox.pop_front();
+        return false;
+    }
+    state_.waiting = detail::CoroutineState::Waiting::Update;
+    return true;
+}
+
+Update CoroutineConversation::UpdateAwaiter::await_resume() {
+    std::lock_guard<std::mutex> lock(state_.mutex);
+    Update update = std::move(*state_.delivered);
+    state_.delivered.reset();
+    return update;
+}
+
+CoroutineConversation::UpdateAwaiter CoroutineConversation::nextUpdate() {
+    return UpdateAwaiter(*state_);
+}
+
+void CoroutineConversation::resume(const std::shared_ptr<detail::CoroutineState>& state) {
+    std::coroutine_handle<> handle;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        handle = state->handle;
+    }
+    if (handle && !state->done) handle.resume();
+}
+
+void CoroutineConversation::resumeAfterIo(const std::shared_ptr<detail::CoroutineState>& state,
+                                          const std::weak_ptr<Conversation>& self) {
+    // Holding the conversation keeps it alive while the coroutine runs on this thread
+    auto alive = self.lock();
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->waiting = detail::CoroutineState::Waiting::Nothing;
+        if (!alive || state->abandoned) {
+            if (state->handle) state->handle.destroy();
+            state->handle = {};
+            return;
+        }
+    }
+    resume(state);
+}
+
+bool CoroutineConversation::continueAfterIo(const std::shared_ptr<detail::CoroutineState>& state) {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->waiting = detail::CoroutineState::Waiting::Nothing;
+    if (state->abandoned) {
+        // The conversation went away while the call ran; the coroutine counts as
+        // suspended here, so its frame can go as a completion would have done it
+        if (state->handle) state->handle.destroy();
+        state->handle = {};
+        return true;
+    }
+    return false;
+}
+
+void CoroutineConversation::runOutbound(std::function<void()> call) {
+    if (!bot_.tryPost(call)) {
+        call();
+    }
+}
+
+CoroutineConversation::CallbackAwaiter<long long> CoroutineConversation::sendMessage(
+        long long chatId, std::string text, std::optional<InlineKeyboardMarkup> keyboard, std::string parseMode) {
+    return awaitCallback<long long>([this, chatId, text = std::move(text), keyboard = std::move(keyboard),
+                                     parseMode = std::move(parseMode)](std::function<void(long long)> done) {
+        runOutbound([&bot = bot_, chatId, text, keyboard, parseMode, done = std::move(done)] {
+            done(bot.sendMessage(chatId, text, keyboard ? &*keyboard : nullptr, parseMode));
+        });
+    });
+}
+
+CoroutineConversation::CallbackAwaiter<bool> CoroutineConversation::editMessage(
+        long long chatId, long long messageId, std::string text, std::optional<InlineKeyboardMarkup> keyboard,
+        std::string parseMode) {
+    return awaitCallback<bool>([this, chatId, messageId, text = std::move(text), keyboard = std::move(keyboard),
+                                parseMode = std::move(parseMode)](std::function<void(bool)> done) {
+        runOutbound([&bot = bot_, chatId, messageId, text, keyboard, parseMode, done = std::move(done)] {
+            bot.editMessage(chatId, messageId, text, keyboard ? &*keyboard : nullptr, parseMode);
+            done(true);
+        });
+    });
+}
+
+CoroutineConversation::CallbackAwaiter<bool> CoroutineConversation::answerCallbackQuery(
+        std::string callbackQueryId, std::string text) {
+    return awaitCallback<bool>([this, callbackQueryId = std::move(callbackQueryId),
+                                text = std::move(text)](std::function<void(bool)> done) {
+        runOutbound([&bot = bot_, callbackQueryId, text, done = std::move(done)] {
+            bot.answerCallbackQuery(callbackQueryId, text);
+            done(true);
+        });
+    });
+}
+
+} // namespace bot
@@ -0,0 +1,191 @@
+#ifndef FRIENDS_TRIP_BOT_COROUTINECONVERSATION_H
+#define FRIENDS_TRIP_BOT_COROUTINECONVERSATION_H
+
+#include <atomic>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "Conversation.h"
+#include "TelegramTypes.h"
+
+namespace bot {
+
+namespace detail {
+
+// Shared between a coroutine conversation and the completions of its outbound calls,
+// which may outlive it
+struct CoroutineState {
+    enum class Waiting { Nothing, Update, Io };
+
+    std::mutex mutex;
+    std::coroutine_handle<> handle;
+    Waiting waiting = Waiting::Nothing;
+    std::deque<Update> inbox;
+    std::optional<Update> delivered;
+    bool abandoned = false;  // conversation destroyed during an outbound call
+    std::atomic<bool> done{false};
+};
+
+} // namespace detail
+
+// Return type of CoroutineConversation::run()
+class ConversationTask {
+public:
+    struct promise_type {
+        std::shared_ptr<detail::CoroutineState> state;
+
+        ConversationTask get_return_object() {
+            return ConversationTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept {
+            struct Finish {
+                bool await_ready() noexcept { return false; }
+                void await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                    handle.promise().state->done = true;
+                }
+                void await_resume() noexcept {}
+            };
+            return Finish{};
+        }
+        void return_void() {}
+        void unhandled_exception();
+    };
+
+    ConversationTask(ConversationTask&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    ConversationTask(const ConversationTask&) = delete;
+    ConversationTask& operator=(const ConversationTask&) = delete;
+    ~ConversationTask() {
+        if (handle_) handle_.destroy();
+    }
+
+    std::coroutine_handle<promise_type> release() { return std::exchange(handle_, {}); }
+
+private:
+    explicit ConversationTask(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// A conversation written as one linear coroutine instead of a state machine:
+//
+//     ConversationTask run() override {
+//         co_await sendMessage(chat_id, "How much?");
+//         Update reply = co_await nextUpdate();
+//         ...
+//     }
+//
+// The dispatcher resumes it when an update for the conversation arrives; outbound calls
+// run as separate worker tasks and resume it when they complete. A suspended
+// conversation holds no worker, only its coroutine frame. The conversation is closed
+// once run() returns.
+class CoroutineConversation : public Conversation {
+public:
+    using Conversation::Conversation;
+    ~CoroutineConversation() override;
+
+    void start(std::weak_ptr<Conversation> self) final;
+    void handleUpdate(const Update& update) final;
+    bool isClosed() const final;
+
+protected:
+    // Resumes with the result passed to the done callback, from whichever thread
+    // calls it. A callback that runs before start_ returns (e.g. the call ran inline
+    // because the pool was saturated) does not resume the coroutine itself: await_suspend
+    // then returns false and the coroutine carries on without recursing into it.
+    template<typename T>
+    class CallbackAwaiter {
+    public:
+        using Start = std::function<void(std::function<void(T)>)>;
+
+        CallbackAwaiter(CoroutineConversation& owner, Start start) : owner_(owner), start_(std::move(start)) {}
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<>) {
+            auto state = owner_.state_;
+            auto self = owner_.self_;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->waiting = detail::CoroutineState::Waiting::Io;
+            }
+            start_([this, state, self](T value) {
+                result_.emplace(std::move(value));
+                // Whoever moves the phase second resumes
+                if (phase_.exchange(Phase::Completed) == Phase::Suspended) {
+                    CoroutineConversation::resumeAfterIo(state, self);
+                }
+            });
+            // Once Suspended is published the coroutine may be resumed (and this awaiter
+            // gone) on another thread: nothing below may touch members
+            if (phase_.exchange(Phase::Suspended) == Phase::Starting) return true;
+            return CoroutineConversation::continueAfterIo(state);
+        }
+
+        T await_resume() { return std::move(*result_); }
+
+    private:
+        enum class Phase { Starting, Suspended, Completed };
+
+        CoroutineConversation& owner_;
+        Start start_;
+        std::optional<T> result_;
+        std::atomic<Phase> phase_{Phase::Starting};
+    };
+
+    class UpdateAwaiter {
+    public:
+        explicit UpdateAwaiter(detail::CoroutineState& state) : state_(state) {}
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<>);
+        Update await_resume();
+
+    private:
+        detail::CoroutineState& state_;
+    };
+
+    virtual ConversationTask run() = 0;
+
+    // The next update routed to this conversation
+    UpdateAwaiter nextUpdate();
+
+    // Any callback-style operation, e.g. an AsyncDatabase query or async repository
+    template<typename T>
+    CallbackAwaiter<T> awaitCallback(typename CallbackAwaiter<T>::Start start) {
+        return CallbackAwaiter<T>(*this, std::move(start));
+    }
+
+    // Bot API calls on another worker; resume with the call's result
+    CallbackAwaiter<long long> sendMessage(long long chatId, std::string text,
+                                           std::optional<InlineKeyboardMarkup> keyboard = std::nullopt,
+                                           std::string parseMode = "");
+    CallbackAwaiter<bool> editMessage(long long chatId, long long messageId, std::string text,
+                                      std::optional<InlineKeyboardMarkup> keyboard = std::nullopt,
+                                      std::string parseMode = "");
+    CallbackAwaiter<bool> answerCallbackQuery(std::string callbackQueryId, std::string text = "");
+
+private:
+    static void resume(const std::shared_ptr<detail::CoroutineState>& state);
+    static void resumeAfterIo(const std::shared_ptr<detail::CoroutineState>& state,
+                              const std::weak_ptr<Conversation>& self);
+    // For a call that completed before its awaiter suspended; the result for
+    // await_suspend
+    static bool continueAfterIo(const std::shared_ptr<detail::CoroutineState>& state);
+
+    // Runs call on another worker, or inline if the pool is saturated
+    void runOutbound(std::function<void()> call);
+
+    std::shared_ptr<detail::CoroutineState> state_ = std::make_shared<detail::CoroutineState>();
+    std::weak_ptr<Conversation> self_;
+};
+
+} // namespace bot
+
+#endif //FRIENDS_TRIP_BOT_COROUTINECONVERSATION_H
@@ -1,25 +1,250 @@
 #include "Scheduler.h"
+#include "../logging/Logging.h"
+#include "../utils/utils.h"
 
-#include <chrono>
-#include <ctime>
+#include <charconv>
 
 namespace bot {
 
-// UTC offset in hours for the timezone that hh:mm:ss values are defined in (GMT+8)
-constexpr int TIMEZONE_UTC_OFFSET = 8;
+namespace {
 
-// Tolerance in seconds to account for early wakeups from wait_until
-constexpr int WAKE_TOLERANCE_SECS = 2;
+// Parses one cron field into bits lo..hi; false on anything malformed or out of range
+bool parseField(std::string_view field, unsigned lo, unsigned hi, std::bitset<64>& bits, bool& any) {
+    auto number = [](std::string_view text, unsigned& value) {
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return ec == std::errc{} && ptr == text.data() + text.size();
+    };
 
-Scheduler::Scheduler() = default;
+    any = field == "*";
+    while (!field.empty()) {
+        std::size_t comma = field.find(',');
+        std::string_view part = field.substr(0, comma);
+        field = comma == std::string_view::npos ? std::string_view{} : field.substr(comma + 1);
+
+        unsigned step = 1;
+        if (std::size_t slash = part.find('/'); slash != std::string_view::npos) {
+            if (!number(part.substr(slash + 1), step) || step == 0) return false;
+            part = part.substr(0, slash);
+        }
+
+        unsigned first = lo;
+        unsigned last = hi;
+        if (part != "*") {
+            std::size_t dash = part.find('-');
+            if (dash != std::string_view::npos) {
+                if (!number(part.substr(0, dash), first) || !number(part.substr(dash + 1), last)) return false;
+            } else {
+                if (!number(part, first)) return false;
+                // "5/15" means from 5 in steps of 15; a bare value is just itself
+                last = step > 1 ? hi : first;
+            }
+        }
+        if (first < lo || last > hi || first > last) return false;
+        for (unsigned v = first; v <= last; v += step) bits.set(v);
+    }
+    return bits.any();
+}
+
+template<std::size_t N>
+std::bitset<N> narrow(const std::bitset<64>& bits) {
+    std::bitset<N> result;
+    for (std::size_t i = 0; i < N; ++i) result[i] = bits[i];
+    return result;
+}
+
+long long floorDiv(long long a, long long b) {
+    return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+} // namespace
+
+std::optional<CronExpression> CronExpression::parse(std::string_view expression) {
+    std::vector<std::string_view> fields;
+    std::size_t pos = 0;
+    while (pos < expression.size()) {
+        while (pos < expression.size() && expression[pos] == ' ') ++pos;
+        std::size_t end = expression.find(' ', pos);
+        if (end == std::string_view::npos) end = expression.size();
+        if (end > pos) fields.push_back(expression.substr(pos, end - pos));
+        pos = end;
+    }
+    if (fields.size() != 5) return std::nullopt;
+
+    CronExpression cron;
+    std::bitset<64> minutes, hours, days, months, weekdays;
+    bool any = false;
+    if (!parseField(fields[0], 0, 59, minutes, any)
+        || !parseField(fields[1], 0, 23, hours, any)
+        || !parseField(fields[2], 1, 31, days, cron.anyDayOfMonth_)
+        || !parseField(fields[3], 1, 12, months, any)
+        || !parseField(fields[4], 0, 7, weekdays, cron.anyDayOfWeek_)) {
+        return std::nullopt;
+    }
+    if (weekdays[7]) weekdays.set(0);
+
+    cron.minutes_ = narrow<60>(minutes);
+    cron.hours_ = narrow<24>(hours);
+    cron.daysOfMonth_ = narrow<32>(days);
+    cron.months_ = narrow<13>(months);
+    cron.daysOfWeek_ = narrow<7>(weekdays);
+    return cron;
+}
+
+bool CronExpression::matchesDay(unsigned dayOfMonth, unsigned month, unsigned dayOfWeek) const {
+    if (!months_[month]) return false;
+    if (anyDayOfMonth_ && anyDayOfWeek_) return true;
+    if (anyDayOfMonth_) return daysOfWeek_[dayOfWeek];
+    if (anyDayOfWeek_) return daysOfMonth_[dayOfMonth];
+    return daysOfMonth_[dayOfMonth] || daysOfWeek_[dayOfWeek];
+}
+
+std::optional<std::chrono::system_clock::time_point> CronExpression::nextAfter(
+        std::chrono::system_clock::time_point after, int utcOffsetHours) const {
+    using namespace std::chrono;
+    const long long offset = utcOffsetHours * 3600LL;
+    long long localMinute = floorDiv(floor<seconds>(after).time_since_epoch().count() + offset, 60) + 1;
+
+    long long day = floorDiv(localMinute, 1440);
+    int startMinuteOfDay = static_cast<int>(localMinute - day * 1440);
+    for (int i = 0; i < 4 * 366; ++i, ++day, startMinuteOfDay = 0) {
+        auto date = utils::detail::civilFromDays(day);
+        unsigned dayOfWeek = static_cast<unsigned>(((day % 7) + 11) % 7);  // 1970-01-01 was a Thursday
+        if (!matchesDay(date.day, date.month, dayOfWeek)) continue;
+
+        for (int hour = startMinuteOfDay / 60; hour < 24; ++hour) {
+            if (!hours_[hour]) continue;
+            int firstMinute = hour == startMinuteOfDay / 60 ? startMinuteOfDay % 60 : 0;
+            for (int minute = firstMinute; minute < 60; ++minute) {
+                if (!minutes_[minute]) continue;
+                long long localSeconds = (day * 1440 + hour * 60 + minute) * 60;
+                return system_clock::time_point{seconds{localSeconds - offset}};
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+Scheduler::Scheduler(int utcOffsetHours, std::size_t workers, std::size_t maxQueueSize)
+    : utcOffsetHours_(utcOffsetHours), executor(workers, maxQueueSize, "scheduler") {}
 
 Scheduler::~Scheduler() {
     stop();
 }
 
-void Scheduler::registerTask(std::function<void()> task, bool isRecurring, int hh, int mm, int ss) {
+Scheduler::TaskId Scheduler::registerTask(std::function<void()> task, bool isRecurring, int hh, int mm, int ss) {
+    int secondOfDay = hh * 3600 + mm * 60 + ss;
+    ScheduledTask scheduled{std::move(task), isRecurring ? Kind::Daily : Kind::Once, {}, secondOfDay, std::nullopt};
+    return add(std::move(scheduled), nextDaily(secondOfDay, std::chrono::system_clock::now()));
+}
+
+Scheduler::TaskId Scheduler::scheduleAfter(Clock::duration delay, std::function<void()> task) {
+    return add(ScheduledTask{std::move(task), Kind::Once, {}, 0, std::nullopt}, Clock::now() + delay);
+}
+
+Scheduler::TaskId Scheduler::scheduleEvery(Clock::duration interval, std::function<void()> task) {
+    if (interval <= Clock::duration::zero()) return 0;
+    return add(ScheduledTask{std::move(task), Kind::Interval, interval, 0, std::nullopt}, Clock::now() + interval);
+}
+
+Scheduler::TaskId Scheduler::scheduleCron(std::string_view expression, std::function<void()> task) {
+    auto cron = CronExpression::parse(expression);
+    if (!cron) {
+        logging::bot().error("Invalid cron expression: '{}'", expression);
+        return 0;
+    }
+    ScheduledTask scheduled{std::move(task), Kind::Cron, {}, 0, std::move(cron)};
+    auto first = nextFire(scheduled, Clock::now());
+    if (!first) {
+        logging::bot().error("Cron expression never fires: '{}'", expression);
+        return 0;
+    }
+    return add(std::move(scheduled), *first);
+}
+
+bool Scheduler::cancel(TaskId id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return cancelLocked(id);
+}
+
+bool Scheduler::cancelAndWait(TaskId id) {
+    std::unique_lock<std::mutex> lock(mutex);
+    bool cancelled = cancelLocked(id);
+    inProgressCv.wait(lock, [this, id] { return inProgress.count(id) == 0; });
+    return cancelled;
+}
+
+bool Scheduler::cancelLocked(TaskId id) {
+    if (tasks.erase(id) == 0) return false;
+
+    // Rebuild once cancelled deadlines dominate, so frequent cancel-and-reschedule
+    // (timeouts that keep being pushed back) cannot grow the heap without bound
+    if (deadlines.size() > 2 * tasks.size() + 64) {
+        std::vector<Deadline> live;
+        live.reserve(tasks.size());
+        while (!deadlines.empty()) {
+            if (tasks.count(deadlines.top().id)) live.push_back(deadlines.top());
+            deadlines.pop();
+        }
+        deadlines = decltype(deadlines)(std::greater<>{}, std::move(live));
+    }
+    return true;
+}
+
+int Scheduler::utcOffsetHours() const {
+    return utcOffsetHours_;
+}
+
+std::size_t Scheduler::pendingTasks() {
     std::lock_guard<std::mutex> lock(mutex);
-    tasks.push_back({std::move(task), isRecurring, hh, mm, ss});
+    return tasks.size();
+}
+
+Scheduler::TaskId Scheduler::add(ScheduledTask task, Clock::time_point first) {
+    TaskId id;
+    bool earliest;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        id = nextId++;
+        tasks.emplace(id, std::move(task));
+        earliest = deadlines.empty() || first < deadlines.top().when;
+        deadlines.push({first, id});
+    }
+    // Only a new earliest deadline changes how long the worker should sleep
+    if (earliest) cv.notify_all();
+    return id;
+}
+
+Scheduler::Clock::time_point Scheduler::nextDaily(int secondOfDay, std::chrono::system_clock::time_point after) const {
+    using namespace std::chrono;
+    auto wallNow = system_clock::now();
+    long long localNow = floor<seconds>(std::max(after, wallNow)).time_since_epoch().count() + utcOffsetHours_ * 3600LL;
+    long long target = floorDiv(localNow, 86400) * 86400 + secondOfDay;
+    if (target <= localNow) target += 86400;
+    auto wallTarget = system_clock::time_point{seconds{target - utcOffsetHours_ * 3600LL}};
+    return Clock::now() + duration_cast<Clock::duration>(wallTarget - wallNow);
+}
+
+std::optional<Scheduler::Clock::time_point> Scheduler::nextFire(const ScheduledTask& task, Clock::time_point after) const {
+    auto now = Clock::now();
+    auto wallAfter = std::chrono::system_clock::now()
+                   + std::chrono::duration_cast<std::chrono::system_clock::duration>(after - now);
+    switch (task.kind) {
+        case Kind::Once:
+            return std::nullopt;
+        case Kind::Interval:
+            // Keeps the original cadence unless the worker fell a whole interval behind
+            return std::max(after + task.interval, now);
+        case Kind::Daily:
+            // after is the deadline just fired; the margin keeps clock jitter from
+            // picking the same target again
+            return nextDaily(task.secondOfDay, wallAfter + std::chrono::seconds(1));
+        case Kind::Cron: {
+            auto next = task.cron->nextAfter(wallAfter, utcOffsetHours_);
+            if (!next) return std::nullopt;
+            return now + std::chrono::duration_cast<Clock::duration>(*next - std::chrono::system_clock::now());
+        }
+    }
+    return std::nullopt;
 }
 
 void Scheduler::startWorker() {
@@ -34,84 +259,63 @@ void Scheduler::stop() {
             workerThread.join();
         }
     }
+    executor.shutdown();
 }
 
-void Scheduler::workerLoop() {
-    // Initialize lastCheckTime to now so the first iteration doesn't fire everything in the past
-    std::time_t nowUtc = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-    lastCheckTime = nowUtc + TIMEZONE_UTC_OFFSET * 3600;
+void Scheduler::finished(TaskId id) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = inProgress.find(id);
+        if (it != inProgress.end() && --it->second == 0) inProgress.erase(it);
+    }
+    inProgressCv.notify_all();
+}
 
+void Scheduler::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
     while (running) {
-        auto now = std::chrono::system_clock::now();
-        nowUtc = std::chrono::system_clock::to_time_t(now);
-        std::time_t nowTime = nowUtc + TIMEZONE_UTC_OFFSET * 3600 + WAKE_TOLERANCE_SECS;
-        std::tm localNow{};
-        gmtime_r(&nowTime, &localNow);
-
-        // Find the earliest next fire time across all tasks
-        std::chrono::system_clock::time_point nextWake = now + std::chrono::hours(24);
-
-        std::vector<std::function<void()>> toFire;
-
-        {
-            std::lock_guard<std::mutex> lock(mutex);
-            std::vector<size_t> toRemove;
-
-            for (size_t i = 0; i < tasks.size(); i++) {
-                const auto& t = tasks[i];
-
-                // Compute the target time for today
-                std::tm target = localNow;
-                target.tm_hour = t.hh;
-                target.tm_min = t.mm;
-                target.tm_sec = t.ss;
-                target.tm_isdst = -1;
-                std::time_t targetTime = timegm(&target);
-
-                // Also check yesterday's target in case we crossed midnight since lastCheck
-                std::time_t yesterdayTarget = targetTime - 86400;
-
-                // Fire if target falls in (lastCheckTime, nowTime]
-                bool shouldFire = (targetTime > lastCheckTime && targetTime <= nowTime)
-                               || (yesterdayTarget > lastCheckTime && yesterdayTarget <= nowTime);
-
-                if (shouldFire) {
-                    toFire.push_back(t.task);
-                    if (!t.recurring) {
-                        toRemove.push_back(i);
-                    }
-                }
-
-                // Compute next fire time for sleep calculation
-                if (targetTime <= nowTime) {
-                    targetTime += 86400;
-                }
-                auto targetPoint = std::chrono::system_clock::from_time_t(targetTime - TIMEZONE_UTC_OFFSET * 3600);
-                if (targetPoint < nextWake) {
-                    nextWake = targetPoint;
-                }
-            }
-
-            // Remove non-recurring tasks that fired
-            for (auto it = toRemove.rbegin(); it != toRemove.rend(); ++it) {
-                tasks[*it] = std::move(tasks.back());
-                tasks.pop_back();
-            }
+        if (deadlines.empty()) {
+            cv.wait(lock, [this] { return !running.load() || !deadlines.empty(); });
+            continue;
         }
 
-        lastCheckTime = nowTime;
-
-        // Fire tasks
-        for (const auto& task : toFire) {
-            std::thread(task).detach();
+        Deadline next = deadlines.top();
+        auto it = tasks.find(next.id);
+        if (it == tasks.end()) {
+            deadlines.pop();  // cancelled
+            continue;
+        }
+        if (next.when > Clock::now()) {
+            // Woken early by stop() or by a new earlier deadline; re-evaluate either way
+            cv.wait_until(lock, next.when);
+            continue;
         }
 
-        // Wait until the next fire time or until stopped
-        {
-            std::unique_lock<std::mutex> lock(mutex);
-            cv.wait_until(lock, nextWake, [this] { return !running.load(); });
+        deadlines.pop();
+        std::function<void()> task = it->second.task;
+        auto following = nextFire(it->second, next.when);
+        if (following) {
+            deadlines.push({*following, next.id});
+        } else {
+            tasks.erase(it);
         }
+
+        // Blocks while the executor's queue is full; later deadlines wait their turn
+        inProgress[next.id]++;
+        lock.unlock();
+        TaskId id = next.id;
+        bool submitted = executor.submit([this, id, task = std::move(task)] {
+            try {
+                task();
+            } catch (...) {
+                finished(id);
+                throw;  // logged by the pool
+            }
+            finished(id);
+        });
+        if (!submitted) finished(id);
+        lock.lock();
     }
 }
 
-}
\ No newline at end of file
+}
@@ -1,43 +1,133 @@
 #ifndef FRIENDS_TRIP_BOT_SCHEDULER_H
 #define FRIENDS_TRIP_BOT_SCHEDULER_H
 
+#include <bitset>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <optional>
+#include <queue>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include <mutex>
 #include <atomic>
 #include <thread>
 #include <condition_variable>
 
+#include "ThreadPool.h"
+
 namespace bot {
 
+// Five-field cron expression: "minute hour day-of-month month day-of-week".
+// Each field takes *, a value, a range a-b, a step */n or a-b/n, or a comma list of
+// those. Day-of-week runs 0-6 from Sunday (7 is also Sunday). As in cron, when both
+// day fields are restricted a day matching either one fires.
+class CronExpression {
+public:
+    static std::optional<CronExpression> parse(std::string_view expression);
+
+    // First matching minute strictly after `after`, in local time at utcOffsetHours.
+    // std::nullopt if nothing matches within four years (e.g. "0 0 31 2 *").
+    std::optional<std::chrono::system_clock::time_point> nextAfter(std::chrono::system_clock::time_point after,
+                                                                   int utcOffsetHours) const;
+
+private:
+    std::bitset<60> minutes_;
+    std::bitset<24> hours_;
+    std::bitset<32> daysOfMonth_;
+    std::bitset<13> months_;
+    std::bitset<7> daysOfWeek_;
+    bool anyDayOfMonth_ = false;
+    bool anyDayOfWeek_ = false;
+
+    bool matchesDay(unsigned dayOfMonth, unsigned month, unsigned dayOfWeek) const;
+};
+
+// Runs tasks at their deadlines: after a delay, at fixed intervals, at a daily local
+// time, or on a cron schedule. Deadlines sit in a min-heap, so inserting and firing are
+// O(log n) and the worker sleeps until the earliest one. Fired tasks run on a small
+// bounded pool, never on the timer thread itself.
 class Scheduler {
 public:
-    Scheduler();
+    using TaskId = uint64_t;
+    using Clock = std::chrono::steady_clock;
+
+    // Daily and cron times are read in local time at utcOffsetHours
+    explicit Scheduler(int utcOffsetHours = 8, std::size_t workers = 2, std::size_t maxQueueSize = 64);
     ~Scheduler();
 
-    void registerTask(std::function<void()> task, bool isRecurring, int hh, int mm, int ss);
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // Daily at hh:mm:ss local time, or only the next time if !isRecurring
+    TaskId registerTask(std::function<void()> task, bool isRecurring, int hh, int mm, int ss);
+
+    TaskId scheduleAfter(Clock::duration delay, std::function<void()> task);
+    TaskId scheduleEvery(Clock::duration interval, std::function<void()> task);
+    // Returns 0 if the expression does not parse or never matches
+    TaskId scheduleCron(std::string_view expression, std::function<void()> task);
+
+    // False if the task already fired (one-shot) or was unknown. A firing already
+    // handed to the pool still runs.
+    bool cancel(TaskId id);
+    // cancel(), then waits until no firing of the task is queued or running, so what
+    // the task captures can be destroyed. Never call it from inside the task itself.
+    bool cancelAndWait(TaskId id);
+
+    int utcOffsetHours() const;
+    std::size_t pendingTasks();
+
     void startWorker();
     void stop();
 
 private:
+    enum class Kind { Once, Interval, Daily, Cron };
+
     struct ScheduledTask {
         std::function<void()> task;
-        bool recurring;
-        int hh;
-        int mm;
-        int ss;
+        Kind kind;
+        Clock::duration interval{};
+        int secondOfDay = 0;
+        std::optional<CronExpression> cron;
     };
 
-    std::vector<ScheduledTask> tasks;
+    struct Deadline {
+        Clock::time_point when;
+        TaskId id;
+        bool operator>(const Deadline& other) const {
+            return when != other.when ? when > other.when : id > other.id;
+        }
+    };
+
+    TaskId add(ScheduledTask task, Clock::time_point first);
+    // Requires mutex
+    bool cancelLocked(TaskId id);
+    void finished(TaskId id);
+    std::optional<Clock::time_point> nextFire(const ScheduledTask& task, Clock::time_point after) const;
+    // Next hh:mm:ss local time strictly after `after`, on the steady clock
+    Clock::time_point nextDaily(int secondOfDay, std::chrono::system_clock::time_point after) const;
+
+    const int utcOffsetHours_;
+
+    std::unordered_map<TaskId, ScheduledTask> tasks;
+    // Cancelled ids stay in the heap until they reach the top and are skipped there
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<>> deadlines;
+    TaskId nextId = 1;
+    // Firings handed to the executor and not yet finished, per task
+    std::unordered_map<TaskId, std::size_t> inProgress;
+    std::condition_variable inProgressCv;
+
     std::mutex mutex;
     std::condition_variable cv;
     std::atomic<bool> running{false};
     std::thread workerThread;
-    std::time_t lastCheckTime{0};
+    ThreadPool executor;
 
     void workerLoop();
 };
 
 }
 
-#endif //FRIENDS_TRIP_BOT_SCHEDULER_H
\ No newline at end of file
+#endif //FRIENDS_TRIP_BOT_SCHEDULER_H
@@ -1,10 +1,13 @@
 #include "ThreadPool.h"
-#include <spdlog/spdlog.h>
+#include "../logging/Logging.h"
 
 namespace bot {
 
-ThreadPool::ThreadPool(std::size_t numWorkers, std::size_t maxQueueSize)
-    : maxQueueSize_(maxQueueSize) {
+ThreadPool::ThreadPool(std::size_t numWorkers, std::size_t maxQueueSize, const std::string& name)
+    : queueDepth_(metrics::registry().gauge("thread_pool_queue_depth", "Tasks waiting for a worker", {{"pool", name}})),
+      queueWait_(metrics::registry().histogram("thread_pool_queue_wait_seconds", "Time tasks spent queued",
+                                               {{"pool", name}})),
+      maxQueueSize_(maxQueueSize) {
     workers_.reserve(numWorkers);
     for (std::size_t i = 0; i < numWorkers; ++i) {
         workers_.emplace_back([this] { workerLoop(); });
@@ -22,7 +25,19 @@ bool ThreadPool::submit(std::function<void()> task) {
             return stopped_ || queue_.size() < maxQueueSize_;
         });
         if (stopped_) return false;
-        queue_.push(std::move(task));
+        queue_.push({std::move(task), std::chrono::steady_clock::now()});
+        queueDepth_.set(static_cast<int64_t>(queue_.size()));
+    }
+    notEmpty_.notify_one();
+    return true;
+}
+
+bool ThreadPool::trySubmit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopped_ || queue_.size() >= maxQueueSize_) return false;
+        queue_.push({std::move(task), std::chrono::steady_clock::now()});
+        queueDepth_.set(static_cast<int64_t>(queue_.size()));
     }
     notEmpty_.notify_one();
     return true;
@@ -58,16 +73,18 @@ void ThreadPool::workerLoop() {
                 return stopped_ || !queue_.empty();
             });
             if (stopped_ && queue_.empty()) return;
-            task = std::move(queue_.front());
+            queueWait_.observe(std::chrono::steady_clock::now() - queue_.front().enqueuedAt);
+            task = std::move(queue_.front().task);
             queue_.pop();
+            queueDepth_.set(static_cast<int64_t>(queue_.size()));
         }
         notFull_.notify_one();
         try {
             task();
         } catch (const std::exception& e) {
-            spdlog::error("ThreadPool worker caught exception: {}", e.what());
+            logging::bot().error("ThreadPool worker caught exception: {}", e.what());
         } catch (...) {
-            spdlog::error("ThreadPool worker caught unknown exception");
+            logging::bot().error("ThreadPool worker caught unknown exception");
         }
     }
 }
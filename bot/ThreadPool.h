@@ -1,19 +1,24 @@
 #ifndef FRIENDS_TRIP_BOT_THREADPOOL_H
 #define FRIENDS_TRIP_BOT_THREADPOOL_H
 
+#include <chrono>
 #include <cstddef>
 #include <functional>
+#include <string>
 #include <vector>
 #include <queue>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 
+#include "../metrics/Metrics.h"
+
 namespace bot {
 
 class ThreadPool {
 public:
-    ThreadPool(std::size_t numWorkers, std::size_t maxQueueSize);
+    // name labels the pool's queue depth and wait time metrics
+    ThreadPool(std::size_t numWorkers, std::size_t maxQueueSize, const std::string& name = "default");
     ~ThreadPool();
 
     ThreadPool(const ThreadPool&) = delete;
@@ -23,6 +28,10 @@ public:
     // Returns false if the pool has been shut down.
     bool submit(std::function<void()> task);
 
+    // Enqueue without blocking. Returns false if the queue is full or the pool has
+    // been shut down; for callers on a worker, which must not wait on the queue.
+    bool trySubmit(std::function<void()> task);
+
     // Initiate shutdown: no new tasks accepted, workers drain the queue then exit.
     void shutdown();
 
@@ -30,8 +39,16 @@ public:
     void waitForDrain();
 
 private:
+    struct QueuedTask {
+        std::function<void()> task;
+        std::chrono::steady_clock::time_point enqueuedAt;
+    };
+
+    metrics::Gauge& queueDepth_;
+    metrics::Histogram& queueWait_;
+
     std::vector<std::thread> workers_;
-    std::queue<std::function<void()>> queue_;
+    std::queue<QueuedTask> queue_;
     std::size_t maxQueueSize_;
 
     std::mutex mutex_;
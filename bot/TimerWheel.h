@@ -0,0 +1,116 @@
+#ifndef FRIENDS_TRIP_BOT_TIMERWHEEL_H
+#define FRIENDS_TRIP_BOT_TIMERWHEEL_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace bot {
+
+// Hashed timing wheel: deadlines are bucketed into `slots` slots of `tick` each, so
+// scheduling, rescheduling and cancelling a key are O(1) and advancing touches only the
+// slots that came due. Size the wheel so tick * slots covers the longest deadline in
+// use; anything further out waits in the last slot and is re-bucketed when it comes
+// round, at the cost of one extra visit.
+//
+// Not thread-safe; the owner serialises access.
+template<typename Key, typename Hash = std::hash<Key>>
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TimerWheel(Clock::duration tick, std::size_t slots, Clock::time_point start = Clock::now())
+        : tick_(tick), slots_(slots), current_(toTick(start)) {}
+
+    // Inserts key, or moves it if already scheduled
+    void schedule(const Key& key, Clock::time_point deadline) {
+        cancel(key);
+        long long due = std::max(toTick(deadline), current_ + 1);
+        std::size_t slot = slotFor(std::min(due, current_ + static_cast<long long>(slots_.size()) - 1));
+        slots_[slot].push_front(key);
+        index_.emplace(key, Location{slot, slots_[slot].begin(), deadline});
+    }
+
+    bool cancel(const Key& key) {
+        auto it = index_.find(key);
+        if (it == index_.end()) return false;
+        slots_[it->second.slot].erase(it->second.position);
+        index_.erase(it);
+        return true;
+    }
+
+    bool contains(const Key& key) const {
+        return index_.count(key) > 0;
+    }
+
+    // Removes and returns every key whose deadline is at or before now; O(expired)
+    // plus one step per elapsed tick (capped at one lap of the wheel)
+    std::vector<Key> advance(Clock::time_point now) {
+        std::vector<Key> expired;
+        long long target = toTick(now);
+        if (target - current_ >= static_cast<long long>(slots_.size())) {
+            // A lap or more behind: every slot is due, and anything not yet expired is
+            // re-bucketed relative to now
+            current_ = target;
+            for (std::size_t slot = 0; slot < slots_.size(); ++slot) {
+                drain(slot, now, expired);
+            }
+            return expired;
+        }
+        while (current_ < target) {
+            ++current_;
+            drain(slotFor(current_), now, expired);
+        }
+        return expired;
+    }
+
+    std::size_t size() const {
+        return index_.size();
+    }
+
+private:
+    struct Location {
+        std::size_t slot;
+        typename std::list<Key>::iterator position;
+        Clock::time_point deadline;
+    };
+
+    long long toTick(Clock::time_point point) const {
+        return point.time_since_epoch() / tick_;
+    }
+
+    std::size_t slotFor(long long tick) const {
+        return static_cast<std::size_t>(tick % static_cast<long long>(slots_.size()));
+    }
+
+    void drain(std::size_t slot, Clock::time_point now, std::vector<Key>& expired) {
+        std::list<Key> due;
+        due.swap(slots_[slot]);
+        for (const Key& key : due) {
+            auto it = index_.find(key);
+            if (it == index_.end()) continue;
+            if (it->second.deadline <= now) {
+                index_.erase(it);
+                expired.push_back(key);
+            } else {
+                // Beyond the wheel's span when scheduled; bucket it again
+                Clock::time_point deadline = it->second.deadline;
+                index_.erase(it);
+                schedule(key, deadline);
+            }
+        }
+    }
+
+    const Clock::duration tick_;
+    std::vector<std::list<Key>> slots_;
+    std::unordered_map<Key, Location, Hash> index_;
+    long long current_;
+};
+
+} // namespace bot
+
+#endif //FRIENDS_TRIP_BOT_TIMERWHEEL_H
@@ -0,0 +1,99 @@
+#include "UpdateRecorder.h"
+#include "../logging/Logging.h"
+#include <filesystem>
+#include <system_error>
+
+namespace bot {
+
+bool UpdateRecorder::open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(path, ec);
+    bool fresh = ec || size == 0;
+    std::chrono::microseconds lastOffset{0};
+    if (!fresh) {
+        UpdateLogReader reader;
+        if (!reader.open(path)) {
+            logging::bot().error("{} exists and is not an update log; not recording", path);
+            return false;
+        }
+        uintmax_t end = kUpdateLogMagic.size() + sizeof(int64_t);
+        while (auto batch = reader.next()) {
+            end += sizeof(int64_t) + sizeof(uint32_t) + batch->body.size();
+            lastOffset = batch->offset;
+        }
+        if (end < size) {
+            logging::bot().warn("Dropping a truncated record at the end of update log {}", path);
+            std::filesystem::resize_file(path, end, ec);
+            if (ec) {
+                logging::bot().error("Cannot truncate update log {}: {}", path, ec.message());
+                return false;
+            }
+        }
+    }
+
+    out_.open(path, std::ios::binary | std::ios::app);
+    if (!out_) {
+        logging::bot().error("Cannot open update log {}", path);
+        return false;
+    }
+
+    start_ = std::chrono::steady_clock::now() - lastOffset;
+    if (fresh) {
+        int64_t startedAt = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        out_.write(kUpdateLogMagic.data(), static_cast<std::streamsize>(kUpdateLogMagic.size()));
+        out_.write(reinterpret_cast<const char*>(&startedAt), sizeof(startedAt));
+        out_.flush();
+    }
+    failed_ = !out_;
+    logging::bot().info("Recording updates to {}", path);
+    return !failed_;
+}
+
+void UpdateRecorder::record(std::string_view body) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (failed_ || !out_.is_open()) return;
+
+    int64_t offset = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start_).count();
+    uint32_t length = static_cast<uint32_t>(body.size());
+    out_.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+    out_.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    out_.write(body.data(), static_cast<std::streamsize>(body.size()));
+    out_.flush();
+    if (!out_) {
+        failed_ = true;
+        logging::bot().error("Writing the update log failed; recording stopped");
+    }
+}
+
+bool UpdateLogReader::open(const std::string& path) {
+    in_.open(path, std::ios::binary);
+    if (!in_) return false;
+
+    std::string magic(kUpdateLogMagic.size(), '\0');
+    int64_t startedAt = 0;
+    in_.read(magic.data(), static_cast<std::streamsize>(magic.size()));
+    in_.read(reinterpret_cast<char*>(&startedAt), sizeof(startedAt));
+    if (!in_ || magic != kUpdateLogMagic) return false;
+
+    startedAt_ = std::chrono::system_clock::time_point(std::chrono::microseconds(startedAt));
+    return true;
+}
+
+std::optional<RecordedBatch> UpdateLogReader::next() {
+    int64_t offset = 0;
+    uint32_t length = 0;
+    in_.read(reinterpret_cast<char*>(&offset), sizeof(offset));
+    in_.read(reinterpret_cast<char*>(&length), sizeof(length));
+    if (!in_) return std::nullopt;
+
+    RecordedBatch batch{std::chrono::microseconds(offset), std::string(length, '\0')};
+    in_.read(batch.body.data(), length);
+    if (!in_) return std::nullopt;
+    return batch;
+}
+
+} // namespace bot
@@ -0,0 +1,68 @@
+#ifndef FRIENDS_TRIP_BOT_UPDATERECORDER_H
+#define FRIENDS_TRIP_BOT_UPDATERECORDER_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace bot {
+
+// Update log format: an 8-byte magic, then the recording's start as int64 microseconds
+// since the Unix epoch, then one record per getUpdates batch:
+//
+//   int64  microseconds since the start (steady clock)
+//   uint32 body length
+//   bytes  the getUpdates response body, exactly as received
+//
+// A log reopened after a restart continues from its last record's offset, so the time
+// the bot was down does not show up as a gap on replay. Integers are in host byte
+// order; logs are replayed on the machine type they came from.
+inline constexpr std::string_view kUpdateLogMagic = "FTBUPD1\n";
+
+// Appends getUpdates responses to an update log. The log holds message text and user
+// names, so treat it like the database it mirrors.
+class UpdateRecorder {
+public:
+    // Appends to an existing update log, dropping a record cut short by a crash, or
+    // starts a new one if the file is missing or empty. False if the file cannot be
+    // opened or holds something other than an update log.
+    bool open(const std::string& path);
+
+    // Written and flushed before returning, so a crash loses at most the batch in hand.
+    // After a write error the recorder logs once and stops recording.
+    void record(std::string_view body);
+
+private:
+    std::mutex mutex_;
+    std::ofstream out_;
+    std::chrono::steady_clock::time_point start_;
+    bool failed_ = false;
+};
+
+struct RecordedBatch {
+    std::chrono::microseconds offset;  // since the recording started
+    std::string body;
+};
+
+class UpdateLogReader {
+public:
+    // False if the file is missing or not an update log
+    bool open(const std::string& path);
+
+    // std::nullopt at the end of the log; a truncated last record is treated as the end
+    std::optional<RecordedBatch> next();
+
+    std::chrono::system_clock::time_point startedAt() const { return startedAt_; }
+
+private:
+    std::ifstream in_;
+    std::chrono::system_clock::time_point startedAt_;
+};
+
+} // namespace bot
+
+#endif //FRIENDS_TRIP_BOT_UPDATERECORDER_H
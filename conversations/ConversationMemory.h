@@ -0,0 +1,56 @@
+#ifndef FRIENDS_TRIP_BOT_CONVERSATIONMEMORY_H
+#define FRIENDS_TRIP_BOT_CONVERSATIONMEMORY_H
+
+#include "../repository/PaymentRepository.h"
+#include "../repository/TripRepository.h"
+#include "../repository/UserRepository.h"
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Rough heap footprint of the state conversations keep, for Bot::conversationStats().
+// Counts object sizes and string/vector capacities, ignoring allocator overhead.
+namespace conversation_memory {
+
+inline std::size_t bytes(const std::string& s) {
+    return s.capacity();
+}
+
+inline std::size_t bytes(const User& user) {
+    return sizeof(User) + bytes(user.name) + bytes(user.gmt_created) + bytes(user.gmt_modified);
+}
+
+inline std::size_t bytes(const Trip& trip) {
+    return sizeof(Trip) + bytes(trip.name) + bytes(trip.gmt_created);
+}
+
+inline std::size_t bytes(const PaymentGroup& group) {
+    return sizeof(PaymentGroup) + bytes(group.name) + group.records.capacity() * sizeof(PaymentRecord);
+}
+
+template<typename T>
+std::size_t bytes(const std::vector<T>& items) {
+    std::size_t total = (items.capacity() - items.size()) * sizeof(T);
+    for (const auto& item : items) total += bytes(item);
+    return total;
+}
+
+template<typename K, typename V>
+std::size_t bytes(const std::unordered_map<K, V>& map) {
+    // One node per element plus the bucket array
+    std::size_t total = map.bucket_count() * sizeof(void*) + map.size() * (sizeof(K) + 2 * sizeof(void*));
+    for (const auto& [key, value] : map) {
+        if constexpr (std::is_arithmetic_v<V>) {
+            total += sizeof(V);
+        } else {
+            total += bytes(value);
+        }
+    }
+    return total;
+}
+
+} // namespace conversation_memory
+
+#endif //FRIENDS_TRIP_BOT_CONVERSATIONMEMORY_H
@@ -1,4 +1,5 @@
 #include "ListPaymentsConversation.h"
+#include "ConversationMemory.h"
 #include "../bot/Bot.h"
 #include "../utils/utils.h"
 #include "../utils/MoneyAmount.h"
@@ -9,77 +10,114 @@
 #include <cmath>
 #include <chrono>
 
-ListPaymentsConversation::ListPaymentsConversation(long long chat_id, long long thread_id, long long user_id, bot::Bot& bot, UserRepository& userRepo, TripRepository& tripRepo, PaymentRepository& payRepo)
-    : Conversation(chat_id, thread_id, user_id, bot), pageSize(10), currentPage(1), closed(false), active_message_id(0), userRepo_(userRepo), tripRepo_(tripRepo), payRepo_(payRepo) {
+ListPaymentsConversation::ListPaymentsConversation(long long chat_id, long long thread_id, long long user_id, bot::Bot& bot, TripSnapshotRepository& snapshotRepo)
+    : CoroutineConversation(chat_id, thread_id, user_id, bot), pageSize(10), currentPage(1), totalPages(1), listClosed(false), active_message_id(0), snapshotRepo_(snapshotRepo) {}
 
-    // Fetch active trip
-    auto activeTrip = tripRepo_.getActiveTrip(chat_id, thread_id);
-    if (activeTrip.has_value()) {
-        trip = activeTrip.value();
-    } else {
-        bot.sendMessage(chat_id, "No active trip found.");
-        closed = true;
-        return;
+ListPaymentsConversation::~ListPaymentsConversation() {
+    // Replaced by another conversation while the list was still open
+    std::lock_guard<std::mutex> lock(messageMutex_);
+    if (!listClosed && active_message_id != 0) {
+        bot_.editMessage(chat_id, active_message_id, "List closed.");
     }
+}
+
+std::optional<bot::ExpiryEdit> ListPaymentsConversation::expire() {
+    std::lock_guard<std::mutex> lock(messageMutex_);
+    if (listClosed) return std::nullopt;
+    listClosed = true;
+    if (active_message_id == 0) return std::nullopt;
+    return bot::ExpiryEdit{chat_id, active_message_id, "List expired."};
+}
 
-    // Fetch all payment groups
-    paymentGroups = payRepo_.getAllPaymentGroups(trip.trip_id);
+long long ListPaymentsConversation::openMessageId() {
+    std::lock_guard<std::mutex> lock(messageMutex_);
+    return listClosed ? 0 : active_message_id;
+}
+
+std::size_t ListPaymentsConversation::approximateBytes() const {
+    return sizeof(*this) + loadedBytes_.load();
+}
+
+bot::ConversationTask ListPaymentsConversation::run() {
+    // Fetch active trip, payment groups and users in one round trip, without holding a worker
+    auto snapshot = co_await awaitCallback<std::optional<TripSnapshot>>(
+        [this](TripSnapshotRepository::LoadedCallback done) {
+            snapshotRepo_.loadAsync(chat_id, thread_id, true, std::move(done));
+        });
+    if (!snapshot.has_value()) {
+        co_await sendMessage(chat_id, "No active trip found.");
+        co_return;
+    }
 
-    // Fetch all users
-    std::vector<User> chatUsers = userRepo_.getUsersByChatAndThread(chat_id, thread_id);
-    for (const auto& u : chatUsers) {
-        users[u.user_id] = u;
+    trip = std::move(snapshot->trip);
+    paymentGroups = std::move(snapshot->paymentGroups);
+    for (auto& u : snapshot->users) {
+        users[u.user_id] = std::move(u);
     }
 
+    loadedBytes_ = conversation_memory::bytes(trip) + conversation_memory::bytes(paymentGroups)
+                 + conversation_memory::bytes(users);
+
     // Calculate total pages
     totalPages = (paymentGroups.empty()) ? 1 : std::ceil(static_cast<double>(paymentGroups.size()) / pageSize);
 
     computeNetBalances();
-    sendCurrentPage(false);
-}
-
-ListPaymentsConversation::~ListPaymentsConversation() {
-    if (!closed && active_message_id != 0) {
-        bot_.editMessage(chat_id, active_message_id, "List closed.");
+    long long messageId = co_await sendMessage(trip.chat_id, renderCurrentPage(), pageKeyboard(), "HTML");
+    bool expired;
+    {
+        std::lock_guard<std::mutex> lock(messageMutex_);
+        active_message_id = messageId;
+        expired = listClosed;
+    }
+    // Expired while the message was on its way
+    if (expired) {
+        if (messageId != 0) co_await editMessage(chat_id, messageId, "List expired.");
+        co_return;
     }
-}
 
-void ListPaymentsConversation::handleUpdate(const bot::Update& update) {
-    if (closed) return;
+    while (true) {
+        bot::Update update = co_await nextUpdate();
 
-    if (update.message.message_id != 0 && update.message.text == "/cancel") {
-        closeConversation();
-        return;
-    }
+        if (update.message.message_id != 0 && update.message.text == "/cancel") {
+            break;
+        }
+        if (update.callback_query.id.empty()) {
+            continue;
+        }
 
-    if (!update.callback_query.id.empty()) {
-        if (update.callback_query.data == "close") {
-            bot_.answerCallbackQuery(update.callback_query.id);
-            closeConversation();
-            return;
+        co_await answerCallbackQuery(update.callback_query.id);
+        const std::string& data = update.callback_query.data;
+        if (data == "close") {
+            break;
+        }
+        if (data == "prev_page" && currentPage > 1) {
+            currentPage--;
+        } else if (data == "next_page" && currentPage < totalPages) {
+            currentPage++;
+        } else {
+            continue;
+        }
+        if (long long openId = openMessageId(); openId != 0) {
+            co_await editMessage(trip.chat_id, openId, renderCurrentPage(), pageKeyboard(), "HTML");
         }
-        handlePageChange(update);
     }
-}
 
-bool ListPaymentsConversation::isClosed() const {
-    return closed;
+    long long closingId;
+    {
+        std::lock_guard<std::mutex> lock(messageMutex_);
+        closingId = listClosed ? 0 : active_message_id;
+        listClosed = true;
+    }
+    if (closingId != 0) {
+        co_await editMessage(chat_id, closingId, "List closed.");
+    }
 }
 
 void ListPaymentsConversation::computeNetBalances() {
-    netBalances.clear();
-    for (const auto& group : paymentGroups) {
-        // Payer paid total_amount
-        netBalances[group.payer_user_id][group.total_amount.currency()] += group.total_amount.minorAmount();
-
-        // Each record recipient "received" (owes) amount
-        for (const auto& record : group.records) {
-            netBalances[record.to_user_id][record.amount.currency()] -= record.amount.minorAmount();
-        }
-    }
+    netBalances = DebtSimplifier::computeNetBalances(paymentGroups);
 }
 
-void ListPaymentsConversation::sendCurrentPage(bool editMessage) {
+std::string ListPaymentsConversation::renderCurrentPage() {
     std::stringstream ss;
     ss << "<b>Payments in " << trip.name << "</b>\n\n";
 
@@ -92,7 +130,7 @@ void ListPaymentsConversation::sendCurrentPage(bool editMessage) {
             ss << "👤 <b>" << users[userId].name << ":</b>\n";
             for (const auto& [currency, amount] : balances) {
                 std::string color = (amount >= 0) ? "🟢" : "🔴";
-                ss << "  " << color << " " << MoneyAmount(currency, amount).toHumanReadable() << "\n";
+                ss << "  " << color << " " << MoneyAmount(currency, amount) << "\n";
             }
         }
     }
@@ -110,7 +148,7 @@ void ListPaymentsConversation::sendCurrentPage(bool editMessage) {
             const auto& group = paymentGroups[i];
 
             ss << "📂 " << paymentGroups.size() - i << ". <b>" << group.name << "</b> (" << utils::formatTimestamp(group.gmt_created, 8) << ")\n";
-            ss << "<b>" << group.total_amount.toHumanReadable() << "</b> paid by <b>" << users[group.payer_user_id].name << "</b>\n";
+            ss << "<b>" << group.total_amount << "</b> paid by <b>" << users[group.payer_user_id].name << "</b>\n";
 
             // Group records by minor amount
             std::map<long long, std::vector<const PaymentRecord*>> amountGroups;
@@ -123,12 +161,16 @@ void ListPaymentsConversation::sendCurrentPage(bool editMessage) {
                     if (j > 0) ss << ", ";
                     ss << users[records[j]->to_user_id].name;
                 }
-                ss << " received " << records[0]->amount.toHumanReadable() << "\n";
+                ss << " received " << records[0]->amount << "\n";
             }
             ss << "\n";
         }
     }
 
+    return ss.str();
+}
+
+bot::InlineKeyboardMarkup ListPaymentsConversation::pageKeyboard() const {
     bot::InlineKeyboardMarkup keyboard;
     std::vector<bot::InlineKeyboardButton> row;
 
@@ -142,31 +184,5 @@ void ListPaymentsConversation::sendCurrentPage(bool editMessage) {
         keyboard.inline_keyboard.push_back(row);
     }
     keyboard.inline_keyboard.push_back({{"Close", "close"}});
-
-    if (editMessage && active_message_id != 0) {
-        bot_.editMessage(trip.chat_id, active_message_id, ss.str(), &keyboard, "HTML");
-    } else {
-        active_message_id = bot_.sendMessage(trip.chat_id, ss.str(), &keyboard, "HTML");
-    }
-}
-
-void ListPaymentsConversation::handlePageChange(const bot::Update& update) {
-    bot_.answerCallbackQuery(update.callback_query.id);
-
-    std::string data = update.callback_query.data;
-    if (data == "prev_page" && currentPage > 1) {
-        currentPage--;
-        sendCurrentPage(true);
-    } else if (data == "next_page" && currentPage < totalPages) {
-        currentPage++;
-        sendCurrentPage(true);
-    }
-}
-
-
-void ListPaymentsConversation::closeConversation() {
-    if (active_message_id != 0) {
-        bot_.editMessage(chat_id, active_message_id, "List closed.");
-    }
-    closed = true;
+    return keyboard;
 }
@@ -1,41 +1,52 @@
 #ifndef FRIENDS_TRIP_BOT_LISTPAYMENTSCONVERSATION_H
 #define FRIENDS_TRIP_BOT_LISTPAYMENTSCONVERSATION_H
 
-#include "../bot/Conversation.h"
-#include "../repository/PaymentRepository.h"
-#include "../repository/TripRepository.h"
-#include "../repository/UserRepository.h"
+#include "../algorithm/DebtSimplifier.h"
+#include "../bot/CoroutineConversation.h"
+#include "../repository/TripSnapshotRepository.h"
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
-class ListPaymentsConversation : public bot::Conversation {
+class ListPaymentsConversation : public bot::CoroutineConversation {
 public:
-    ListPaymentsConversation(long long chat_id, long long thread_id, long long user_id, bot::Bot& bot, UserRepository& userRepo, TripRepository& tripRepo, PaymentRepository& payRepo);
+    ListPaymentsConversation(long long chat_id, long long thread_id, long long user_id, bot::Bot& bot, TripSnapshotRepository& snapshotRepo);
     ~ListPaymentsConversation() override;
 
-    void handleUpdate(const bot::Update& update) override;
-    bool isClosed() const override;
+    std::optional<bot::ExpiryEdit> expire() override;
+    std::size_t approximateBytes() const override;
+
+protected:
+    bot::ConversationTask run() override;
 
 private:
     void computeNetBalances();
-    void sendCurrentPage(bool editMessage = false);
-    void handlePageChange(const bot::Update& update);
-    void closeConversation();
+    std::string renderCurrentPage();
+    bot::InlineKeyboardMarkup pageKeyboard() const;
+    // The list message while it is open, else 0
+    long long openMessageId();
 
     int pageSize;
     int currentPage;
     int totalPages;
-    bool closed;
+
+    // Written by the coroutine, which runs after outbound calls without the bot's
+    // conversation lock, and read by expire(): guarded by messageMutex_
+    std::mutex messageMutex_;
+    bool listClosed;
     long long active_message_id;
 
     Trip trip;
     std::vector<PaymentGroup> paymentGroups;
     std::unordered_map<long long, User> users;
-    std::unordered_map<long long, std::unordered_map<std::string, long long>> netBalances;
+    CurrencyBalances netBalances;
+    // Set once the snapshot is loaded; read by the gauge while the coroutine may be running
+    std::atomic<std::size_t> loadedBytes_{0};
 
-    UserRepository& userRepo_;
-    TripRepository& tripRepo_;
-    PaymentRepository& payRepo_;
+    TripSnapshotRepository& snapshotRepo_;
 };
 
-#endif //FRIENDS_TRIP_BOT_LISTPAYMENTSCONVERSATION_H
\ No newline at end of file
+#endif //FRIENDS_TRIP_BOT_LISTPAYMENTSCONVERSATION_H
@@ -1,15 +1,13 @@
 #include "RecordPaymentConversation.h"
+#include "ConversationMemory.h"
 #include "../bot/Bot.h"
 #include "../utils/MoneyAmount.h"
 #include <sstream>
 #include <random>
 #include <algorithm>
 #include <spdlog/spdlog.h>
-#include <nlohmann/json.hpp>
 #include <cctype>
 
-using json = nlohmann::json;
-
 RecordPaymentConversation::RecordPaymentConversation(long long chat_id, long long thread_id, long long user_id, bot::Bot& bot, UserRepository& userRepo, TripRepository& tripRepo, PaymentRepository& payRepo)
     : Conversation(chat_id, thread_id, user_id, bot),
       current_recipient_id(0), currentState_(State::Description), closed(false), userRepo_(userRepo), tripRepo_(tripRepo), payRepo_(payRepo) {
@@ -85,22 +83,32 @@ bool RecordPaymentConversation::isClosed() const {
     return closed;
 }
 
-std::string RecordPaymentConversation::createCallbackData(State targetState, const std::string& data) {
-    json j;
-    j["targetStep"] = static_cast<int>(targetState);
-    j["data"] = data;
-    return j.dump();
+std::optional<bot::ExpiryEdit> RecordPaymentConversation::expire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed) return std::nullopt;
+    closed = true;
+    if (active_message_id == 0) return std::nullopt;
+    return bot::ExpiryEdit{chat_id, active_message_id, "Record expired."};
 }
 
-bool RecordPaymentConversation::parseCallbackData(const std::string& jsonStr, State& targetState, std::string& data) {
-    try {
-        auto j = json::parse(jsonStr);
-        targetState = static_cast<State>(j["targetStep"].get<int>());
-        data = j["data"].get<std::string>();
-        return true;
-    } catch (...) {
-        return false;
-    }
+std::size_t RecordPaymentConversation::approximateBytes() const {
+    return sizeof(*this) + conversation_memory::bytes(users) + conversation_memory::bytes(trip)
+         + conversation_memory::bytes(allocatedAmounts) + conversation_memory::bytes(pendingCurrency_)
+         + conversation_memory::bytes(paymentGroup);
+}
+
+std::string RecordPaymentConversation::createCallbackData(State targetState, std::string_view token) {
+    return bot::CallbackData::token(static_cast<uint8_t>(targetState), token).encode();
+}
+
+std::string RecordPaymentConversation::createCallbackData(State targetState, long long id) {
+    return bot::CallbackData::id(static_cast<uint8_t>(targetState), id).encode();
+}
+
+std::optional<bot::CallbackData> RecordPaymentConversation::parseCallbackData(const bot::Update& update) const {
+    auto callback = bot::CallbackData::decode(update.callback_query.data);
+    if (!callback || callback->step() != static_cast<uint8_t>(currentState_)) return std::nullopt;
+    return callback;
 }
 
 static std::string validateDescription(const std::string& name) {
@@ -161,11 +169,11 @@ void RecordPaymentConversation::handleCurrency(const bot::Update& update) {
     if (update.callback_query.id.empty()) return;
     bot_.answerCallbackQuery(update.callback_query.id);
 
-    State targetState;
-    std::string data;
-    if (!parseCallbackData(update.callback_query.data, targetState, data) || targetState != currentState_) return;
+    auto callback = parseCallbackData(update);
+    if (!callback) return;
+    std::string_view data = callback->token();
 
-    pendingCurrency_ = data;
+    pendingCurrency_ = std::string(data);
 
     // Update original message
     std::stringstream editedMsg;
@@ -180,18 +188,16 @@ void RecordPaymentConversation::handleCurrency(const bot::Update& update) {
 void RecordPaymentConversation::handleAmount(const bot::Update& update) {
     if (update.message.message_id == 0) return;
 
-    auto result = MoneyAmount::parseAndValidateAmount(update.message.text, AmountValidation::Positive);
+    auto result = MoneyAmount::parseAndValidateAmount(update.message.text, pendingCurrency_, AmountValidation::Positive);
     if (!result.success) {
-        bot_.editMessage(chat_id, active_message_id, result.error);
+        bot_.editMessage(chat_id, active_message_id, std::string(result.error));
         return;
     }
-    pendingRawAmount_ = result.amount;
-
-    paymentGroup.total_amount = MoneyAmount::fromMajorUnits(pendingCurrency_, pendingRawAmount_);
+    paymentGroup.total_amount = result.amount;
 
     // Update original message
     std::stringstream editedMsg;
-    editedMsg << "✅ Amount: " << paymentGroup.total_amount.toHumanReadable();
+    editedMsg << "✅ Amount: " << paymentGroup.total_amount;
     bot_.editMessage(chat_id, active_message_id, editedMsg.str());
 
     // Ask for Payer (paginated if >10 users)
@@ -218,7 +224,7 @@ void RecordPaymentConversation::appendPaginatedUserButtons(
     for (int i = start; i < end; ++i) {
         const auto& [uid, user] = userList[i];
         keyboard.inline_keyboard.push_back(
-            {{buttonTextFn(uid, user), createCallbackData(targetState, std::to_string(uid))}});
+            {{buttonTextFn(uid, user), createCallbackData(targetState, uid)}});
     }
 
     if (totalPages > 1) {
@@ -251,20 +257,17 @@ void RecordPaymentConversation::handlePayer(const bot::Update& update) {
     if (update.callback_query.id.empty()) return;
     bot_.answerCallbackQuery(update.callback_query.id);
 
-    State targetState;
-    std::string data;
-    if (!parseCallbackData(update.callback_query.data, targetState, data) || targetState != currentState_) return;
+    auto callback = parseCallbackData(update);
+    if (!callback) return;
+    std::string_view data = callback->token();
 
     // Handle pagination
     if (data == "page_next") { ++page_; sendPayerSelection(true); return; }
     if (data == "page_prev") { --page_; sendPayerSelection(true); return; }
     if (data == "noop") return;
 
-    try {
-        paymentGroup.payer_user_id = std::stoll(data);
-    } catch (...) {
-        return;
-    }
+    if (!callback->isId()) return;
+    paymentGroup.payer_user_id = callback->id();
 
     // Update original message
     std::stringstream editedMsg;
@@ -285,9 +288,9 @@ void RecordPaymentConversation::handleRecipient(const bot::Update& update) {
     if (update.callback_query.id.empty()) return;
     bot_.answerCallbackQuery(update.callback_query.id);
 
-    State targetState;
-    std::string data;
-    if (!parseCallbackData(update.callback_query.data, targetState, data) || targetState != currentState_) return;
+    auto callback = parseCallbackData(update);
+    if (!callback) return;
+    std::string_view data = callback->token();
 
     page_ = 0;
     if (data == "split_manually") {
@@ -329,22 +332,17 @@ void RecordPaymentConversation::handleSingleRecipient(const bot::Update& update)
     if (update.callback_query.id.empty()) return;
     bot_.answerCallbackQuery(update.callback_query.id);
 
-    State targetState;
-    std::string data;
-    if (!parseCallbackData(update.callback_query.data, targetState, data) || targetState != currentState_) return;
+    auto callback = parseCallbackData(update);
+    if (!callback) return;
+    std::string_view data = callback->token();
 
     // Handle pagination
     if (data == "page_next") { ++page_; sendSingleRecipients(true); return; }
     if (data == "page_prev") { --page_; sendSingleRecipients(true); return; }
     if (data == "noop") return;
 
-    long long recipientId;
-    try {
-        recipientId = std::stoll(data);
-    } catch (...) {
-        return;
-    }
-    allocatedAmounts[recipientId] = paymentGroup.total_amount.minorAmount();
+    if (!callback->isId()) return;
+    allocatedAmounts[callback->id()] = paymentGroup.total_amount.minorAmount();
     completeConversation();
 }
 
@@ -400,7 +398,7 @@ void RecordPaymentConversation::sendEqualSplitRecipients(bool editMessage) {
                 if (j > 0) ss << ", ";
                 ss << extraNames[j];
             }
-            ss << (extraNames.size() == 1 ? " gets " : " get ") << extraAmount.toHumanReadable();
+            ss << (extraNames.size() == 1 ? " gets " : " get ") << extraAmount;
 
             if (!baseNames.empty()) {
                 ss << "\n";
@@ -408,11 +406,11 @@ void RecordPaymentConversation::sendEqualSplitRecipients(bool editMessage) {
                     if (j > 0) ss << ", ";
                     ss << baseNames[j];
                 }
-                ss << (baseNames.size() == 1 ? " gets " : " get ") << baseAmount.toHumanReadable();
+                ss << (baseNames.size() == 1 ? " gets " : " get ") << baseAmount;
             }
         } else {
             MoneyAmount baseAmount(currency, base);
-            ss << " (" << baseAmount.toHumanReadable() << " each)";
+            ss << " (" << baseAmount << " each)";
         }
         text = ss.str();
     } else {
@@ -444,9 +442,9 @@ void RecordPaymentConversation::handleEqualSplitRecipients(const bot::Update& up
     if (update.callback_query.id.empty()) return;
     bot_.answerCallbackQuery(update.callback_query.id);
 
-    State targetState;
-    std::string data;
-    if (!parseCallbackData(update.callback_query.data, targetState, data) || targetState != currentState_) return;
+    auto callback = parseCallbackData(update);
+    if (!callback) return;
+    std::string_view data = callback->token();
 
     // Handle pagination
     if (data == "page_next") { ++page_; sendEqualSplitRecipients(true); return; }
@@ -474,12 +472,8 @@ void RecordPaymentConversation::handleEqualSplitRecipients(const bot::Update& up
     } else if (data == "unselect_all") {
         allocatedAmounts.clear();
     } else {
-        long long recipientId;
-        try {
-            recipientId = std::stoll(data);
-        } catch (...) {
-            return;
-        }
+        if (!callback->isId()) return;
+        long long recipientId = callback->id();
         if (allocatedAmounts.find(recipientId) != allocatedAmounts.end()) {
             allocatedAmounts.erase(recipientId);
         } else {
@@ -501,8 +495,8 @@ void RecordPaymentConversation::sendManualRecipients(bool editMessage) {
     MoneyAmount remaining(currency, paymentGroup.total_amount.minorAmount() - currentAllocated);
 
     std::stringstream ss;
-    ss << "Allocated " << allocated.toHumanReadable() << "/" << paymentGroup.total_amount.toHumanReadable()
-       << " (" << remaining.toHumanReadable() << " remaining)";
+    ss << "Allocated " << allocated << "/" << paymentGroup.total_amount
+       << " (" << remaining << " remaining)";
     std::string text = ss.str();
 
     bot::InlineKeyboardMarkup keyboard;
@@ -513,7 +507,7 @@ void RecordPaymentConversation::sendManualRecipients(bool editMessage) {
     appendPaginatedUserButtons(keyboard, State::ManualRecipient,
         [this, &currency](long long uid, const User& user) {
             std::stringstream btnText;
-            btnText << user.name << " (" << MoneyAmount(currency, allocatedAmounts[uid]).toHumanReadable() << ")";
+            btnText << user.name << " (" << MoneyAmount(currency, allocatedAmounts[uid]) << ")";
             return btnText.str();
         });
 
@@ -528,9 +522,9 @@ void RecordPaymentConversation::handleManualRecipient(const bot::Update& update)
     if (update.callback_query.id.empty()) return;
     bot_.answerCallbackQuery(update.callback_query.id);
 
-    State targetState;
-    std::string data;
-    if (!parseCallbackData(update.callback_query.data, targetState, data) || targetState != currentState_) return;
+    auto callback = parseCallbackData(update);
+    if (!callback) return;
+    std::string_view data = callback->token();
 
     // Handle pagination
     if (data == "page_next") { ++page_; sendManualRecipients(true); return; }
@@ -554,11 +548,8 @@ void RecordPaymentConversation::handleManualRecipient(const bot::Update& update)
         return;
     }
 
-    try {
-        current_recipient_id = std::stoll(data);
-    } catch (...) {
-        // Handle error
-    }
+    if (!callback->isId()) return;
+    current_recipient_id = callback->id();
     currentState_ = State::ManualAmount;
     bot_.editMessage(chat_id, active_message_id, "Enter amount for " + users[current_recipient_id].name + " (e.g. 123 or 123.00):");
 }
@@ -566,13 +557,13 @@ void RecordPaymentConversation::handleManualRecipient(const bot::Update& update)
 void RecordPaymentConversation::handleManualAmount(const bot::Update& update) {
     if (update.message.message_id == 0) return;
 
-    auto result = MoneyAmount::parseAndValidateAmount(update.message.text, AmountValidation::NonNegative);
+    auto result = MoneyAmount::parseAndValidateAmount(update.message.text, paymentGroup.total_amount.currencyView(),
+                                                      AmountValidation::NonNegative);
     if (!result.success) {
-        bot_.editMessage(chat_id, active_message_id, result.error);
+        bot_.editMessage(chat_id, active_message_id, std::string(result.error));
         return;
     }
-    long long minorAmount = MoneyAmount::fromMajorUnits(paymentGroup.total_amount.currency(), result.amount).minorAmount();
-    allocatedAmounts[current_recipient_id] = minorAmount;
+    allocatedAmounts[current_recipient_id] = result.amount.minorAmount();
 
     currentState_ = State::ManualRecipient;
     sendManualRecipients(true);
@@ -598,14 +589,14 @@ void RecordPaymentConversation::completeConversation() {
     std::stringstream overviewMsg;
     overviewMsg << "<b>👍 Payment recorded!</b>\n";
     overviewMsg << "<b>Name:</b> " << paymentGroup.name << "\n";
-    overviewMsg << "<b>Amount:</b> " << paymentGroup.total_amount.toHumanReadable() << "\n";
+    overviewMsg << "<b>Amount:</b> " << paymentGroup.total_amount << "\n";
     overviewMsg << "<b>Payer:</b> " << users[paymentGroup.payer_user_id].name << "\n";
     overviewMsg << "<b>Recipients:</b>\n";
 
     for (const auto& [uid, amount] : allocatedAmounts) {
         if (amount > 0) {
             overviewMsg << "- " << users[uid].name << " ("
-                        << MoneyAmount(currency, amount).toHumanReadable() << ")\n";
+                        << MoneyAmount(currency, amount) << ")\n";
         }
     }
 
@@ -1,12 +1,15 @@
 #ifndef FRIENDS_TRIP_BOT_RECORDPAYMENTCONVERSATION_H
 #define FRIENDS_TRIP_BOT_RECORDPAYMENTCONVERSATION_H
 
+#include "../bot/CallbackData.h"
 #include "../bot/Conversation.h"
 #include "../repository/PaymentRepository.h"
 #include "../repository/TripRepository.h"
 #include "../repository/UserRepository.h"
 #include <unordered_map>
 #include <functional>
+#include <optional>
+#include <string_view>
 #include <string>
 
 class RecordPaymentConversation : public bot::Conversation {
@@ -16,6 +19,8 @@ public:
 
     void handleUpdate(const bot::Update& update) override;
     bool isClosed() const override;
+    std::optional<bot::ExpiryEdit> expire() override;
+    std::size_t approximateBytes() const override;
 
 private:
     enum class State {
@@ -51,8 +56,10 @@ private:
     void cancelConversation();
     void distributeEqually();
 
-    std::string createCallbackData(State targetState, const std::string& data);
-    bool parseCallbackData(const std::string& jsonStr, State& targetState, std::string& data);
+    static std::string createCallbackData(State targetState, std::string_view token);
+    static std::string createCallbackData(State targetState, long long id);
+    // std::nullopt unless the pressed button was rendered for the current step
+    std::optional<bot::CallbackData> parseCallbackData(const bot::Update& update) const;
 
     std::mutex mutex_;
 
@@ -65,7 +72,6 @@ private:
 
     // Allocated amounts stored as minor units (same currency as paymentGroup.total_amount)
     std::unordered_map<long long, long long> allocatedAmounts;
-    double pendingRawAmount_ = 0.0;
     std::string pendingCurrency_;
     int page_ = 0;
     long long current_recipient_id;
@@ -1,9 +1,15 @@
 #include "SimplifyPaymentsConversation.h"
+#include "../logging/Logging.h"
+#include "ConversationMemory.h"
+#include "../metrics/Metrics.h"
 #include "../algorithm/GreedyDebtSimplifier.h"
 #include "../algorithm/MinTransactionsSimplifier.h"
+#include "../algorithm/SettlementEngine.h"
 #include "../bot/Bot.h"
 #include "../service/PaymentService.h"
+#include "../repository/TripSnapshotRepository.h"
 #include <memory>
+#include <optional>
 #include <sstream>
 #include <iomanip>
 #include <cmath>
@@ -11,15 +17,18 @@
 #include <set>
 #include <map>
 #include <chrono>
-#include <spdlog/spdlog.h>
+
+// Callback data of the option that skips the target currency and exchange-rate prompts
+static const std::string PER_CURRENCY = "PER_CURRENCY";
 
 SimplifyPaymentsConversation::SimplifyPaymentsConversation(long long chat_id, long long thread_id, long long user_id,
     bot::Bot& bot, UserRepository& userRepo, TripRepository& tripRepo, PaymentRepository& payRepo,
-    PaymentService& paymentService)
+    TripSnapshotRepository& snapshotRepo, PaymentService& paymentService, SettlementEngine& settlementEngine)
     : Conversation(chat_id, thread_id, user_id, bot),
       currentState_(State::SelectingCurrency), closed_(false), active_message_id_(0),
-      userRepo_(userRepo), tripRepo_(tripRepo), payRepo_(payRepo), paymentService_(paymentService),
-      currentForeignCurrencyIndex_(0) {
+      settlementLoaded_(false), participantCount_(0),
+      userRepo_(userRepo), tripRepo_(tripRepo), payRepo_(payRepo), snapshotRepo_(snapshotRepo),
+      paymentService_(paymentService), settlementEngine_(settlementEngine), currentForeignCurrencyIndex_(0) {
 
     auto activeTrip = tripRepo_.getActiveTrip(chat_id, thread_id);
     if (activeTrip.has_value()) {
@@ -30,14 +39,56 @@ SimplifyPaymentsConversation::SimplifyPaymentsConversation(long long chat_id, lo
         return;
     }
 
-    paymentGroups_ = payRepo_.getAllPaymentGroups(trip_.trip_id);
-    if (paymentGroups_.empty()) {
+    // Payment history is only read when the engine has no state for this trip yet,
+    // and then comes with the roster in a single query
+    std::vector<User> chatUsers;
+    bool rosterLoaded = false;
+    if (!settlementEngine_.isLoaded(trip_.trip_id)) {
+        uint64_t epoch = settlementEngine_.beginLoad(trip_.trip_id);
+        auto snapshot = snapshotRepo_.load(chat_id, thread_id);
+        if (!snapshot.has_value()) {
+            bot_.sendMessage(chat_id, "No active trip found.");
+            closed_ = true;
+            return;
+        }
+        // The active trip may have been switched between the two reads; then the
+        // snapshot's trip is used as is, without installing it in the engine
+        bool sameTrip = snapshot->trip.trip_id == trip_.trip_id;
+        trip_ = std::move(snapshot->trip);
+        paymentGroups_ = std::move(snapshot->paymentGroups);
+        chatUsers = std::move(snapshot->users);
+        rosterLoaded = true;
+        if (sameTrip && settlementEngine_.load(trip_.trip_id, paymentGroups_, epoch)) {
+            paymentGroups_.clear();
+        }
+    }
+
+    size_t paymentGroupCount = 0;
+    if (auto summary = settlementEngine_.summary(trip_.trip_id)) {
+        settlementLoaded_ = true;
+        paymentGroupCount = summary->paymentGroupCount;
+        participantCount_ = summary->participantCount;
+    } else {
+        std::set<long long> participants;
+        for (const auto& group : paymentGroups_) {
+            for (const auto& record : group.records) {
+                participants.insert(record.from_user_id);
+                participants.insert(record.to_user_id);
+            }
+        }
+        paymentGroupCount = paymentGroups_.size();
+        participantCount_ = participants.size();
+    }
+
+    if (paymentGroupCount == 0) {
         bot_.sendMessage(chat_id, "No payments recorded yet.");
         closed_ = true;
         return;
     }
 
-    std::vector<User> chatUsers = userRepo_.getUsersByChatAndThread(chat_id, thread_id);
+    if (!rosterLoaded) {
+        chatUsers = userRepo_.getUsersByChatAndThread(chat_id, thread_id);
+    }
     for (const auto& u : chatUsers) {
         users_[u.user_id] = u;
     }
@@ -78,6 +129,22 @@ bool SimplifyPaymentsConversation::isClosed() const {
     return closed_;
 }
 
+std::optional<bot::ExpiryEdit> SimplifyPaymentsConversation::expire() {
+    if (closed_) return std::nullopt;
+    std::optional<bot::ExpiryEdit> edit;
+    if (active_message_id_ != 0) {
+        edit = bot::ExpiryEdit{chat_id, active_message_id_, "Simplify expired."};
+    }
+    closeConversation();
+    return edit;
+}
+
+std::size_t SimplifyPaymentsConversation::approximateBytes() const {
+    return sizeof(*this) + conversation_memory::bytes(trip_) + conversation_memory::bytes(paymentGroups_)
+         + conversation_memory::bytes(users_) + conversation_memory::bytes(targetCurrency_)
+         + conversation_memory::bytes(foreignCurrencies_) + conversation_memory::bytes(exchangeRates_);
+}
+
 void SimplifyPaymentsConversation::sendCurrencySelection(bool edit) {
     bot::InlineKeyboardMarkup keyboard;
     std::vector<std::string> currencies = {
@@ -95,6 +162,7 @@ void SimplifyPaymentsConversation::sendCurrencySelection(bool edit) {
         }
     }
     if (!row.empty()) keyboard.inline_keyboard.push_back(row);
+    keyboard.inline_keyboard.push_back({{"🌐 Settle each currency separately", PER_CURRENCY}});
 
     if (edit && active_message_id_ != 0) {
         bot_.editMessage(chat_id, active_message_id_, "Select the settlement currency:", &keyboard);
@@ -105,14 +173,28 @@ void SimplifyPaymentsConversation::sendCurrencySelection(bool edit) {
 
 void SimplifyPaymentsConversation::handleCurrencySelection(const bot::Update& update) {
     bot_.answerCallbackQuery(update.callback_query.id);
+    if (update.callback_query.data == PER_CURRENCY) {
+        bot_.editMessage(chat_id, active_message_id_, "✅ Settling each currency separately");
+        computeAndDisplayPerCurrencyResults();
+        return;
+    }
+
     targetCurrency_ = update.callback_query.data;
     exchangeRates_[targetCurrency_] = 1.0;
 
     // Collect distinct foreign currencies from all payment groups
     std::set<std::string> seen;
-    for (const auto& group : paymentGroups_) {
-        if (group.total_amount.currency() != targetCurrency_) {
-            seen.insert(group.total_amount.currency());
+    if (auto summary = settlementEngine_.summary(trip_.trip_id); settlementLoaded_ && summary) {
+        for (const auto& currency : summary->currencies) {
+            if (currency != targetCurrency_) {
+                seen.insert(currency);
+            }
+        }
+    } else {
+        for (const auto& group : paymentGroups_) {
+            if (group.total_amount.currency() != targetCurrency_) {
+                seen.insert(group.total_amount.currency());
+            }
         }
     }
     foreignCurrencies_.assign(seen.begin(), seen.end());
@@ -176,32 +258,97 @@ void SimplifyPaymentsConversation::handleExchangeRateInput(const bot::Update& up
     }
 }
 
-void SimplifyPaymentsConversation::computeAndDisplayResults() {
-    std::set<long long> participants;
+bool SimplifyPaymentsConversation::promptForNewCurrencies() {
+    std::set<std::string> present;
+    if (auto summary = settlementEngine_.summary(trip_.trip_id); settlementLoaded_ && summary) {
+        present.insert(summary->currencies.begin(), summary->currencies.end());
+    }
     for (const auto& group : paymentGroups_) {
         for (const auto& record : group.records) {
-            participants.insert(record.from_user_id);
-            participants.insert(record.to_user_id);
+            present.insert(record.amount.currency());
         }
     }
 
+    std::size_t firstNew = foreignCurrencies_.size();
+    for (const auto& currency : present) {
+        if (exchangeRates_.find(currency) == exchangeRates_.end()) {
+            foreignCurrencies_.push_back(currency);
+        }
+    }
+    if (foreignCurrencies_.size() == firstNew) return false;
+
+    bot_.sendMessage(chat_id, "A payment in " + foreignCurrencies_[firstNew] + " was recorded meanwhile.");
+    currentForeignCurrencyIndex_ = firstNew;
+    currentState_ = State::CollectingExchangeRate;
+    sendExchangeRatePrompt(false);
+    return true;
+}
+
+void SimplifyPaymentsConversation::computeAndDisplayResults() {
     static constexpr size_t MIN_TRANSACTIONS_THRESHOLD = 0;
     std::unique_ptr<DebtSimplifier> simplifier;
-    if (participants.size() <= MIN_TRANSACTIONS_THRESHOLD) {
+    if (participantCount_ <= MIN_TRANSACTIONS_THRESHOLD) {
         simplifier = std::make_unique<MinTransactionsSimplifier>();
     } else {
         simplifier = std::make_unique<GreedyDebtSimplifier>();
     }
 
     auto start = std::chrono::steady_clock::now();
-    auto simplifiedPayments = simplifier->simplifyDebts(paymentGroups_, exchangeRates_, targetCurrency_);
+    std::optional<std::vector<SimplifiedPayment>> fromEngine;
+    if (settlementLoaded_) {
+        fromEngine = settlementEngine_.simplify(trip_.trip_id, *simplifier, exchangeRates_, targetCurrency_);
+    }
+    if (!fromEngine && paymentGroups_.empty()) {
+        // Evicted between the summary and now; fall back to a full read
+        paymentGroups_ = payRepo_.getAllPaymentGroups(trip_.trip_id);
+    }
+    // A payment in another currency may have been recorded since the rates were asked for
+    if (!fromEngine && promptForNewCurrencies()) {
+        return;
+    }
+    auto simplifiedPayments = fromEngine
+        ? std::move(*fromEngine)
+        : simplifier->simplifyDebts(paymentGroups_, exchangeRates_, targetCurrency_);
     auto elapsed = std::chrono::steady_clock::now() - start;
-    spdlog::info("simplifyDebts took {}ms for {} paymentGroups",
+    static metrics::Histogram& simplifyLatency = metrics::registry().histogram(
+        "simplify_duration_seconds", "Debt simplification time", {{"mode", "target_currency"}});
+    simplifyLatency.observe(elapsed);
+    logging::bot().debug("simplifyDebts took {}ms for {} participants (incremental={})",
                  std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(),
-                 paymentGroups_.size());
+                 participantCount_, fromEngine.has_value());
 
+    displayResults(simplifiedPayments, targetCurrency_);
+}
+
+void SimplifyPaymentsConversation::computeAndDisplayPerCurrencyResults() {
+    GreedyDebtSimplifier simplifier;
+
+    auto start = std::chrono::steady_clock::now();
+    std::optional<std::vector<SimplifiedPayment>> fromEngine;
+    if (settlementLoaded_) {
+        fromEngine = settlementEngine_.simplifyPerCurrency(trip_.trip_id, simplifier);
+    }
+    if (!fromEngine && paymentGroups_.empty()) {
+        paymentGroups_ = payRepo_.getAllPaymentGroups(trip_.trip_id);
+    }
+    auto simplifiedPayments = fromEngine
+        ? std::move(*fromEngine)
+        : simplifier.simplifyDebtsPerCurrency(DebtSimplifier::computeNetBalances(paymentGroups_));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    static metrics::Histogram& simplifyLatency = metrics::registry().histogram(
+        "simplify_duration_seconds", "Debt simplification time", {{"mode", "per_currency"}});
+    simplifyLatency.observe(elapsed);
+    logging::bot().debug("simplifyDebtsPerCurrency took {}ms for {} participants",
+                 std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(),
+                 participantCount_);
+
+    displayResults(simplifiedPayments, "per currency");
+}
+
+void SimplifyPaymentsConversation::displayResults(const std::vector<SimplifiedPayment>& simplifiedPayments,
+                                                  const std::string& settlementLabel) {
     std::stringstream ss;
-    ss << "💰 <b>Simplified Payments (" << targetCurrency_ << ")</b>\n";
+    ss << "💰 <b>Simplified Payments (" << settlementLabel << ")</b>\n";
     ss << "🧳 <b>Trip: " << trip_.name << "</b>\n\n";
 
     if (simplifiedPayments.empty()) {
@@ -210,7 +357,7 @@ void SimplifyPaymentsConversation::computeAndDisplayResults() {
         for (const auto& payment : simplifiedPayments) {
             ss << "➡️ <b>" << users_[payment.from_user_id].name << "</b> pays "
                << "<b>" << users_[payment.to_user_id].name << "</b>: "
-               << "<b>" << payment.amount.toHumanReadable() << "</b>\n";
+               << "<b>" << payment.amount << "</b>\n";
         }
         ss << "\n✅ <b>" << simplifiedPayments.size() << "</b> transaction"
            << (simplifiedPayments.size() > 1 ? "s" : "") << " to settle all debts"
@@ -225,40 +372,21 @@ void SimplifyPaymentsConversation::computeAndDisplayResults() {
             std::stringstream dm;
             dm << "💰 <b>Trip: " << trip_.name << "</b>\n"
                << "➡️ Pay <b>" << users_[payment.to_user_id].name << "</b>: "
-               << "<b>" << payment.amount.toHumanReadable() << "</b>";
-
-            // Build PaymentGroup with pre-stored parameters
-            PaymentGroup paymentGroup;
-            paymentGroup.payment_group_id = 0;
-            paymentGroup.trip_id = trip_.trip_id;
-            paymentGroup.name = "Simplified Repayment";
-            paymentGroup.total_amount = payment.amount;
-            paymentGroup.payer_user_id = payment.from_user_id;
-            paymentGroup.gmt_created = {};
-
-            PaymentRecord record;
-            record.payment_record_id = 0;
-            record.payment_group_id = 0;
-            record.trip_id = trip_.trip_id;
-            record.amount = payment.amount;
-            record.from_user_id = payment.from_user_id;
-            record.to_user_id = payment.to_user_id;
-            record.gmt_created = {};
-            paymentGroup.records.push_back(record);
-
-            std::string fromName = users_[payment.from_user_id].name;
-            std::string toName = users_[payment.to_user_id].name;
-
-            std::string key = bot_.storeCallback(
-                [&paymentService = paymentService_, paymentGroup, fromName, toName, groupChatId = chat_id]() {
-                    paymentService.logSimplifiedPayment(paymentGroup, fromName, toName, groupChatId);
-                });
+               << "<b>" << payment.amount << "</b>";
+
+            // Stored durably, so the button keeps working across restarts
+            std::string key = paymentService_.offerSimplifiedPayment(LogSimplifiedPayment{
+                trip_.trip_id, chat_id, thread_id, payment.from_user_id, payment.to_user_id, payment.amount});
+            if (key.empty()) {
+                bot_.sendMessage(payment.from_user_id, dm.str(), nullptr, "HTML");
+                continue;
+            }
 
             bot::InlineKeyboardMarkup keyboard;
             keyboard.inline_keyboard.push_back(
                 {{"\xe2\x9c\x85 Log Payment", key}});
 
-            bot_.sendMessage(payment.from_user_id, dm.str(), &keyboard, "HTML", "lp");
+            bot_.sendMessage(payment.from_user_id, dm.str(), &keyboard, "HTML", "ls");
         }
     }
 
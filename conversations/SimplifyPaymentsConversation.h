@@ -11,16 +11,20 @@
 #include <string>
 
 class PaymentService;
+class SettlementEngine;
+class TripSnapshotRepository;
 
 class SimplifyPaymentsConversation : public bot::Conversation {
 public:
     SimplifyPaymentsConversation(long long chat_id, long long thread_id, long long user_id,
         bot::Bot& bot, UserRepository& userRepo, TripRepository& tripRepo, PaymentRepository& payRepo,
-        PaymentService& paymentService);
+        TripSnapshotRepository& snapshotRepo, PaymentService& paymentService, SettlementEngine& settlementEngine);
     ~SimplifyPaymentsConversation() override;
 
     void handleUpdate(const bot::Update& update) override;
     bool isClosed() const override;
+    std::optional<bot::ExpiryEdit> expire() override;
+    std::size_t approximateBytes() const override;
 
 private:
     enum class State {
@@ -32,7 +36,13 @@ private:
     void handleCurrencySelection(const bot::Update& update);
     void sendExchangeRatePrompt(bool edit);
     void handleExchangeRateInput(const bot::Update& update);
+    // Asks for the rate of any currency recorded since the rates were collected;
+    // false if every currency already has one
+    bool promptForNewCurrencies();
     void computeAndDisplayResults();
+    void computeAndDisplayPerCurrencyResults();
+    void displayResults(const std::vector<SimplifiedPayment>& simplifiedPayments,
+                        const std::string& settlementLabel);
     void closeConversation();
 
     State currentState_;
@@ -40,13 +50,18 @@ private:
     long long active_message_id_;
 
     Trip trip_;
+    // Only populated when the trip's settlement state could not be installed in the engine
     std::vector<PaymentGroup> paymentGroups_;
+    bool settlementLoaded_;
+    size_t participantCount_;
     std::unordered_map<long long, User> users_;
 
     UserRepository& userRepo_;
     TripRepository& tripRepo_;
     PaymentRepository& payRepo_;
+    TripSnapshotRepository& snapshotRepo_;
     PaymentService& paymentService_;
+    SettlementEngine& settlementEngine_;
 
     std::string targetCurrency_;
     std::vector<std::string> foreignCurrencies_;
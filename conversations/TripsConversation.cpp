@@ -1,7 +1,9 @@
 #include "TripsConversation.h"
+#include "ConversationMemory.h"
 #include <sstream>
 #include <algorithm>
 #include <cctype>
+#include <utility>
 
 
 TripsConversation::TripsConversation(long long chat_id, long long user_id, bot::Bot& bot, TripRepository& tripRepo, UserRepository& userRepo)
@@ -36,6 +38,18 @@ bool TripsConversation::isClosed() const {
     return closed_;
 }
 
+std::optional<bot::ExpiryEdit> TripsConversation::expire() {
+    if (closed_) return std::nullopt;
+    closed_ = true;
+    if (message_id_ == 0) return std::nullopt;
+    return bot::ExpiryEdit{chat_id, std::exchange(message_id_, 0), "Trip selection expired."};
+}
+
+std::size_t TripsConversation::approximateBytes() const {
+    return sizeof(*this) + conversation_memory::bytes(allTrips_)
+         + (activeTrip_ ? conversation_memory::bytes(*activeTrip_) : 0) + conversation_memory::bytes(users_);
+}
+
 void TripsConversation::sendTripList(bool edit) {
     std::stringstream ss;
     if (allTrips_.empty()) {
@@ -61,18 +75,18 @@ void TripsConversation::sendTripList(bool edit) {
         if (activeTrip_ && activeTrip_->trip_id == trip.trip_id) {
             buttonText = "✅ " + buttonText;
         }
-        keyboard.inline_keyboard.push_back({{buttonText, "trip_" + std::to_string(trip.trip_id)}});
+        keyboard.inline_keyboard.push_back({{buttonText, createCallbackData(State::ShowingTrips, trip.trip_id)}});
     }
 
     if (allTrips_.size() >= 2) {
-        keyboard.inline_keyboard.push_back({{"🗑️ Delete selected trip", "delete_trip"}});
+        keyboard.inline_keyboard.push_back({{"🗑️ Delete selected trip", createCallbackData(State::ShowingTrips, "delete_trip")}});
     }
 
     if (allTrips_.size() < 8) {
-        keyboard.inline_keyboard.push_back({{"➕ New Trip", "new_trip"}});
+        keyboard.inline_keyboard.push_back({{"➕ New Trip", createCallbackData(State::ShowingTrips, "new_trip")}});
     }
 
-    keyboard.inline_keyboard.push_back({{"Close", "close"}});
+    keyboard.inline_keyboard.push_back({{"Close", createCallbackData(State::ShowingTrips, "close")}});
 
     if (edit) {
         bot_.editMessage(chat_id, message_id_, ss.str(), &keyboard);
@@ -81,20 +95,30 @@ void TripsConversation::sendTripList(bool edit) {
     }
 }
 
+std::string TripsConversation::createCallbackData(State targetState, std::string_view token) {
+    return bot::CallbackData::token(static_cast<uint8_t>(targetState), token).encode();
+}
+
+std::string TripsConversation::createCallbackData(State targetState, long long id) {
+    return bot::CallbackData::id(static_cast<uint8_t>(targetState), id).encode();
+}
+
 void TripsConversation::handleCallback(const bot::Update& update) {
     bot_.answerCallbackQuery(update.callback_query.id);
-    const std::string& data = update.callback_query.data;
+    auto callback = bot::CallbackData::decode(update.callback_query.data);
 
     if (currentState_ == State::ConfirmingDelete) {
-        handleDeleteConfirm(update);
+        handleDeleteConfirm(callback);
         return;
     }
+    if (!callback || callback->step() != static_cast<uint8_t>(State::ShowingTrips)) return;
+    std::string_view data = callback->token();
 
     if (data == "new_trip") {
         currentState_ = State::CreatingTrip;
         bot_.editMessage(chat_id, message_id_, "Please enter the name for the new trip:");
-    } else if (data.rfind("trip_", 0) == 0) {
-        long long tripId = std::stoll(data.substr(5));
+    } else if (callback->isId()) {
+        long long tripId = callback->id();
         if (tripRepo_.updateActiveTrip(chat_id, 0, tripId)) {
              activeTrip_ = tripRepo_.getActiveTrip(chat_id, 0);
              allTrips_ = tripRepo_.getAllTrips(chat_id, 0); // Refresh trips
@@ -104,7 +128,8 @@ void TripsConversation::handleCallback(const bot::Update& update) {
         if (activeTrip_ && allTrips_.size() >= 2) {
             currentState_ = State::ConfirmingDelete;
             bot::InlineKeyboardMarkup keyboard;
-            keyboard.inline_keyboard.push_back({{"Yes, delete", "confirm_delete"}, {"Cancel", "cancel_delete"}});
+            keyboard.inline_keyboard.push_back({{"Yes, delete", createCallbackData(State::ConfirmingDelete, "confirm_delete")},
+                                                {"Cancel", createCallbackData(State::ConfirmingDelete, "cancel_delete")}});
             bot_.editMessage(chat_id, message_id_,
                 "Are you sure you want to delete the current trip \"" + activeTrip_->name + "\"?",
                 &keyboard);
@@ -159,9 +184,10 @@ void TripsConversation::handleNewTripName(const bot::Update& update) {
     }
 }
 
-void TripsConversation::handleDeleteConfirm(const bot::Update& update) {
-    const std::string& data = update.callback_query.data;
-    if (data == "confirm_delete") {
+void TripsConversation::handleDeleteConfirm(const std::optional<bot::CallbackData>& callback) {
+    // Anything but the confirm button cancels
+    if (callback && callback->step() == static_cast<uint8_t>(State::ConfirmingDelete)
+        && callback->token() == "confirm_delete") {
         if (activeTrip_) {
             tripRepo_.deleteTrip(activeTrip_->trip_id);
             allTrips_ = tripRepo_.getAllTrips(chat_id, 0);
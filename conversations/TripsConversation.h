@@ -2,10 +2,13 @@
 #define TRIPS_CONVERSATION_H
 
 #include "../bot/Bot.h"
+#include "../bot/CallbackData.h"
 #include "../repository/TripRepository.h"
 #include "../repository/UserRepository.h"
 #include <vector>
 #include <optional>
+#include <string>
+#include <string_view>
 
 class TripsConversation : public bot::Conversation {
 public:
@@ -14,6 +17,8 @@ public:
 
     void handleUpdate(const bot::Update& update) override;
     bool isClosed() const override;
+    std::optional<bot::ExpiryEdit> expire() override;
+    std::size_t approximateBytes() const override;
 
 private:
     enum class State {
@@ -25,9 +30,12 @@ private:
     void sendTripList(bool edit);
     void handleCallback(const bot::Update& update);
     void handleNewTripName(const bot::Update& update);
-    void handleDeleteConfirm(const bot::Update& update);
+    void handleDeleteConfirm(const std::optional<bot::CallbackData>& callback);
     void closeConversation();
 
+    static std::string createCallbackData(State targetState, std::string_view token);
+    static std::string createCallbackData(State targetState, long long id);
+
     bot::Bot& bot_;
     TripRepository& tripRepo_;
     UserRepository& userRepo_;
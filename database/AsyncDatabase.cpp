@@ -0,0 +1,367 @@
+#include "AsyncDatabase.h"
+#include "../logging/Logging.h"
+#include "../tracing/Tracing.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+
+namespace {
+
+constexpr auto kReconnectDelay = std::chrono::seconds(5);
+
+} // namespace
+
+AsyncResult::AsyncResult(PGresult* result) : result_(result) {
+    if (!result_) {
+        error_ = "no result";
+        return;
+    }
+    ExecStatusType status = PQresultStatus(result_.get());
+    if (status != PGRES_TUPLES_OK && status != PGRES_COMMAND_OK) {
+        error_ = PQresultErrorMessage(result_.get());
+        if (error_.empty()) error_ = PQresStatus(status);
+    }
+}
+
+AsyncResult AsyncResult::failure(std::string message) {
+    AsyncResult result;
+    result.error_ = std::move(message);
+    return result;
+}
+
+bool AsyncResult::ok() const {
+    return result_ && error_.empty();
+}
+
+std::string_view AsyncResult::error() const {
+    return error_;
+}
+
+int AsyncResult::rows() const {
+    return ok() ? PQntuples(result_.get()) : 0;
+}
+
+int AsyncResult::column(const char* name) const {
+    return ok() ? PQfnumber(result_.get(), name) : -1;
+}
+
+bool AsyncResult::isNull(int row, int column) const {
+    return PQgetisnull(result_.get(), row, column) == 1;
+}
+
+std::string_view AsyncResult::get(int row, int column) const {
+    return {PQgetvalue(result_.get(), row, column),
+            static_cast<std::size_t>(PQgetlength(result_.get(), row, column))};
+}
+
+long long AsyncResult::getLongLong(int row, int column) const {
+    std::string_view text = get(row, column);
+    long long value = 0;
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    return value;
+}
+
+AsyncDatabase::AsyncDatabase(std::string connectionString, std::size_t connections, Executor executor)
+    : connectionString_(std::move(connectionString)), executor_(std::move(executor)),
+      connections_(std::max<std::size_t>(1, connections)) {
+    if (pipe(wakeFds_) == 0) {
+        for (int fd : wakeFds_) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    } else {
+        logging::db().error("Error creating async database wake-up pipe");
+    }
+}
+
+AsyncDatabase::~AsyncDatabase() {
+    stop();
+    for (int fd : wakeFds_) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+void AsyncDatabase::start() {
+    if (running_.exchange(true)) return;
+    loopThread_ = std::thread([this] { eventLoop(); });
+}
+
+void AsyncDatabase::stop() {
+    {
+        // Under the lock: enqueue() either sees the flag or is drained by the loop
+        std::lock_guard<std::mutex> lock(requestsMutex_);
+        running_ = false;
+    }
+    wake();
+    if (loopThread_.joinable()) {
+        loopThread_.join();
+    }
+}
+
+void AsyncDatabase::query(std::string sql, AsyncParams params, Callback onDone) {
+    // The continuation stays in the caller's trace, whichever thread runs it
+    if (tracing::TraceContext trace = tracing::current(); trace.sampled) {
+        onDone = [trace, onDone = std::move(onDone)](AsyncResult result) {
+            tracing::ScopedContext scope(trace);
+            onDone(std::move(result));
+        };
+    }
+    enqueue(Request{std::move(sql), std::move(params), std::move(onDone), false});
+}
+
+std::future<AsyncResult> AsyncDatabase::query(std::string sql, AsyncParams params) {
+    auto promise = std::make_shared<std::promise<AsyncResult>>();
+    auto future = promise->get_future();
+    // Completed on the loop thread: a worker blocking on the future must not also be
+    // the one the result would be handed to
+    enqueue(Request{std::move(sql), std::move(params),
+                    [promise](AsyncResult result) { promise->set_value(std::move(result)); }, true});
+    return future;
+}
+
+void AsyncDatabase::enqueue(Request request) {
+    submitted_.fetch_add(1, std::memory_order_relaxed);
+    std::size_t inFlight = inFlight_.fetch_add(1, std::memory_order_relaxed) + 1;
+    std::size_t max = maxInFlight_.load(std::memory_order_relaxed);
+    while (inFlight > max && !maxInFlight_.compare_exchange_weak(max, inFlight, std::memory_order_relaxed)) {}
+
+    {
+        std::lock_guard<std::mutex> lock(requestsMutex_);
+        if (running_) {
+            requests_.push_back(std::move(request));
+            request.onDone = nullptr;
+        }
+    }
+    if (request.onDone) {
+        complete(std::move(request.onDone), request.onLoopThread, AsyncResult::failure("async database not running"));
+        return;
+    }
+    wake();
+}
+
+AsyncDatabase::Stats AsyncDatabase::stats() const {
+    return {submitted_.load(std::memory_order_relaxed),
+            completed_.load(std::memory_order_relaxed),
+            failed_.load(std::memory_order_relaxed),
+            inFlight_.load(std::memory_order_relaxed),
+            maxInFlight_.load(std::memory_order_relaxed)};
+}
+
+void AsyncDatabase::logStats() const {
+    Stats s = stats();
+    logging::db().info("Async database: submitted={}, completed={}, failed={}, in_flight={}, max_in_flight={}",
+                       s.submitted, s.completed, s.failed, s.inFlight, s.maxInFlight);
+}
+
+void AsyncDatabase::wake() {
+    if (wakeFds_[1] < 0) return;
+    char byte = 1;
+    // A full pipe already guarantees a wake-up
+    [[maybe_unused]] ssize_t written = write(wakeFds_[1], &byte, 1);
+}
+
+void AsyncDatabase::drainWakeups() {
+    char buffer[64];
+    while (read(wakeFds_[0], buffer, sizeof(buffer)) > 0) {}
+}
+
+bool AsyncDatabase::connect(Connection& connection) {
+    // Blocking connect on the loop thread; only at start-up and after a failure
+    PGconn* conn = PQconnectdb(connectionString_.c_str());
+    if (PQstatus(conn) != CONNECTION_OK || PQsetnonblocking(conn, 1) != 0 || PQenterPipelineMode(conn) != 1) {
+        logging::db().error("Error opening async database connection: {}", PQerrorMessage(conn));
+        PQfinish(conn);
+        connection.retryAt = std::chrono::steady_clock::now() + kReconnectDelay;
+        return false;
+    }
+    connection.conn = conn;
+    connection.wantsWrite = false;
+    return true;
+}
+
+void AsyncDatabase::failConnection(Connection& connection, const std::string& reason) {
+    if (running_) {
+        logging::db().error("Error on async database connection: {}", reason);
+    }
+    while (!connection.pending.empty()) {
+        Pending pending = std::move(connection.pending.front());
+        connection.pending.pop_front();
+        if (pending.result) PQclear(pending.result);
+        complete(std::move(pending.onDone), pending.onLoopThread, AsyncResult::failure(reason));
+    }
+    if (connection.conn) {
+        PQfinish(connection.conn);
+        connection.conn = nullptr;
+    }
+    connection.retryAt = std::chrono::steady_clock::now() + kReconnectDelay;
+}
+
+AsyncDatabase::Connection* AsyncDatabase::pickConnection() {
+    Connection* best = nullptr;
+    for (auto& connection : connections_) {
+        if (!connection.conn) continue;
+        if (!best || connection.pending.size() < best->pending.size()) {
+            best = &connection;
+        }
+    }
+    return best;
+}
+
+void AsyncDatabase::send(Connection& connection, Request request) {
+    const auto& values = request.params.values();
+    std::vector<const char*> pointers;
+    pointers.reserve(values.size());
+    for (const auto& value : values) {
+        pointers.push_back(value ? value->c_str() : nullptr);
+    }
+
+    // A sync after every query gives each its own implicit transaction, so one
+    // failing query does not abort the ones queued behind it
+    if (PQsendQueryParams(connection.conn, request.sql.c_str(), static_cast<int>(pointers.size()), nullptr,
+                          pointers.data(), nullptr, nullptr, 0) != 1
+        || PQpipelineSync(connection.conn) != 1) {
+        std::string reason = PQerrorMessage(connection.conn);
+        if (PQstatus(connection.conn) != CONNECTION_OK) {
+            connection.pending.push_back(Pending{std::move(request.onDone), request.onLoopThread});
+            failConnection(connection, reason);
+        } else {
+            complete(std::move(request.onDone), request.onLoopThread, AsyncResult::failure(reason));
+        }
+        return;
+    }
+    connection.pending.push_back(Pending{std::move(request.onDone), request.onLoopThread});
+    flush(connection);
+}
+
+void AsyncDatabase::flush(Connection& connection) {
+    int result = PQflush(connection.conn);
+    if (result < 0) {
+        failConnection(connection, PQerrorMessage(connection.conn));
+        return;
+    }
+    connection.wantsWrite = result == 1;
+}
+
+void AsyncDatabase::readResults(Connection& connection) {
+    if (PQconsumeInput(connection.conn) != 1) {
+        failConnection(connection, PQerrorMessage(connection.conn));
+        return;
+    }
+
+    // Per query: its result(s), a NULL, then the PIPELINE_SYNC that ends it
+    bool sawNull = false;
+    while (!connection.pending.empty() && PQisBusy(connection.conn) == 0) {
+        PGresult* result = PQgetResult(connection.conn);
+        if (!result) {
+            if (sawNull) break;
+            sawNull = true;
+            continue;
+        }
+        sawNull = false;
+
+        Pending& front = connection.pending.front();
+        if (PQresultStatus(result) == PGRES_PIPELINE_SYNC) {
+            PQclear(result);
+            Pending done = std::move(front);
+            connection.pending.pop_front();
+            complete(std::move(done.onDone), done.onLoopThread, AsyncResult(done.result));
+        } else if (!front.result) {
+            front.result = result;
+        } else {
+            PQclear(result);
+        }
+    }
+
+    if (PQstatus(connection.conn) != CONNECTION_OK) {
+        failConnection(connection, PQerrorMessage(connection.conn));
+    }
+}
+
+void AsyncDatabase::complete(Callback onDone, bool onLoopThread, AsyncResult result) {
+    inFlight_.fetch_sub(1, std::memory_order_relaxed);
+    (result.ok() ? completed_ : failed_).fetch_add(1, std::memory_order_relaxed);
+    if (!onDone) return;
+    if (onLoopThread || !executor_) {
+        onDone(std::move(result));
+        return;
+    }
+    // std::function needs a copyable callable; the result itself is move-only
+    auto shared = std::make_shared<AsyncResult>(std::move(result));
+    std::function<void()> task = [onDone = std::move(onDone), shared] { onDone(std::move(*shared)); };
+    // A copy goes to the executor, so a declined task can still run here; waiting for
+    // room in the queue would stall every other query on this thread
+    if (!executor_(task)) {
+        task();
+    }
+}
+
+void AsyncDatabase::eventLoop() {
+    for (auto& connection : connections_) {
+        connect(connection);
+    }
+
+    std::vector<pollfd> fds;
+    while (running_) {
+        std::deque<Request> batch;
+        {
+            std::lock_guard<std::mutex> lock(requestsMutex_);
+            batch.swap(requests_);
+        }
+        auto now = std::chrono::steady_clock::now();
+        for (auto& connection : connections_) {
+            if (!connection.conn && now >= connection.retryAt) connect(connection);
+        }
+        for (auto& request : batch) {
+            Connection* connection = pickConnection();
+            if (!connection) {
+                complete(std::move(request.onDone), request.onLoopThread,
+                         AsyncResult::failure("database connection unavailable"));
+                continue;
+            }
+            send(*connection, std::move(request));
+        }
+
+        fds.clear();
+        fds.push_back({wakeFds_[0], POLLIN, 0});
+        for (auto& connection : connections_) {
+            short events = POLLIN;
+            if (connection.wantsWrite) events |= POLLOUT;
+            fds.push_back({connection.conn ? PQsocket(connection.conn) : -1, events, 0});
+        }
+
+        // Wake up every second to retry dead connections and notice stop()
+        if (poll(fds.data(), fds.size(), 1000) < 0 && errno != EINTR) {
+            logging::db().error("Error polling async database connections");
+            continue;
+        }
+        if (fds[0].revents & POLLIN) drainWakeups();
+
+        for (std::size_t i = 0; i < connections_.size(); ++i) {
+            Connection& connection = connections_[i];
+            short revents = fds[i + 1].revents;
+            if (!connection.conn || revents == 0) continue;
+            if (revents & POLLOUT) flush(connection);
+            if (connection.conn && (revents & (POLLIN | POLLERR | POLLHUP))) readResults(connection);
+        }
+    }
+
+    // Shutting down: fail whatever is still queued or in flight
+    std::deque<Request> leftover;
+    {
+        std::lock_guard<std::mutex> lock(requestsMutex_);
+        leftover.swap(requests_);
+    }
+    for (auto& request : leftover) {
+        complete(std::move(request.onDone), request.onLoopThread, AsyncResult::failure("async database stopped"));
+    }
+    for (auto& connection : connections_) {
+        if (connection.conn || !connection.pending.empty()) {
+            failConnection(connection, "async database stopped");
+        }
+    }
+}
@@ -0,0 +1,166 @@
+#ifndef FRIENDS_TRIP_BOT_ASYNCDATABASE_H
+#define FRIENDS_TRIP_BOT_ASYNCDATABASE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <libpq-fe.h>
+
+// Result of one asynchronous query. Owns the PGresult; move-only.
+class AsyncResult {
+public:
+    AsyncResult() = default;
+    explicit AsyncResult(PGresult* result);
+    static AsyncResult failure(std::string message);
+
+    bool ok() const;
+    std::string_view error() const;
+
+    int rows() const;
+    // Column index by name, or -1
+    int column(const char* name) const;
+    bool isNull(int row, int column) const;
+    std::string_view get(int row, int column) const;
+    long long getLongLong(int row, int column) const;
+
+private:
+    struct Clear {
+        void operator()(PGresult* result) const { PQclear(result); }
+    };
+    std::unique_ptr<PGresult, Clear> result_;
+    std::string error_;
+};
+
+// Text-format query parameters; std::nullopt is sent as NULL
+class AsyncParams {
+public:
+    AsyncParams() = default;
+
+    template<typename First, typename... Rest,
+             typename = std::enable_if_t<!std::is_same_v<std::decay_t<First>, AsyncParams>>>
+    explicit AsyncParams(First&& first, Rest&&... rest) {
+        values_.reserve(1 + sizeof...(rest));
+        add(std::forward<First>(first));
+        (add(std::forward<Rest>(rest)), ...);
+    }
+
+    void add(std::string value) { values_.emplace_back(std::move(value)); }
+    void add(const char* value) { values_.emplace_back(std::string(value)); }
+    void add(std::nullopt_t) { values_.emplace_back(std::nullopt); }
+
+    template<typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+    void add(T value) { values_.emplace_back(std::to_string(value)); }
+
+    const std::vector<std::optional<std::string>>& values() const { return values_; }
+
+private:
+    std::vector<std::optional<std::string>> values_;
+};
+
+// Non-blocking database access on libpq's asynchronous API. One event-loop thread owns
+// a few connections in pipeline mode and polls their sockets; queries are sent with
+// PQsendQueryParams and their callbacks are handed to the executor (the bot's worker
+// pool) when the result arrives. No thread waits on a round trip, so the number of
+// queries in flight is bounded by neither the worker count nor the connection count.
+//
+// The executor must not block: a callback it declines (queue full, bot stopping) runs
+// inline on the event-loop thread instead, so every callback runs exactly once, with
+// an error result for queries failed by stop().
+//
+// Each query runs in its own implicit transaction, so multi-statement work has to be a
+// single statement (a data-modifying CTE), as the synchronous repositories already do.
+class AsyncDatabase {
+public:
+    using Callback = std::function<void(AsyncResult)>;
+    // Returns false, without running the task, if it cannot take it right now
+    using Executor = std::function<bool(std::function<void()>)>;
+
+    struct Stats {
+        uint64_t submitted;
+        uint64_t completed;
+        uint64_t failed;
+        std::size_t inFlight;
+        std::size_t maxInFlight;
+    };
+
+    AsyncDatabase(std::string connectionString, std::size_t connections, Executor executor);
+    ~AsyncDatabase();
+
+    AsyncDatabase(const AsyncDatabase&) = delete;
+    AsyncDatabase& operator=(const AsyncDatabase&) = delete;
+
+    void start();
+    // Fails queries still in flight and joins the event loop
+    void stop();
+
+    void query(std::string sql, AsyncParams params, Callback onDone);
+    std::future<AsyncResult> query(std::string sql, AsyncParams params);
+
+    Stats stats() const;
+    void logStats() const;
+
+private:
+    struct Pending {
+        Callback onDone;
+        bool onLoopThread;
+        PGresult* result = nullptr;
+    };
+
+    struct Request {
+        std::string sql;
+        AsyncParams params;
+        Callback onDone;
+        bool onLoopThread = false;  // skip the executor (futures)
+    };
+
+    struct Connection {
+        PGconn* conn = nullptr;
+        std::deque<Pending> pending;
+        bool wantsWrite = false;
+        std::chrono::steady_clock::time_point retryAt{};
+    };
+
+    void eventLoop();
+    void wake();
+    void drainWakeups();
+    bool connect(Connection& connection);
+    void failConnection(Connection& connection, const std::string& reason);
+    void send(Connection& connection, Request request);
+    void flush(Connection& connection);
+    void readResults(Connection& connection);
+    void complete(Callback onDone, bool onLoopThread, AsyncResult result);
+    void enqueue(Request request);
+    Connection* pickConnection();
+
+    const std::string connectionString_;
+    const Executor executor_;
+    std::vector<Connection> connections_;
+
+    std::mutex requestsMutex_;
+    std::deque<Request> requests_;
+
+    int wakeFds_[2] = {-1, -1};
+    std::atomic<bool> running_{false};
+    std::thread loopThread_;
+
+    std::atomic<uint64_t> submitted_{0};
+    std::atomic<uint64_t> completed_{0};
+    std::atomic<uint64_t> failed_{0};
+    std::atomic<std::size_t> inFlight_{0};
+    std::atomic<std::size_t> maxInFlight_{0};
+};
+
+#endif //FRIENDS_TRIP_BOT_ASYNCDATABASE_H
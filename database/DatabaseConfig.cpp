@@ -0,0 +1,39 @@
+#include "DatabaseConfig.h"
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace DatabaseConfig {
+
+void loadEnv(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) return;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        size_t delimPos = line.find('=');
+        if (delimPos != std::string::npos) {
+            setenv(line.substr(0, delimPos).c_str(), line.substr(delimPos + 1).c_str(), 0);
+        }
+    }
+}
+
+std::string buildConnString(std::string_view database) {
+    const char* host = std::getenv("POSTGRES_HOST");
+    const char* port = std::getenv("POSTGRES_PORT");
+    const char* name = std::getenv("POSTGRES_DB");
+    const char* user = std::getenv("POSTGRES_USER");
+    const char* pass = std::getenv("POSTGRES_PASSWORD");
+
+    if (!host || !port || (database.empty() && !name) || !user || !pass) return "";
+
+    std::stringstream ss;
+    ss << "host=" << host << " port=" << port << " dbname=";
+    if (database.empty()) ss << name;
+    else ss << database;
+    ss << " user=" << user << " password=" << pass;
+    return ss.str();
+}
+
+} // namespace DatabaseConfig
@@ -0,0 +1,20 @@
+#ifndef DATABASE_CONFIG_H
+#define DATABASE_CONFIG_H
+
+#include <string>
+#include <string_view>
+
+// Environment-driven configuration shared by the bot and the bench tools
+namespace DatabaseConfig {
+    // KEY=VALUE lines from filename into the environment; lines starting with '#' are
+    // skipped. Variables already set are left alone, so the real environment (e.g.
+    // docker-compose's POSTGRES_HOST) wins over the file. A missing file is ignored.
+    void loadEnv(const std::string& filename);
+
+    // libpq connection string from POSTGRES_HOST, POSTGRES_PORT, POSTGRES_USER,
+    // POSTGRES_PASSWORD and POSTGRES_DB, or database instead of POSTGRES_DB when given.
+    // Empty if any of them is unset.
+    std::string buildConnString(std::string_view database = {});
+}
+
+#endif // DATABASE_CONFIG_H
@@ -1,19 +1,24 @@
 #include "DatabaseManager.h"
-#include <iostream>
+#include "../logging/Logging.h"
+#include <chrono>
 
 DatabaseManager::DatabaseManager(const std::string& connection_string)
     : connection_string_(connection_string) {}
 
+DatabaseManager::~DatabaseManager() {
+    stopListener();
+}
+
 void DatabaseManager::connect() {
     try {
         connection_ = std::make_unique<pqxx::connection>(connection_string_);
         if (connection_->is_open()) {
-            std::cout << "Opened database successfully: " << connection_->dbname() << std::endl;
+            logging::db().info("Opened database successfully: {}", connection_->dbname());
         } else {
-            std::cerr << "Can't open database" << std::endl;
+            logging::db().error("Can't open database");
         }
     } catch (const std::exception &e) {
-        std::cerr << e.what() << std::endl;
+        logging::db().error("{}", e.what());
     }
 }
 
@@ -21,7 +26,7 @@ void DatabaseManager::disconnect() {
     if (connection_) {
         if (connection_ && connection_->is_open()) {
             connection_->close();
-            std::cout << "Disconnected from database" << std::endl;
+            logging::db().info("Disconnected from database");
         }
     }
 }
@@ -29,3 +34,43 @@ void DatabaseManager::disconnect() {
 pqxx::connection* DatabaseManager::getConnection() {
     return connection_.get();
 }
+
+void DatabaseManager::startListener(const std::string& channel, NotificationHandler onNotification,
+                                    std::function<void()> onResubscribed) {
+    if (listening_.exchange(true)) return;
+    listenerThread_ = std::thread([this, channel, onNotification = std::move(onNotification),
+                                   onResubscribed = std::move(onResubscribed)] {
+        listenLoop(channel, onNotification, onResubscribed);
+    });
+}
+
+void DatabaseManager::stopListener() {
+    listening_ = false;
+    if (listenerThread_.joinable()) {
+        listenerThread_.join();
+    }
+}
+
+void DatabaseManager::listenLoop(const std::string& channel, const NotificationHandler& onNotification,
+                                 const std::function<void()>& onResubscribed) {
+    while (listening_) {
+        try {
+            pqxx::connection conn(connection_string_);
+            conn.listen(channel, [&onNotification](pqxx::notification n) {
+                onNotification(n.payload);
+            });
+            logging::db().info("Listening for notifications on {}", channel);
+            onResubscribed();
+
+            // Wake up every second to notice stopListener()
+            while (listening_) {
+                conn.await_notification(1, 0);
+            }
+        } catch (const std::exception& e) {
+            logging::db().error("Error in notification listener: {}", e.what());
+            for (int i = 0; i < 50 && listening_; ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+    }
+}
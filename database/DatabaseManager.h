@@ -2,19 +2,40 @@
 #define DATABASE_MANAGER_H
 
 #include <pqxx/pqxx>
+#include <atomic>
+#include <functional>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <thread>
 
 class DatabaseManager {
 public:
+    // Called on the listener thread with the notification's payload
+    using NotificationHandler = std::function<void(std::string_view payload)>;
+
     DatabaseManager(const std::string& connection_string);
+    ~DatabaseManager();
     void connect();
     void disconnect();
     pqxx::connection* getConnection();
 
+    // LISTENs on channel over a dedicated connection, reconnecting on failure.
+    // onResubscribed runs after every (re)connect, since notifications sent while
+    // the listener was down are lost.
+    void startListener(const std::string& channel, NotificationHandler onNotification,
+                       std::function<void()> onResubscribed);
+    void stopListener();
+
 private:
+    void listenLoop(const std::string& channel, const NotificationHandler& onNotification,
+                    const std::function<void()>& onResubscribed);
+
     std::string connection_string_;
     std::unique_ptr<pqxx::connection> connection_;
+
+    std::atomic<bool> listening_{false};
+    std::thread listenerThread_;
 };
 
 #endif // DATABASE_MANAGER_H
@@ -1,12 +1,13 @@
 #include "DatabaseSchema.h"
-#include <iostream>
+#include "../logging/Logging.h"
+#include <string>
 
 namespace DatabaseSchema {
 
 void createTables(DatabaseManager& dbManager) {
     pqxx::connection* conn = dbManager.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Database connection is not open. Cannot create tables." << std::endl;
+        logging::db().error("Database connection is not open. Cannot create tables.");
         return;
     }
 
@@ -79,10 +80,69 @@ void createTables(DatabaseManager& dbManager) {
             CREATE INDEX IF NOT EXISTS idx_payment_records_trip_id ON payment_records(trip_id);
         )");
 
+        // Create stored_callbacks table: payloads of buttons that must survive restarts
+        txn.exec(R"(
+            CREATE TABLE IF NOT EXISTS stored_callbacks (
+                callback_id BIGSERIAL PRIMARY KEY,
+                kind SMALLINT NOT NULL,
+                trip_id BIGINT NOT NULL REFERENCES trips(trip_id) ON DELETE CASCADE,
+                chat_id BIGINT,
+                thread_id BIGINT,
+                from_user_id BIGINT,
+                to_user_id BIGINT,
+                amount BIGINT,
+                currency VARCHAR(3),
+                expires_at TIMESTAMP NOT NULL
+            );
+        )");
+
+        // Create bot_state table: named values such as the getUpdates offset
+        txn.exec(R"(
+            CREATE TABLE IF NOT EXISTS bot_state (
+                name VARCHAR(64) PRIMARY KEY,
+                value BIGINT NOT NULL,
+                gmt_modified TIMESTAMP DEFAULT CURRENT_TIMESTAMP
+            );
+        )");
+
+        // Cache invalidation: every committed row change is announced on the
+        // cache_invalidation channel so other bot processes drop what they cached.
+        // origin is the writing process's id (CacheInvalidator::ORIGIN_SETTING), null
+        // for sessions that set none such as psql
+        txn.exec(R"(
+            CREATE OR REPLACE FUNCTION notify_cache_invalidation() RETURNS trigger AS $$
+            DECLARE
+                row_data JSONB;
+            BEGIN
+                IF TG_OP = 'DELETE' THEN
+                    row_data := to_jsonb(OLD);
+                ELSE
+                    row_data := to_jsonb(NEW);
+                END IF;
+                PERFORM pg_notify('cache_invalidation', jsonb_build_object(
+                    'table', TG_TABLE_NAME,
+                    'op', TG_OP,
+                    'chat_id', row_data->'chat_id',
+                    'thread_id', row_data->'thread_id',
+                    'trip_id', row_data->'trip_id',
+                    'origin', current_setting('friends_trip_bot.origin', true),
+                    'sent_at_ms', (extract(epoch FROM clock_timestamp()) * 1000)::bigint
+                )::text);
+                RETURN NULL;
+            END;
+            $$ LANGUAGE plpgsql;
+        )");
+        for (const char* table : {"users", "trips", "chats", "payment_groups", "payment_records"}) {
+            std::string trigger = std::string(table) + "_cache_invalidation";
+            txn.exec("DROP TRIGGER IF EXISTS " + trigger + " ON " + table);
+            txn.exec("CREATE TRIGGER " + trigger + " AFTER INSERT OR UPDATE OR DELETE ON " + table +
+                     " FOR EACH ROW EXECUTE FUNCTION notify_cache_invalidation()");
+        }
+
         txn.commit();
-        std::cout << "Tables created/verified successfully." << std::endl;
+        logging::db().info("Tables created/verified successfully.");
     } catch (const std::exception &e) {
-        std::cerr << "Error creating tables: " << e.what() << std::endl;
+        logging::db().error("Error creating tables: {}", e.what());
     }
 }
 
@@ -71,16 +71,16 @@ void registerHandlers(bot::Bot& bot, const Services& services, const Repositorie
     // list payments handler
     bot.registerCommandHandler("/list", [&bot, &repos](const bot::Message& msg) {
         auto convo = std::make_unique<ListPaymentsConversation>(
-            msg.chat_id, 0, msg.sender_id,
-            bot, repos.userRepository, repos.tripRepository, repos.paymentRepository);
+            msg.chat_id, 0, msg.sender_id, bot, repos.tripSnapshotRepository);
         bot.registerConversation(std::move(convo));
     });
 
     // simplify payments handler
-    bot.registerCommandHandler("/simplify", [&bot, &repos, &paymentService = services.paymentService](const bot::Message& msg) {
+    bot.registerCommandHandler("/simplify", [&bot, &repos, &services](const bot::Message& msg) {
         auto convo = std::make_unique<SimplifyPaymentsConversation>(
             msg.chat_id, 0, msg.sender_id,
-            bot, repos.userRepository, repos.tripRepository, repos.paymentRepository, paymentService);
+            bot, repos.userRepository, repos.tripRepository, repos.paymentRepository,
+            repos.tripSnapshotRepository, services.paymentService, services.settlementEngine);
         bot.registerConversation(std::move(convo));
     });
 
@@ -97,17 +97,26 @@ void registerHandlers(bot::Bot& bot, const Services& services, const Repositorie
     });
 
     // Log payment callback handler (from simplify DMs)
-    bot.registerCallbackHandler("lp", [&bot](const bot::CallbackQuery& query) {
-        auto callback = bot.fetchCallback(query.data);
-        if (callback) {
-            (*callback)();
-            bot.answerCallbackQuery(query.id, "Payment logged!");
-            bot.editMessage(query.chat_id, query.message_id,
-                query.message_text + "\n\xe2\x9c\x85 Paid", nullptr, "");
-        } else {
-            bot.answerCallbackQuery(query.id, "This button has expired.", true);
+    bot.registerCallbackHandler("ls", [&bot, &paymentService = services.paymentService](const bot::CallbackQuery& query) {
+        switch (paymentService.logOfferedPayment(query.data)) {
+            case LogPaymentResult::Logged:
+                bot.answerCallbackQuery(query.id, "Payment logged!");
+                bot.editMessage(query.chat_id, query.message_id,
+                    query.message_text + "\n\xe2\x9c\x85 Paid", nullptr, "");
+                break;
+            case LogPaymentResult::Expired:
+                bot.answerCallbackQuery(query.id, "This button has expired.", true);
+                break;
+            case LogPaymentResult::Failed:
+                bot.answerCallbackQuery(query.id, "Could not log the payment. Please try again.", true);
+                break;
         }
     });
+
+    // Buttons from before payloads were stored durably; their in-memory keys are gone
+    bot.registerCallbackHandler("lp", [&bot](const bot::CallbackQuery& query) {
+        bot.answerCallbackQuery(query.id, "This button has expired.", true);
+    });
 }
 
 } // namespace handlers
\ No newline at end of file
@@ -7,18 +7,22 @@
 
 class PaymentRepository;
 class TripRepository;
+class TripSnapshotRepository;
+class SettlementEngine;
 
 namespace handlers {
 
 struct Services {
     UserService& userService;
     PaymentService& paymentService;
+    SettlementEngine& settlementEngine;
 };
 
 struct Repositories {
     UserRepository& userRepository;
     TripRepository& tripRepository;
     PaymentRepository& paymentRepository;
+    TripSnapshotRepository& tripSnapshotRepository;
 };
 
 void registerHandlers(bot::Bot& bot, const Services& services, const Repositories& repos);
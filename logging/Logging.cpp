@@ -0,0 +1,154 @@
+#include "Logging.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <spdlog/async_logger.h>
+#include <spdlog/details/thread_pool.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+namespace logging {
+
+namespace {
+
+struct State {
+    std::mutex mutex;
+    std::shared_ptr<spdlog::sinks::sink> sink;
+    std::shared_ptr<spdlog::details::thread_pool> pool;
+    std::vector<std::shared_ptr<spdlog::logger>> loggers;
+    spdlog::level::level_enum defaultLevel = spdlog::level::info;
+    std::map<std::string, spdlog::level::level_enum, std::less<>> levels;
+};
+
+State& state() {
+    static State instance;
+    return instance;
+}
+
+// Requires state().mutex
+std::shared_ptr<spdlog::sinks::sink> sharedSink(State& s) {
+    if (!s.sink) {
+        s.sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+        s.sink->set_pattern(kPattern);
+    }
+    return s.sink;
+}
+
+// Requires state().mutex
+void applyLevel(State& s, spdlog::logger& logger) {
+    auto it = s.levels.find(logger.name());
+    logger.set_level(it != s.levels.end() ? it->second : s.defaultLevel);
+}
+
+// Requires state().mutex
+std::shared_ptr<spdlog::logger> makeLogger(State& s, const std::string& name) {
+    std::shared_ptr<spdlog::logger> logger;
+    if (s.pool) {
+        // Overrun rather than block: a worker must never wait for the terminal
+        logger = std::make_shared<spdlog::async_logger>(name, sharedSink(s), s.pool,
+                                                        spdlog::async_overflow_policy::overrun_oldest);
+    } else {
+        logger = std::make_shared<spdlog::logger>(name, sharedSink(s));
+    }
+    applyLevel(s, *logger);
+    return logger;
+}
+
+spdlog::logger& subsystem(const std::string& name) {
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto logger = makeLogger(s, name);
+    s.loggers.push_back(logger);
+    return *logger;
+}
+
+bool parseLevel(std::string_view text, spdlog::level::level_enum& level) {
+    level = spdlog::level::from_str(std::string(text));
+    // from_str maps anything it does not know to off
+    return level != spdlog::level::off || text == "off";
+}
+
+} // namespace
+
+void init(std::size_t queueSize) {
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.pool) return;
+    s.pool = std::make_shared<spdlog::details::thread_pool>(queueSize, 1);
+    // Whatever still calls spdlog:: directly goes through the same queue
+    spdlog::set_default_logger(makeLogger(s, "main"));
+}
+
+void shutdown() {
+    State& s = state();
+    std::shared_ptr<spdlog::details::thread_pool> pool;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        pool.swap(s.pool);
+    }
+    // The pool drains its queue before its thread exits
+    pool.reset();
+}
+
+bool setLevels(std::string_view spec) {
+    spdlog::level::level_enum defaultLevel = spdlog::level::info;
+    std::map<std::string, spdlog::level::level_enum, std::less<>> levels;
+    while (!spec.empty()) {
+        std::size_t comma = spec.find(',');
+        std::string_view entry = spec.substr(0, comma);
+        spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+        if (entry.empty()) continue;
+
+        spdlog::level::level_enum level;
+        std::size_t equals = entry.find('=');
+        if (equals == std::string_view::npos) {
+            if (!parseLevel(entry, level)) return false;
+            defaultLevel = level;
+        } else {
+            if (equals == 0 || !parseLevel(entry.substr(equals + 1), level)) return false;
+            levels[std::string(entry.substr(0, equals))] = level;
+        }
+    }
+
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.defaultLevel = defaultLevel;
+    s.levels = std::move(levels);
+    for (auto& logger : s.loggers) applyLevel(s, *logger);
+    if (s.pool) applyLevel(s, *spdlog::default_logger_raw());
+    return true;
+}
+
+uint64_t droppedMessages() {
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.pool ? s.pool->overrun_counter() : 0;
+}
+
+spdlog::logger& bot() {
+    static spdlog::logger& logger = subsystem("bot");
+    return logger;
+}
+
+spdlog::logger& db() {
+    static spdlog::logger& logger = subsystem("db");
+    return logger;
+}
+
+spdlog::logger& repo() {
+    static spdlog::logger& logger = subsystem("repo");
+    return logger;
+}
+
+spdlog::logger& service() {
+    static spdlog::logger& logger = subsystem("service");
+    return logger;
+}
+
+spdlog::logger& metrics() {
+    static spdlog::logger& logger = subsystem("metrics");
+    return logger;
+}
+
+} // namespace logging
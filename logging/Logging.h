@@ -0,0 +1,46 @@
+#ifndef FRIENDS_TRIP_BOT_LOGGING_H
+#define FRIENDS_TRIP_BOT_LOGGING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <spdlog/logger.h>
+
+// One spdlog logger per subsystem, so each can be quietened or turned up on its own.
+// Messages carry their fields as key=value pairs after a short description, e.g.
+// "Created trip: trip_id=3, chat_id=-100...", and every line is stamped with the
+// subsystem and thread.
+//
+// After init() the loggers are asynchronous: the calling thread formats the message
+// and hands it to a bounded queue, and one background thread writes it. When the
+// queue is full the oldest message is dropped rather than blocking a worker; see
+// droppedMessages(). Without init() (benchmarks, tools) they write synchronously.
+namespace logging {
+
+inline constexpr std::size_t kDefaultQueueSize = 8192;
+inline constexpr const char* kPattern = "[%Y-%m-%d %H:%M:%S.%e] [%^%l%$] [%n] [t%t] %v";
+
+// Call first thing in main, before any logger is used; loggers created earlier stay
+// synchronous
+void init(std::size_t queueSize = kDefaultQueueSize);
+// Writes out what is queued; call before exiting
+void shutdown();
+
+// Applies a level spec such as "info" or "warn,db=debug,repo=info": a bare level is
+// the default for every subsystem, name=level overrides one. Safe to call at any time;
+// false, with nothing changed, if the spec does not parse.
+bool setLevels(std::string_view spec);
+
+// Messages discarded because the queue was full
+uint64_t droppedMessages();
+
+spdlog::logger& bot();      // bot/, conversations/, handlers/
+spdlog::logger& db();       // database/
+spdlog::logger& repo();     // repository/
+spdlog::logger& service();  // service/
+spdlog::logger& metrics();  // metrics/, tracing/
+
+} // namespace logging
+
+#endif //FRIENDS_TRIP_BOT_LOGGING_H
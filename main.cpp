@@ -1,20 +1,33 @@
-#include <iostream>
 #include <cstdlib>
 #include <csignal>
 #include <fstream>
 #include <string>
-#include <sstream>
 #include <memory>
 #include "bot/Bot.h"
+#include "bot/UpdateRecorder.h"
+#include "database/AsyncDatabase.h"
+#include "database/DatabaseConfig.h"
 #include "database/DatabaseManager.h"
 #include "database/DatabaseSchema.h"
 #include "handlers/Handlers.h"
 #include "repository/UserRepository.h"
+#include "repository/AsyncPaymentRepository.h"
+#include "repository/BotStateRepository.h"
+#include "repository/CallbackRepository.h"
 #include "repository/PaymentRepository.h"
 #include "repository/TripRepository.h"
+#include "repository/TripSnapshotRepository.h"
 #include "service/UserService.h"
 #include "service/PaymentService.h"
 #include "bot/Scheduler.h"
+#include "algorithm/SettlementEngine.h"
+#include "repository/ChatCache.h"
+#include "repository/CacheInvalidator.h"
+#include "metrics/Metrics.h"
+#include "logging/Logging.h"
+#include "metrics/MetricsServer.h"
+#include "tracing/Tracing.h"
+#include <spdlog/spdlog.h>
 
 static bot::Bot* g_bot = nullptr;
 static bot::Scheduler* g_scheduler = nullptr;
@@ -24,87 +37,178 @@ extern "C" void signalHandler(int) {
     if (g_scheduler) g_scheduler->stop();
 }
 
-void loadEnv(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) return;
-
-    std::string line;
-    while (std::getline(file, line)) {
-        if (line.empty() || line[0] == '#') continue;
-        size_t delimPos = line.find('=');
-        if (delimPos != std::string::npos) {
-            setenv(line.substr(0, delimPos).c_str(), line.substr(delimPos + 1).c_str(), 1);
-        }
-    }
-}
-
-std::string buildDbConnString() {
-    const char* host = std::getenv("POSTGRES_HOST");
-    const char* port = std::getenv("POSTGRES_PORT");
-    const char* name = std::getenv("POSTGRES_DB");
-    const char* user = std::getenv("POSTGRES_USER");
-    const char* pass = std::getenv("POSTGRES_PASSWORD");
-
-    if (!host || !port || !name || !user || !pass) return "";
-
-    std::stringstream ss;
-    ss << "host=" << host << " port=" << port << " dbname=" << name
-       << " user=" << user << " password=" << pass;
-    return ss.str();
-}
-
 int main() {
-    loadEnv(".env");
+    DatabaseConfig::loadEnv(".env");
+
+    // Logging is asynchronous from here on. LOG_LEVEL is a spec such as "info,db=debug";
+    // LOG_LEVEL_FILE, when set, is re-read every 10 seconds so levels change at runtime
+    logging::init();
+    const char* logLevelEnv = std::getenv("LOG_LEVEL");
+    if (logLevelEnv && !logging::setLevels(logLevelEnv)) {
+        spdlog::warn("Ignoring unparseable LOG_LEVEL '{}'", logLevelEnv);
+    }
 
     const char* tokenEnv = std::getenv("TELEGRAM_BOT_TOKEN");
     if (!tokenEnv) {
-        std::cerr << "Error: TELEGRAM_BOT_TOKEN environment variable not set." << std::endl;
+        spdlog::error("TELEGRAM_BOT_TOKEN environment variable not set.");
+        logging::shutdown();
         return 1;
     }
 
-    std::string dbConnString = buildDbConnString();
+    std::string dbConnString = DatabaseConfig::buildConnString();
     if (dbConnString.empty()) {
-        std::cerr << "Error: Database environment variables not fully set." << std::endl;
+        spdlog::error("Database environment variables not fully set.");
+        logging::shutdown();
         return 1;
     }
 
-    // Database
-    auto db = std::make_unique<DatabaseManager>(dbConnString);
-    db->connect();
-    DatabaseSchema::createTables(*db);
-
-    // Repositories
-    auto userRepo    = std::make_unique<UserRepository>(*db);
-    auto paymentRepo = std::make_unique<PaymentRepository>(*db);
-    auto tripRepo    = std::make_unique<TripRepository>(*db);
+    // The services log from their destructors and background threads, so all of them
+    // are gone before logging::shutdown() drains the queue
+    {
+        // Every connection carries this process's origin, so CacheInvalidator can tell
+        // our own writes' notifications from everyone else's
+        std::string origin = CacheInvalidator::newOrigin();
+        dbConnString = CacheInvalidator::withOrigin(dbConnString, origin);
+
+        // Database
+        auto db = std::make_unique<DatabaseManager>(dbConnString);
+        db->connect();
+        DatabaseSchema::createTables(*db);
+
+        // In-memory per-trip settlement state, kept current by PaymentRepository writes
+        auto settlementEngine = std::make_unique<SettlementEngine>();
+
+        // Rosters and trips read by every conversation, invalidated by repository writes
+        auto chatCache = std::make_unique<ChatCache>();
+
+        // Repositories
+        auto userRepo    = std::make_unique<UserRepository>(*db, *chatCache);
+        auto paymentRepo = std::make_unique<PaymentRepository>(*db, *settlementEngine);
+        auto tripRepo    = std::make_unique<TripRepository>(*db, *chatCache);
+
+        auto botStateRepo = std::make_unique<BotStateRepository>(*db);
+
+        // Outstanding "Log Payment" buttons from before the restart
+        auto callbackRepo = std::make_unique<CallbackRepository>(*db);
+        callbackRepo->load();
+
+        // Writes from other processes arrive as NOTIFYs from the schema's triggers
+        auto cacheInvalidator = std::make_unique<CacheInvalidator>(*chatCache, *settlementEngine, origin);
+        db->startListener(CacheInvalidator::CHANNEL,
+            [&cacheInvalidator](std::string_view payload) {
+                cacheInvalidator->handleNotification(payload);
+            },
+            [&cacheInvalidator] { cacheInvalidator->resync(); });
+
+        // Scheduler; daily times are local to SCHEDULER_UTC_OFFSET_HOURS (default GMT+8)
+        const char* utcOffsetEnv = std::getenv("SCHEDULER_UTC_OFFSET_HOURS");
+        bot::Scheduler scheduler(utcOffsetEnv ? std::atoi(utcOffsetEnv) : 8);
+        scheduler.registerTask([&chatCache, &cacheInvalidator] {
+            chatCache->logStats();
+            cacheInvalidator->logStats();
+        }, true, 00, 00, 00);
+        scheduler.scheduleEvery(std::chrono::minutes(1), [&callbackRepo] { callbackRepo->expire(); });
+        if (const char* levelFileEnv = std::getenv("LOG_LEVEL_FILE"); levelFileEnv && *levelFileEnv) {
+            scheduler.scheduleEvery(std::chrono::seconds(10), [path = std::string(levelFileEnv), applied = std::string()]() mutable {
+                std::ifstream file(path);
+                std::string spec;
+                if (!file || !std::getline(file, spec) || spec == applied) return;
+                applied = spec;
+                if (logging::setLevels(spec)) {
+                    spdlog::info("Log levels set to '{}'", spec);
+                } else {
+                    spdlog::warn("Ignoring unparseable log levels '{}' in {}", spec, path);
+                }
+            });
+        }
 
-    // Scheduler
-    bot::Scheduler scheduler;
+        // Bot; TELEGRAM_API_BASE_URL points it at a self-hosted Bot API server
+        const char* apiBaseUrlEnv = std::getenv("TELEGRAM_API_BASE_URL");
+        bot::Bot myBot(tokenEnv, scheduler, apiBaseUrlEnv ? apiBaseUrlEnv : "https://api.telegram.org");
+        if (const char* botUsername = std::getenv("TELEGRAM_BOT_USERNAME")) {
+            myBot.setUsername(botUsername);
+        }
+        // Resume after the last dispatched update rather than whatever Telegram still holds
+        myBot.setUpdateOffsetStore([&botStateRepo] { return botStateRepo->loadUpdateOffset(); },
+                                   [&botStateRepo](long long offset) { return botStateRepo->saveUpdateOffset(offset); });
+        // RECORD_UPDATES_PATH appends every batch of updates to an update log for replay_updates
+        bot::UpdateRecorder updateRecorder;
+        if (const char* recordPathEnv = std::getenv("RECORD_UPDATES_PATH"); recordPathEnv && *recordPathEnv) {
+            if (updateRecorder.open(recordPathEnv)) {
+                myBot.setUpdateRecorder([&updateRecorder](std::string_view body) { updateRecorder.record(body); });
+            }
+        }
+        // TRACE_PATH writes TRACE_SAMPLE_RATE (default 0.01) of updates as Chrome trace JSON
+        bool tracingEnabled = false;
+        if (const char* tracePathEnv = std::getenv("TRACE_PATH"); tracePathEnv && *tracePathEnv) {
+            const char* sampleRateEnv = std::getenv("TRACE_SAMPLE_RATE");
+            tracingEnabled = tracing::start(tracePathEnv, sampleRateEnv ? std::atof(sampleRateEnv) : 0.01);
+            if (tracingEnabled) {
+                scheduler.scheduleEvery(std::chrono::seconds(1), [] { tracing::flush(); });
+            }
+        }
+        // Abandoned conversations expire after CONVERSATION_IDLE_MINUTES (default 15);
+        // at most MAX_CONVERSATIONS (default 10000) stay live
+        const char* idleMinutesEnv = std::getenv("CONVERSATION_IDLE_MINUTES");
+        const char* maxConversationsEnv = std::getenv("MAX_CONVERSATIONS");
+        myBot.setConversationLimits(std::chrono::minutes(idleMinutesEnv ? std::atoi(idleMinutesEnv) : 15),
+                                    maxConversationsEnv ? std::strtoul(maxConversationsEnv, nullptr, 10) : 10000);
+
+        // Non-blocking queries; their continuations run on the bot's workers
+        auto asyncDb = std::make_unique<AsyncDatabase>(dbConnString, 2,
+            [&myBot](std::function<void()> task) { return myBot.tryPost(std::move(task)); });
+        asyncDb->start();
+        auto asyncPaymentRepo = std::make_unique<AsyncPaymentRepository>(*asyncDb, *settlementEngine);
+        auto snapshotRepo = std::make_unique<TripSnapshotRepository>(*db, *asyncDb);
+        scheduler.registerTask([&asyncDb] { asyncDb->logStats(); }, true, 00, 00, 00);
+
+        // Services
+        auto userService    = std::make_unique<UserService>(*userRepo, myBot);
+        auto paymentService = std::make_unique<PaymentService>(*paymentRepo, *asyncPaymentRepo, *tripRepo, *userRepo,
+                                                               *callbackRepo, myBot);
+
+        // Register handlers and start
+        handlers::Services services{*userService, *paymentService, *settlementEngine};
+        handlers::Repositories repos{*userRepo, *tripRepo, *paymentRepo, *snapshotRepo};
+        handlers::registerHandlers(myBot, services, repos);
+
+        // Prometheus scrape endpoint on METRICS_PORT (default 9464); 0 disables it
+        metrics::registry().gaugeFunction("log_messages_dropped", "Log messages dropped because the queue was full",
+            [] { return static_cast<double>(logging::droppedMessages()); });
+        metrics::registry().gaugeFunction("bot_stored_callbacks", "Stored button callbacks",
+            [&callbackRepo] { return static_cast<double>(callbackRepo->size()); }, {{"store", "durable"}});
+        const char* metricsPortEnv = std::getenv("METRICS_PORT");
+        const char* metricsBindEnv = std::getenv("METRICS_BIND_ADDRESS");
+        int metricsPort = metricsPortEnv ? std::atoi(metricsPortEnv) : 9464;
+        metrics::MetricsServer metricsServer(metrics::registry(), metricsBindEnv ? metricsBindEnv : "127.0.0.1", metricsPort);
+        if (metricsPort > 0) {
+            metricsServer.start();
+        }
 
-    // Bot
-    bot::Bot myBot(tokenEnv, scheduler);
-    if (const char* botUsername = std::getenv("TELEGRAM_BOT_USERNAME")) {
-        myBot.setUsername(botUsername);
+        // Signal handling for graceful shutdown
+        g_bot = &myBot;
+        g_scheduler = &scheduler;
+        std::signal(SIGINT, signalHandler);
+        std::signal(SIGTERM, signalHandler);
+
+        // Start scheduler before bot (bot.start() blocks)
+        scheduler.startWorker();
+        myBot.start();
+
+        // The listener calls into the invalidator, which is destroyed before db
+        db->stopListener();
+        // Fails what is still in flight while the repositories it calls back into exist
+        asyncDb->stop();
+        // Its samplers read the repositories and the bot
+        metricsServer.stop();
+        if (tracingEnabled) {
+            tracing::stop();
+        }
+        // A late signal must not reach the bot or scheduler once they are destroyed
+        g_bot = nullptr;
+        g_scheduler = nullptr;
     }
-
-    // Services
-    auto userService    = std::make_unique<UserService>(*userRepo, myBot);
-    auto paymentService = std::make_unique<PaymentService>(*paymentRepo, *tripRepo, *userRepo, myBot);
-
-    // Register handlers and start
-    handlers::Services services{*userService, *paymentService};
-    handlers::Repositories repos{*userRepo, *tripRepo, *paymentRepo};
-    handlers::registerHandlers(myBot, services, repos);
-
-    // Signal handling for graceful shutdown
-    g_bot = &myBot;
-    g_scheduler = &scheduler;
-    std::signal(SIGINT, signalHandler);
-    std::signal(SIGTERM, signalHandler);
-
-    // Start scheduler before bot (bot.start() blocks)
-    scheduler.startWorker();
-    myBot.start();
+    logging::shutdown();
 
     return 0;
 }
\ No newline at end of file
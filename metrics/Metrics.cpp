@@ -0,0 +1,169 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace metrics {
+
+namespace {
+
+std::string escapeLabelValue(std::string_view value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') escaped += '\\';
+        if (c == '\n') {
+            escaped += "\\n";
+            continue;
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+std::string renderLabels(const Labels& labels) {
+    std::string rendered;
+    for (const auto& [key, value] : labels) {
+        if (!rendered.empty()) rendered += ',';
+        rendered += key + "=\"" + escapeLabelValue(value) + "\"";
+    }
+    return rendered;
+}
+
+std::string formatValue(double value) {
+    if (std::isinf(value)) return value > 0 ? "+Inf" : "-Inf";
+    std::ostringstream out;
+    out.precision(12);
+    out << value;
+    return out.str();
+}
+
+// name{labels,extra}
+std::string seriesName(std::string_view name, const std::string& labels, const std::string& extra = "") {
+    std::string result(name);
+    if (labels.empty() && extra.empty()) return result;
+    result += '{';
+    result += labels;
+    if (!labels.empty() && !extra.empty()) result += ',';
+    result += extra;
+    result += '}';
+    return result;
+}
+
+} // namespace
+
+Histogram::Histogram(std::initializer_list<double> bounds) {
+    for (double bound : bounds) {
+        if (bucketCount_ == kMaxBuckets) break;
+        bounds_[bucketCount_++] = bound;
+    }
+    std::sort(bounds_.begin(), bounds_.begin() + bucketCount_);
+}
+
+void Histogram::observe(double value) {
+    std::size_t i = 0;
+    while (i < bucketCount_ && value > bounds_[i]) ++i;
+    counts_[i].fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+}
+
+Registry::Series& Registry::series(std::string_view name, std::string_view help, Type type, const Labels& labels) {
+    std::string rendered = renderLabels(labels);
+    auto familyIt = std::find_if(families_.begin(), families_.end(),
+                                 [name](const auto& family) { return family->name == name; });
+    if (familyIt == families_.end()) {
+        families_.push_back(std::make_unique<Family>(Family{std::string(name), std::string(help), type, {}}));
+        familyIt = std::prev(families_.end());
+    }
+    auto& family = **familyIt;
+    for (auto& existing : family.series) {
+        if (existing->labels == rendered) return *existing;
+    }
+    family.series.push_back(std::make_unique<Series>());
+    family.series.back()->labels = std::move(rendered);
+    return *family.series.back();
+}
+
+Counter& Registry::counter(std::string_view name, std::string_view help, const Labels& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& s = series(name, help, Type::Counter, labels);
+    if (!s.counter) s.counter = std::make_unique<Counter>();
+    return *s.counter;
+}
+
+Gauge& Registry::gauge(std::string_view name, std::string_view help, const Labels& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& s = series(name, help, Type::Gauge, labels);
+    if (!s.gauge) s.gauge = std::make_unique<Gauge>();
+    return *s.gauge;
+}
+
+Histogram& Registry::histogram(std::string_view name, std::string_view help, const Labels& labels,
+                               std::initializer_list<double> bounds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& s = series(name, help, Type::Histogram, labels);
+    if (!s.histogram) s.histogram = std::make_unique<Histogram>(bounds);
+    return *s.histogram;
+}
+
+void Registry::gaugeFunction(std::string_view name, std::string_view help, std::function<double()> sample,
+                             const Labels& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    series(name, help, Type::Gauge, labels).sample = std::move(sample);
+}
+
+std::string Registry::render() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string out;
+    for (const auto& family : families_) {
+        const char* type = family->type == Type::Counter ? "counter"
+                         : family->type == Type::Gauge ? "gauge" : "histogram";
+        out += "# HELP " + family->name + " " + family->help + "\n";
+        out += "# TYPE " + family->name + " " + type + "\n";
+
+        for (const auto& s : family->series) {
+            if (s->counter) {
+                out += seriesName(family->name, s->labels) + " " + std::to_string(s->counter->value()) + "\n";
+            } else if (s->sample) {
+                out += seriesName(family->name, s->labels) + " " + formatValue(s->sample()) + "\n";
+            } else if (s->gauge) {
+                out += seriesName(family->name, s->labels) + " " + std::to_string(s->gauge->value()) + "\n";
+            } else if (s->histogram) {
+                const Histogram& h = *s->histogram;
+                uint64_t cumulative = 0;
+                for (std::size_t i = 0; i <= h.bucketCount(); ++i) {
+                    cumulative += h.bucketValue(i);
+                    double le = i < h.bucketCount() ? h.bound(i) : INFINITY;
+                    out += seriesName(family->name + "_bucket", s->labels, "le=\"" + formatValue(le) + "\"")
+                         + " " + std::to_string(cumulative) + "\n";
+                }
+                out += seriesName(family->name + "_sum", s->labels) + " " + formatValue(h.sum()) + "\n";
+                out += seriesName(family->name + "_count", s->labels) + " " + std::to_string(cumulative) + "\n";
+            }
+        }
+    }
+    return out;
+}
+
+void Registry::visitHistograms(std::string_view name,
+                               const std::function<void(const std::string&, const Histogram&)>& visit) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& family : families_) {
+        if (family->name != name) continue;
+        for (const auto& s : family->series) {
+            if (s->histogram) visit(s->labels, *s->histogram);
+        }
+    }
+}
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+Histogram& dbQueryLatency(std::string_view statement) {
+    return registry().histogram("db_query_duration_seconds", "Database statement latency",
+                                {{"statement", std::string(statement)}});
+}
+
+} // namespace metrics
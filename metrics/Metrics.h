@@ -0,0 +1,139 @@
+#ifndef FRIENDS_TRIP_BOT_METRICS_H
+#define FRIENDS_TRIP_BOT_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace metrics {
+
+using Labels = std::vector<std::pair<std::string, std::string>>;
+
+class Counter {
+public:
+    void inc(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+class Gauge {
+public:
+    void set(int64_t v) { value_.store(v, std::memory_order_relaxed); }
+    void add(int64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+// Fixed upper bounds chosen at registration; observe() is a short linear scan plus
+// two relaxed atomic adds, with no allocation or locking
+class Histogram {
+public:
+    static constexpr std::size_t kMaxBuckets = 16;
+
+    explicit Histogram(std::initializer_list<double> bounds);
+
+    void observe(double value);
+    void observe(std::chrono::steady_clock::duration elapsed) {
+        observe(std::chrono::duration<double>(elapsed).count());
+    }
+
+    std::size_t bucketCount() const { return bucketCount_; }
+    double bound(std::size_t i) const { return bounds_[i]; }
+    // Non-cumulative; index bucketCount() is the +Inf overflow bucket
+    uint64_t bucketValue(std::size_t i) const { return counts_[i].load(std::memory_order_relaxed); }
+    double sum() const { return sum_.load(std::memory_order_relaxed); }
+
+private:
+    std::array<double, kMaxBuckets> bounds_{};
+    std::size_t bucketCount_ = 0;
+    std::array<std::atomic<uint64_t>, kMaxBuckets + 1> counts_{};
+    std::atomic<double> sum_{0.0};
+};
+
+// Bucket sets shared by the latency and size histograms
+inline constexpr std::initializer_list<double> kLatencyBuckets = {
+    0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30};
+inline constexpr std::initializer_list<double> kSizeBuckets = {0, 1, 2, 5, 10, 20, 50, 100};
+
+// Metrics by name and label set, rendered in the Prometheus text format. Registering
+// allocates and locks, so callers look a metric up once and keep the reference;
+// references stay valid for the life of the process.
+class Registry {
+public:
+    Counter& counter(std::string_view name, std::string_view help, const Labels& labels = {});
+    Gauge& gauge(std::string_view name, std::string_view help, const Labels& labels = {});
+    Histogram& histogram(std::string_view name, std::string_view help, const Labels& labels = {},
+                         std::initializer_list<double> bounds = kLatencyBuckets);
+    // Sampled when scraped, for values something else already tracks (e.g. a map's size).
+    // Replaces any earlier function for the same name and labels.
+    void gaugeFunction(std::string_view name, std::string_view help, std::function<double()> sample,
+                       const Labels& labels = {});
+
+    std::string render() const;
+
+    // Calls visit with every series of the histogram family name and its rendered
+    // labels, e.g. for a tool summarising a run in-process
+    void visitHistograms(std::string_view name,
+                         const std::function<void(const std::string& labels, const Histogram&)>& visit) const;
+
+private:
+    enum class Type { Counter, Gauge, Histogram };
+
+    struct Series {
+        std::string labels;  // rendered, e.g. method="sendMessage",status="2xx"
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+        std::function<double()> sample;
+    };
+
+    struct Family {
+        std::string name;
+        std::string help;
+        Type type;
+        std::vector<std::unique_ptr<Series>> series;
+    };
+
+    Series& series(std::string_view name, std::string_view help, Type type, const Labels& labels);
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Family>> families_;
+};
+
+Registry& registry();
+
+// Observes the time from construction to destruction
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& histogram)
+        : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() { histogram_.observe(std::chrono::steady_clock::now() - start_); }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// db_query_duration_seconds{statement=...}; keep the result in a function-local static
+Histogram& dbQueryLatency(std::string_view statement);
+
+} // namespace metrics
+
+#endif //FRIENDS_TRIP_BOT_METRICS_H
@@ -0,0 +1,118 @@
+#include "MetricsServer.h"
+#include "../logging/Logging.h"
+#include "Metrics.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <string_view>
+
+namespace metrics {
+
+namespace {
+
+void writeAll(int fd, const std::string& data) {
+    std::size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return;
+        }
+        written += static_cast<std::size_t>(n);
+    }
+}
+
+std::string response(const char* status, const char* contentType, const std::string& body) {
+    return std::string("HTTP/1.1 ") + status + "\r\n"
+         + "Content-Type: " + contentType + "\r\n"
+         + "Content-Length: " + std::to_string(body.size()) + "\r\n"
+         + "Connection: close\r\n\r\n" + body;
+}
+
+} // namespace
+
+MetricsServer::MetricsServer(Registry& registry, std::string bindAddress, int port)
+    : registry_(registry), bindAddress_(std::move(bindAddress)), port_(port) {}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+bool MetricsServer::start() {
+    listenFd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd_ < 0) {
+        logging::metrics().error("Metrics server: socket() failed: {}", std::strerror(errno));
+        return false;
+    }
+    int reuse = 1;
+    ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port_));
+    if (::inet_pton(AF_INET, bindAddress_.c_str(), &addr.sin_addr) != 1
+        || ::bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+        || ::listen(listenFd_, 16) != 0) {
+        logging::metrics().error("Metrics server: cannot listen on {}:{}: {}", bindAddress_, port_, std::strerror(errno));
+        ::close(listenFd_);
+        listenFd_ = -1;
+        return false;
+    }
+
+    running_ = true;
+    thread_ = std::thread(&MetricsServer::serveLoop, this);
+    logging::metrics().info("Metrics available at http://{}:{}/metrics", bindAddress_, port_);
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (running_.exchange(false) && thread_.joinable()) {
+        thread_.join();
+    }
+    if (listenFd_ >= 0) {
+        ::close(listenFd_);
+        listenFd_ = -1;
+    }
+}
+
+void MetricsServer::serveLoop() {
+    while (running_) {
+        // Wakes every 500ms to notice stop()
+        pollfd pfd{listenFd_, POLLIN, 0};
+        if (::poll(&pfd, 1, 500) <= 0) continue;
+
+        int fd = ::accept(listenFd_, nullptr, nullptr);
+        if (fd < 0) continue;
+        handleConnection(fd);
+        ::close(fd);
+    }
+}
+
+void MetricsServer::handleConnection(int fd) {
+    // Only the request line matters; a scraper's headers fit well within this
+    std::string request;
+    char buffer[2048];
+    while (request.find("\r\n") == std::string::npos && request.size() < 8192) {
+        pollfd pfd{fd, POLLIN, 0};
+        if (::poll(&pfd, 1, 2000) <= 0) return;
+        ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) return;
+        request.append(buffer, static_cast<std::size_t>(n));
+    }
+
+    std::string requestLine = request.substr(0, request.find("\r\n"));
+    constexpr std::string_view prefix = "GET /metrics";
+    bool isMetrics = requestLine.rfind(prefix, 0) == 0 && requestLine.size() > prefix.size()
+                  && (requestLine[prefix.size()] == ' ' || requestLine[prefix.size()] == '?');
+    if (isMetrics) {
+        writeAll(fd, response("200 OK", "text/plain; version=0.0.4; charset=utf-8", registry_.render()));
+    } else {
+        writeAll(fd, response("404 Not Found", "text/plain", "Not found\n"));
+    }
+}
+
+} // namespace metrics
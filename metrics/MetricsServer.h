@@ -0,0 +1,40 @@
+#ifndef FRIENDS_TRIP_BOT_METRICSSERVER_H
+#define FRIENDS_TRIP_BOT_METRICSSERVER_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+namespace metrics {
+
+class Registry;
+
+// Serves GET /metrics from registry on its own thread, one connection at a time.
+// Meant for a local scraper; it only speaks enough HTTP/1.1 for that.
+class MetricsServer {
+public:
+    MetricsServer(Registry& registry, std::string bindAddress, int port);
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    // False if the socket could not be bound
+    bool start();
+    void stop();
+
+private:
+    void serveLoop();
+    void handleConnection(int fd);
+
+    Registry& registry_;
+    std::string bindAddress_;
+    int port_;
+    int listenFd_ = -1;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+};
+
+} // namespace metrics
+
+#endif //FRIENDS_TRIP_BOT_METRICSSERVER_H
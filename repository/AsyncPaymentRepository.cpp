@@ -0,0 +1,100 @@
+#include "AsyncPaymentRepository.h"
+#include "../logging/Logging.h"
+#include "../algorithm/SettlementEngine.h"
+#include "../database/AsyncDatabase.h"
+#include "../metrics/Metrics.h"
+#include "../tracing/Tracing.h"
+#include "../utils/utils.h"
+#include <memory>
+
+AsyncPaymentRepository::AsyncPaymentRepository(AsyncDatabase& db, SettlementEngine& settlementEngine)
+    : db_(db), settlementEngine_(settlementEngine) {}
+
+void AsyncPaymentRepository::deleteLastPaymentGroupInActiveTrip(long long chatId, long long threadId,
+                                                                 DeletedCallback onDone) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("payment_group_delete_last_async");
+    auto start = std::chrono::steady_clock::now();
+    tracing::AsyncSpan span("db", "payment_group_delete_last_async");
+    // The statement commits on its own and only it knows the trip, so begin the write
+    // for any trip before sending it. Shared: the continuation must be copyable.
+    auto write = std::make_shared<SettlementEngine::PendingWrite>(settlementEngine_.beginWrite());
+    db_.query(
+        "WITH target AS ("
+        "    SELECT g.group_id FROM payment_groups g "
+        "    JOIN chats c ON c.active_trip_id = g.trip_id "
+        "    WHERE c.chat_id = $1 AND c.thread_id = $2 "
+        "    ORDER BY g.gmt_created DESC LIMIT 1 FOR UPDATE OF g"
+        "), deleted_records AS ("
+        "    DELETE FROM payment_records WHERE group_id IN (SELECT group_id FROM target) "
+        "    RETURNING record_id, group_id, trip_id, amount, currency, from_user_id, to_user_id, gmt_created"
+        "), deleted_group AS ("
+        "    DELETE FROM payment_groups WHERE group_id IN (SELECT group_id FROM target) "
+        "    RETURNING group_id, trip_id, name, total_amount, currency, payer_user_id, gmt_created"
+        ") "
+        "SELECT g.group_id, g.trip_id, g.name, g.total_amount, g.currency, g.payer_user_id, g.gmt_created, "
+        "       r.record_id, r.trip_id AS record_trip_id, r.amount AS record_amount, "
+        "       r.currency AS record_currency, r.from_user_id, r.to_user_id, r.gmt_created AS record_gmt_created "
+        "FROM deleted_group g LEFT JOIN deleted_records r ON r.group_id = g.group_id "
+        "ORDER BY r.gmt_created DESC",
+        AsyncParams(chatId, threadId),
+        [start, span, write, onDone = std::move(onDone)](AsyncResult res) {
+            // Until the continuation runs, which is what the caller waits for
+            latency.observe(std::chrono::steady_clock::now() - start);
+            span.end();
+            if (!res.ok()) {
+                // The write is left unfinished: the settlement state is evicted
+                logging::repo().error("Error deleting last payment group: {}", res.error());
+                onDone(std::nullopt);
+                return;
+            }
+            if (res.rows() == 0) {
+                write->unchanged();
+                onDone(std::nullopt);
+                return;
+            }
+
+            const int groupId = res.column("group_id");
+            const int tripId = res.column("trip_id");
+            const int name = res.column("name");
+            const int totalAmount = res.column("total_amount");
+            const int currency = res.column("currency");
+            const int payerUserId = res.column("payer_user_id");
+            const int gmtCreated = res.column("gmt_created");
+            const int recordId = res.column("record_id");
+            const int recordTripId = res.column("record_trip_id");
+            const int recordAmount = res.column("record_amount");
+            const int recordCurrency = res.column("record_currency");
+            const int fromUserId = res.column("from_user_id");
+            const int toUserId = res.column("to_user_id");
+            const int recordGmtCreated = res.column("record_gmt_created");
+
+            PaymentGroup group{
+                res.getLongLong(0, groupId),
+                res.getLongLong(0, tripId),
+                std::string(res.get(0, name)),
+                MoneyAmount(res.get(0, currency), res.getLongLong(0, totalAmount)),
+                res.getLongLong(0, payerUserId),
+                utils::parseTimestamp(res.get(0, gmtCreated)),
+                {}
+            };
+
+            for (int row = 0; row < res.rows(); ++row) {
+                if (res.isNull(row, recordId)) continue;  // group without records
+                group.records.emplace_back(PaymentRecord{
+                    res.getLongLong(row, recordId),
+                    group.payment_group_id,
+                    res.getLongLong(row, recordTripId),
+                    MoneyAmount(res.get(row, recordCurrency), res.getLongLong(row, recordAmount)),
+                    res.getLongLong(row, fromUserId),
+                    res.getLongLong(row, toUserId),
+                    utils::parseTimestamp(res.get(row, recordGmtCreated))
+                });
+            }
+
+            write->revert(group);
+            logging::repo().info("Deleted last payment group: group_id={}, trip_id={}, name='{}', total_amount={} {}, payer_user_id={}, records={}",
+                                 group.payment_group_id, group.trip_id, group.name, group.total_amount.minorAmount(),
+                                 group.total_amount.currency(), group.payer_user_id, group.records.size());
+            onDone(std::move(group));
+        });
+}
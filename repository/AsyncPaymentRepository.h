@@ -0,0 +1,28 @@
+#ifndef FRIENDS_TRIP_BOT_ASYNCPAYMENTREPOSITORY_H
+#define FRIENDS_TRIP_BOT_ASYNCPAYMENTREPOSITORY_H
+
+#include "PaymentRepository.h"
+#include <functional>
+#include <optional>
+
+class AsyncDatabase;
+class SettlementEngine;
+
+// Payment operations on the non-blocking AsyncDatabase. Callbacks run on a bot worker
+// once the result is in; no worker is held while the query is on the wire.
+class AsyncPaymentRepository {
+public:
+    // Called with the deleted group, or std::nullopt if there was none or the query failed
+    using DeletedCallback = std::function<void(std::optional<PaymentGroup>)>;
+
+    AsyncPaymentRepository(AsyncDatabase& db, SettlementEngine& settlementEngine);
+
+    // Deletes the newest payment group of the chat's active trip, in one statement
+    void deleteLastPaymentGroupInActiveTrip(long long chatId, long long threadId, DeletedCallback onDone);
+
+private:
+    AsyncDatabase& db_;
+    SettlementEngine& settlementEngine_;
+};
+
+#endif //FRIENDS_TRIP_BOT_ASYNCPAYMENTREPOSITORY_H
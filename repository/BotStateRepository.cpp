@@ -0,0 +1,56 @@
+#include "BotStateRepository.h"
+#include "../logging/Logging.h"
+#include "../metrics/Metrics.h"
+#include "../tracing/Tracing.h"
+#include "../database/DatabaseManager.h"
+#include <pqxx/pqxx>
+
+BotStateRepository::BotStateRepository(DatabaseManager& dbManager) : dbManager_(dbManager) {}
+
+std::optional<long long> BotStateRepository::loadUpdateOffset() {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("update_offset_load");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "update_offset_load");
+
+    pqxx::connection* conn = dbManager_.getConnection();
+    if (!conn || !conn->is_open()) {
+        logging::repo().error("Error loading update offset: database connection unavailable");
+        return std::nullopt;
+    }
+
+    try {
+        pqxx::work txn(*conn);
+        pqxx::result res = txn.exec("SELECT value FROM bot_state WHERE name = 'update_offset'");
+        txn.commit();
+        return res.empty() ? 0 : res[0][0].as<long long>();
+    } catch (const std::exception& e) {
+        logging::repo().error("Error loading update offset: {}", e.what());
+        return std::nullopt;
+    }
+}
+
+bool BotStateRepository::saveUpdateOffset(long long offset) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("update_offset_save");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "update_offset_save");
+
+    pqxx::connection* conn = dbManager_.getConnection();
+    if (!conn || !conn->is_open()) {
+        logging::repo().error("Error saving update offset: database connection unavailable");
+        return false;
+    }
+
+    try {
+        pqxx::work txn(*conn);
+        txn.exec(
+            "INSERT INTO bot_state (name, value) VALUES ('update_offset', $1) "
+            "ON CONFLICT (name) DO UPDATE SET value = EXCLUDED.value, "
+            "                                 gmt_modified = CURRENT_TIMESTAMP",
+            pqxx::params{offset});
+        txn.commit();
+        return true;
+    } catch (const std::exception& e) {
+        logging::repo().error("Error saving update offset: {}", e.what());
+        return false;
+    }
+}
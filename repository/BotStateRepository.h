@@ -0,0 +1,24 @@
+#ifndef FRIENDS_TRIP_BOT_BOTSTATEREPOSITORY_H
+#define FRIENDS_TRIP_BOT_BOTSTATEREPOSITORY_H
+
+#include <optional>
+
+class DatabaseManager;
+
+// Small pieces of bot state that must survive restarts, one row each in bot_state
+class BotStateRepository {
+public:
+    explicit BotStateRepository(DatabaseManager& dbManager);
+
+    // getUpdates offset from the last checkpoint; 0 if never saved,
+    // std::nullopt on database errors
+    std::optional<long long> loadUpdateOffset();
+    // Overwrites the stored offset, backwards too (Telegram can reset update_id);
+    // false on database errors
+    bool saveUpdateOffset(long long offset);
+
+private:
+    DatabaseManager& dbManager_;
+};
+
+#endif //FRIENDS_TRIP_BOT_BOTSTATEREPOSITORY_H
@@ -0,0 +1,104 @@
+#include "CacheInvalidator.h"
+#include "../logging/Logging.h"
+#include "ChatCache.h"
+#include "../algorithm/SettlementEngine.h"
+#include <chrono>
+#include <cstdio>
+#include <optional>
+#include <random>
+#include <string>
+#include <nlohmann/json.hpp>
+
+std::string CacheInvalidator::newOrigin() {
+    std::random_device device;
+    std::mt19937_64 rng((static_cast<uint64_t>(device()) << 32) ^ device());
+    uint64_t high = rng();
+    uint64_t low = rng();
+    high = (high & ~0xf000ULL) | 0x4000ULL;             // version 4
+    low = (low & ~(0xc0ULL << 56)) | (0x80ULL << 56);   // RFC 4122 variant
+
+    char text[37];
+    std::snprintf(text, sizeof(text), "%08llx-%04llx-%04llx-%04llx-%012llx",
+                  static_cast<unsigned long long>(high >> 32),
+                  static_cast<unsigned long long>(high >> 16 & 0xffff),
+                  static_cast<unsigned long long>(high & 0xffff),
+                  static_cast<unsigned long long>(low >> 48),
+                  static_cast<unsigned long long>(low & 0xffffffffffffULL));
+    return text;
+}
+
+std::string CacheInvalidator::withOrigin(const std::string& connectionString, const std::string& origin) {
+    // libpq passes options to the server as command-line switches for the session
+    return connectionString + " options='-c " + ORIGIN_SETTING + "=" + origin + "'";
+}
+
+CacheInvalidator::CacheInvalidator(ChatCache& chatCache, SettlementEngine& settlementEngine, std::string origin)
+    : chatCache_(chatCache), settlementEngine_(settlementEngine), origin_(std::move(origin)) {}
+
+void CacheInvalidator::handleNotification(std::string_view payload) {
+    received_.fetch_add(1, std::memory_order_relaxed);
+
+    try {
+        auto j = nlohmann::json::parse(payload);
+        if (auto origin = j.find("origin"); origin != j.end() && origin->is_string() && *origin == origin_) {
+            ownSkipped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        const std::string table = j.at("table").get<std::string>();
+        const std::string op = j.at("op").get<std::string>();
+        auto id = [&j](const char* key) -> std::optional<long long> {
+            if (!j.contains(key) || j[key].is_null()) return std::nullopt;
+            return j[key].get<long long>();
+        };
+
+        auto chatId = id("chat_id");
+        auto threadId = id("thread_id");
+        auto tripId = id("trip_id");
+
+        if (table == "users" && chatId && threadId) {
+            chatCache_.rosters.invalidate({*chatId, *threadId});
+        } else if (table == "trips" && chatId && threadId) {
+            chatCache_.trips.invalidate({*chatId, *threadId});
+            chatCache_.activeTrips.invalidate({*chatId, *threadId});
+            if (op == "DELETE" && tripId) settlementEngine_.evict(*tripId);
+        } else if (table == "chats" && chatId && threadId) {
+            chatCache_.activeTrips.invalidate({*chatId, *threadId});
+        } else if ((table == "payment_groups" || table == "payment_records") && tripId) {
+            settlementEngine_.evict(*tripId);
+        } else {
+            malformed_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        if (auto sentAtMs = id("sent_at_ms")) {
+            auto nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            int64_t lag = nowMs - *sentAtMs;
+            lagSamples_.fetch_add(1, std::memory_order_relaxed);
+            lagTotalMs_.fetch_add(lag, std::memory_order_relaxed);
+            int64_t max = lagMaxMs_.load(std::memory_order_relaxed);
+            while (lag > max && !lagMaxMs_.compare_exchange_weak(max, lag, std::memory_order_relaxed)) {}
+        }
+    } catch (const std::exception& e) {
+        malformed_.fetch_add(1, std::memory_order_relaxed);
+        logging::repo().error("Error handling cache invalidation '{}': {}", payload, e.what());
+    }
+}
+
+void CacheInvalidator::resync() {
+    resyncs_.fetch_add(1, std::memory_order_relaxed);
+    chatCache_.clear();
+    settlementEngine_.evictAll();
+}
+
+void CacheInvalidator::logStats() const {
+    uint64_t samples = lagSamples_.load(std::memory_order_relaxed);
+    logging::repo().info("Cache invalidation: received={}, own_skipped={}, malformed={}, resyncs={}, lag_avg_ms={:.1f}, lag_max_ms={}",
+                         received_.load(std::memory_order_relaxed),
+                         ownSkipped_.load(std::memory_order_relaxed),
+                         malformed_.load(std::memory_order_relaxed),
+                         resyncs_.load(std::memory_order_relaxed),
+                         samples ? static_cast<double>(lagTotalMs_.load(std::memory_order_relaxed)) / samples : 0.0,
+                         lagMaxMs_.load(std::memory_order_relaxed));
+}
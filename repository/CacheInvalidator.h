@@ -0,0 +1,55 @@
+#ifndef FRIENDS_TRIP_BOT_CACHEINVALIDATOR_H
+#define FRIENDS_TRIP_BOT_CACHEINVALIDATOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+class ChatCache;
+class SettlementEngine;
+
+// Applies row-change notifications from the database triggers (see DatabaseSchema) to
+// the in-memory caches, so writes made by other bot processes or by hand are seen.
+// Notifications caused by this process are skipped: its repositories already
+// invalidated (or updated) the caches when they wrote. Each process picks a random
+// origin id and sets it on every connection it opens (withOrigin()); the triggers copy
+// it into the payload, so this holds for all of its connections and across reconnects.
+class CacheInvalidator {
+public:
+    static constexpr const char* CHANNEL = "cache_invalidation";
+    // Custom session setting the triggers read the origin from
+    static constexpr const char* ORIGIN_SETTING = "friends_trip_bot.origin";
+
+    // A random UUID (version 4) identifying this process
+    static std::string newOrigin();
+    // connectionString with ORIGIN_SETTING set to origin for the session
+    static std::string withOrigin(const std::string& connectionString, const std::string& origin);
+
+    CacheInvalidator(ChatCache& chatCache, SettlementEngine& settlementEngine, std::string origin);
+
+    void handleNotification(std::string_view payload);
+
+    // Drops everything cached; used when notifications may have been missed
+    void resync();
+
+    void logStats() const;
+
+private:
+    ChatCache& chatCache_;
+    SettlementEngine& settlementEngine_;
+    const std::string origin_;
+
+    std::atomic<uint64_t> received_{0};
+    std::atomic<uint64_t> ownSkipped_{0};
+    std::atomic<uint64_t> malformed_{0};
+    std::atomic<uint64_t> resyncs_{0};
+
+    // Commit-to-invalidation lag, measured against the trigger's clock_timestamp()
+    // (so it includes any clock skew between the database and this host)
+    std::atomic<uint64_t> lagSamples_{0};
+    std::atomic<int64_t> lagTotalMs_{0};
+    std::atomic<int64_t> lagMaxMs_{0};
+};
+
+#endif //FRIENDS_TRIP_BOT_CACHEINVALIDATOR_H
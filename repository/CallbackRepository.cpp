@@ -0,0 +1,223 @@
+#include "CallbackRepository.h"
+#include "../logging/Logging.h"
+#include "../metrics/Metrics.h"
+#include "../tracing/Tracing.h"
+#include "../database/DatabaseManager.h"
+#include <charconv>
+#include <pqxx/pqxx>
+#include <vector>
+
+namespace {
+
+// stored_callbacks.kind
+constexpr int KIND_LOG_SIMPLIFIED_PAYMENT = 1;
+
+} // namespace
+
+CallbackRepository::CallbackRepository(DatabaseManager& dbManager) : dbManager_(dbManager) {}
+
+std::size_t CallbackRepository::load() {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("callback_load");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "callback_load");
+
+    pqxx::connection* conn = dbManager_.getConnection();
+    if (!conn || !conn->is_open()) {
+        logging::repo().error("Error loading stored callbacks: database connection unavailable");
+        return 0;
+    }
+
+    try {
+        pqxx::work txn(*conn);
+        txn.exec("DELETE FROM stored_callbacks WHERE expires_at <= LOCALTIMESTAMP");
+        pqxx::result res = txn.exec(
+            "SELECT callback_id, kind, trip_id, chat_id, thread_id, from_user_id, to_user_id, amount, currency, "
+            "       EXTRACT(EPOCH FROM (expires_at - LOCALTIMESTAMP))::bigint AS remaining_seconds "
+            "FROM stored_callbacks "
+            "ORDER BY callback_id");
+        txn.commit();
+
+        auto now = std::chrono::steady_clock::now();
+        std::size_t loaded = 0;
+        for (const auto& row : res) {
+            if (row["kind"].as<int>() != KIND_LOG_SIMPLIFIED_PAYMENT) {
+                logging::repo().warn("Skipping stored callback {} of unknown kind {}",
+                                     row["callback_id"].as<long long>(), row["kind"].as<int>());
+                continue;
+            }
+            LogSimplifiedPayment payment{
+                row["trip_id"].as<long long>(),
+                row["chat_id"].as<long long>(),
+                row["thread_id"].as<long long>(),
+                row["from_user_id"].as<long long>(),
+                row["to_user_id"].as<long long>(),
+                MoneyAmount(row["currency"].as<std::string>(), row["amount"].as<long long>())};
+            remember(row["callback_id"].as<long long>(), payment,
+                     now + std::chrono::seconds(row["remaining_seconds"].as<long long>()));
+            ++loaded;
+        }
+        logging::repo().info("Loaded {} stored callback(s)", loaded);
+        return loaded;
+    } catch (const std::exception& e) {
+        logging::repo().error("Error loading stored callbacks: {}", e.what());
+        return 0;
+    }
+}
+
+std::string CallbackRepository::store(const CallbackPayload& payload, std::chrono::hours expiry) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("callback_store");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "callback_store");
+
+    pqxx::connection* conn = dbManager_.getConnection();
+    if (!conn || !conn->is_open()) {
+        logging::repo().error("Error storing callback: database connection unavailable");
+        return "";
+    }
+
+    const auto& payment = std::get<LogSimplifiedPayment>(payload);
+    try {
+        pqxx::work txn(*conn);
+        pqxx::result res = txn.exec(
+            "INSERT INTO stored_callbacks "
+            "    (kind, trip_id, chat_id, thread_id, from_user_id, to_user_id, amount, currency, expires_at) "
+            "VALUES ($1, $2, $3, $4, $5, $6, $7, $8, LOCALTIMESTAMP + make_interval(hours => $9)) "
+            "RETURNING callback_id",
+            pqxx::params{KIND_LOG_SIMPLIFIED_PAYMENT, payment.trip_id, payment.chat_id, payment.thread_id,
+                         payment.from_user_id, payment.to_user_id, payment.amount.minorAmount(),
+                         payment.amount.currency(), static_cast<int>(expiry.count())});
+        txn.commit();
+
+        long long id = res[0][0].as<long long>();
+        remember(id, payload, std::chrono::steady_clock::now() + expiry);
+        return std::to_string(id);
+    } catch (const std::exception& e) {
+        logging::repo().error("Error storing callback: {}", e.what());
+        return "";
+    }
+}
+
+std::optional<StoredCallback> CallbackRepository::take(const std::string& key) {
+    long long id = 0;
+    auto [ptr, ec] = std::from_chars(key.data(), key.data() + key.size(), id);
+    if (ec != std::errc{} || ptr != key.data() + key.size()) return std::nullopt;
+
+    std::optional<StoredCallback> entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(id);
+        if (it == index_.end()) return std::nullopt;
+        entry = std::move(it->second);
+        index_.erase(it);
+        deadlines_.cancel(id);
+    }
+    // Past its deadline but not yet reached by expire()
+    if (entry->deadline <= std::chrono::steady_clock::now()) return std::nullopt;
+
+    pqxx::connection* conn = dbManager_.getConnection();
+    if (!conn || !conn->is_open()) {
+        logging::repo().error("Error taking callback: database connection unavailable");
+        remember(id, std::move(entry->payload), entry->deadline);
+        return std::nullopt;
+    }
+
+    // The row goes before the payload runs: a crash in between loses one press
+    // rather than letting the button fire again after a restart
+    static metrics::Histogram& latency = metrics::dbQueryLatency("callback_take");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "callback_take");
+    try {
+        pqxx::work txn(*conn);
+        pqxx::result res = txn.exec("DELETE FROM stored_callbacks WHERE callback_id = $1 RETURNING callback_id",
+                                    pqxx::params{id});
+        txn.commit();
+        if (res.empty()) return std::nullopt;
+        return entry;
+    } catch (const std::exception& e) {
+        logging::repo().error("Error taking callback: {}", e.what());
+        // Still valid; the user can press again
+        remember(id, std::move(entry->payload), entry->deadline);
+        return std::nullopt;
+    }
+}
+
+bool CallbackRepository::restore(const std::string& key, const StoredCallback& callback) {
+    long long id = 0;
+    auto [ptr, ec] = std::from_chars(key.data(), key.data() + key.size(), id);
+    if (ec != std::errc{} || ptr != key.data() + key.size()) return false;
+
+    auto remaining = std::chrono::duration_cast<std::chrono::seconds>(
+        callback.deadline - std::chrono::steady_clock::now());
+    if (remaining.count() <= 0) return false;
+
+    static metrics::Histogram& latency = metrics::dbQueryLatency("callback_restore");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "callback_restore");
+
+    pqxx::connection* conn = dbManager_.getConnection();
+    if (!conn || !conn->is_open()) {
+        logging::repo().error("Error restoring callback: database connection unavailable");
+        return false;
+    }
+
+    const auto& payment = std::get<LogSimplifiedPayment>(callback.payload);
+    try {
+        pqxx::work txn(*conn);
+        txn.exec(
+            "INSERT INTO stored_callbacks "
+            "    (callback_id, kind, trip_id, chat_id, thread_id, from_user_id, to_user_id, amount, currency, expires_at) "
+            "VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9, LOCALTIMESTAMP + make_interval(secs => $10)) "
+            "ON CONFLICT (callback_id) DO NOTHING",
+            pqxx::params{id, KIND_LOG_SIMPLIFIED_PAYMENT, payment.trip_id, payment.chat_id, payment.thread_id,
+                         payment.from_user_id, payment.to_user_id, payment.amount.minorAmount(),
+                         payment.amount.currency(), static_cast<double>(remaining.count())});
+        txn.commit();
+        remember(id, callback.payload, callback.deadline);
+        return true;
+    } catch (const std::exception& e) {
+        logging::repo().error("Error restoring callback: {}", e.what());
+        return false;
+    }
+}
+
+void CallbackRepository::expire() {
+    std::vector<long long> expired;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        expired = deadlines_.advance(std::chrono::steady_clock::now());
+        for (long long id : expired) {
+            index_.erase(id);
+        }
+    }
+    if (expired.empty()) return;
+
+    static metrics::Histogram& latency = metrics::dbQueryLatency("callback_expire");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "callback_expire");
+    pqxx::connection* conn = dbManager_.getConnection();
+    if (!conn || !conn->is_open()) {
+        logging::repo().error("Error expiring callbacks: database connection unavailable");
+        return;
+    }
+
+    try {
+        pqxx::work txn(*conn);
+        txn.exec("DELETE FROM stored_callbacks WHERE expires_at <= LOCALTIMESTAMP");
+        txn.commit();
+        logging::repo().info("Expired {} stored callback(s)", expired.size());
+    } catch (const std::exception& e) {
+        // Rows left behind are dropped by the next expire() or load()
+        logging::repo().error("Error expiring callbacks: {}", e.what());
+    }
+}
+
+std::size_t CallbackRepository::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index_.size();
+}
+
+void CallbackRepository::remember(long long id, CallbackPayload payload, std::chrono::steady_clock::time_point deadline) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    index_.insert_or_assign(id, StoredCallback{std::move(payload), deadline});
+    deadlines_.schedule(id, deadline);
+}
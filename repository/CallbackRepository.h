@@ -0,0 +1,72 @@
+#ifndef FRIENDS_TRIP_BOT_CALLBACKREPOSITORY_H
+#define FRIENDS_TRIP_BOT_CALLBACKREPOSITORY_H
+
+#include "../bot/TimerWheel.h"
+#include "../utils/MoneyAmount.h"
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <variant>
+
+class DatabaseManager;
+
+// "Log Payment" button under a simplify DM: from_user_id paid to_user_id amount
+struct LogSimplifiedPayment {
+    long long trip_id;
+    long long chat_id;     // group the trip belongs to, told once the payment is logged
+    long long thread_id;
+    long long from_user_id;
+    long long to_user_id;
+    MoneyAmount amount;
+};
+
+// What a stored button does when pressed; one alternative per kind of button
+using CallbackPayload = std::variant<LogSimplifiedPayment>;
+
+struct StoredCallback {
+    CallbackPayload payload;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+// Button payloads that outlive the process: each one is a row in stored_callbacks,
+// with every live row mirrored in memory so presses never wait on a read. The key
+// handed out for callback_data is the row's id.
+class CallbackRepository {
+public:
+    explicit CallbackRepository(DatabaseManager& dbManager);
+
+    // Reads every unexpired row into memory in one query; call once at startup.
+    // Returns the number loaded.
+    std::size_t load();
+
+    // Empty string if the row could not be written
+    std::string store(const CallbackPayload& payload, std::chrono::hours expiry = std::chrono::hours(72));
+
+    // Removes the payload, so each button fires at most once, even across restarts.
+    // std::nullopt if the key is unknown, expired or already taken.
+    std::optional<StoredCallback> take(const std::string& key);
+
+    // Puts back a payload whose action failed after take(), under the same key and
+    // deadline, so the button can be pressed again. False if the row could not be written.
+    bool restore(const std::string& key, const StoredCallback& callback);
+
+    // Drops what has expired from memory and from the table
+    void expire();
+
+    std::size_t size();
+
+private:
+    void remember(long long id, CallbackPayload payload, std::chrono::steady_clock::time_point deadline);
+
+    DatabaseManager& dbManager_;
+
+    std::mutex mutex_;
+    std::unordered_map<long long, StoredCallback> index_;
+    // 5-minute ticks over 1024 slots span ~85h, past the default 72h expiry
+    bot::TimerWheel<long long> deadlines_{std::chrono::minutes(5), 1024};
+};
+
+#endif //FRIENDS_TRIP_BOT_CALLBACKREPOSITORY_H
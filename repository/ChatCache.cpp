@@ -0,0 +1,63 @@
+#include "ChatCache.h"
+#include "../logging/Logging.h"
+
+namespace {
+
+std::size_t userBytes(const User& user) {
+    return sizeof(User) + user.name.capacity() + user.gmt_created.capacity() + user.gmt_modified.capacity();
+}
+
+std::size_t tripBytes(const Trip& trip) {
+    return sizeof(Trip) + trip.name.capacity() + trip.gmt_created.capacity();
+}
+
+std::size_t rosterBytes(const std::vector<User>& users) {
+    std::size_t bytes = 0;
+    for (const auto& user : users) bytes += userBytes(user);
+    return bytes;
+}
+
+std::size_t tripListBytes(const std::vector<Trip>& trips) {
+    std::size_t bytes = 0;
+    for (const auto& trip : trips) bytes += tripBytes(trip);
+    return bytes;
+}
+
+std::size_t activeTripBytes(const std::optional<Trip>& trip) {
+    return trip ? tripBytes(*trip) : 0;
+}
+
+template<typename Stats>
+void logCacheStats(const char* name, const Stats& stats) {
+    uint64_t lookups = stats.hits + stats.misses;
+    logging::repo().info("Cache {}: hits={}, misses={}, hit_rate={:.1f}%, evictions={}, invalidations={}, entries={}, bytes={}",
+                         name, stats.hits, stats.misses, lookups ? 100.0 * stats.hits / lookups : 0.0,
+                         stats.evictions, stats.invalidations, stats.entries, stats.bytes);
+}
+
+} // namespace
+
+ChatCache::ChatCache() : ChatCache(Limits{}) {}
+
+ChatCache::ChatCache(Limits limits)
+    : rosters(limits.maxEntries, limits.maxBytes, rosterBytes),
+      trips(limits.maxEntries, limits.maxBytes, tripListBytes),
+      activeTrips(limits.maxEntries, limits.maxBytes, activeTripBytes) {}
+
+void ChatCache::invalidateChat(long long chatId, long long threadId) {
+    rosters.invalidate({chatId, threadId});
+    trips.invalidate({chatId, threadId});
+    activeTrips.invalidate({chatId, threadId});
+}
+
+void ChatCache::clear() {
+    rosters.clear();
+    trips.clear();
+    activeTrips.clear();
+}
+
+void ChatCache::logStats() const {
+    logCacheStats("rosters", rosters.stats());
+    logCacheStats("trips", trips.stats());
+    logCacheStats("active_trips", activeTrips.stats());
+}
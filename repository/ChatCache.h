@@ -0,0 +1,49 @@
+#ifndef FRIENDS_TRIP_BOT_CHATCACHE_H
+#define FRIENDS_TRIP_BOT_CHATCACHE_H
+
+#include "ReadThroughCache.h"
+#include "UserRepository.h"
+#include "TripRepository.h"
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Per-chat data read at the start of almost every conversation: the roster, the trip
+// list and the active trip, keyed by {chat_id, thread_id}. Shared by UserRepository
+// and TripRepository, which read through it and invalidate it on every write.
+class ChatCache {
+public:
+    using ChatKey = std::pair<long long, long long>;
+
+    struct ChatKeyHash {
+        size_t operator()(const ChatKey& key) const {
+            size_t h1 = phmap::Hash<long long>{}(key.first);
+            size_t h2 = phmap::Hash<long long>{}(key.second);
+            return phmap::HashState::combine(0, h1, h2);
+        }
+    };
+
+    // Bounds apply to each of the three caches separately
+    struct Limits {
+        std::size_t maxEntries = 4096;
+        std::size_t maxBytes = 8 * 1024 * 1024;
+    };
+
+    ChatCache();
+    explicit ChatCache(Limits limits);
+
+    // Drops everything cached for a chat/thread
+    void invalidateChat(long long chatId, long long threadId);
+
+    // Drops everything, for when invalidations may have been missed
+    void clear();
+
+    void logStats() const;
+
+    ReadThroughCache<ChatKey, std::vector<User>, ChatKeyHash> rosters;
+    ReadThroughCache<ChatKey, std::vector<Trip>, ChatKeyHash> trips;
+    ReadThroughCache<ChatKey, std::optional<Trip>, ChatKeyHash> activeTrips;
+};
+
+#endif //FRIENDS_TRIP_BOT_CHATCACHE_H
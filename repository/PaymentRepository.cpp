@@ -1,56 +1,113 @@
 #include "PaymentRepository.h"
+#include "../logging/Logging.h"
+#include "../metrics/Metrics.h"
+#include "../tracing/Tracing.h"
 #include "../database/DatabaseManager.h"
+#include "../algorithm/SettlementEngine.h"
 #include "../utils/utils.h"
-#include <iostream>
 #include <pqxx/pqxx>
 #include <map>
+#include <string>
+#include <type_traits>
+#include <vector>
 #include <chrono>
-#include <spdlog/spdlog.h>
 
-PaymentRepository::PaymentRepository(DatabaseManager& dbManager) : dbManager_(dbManager) {}
+namespace {
+
+// Postgres array literal for an array-typed parameter, e.g. {1,2,3} or {"SGD","USD"}
+template<typename T>
+std::string toArrayLiteral(const std::vector<T>& values) {
+    std::string literal = "{";
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i > 0) literal += ",";
+        if constexpr (std::is_same_v<T, std::string>) {
+            // Quoted, so commas, braces, spaces and NULL are taken literally; only quotes
+            // and backslashes need a backslash
+            literal += '"';
+            for (char c : values[i]) {
+                if (c == '"' || c == '\\') literal += '\\';
+                literal += c;
+            }
+            literal += '"';
+        } else {
+            literal += std::to_string(values[i]);
+        }
+    }
+    literal += "}";
+    return literal;
+}
+
+} // namespace
+
+PaymentRepository::PaymentRepository(DatabaseManager& dbManager, SettlementEngine& settlementEngine)
+    : dbManager_(dbManager), settlementEngine_(settlementEngine) {}
 
 bool PaymentRepository::createPaymentGroup(const PaymentGroup& group) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("payment_group_create");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "payment_group_create");
+
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error creating payment group: database connection unavailable" << std::endl;
+        logging::repo().error("Error creating payment group: database connection unavailable");
         return false;
     }
 
     try {
         pqxx::work txn(*conn);
 
-        // 1. Create the Payment Group
+        // Group and records in one statement; records travel as parallel arrays
+        std::vector<long long> amounts, fromUserIds, toUserIds;
+        std::vector<std::string> currencies;
+        for (const auto& rec : group.records) {
+            amounts.push_back(rec.amount.minorAmount());
+            currencies.push_back(rec.amount.currency());
+            fromUserIds.push_back(rec.from_user_id);
+            toUserIds.push_back(rec.to_user_id);
+        }
+
         pqxx::result groupRes = txn.exec(
-            "INSERT INTO payment_groups (trip_id, name, total_amount, currency, payer_user_id) VALUES ($1, $2, $3, $4, $5) RETURNING group_id",
-            pqxx::params{group.trip_id, group.name, group.total_amount.minorAmount(), group.total_amount.currency(), group.payer_user_id}
+            "WITH new_group AS ("
+            "    INSERT INTO payment_groups (trip_id, name, total_amount, currency, payer_user_id) "
+            "    VALUES ($1, $2, $3, $4, $5) RETURNING group_id"
+            "), new_records AS ("
+            "    INSERT INTO payment_records (group_id, trip_id, amount, currency, from_user_id, to_user_id) "
+            "    SELECT g.group_id, $1, r.amount, r.currency, r.from_user_id, r.to_user_id "
+            "    FROM new_group g, unnest($6::bigint[], $7::varchar[], $8::bigint[], $9::bigint[]) "
+            "        AS r(amount, currency, from_user_id, to_user_id)"
+            ") "
+            "SELECT group_id FROM new_group",
+            pqxx::params{group.trip_id, group.name, group.total_amount.minorAmount(), group.total_amount.currency(),
+                         group.payer_user_id, toArrayLiteral(amounts), toArrayLiteral(currencies),
+                         toArrayLiteral(fromUserIds), toArrayLiteral(toUserIds)}
         );
 
         if (groupRes.empty()) return false;
         long long groupId = groupRes[0][0].as<long long>();
 
-        // 2. Create the Payment Records linked to the new group
-        for (const auto& rec : group.records) {
-            txn.exec(
-                "INSERT INTO payment_records (group_id, trip_id, amount, currency, from_user_id, to_user_id) VALUES ($1, $2, $3, $4, $5, $6)",
-                pqxx::params{groupId, group.trip_id, rec.amount.minorAmount(), rec.amount.currency(), rec.from_user_id, rec.to_user_id}
-            );
-        }
-
+        // Before the commit, so a concurrent load cannot see the group and get it again
+        // as a delta
+        auto write = settlementEngine_.beginWrite(group.trip_id);
         txn.commit();
-        spdlog::info("Created payment group: group_id={}, trip_id={}, name='{}', total_amount={} {}, payer_user_id={}, records={}",
-                     groupId, group.trip_id, group.name, group.total_amount.minorAmount(), group.total_amount.currency(),
-                     group.payer_user_id, group.records.size());
+        write.apply(group);
+        logging::repo().info("Created payment group: group_id={}, trip_id={}, name='{}', total_amount={} {}, payer_user_id={}, records={}",
+                             groupId, group.trip_id, group.name, group.total_amount.minorAmount(), group.total_amount.currency(),
+                             group.payer_user_id, group.records.size());
         return true;
     } catch (const std::exception& e) {
-        std::cerr << "Error creating payment group: " << e.what() << std::endl;
+        logging::repo().error("Error creating payment group: {}", e.what());
         return false;
     }
 }
 
 int PaymentRepository::getPaymentRecordCount(long long tripId) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("payment_record_count");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "payment_record_count");
+
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error getting payment record count: database connection unavailable" << std::endl;
+        logging::repo().error("Error getting payment record count: database connection unavailable");
         return 0;
     }
 
@@ -64,17 +121,21 @@ int PaymentRepository::getPaymentRecordCount(long long tripId) {
         if (res.empty()) return 0;
         return res[0][0].as<int>();
     } catch (const std::exception& e) {
-        std::cerr << "Error getting payment record count: " << e.what() << std::endl;
+        logging::repo().error("Error getting payment record count: {}", e.what());
     }
 
     return 0;
 }
 
 std::vector<PaymentGroup> PaymentRepository::getPaymentGroups(long long tripId, int pageSize, int pageNumber) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("payment_group_page");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "payment_group_page");
+
     std::vector<PaymentGroup> groups;
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error getting payment groups: database connection unavailable" << std::endl;
+        logging::repo().error("Error getting payment groups: database connection unavailable");
         return groups;
     }
 
@@ -148,16 +209,20 @@ std::vector<PaymentGroup> PaymentRepository::getPaymentGroups(long long tripId,
             }
         }
     } catch (const std::exception& e) {
-        std::cerr << "Error getting payment groups: " << e.what() << std::endl;
+        logging::repo().error("Error getting payment groups: {}", e.what());
     }
     return groups;
 }
 
 std::vector<PaymentGroup> PaymentRepository::getAllPaymentGroups(long long tripId) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("payment_group_list");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "payment_group_list");
+
     std::vector<PaymentGroup> groups;
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error getting all payment groups: database connection unavailable" << std::endl;
+        logging::repo().error("Error getting all payment groups: database connection unavailable");
         return groups;
     }
 
@@ -218,16 +283,20 @@ std::vector<PaymentGroup> PaymentRepository::getAllPaymentGroups(long long tripI
             }
         }
     } catch (const std::exception& e) {
-        std::cerr << "Error getting payment groups: " << e.what() << std::endl;
+        logging::repo().error("Error getting payment groups: {}", e.what());
     }
     return groups;
 }
 
 std::vector<PaymentRecord> PaymentRepository::getAllPaymentRecords(long long tripId) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("payment_record_list");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "payment_record_list");
+
     std::vector<PaymentRecord> records;
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error getting all payment records: database connection unavailable" << std::endl;
+        logging::repo().error("Error getting all payment records: database connection unavailable");
         return records;
     }
 
@@ -254,30 +323,48 @@ std::vector<PaymentRecord> PaymentRepository::getAllPaymentRecords(long long tri
             });
         }
     } catch (const std::exception& e) {
-        std::cerr << "Error getting all payment records: " << e.what() << std::endl;
+        logging::repo().error("Error getting all payment records: {}", e.what());
     }
     return records;
 }
 
 std::optional<PaymentGroup> PaymentRepository::deleteLastPaymentGroup(long long tripId) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("payment_group_delete_last");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "payment_group_delete_last");
+
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error deleting last payment group: database connection unavailable" << std::endl;
+        logging::repo().error("Error deleting last payment group: database connection unavailable");
         return std::nullopt;
     }
 
     try {
         pqxx::work txn(*conn);
 
-        pqxx::result groupRes = txn.exec(
-            "SELECT group_id, trip_id, name, total_amount, currency, payer_user_id, gmt_created "
-            "FROM payment_groups WHERE trip_id = $1 ORDER BY gmt_created DESC LIMIT 1",
+        // Pick, delete and return the newest group and its records in one statement
+        pqxx::result res = txn.exec(
+            "WITH target AS ("
+            "    SELECT group_id FROM payment_groups WHERE trip_id = $1 "
+            "    ORDER BY gmt_created DESC LIMIT 1 FOR UPDATE"
+            "), deleted_records AS ("
+            "    DELETE FROM payment_records WHERE group_id IN (SELECT group_id FROM target) "
+            "    RETURNING record_id, group_id, trip_id, amount, currency, from_user_id, to_user_id, gmt_created"
+            "), deleted_group AS ("
+            "    DELETE FROM payment_groups WHERE group_id IN (SELECT group_id FROM target) "
+            "    RETURNING group_id, trip_id, name, total_amount, currency, payer_user_id, gmt_created"
+            ") "
+            "SELECT g.group_id, g.trip_id, g.name, g.total_amount, g.currency, g.payer_user_id, g.gmt_created, "
+            "       r.record_id, r.trip_id AS record_trip_id, r.amount AS record_amount, "
+            "       r.currency AS record_currency, r.from_user_id, r.to_user_id, r.gmt_created AS record_gmt_created "
+            "FROM deleted_group g LEFT JOIN deleted_records r ON r.group_id = g.group_id "
+            "ORDER BY r.gmt_created DESC",
             pqxx::params{tripId}
         );
 
-        if (groupRes.empty()) return std::nullopt;
+        if (res.empty()) return std::nullopt;
 
-        const auto& groupRow = groupRes[0];
+        const auto& groupRow = res[0];
         long long groupId = groupRow["group_id"].as<long long>();
 
         PaymentGroup group{
@@ -290,58 +377,57 @@ std::optional<PaymentGroup> PaymentRepository::deleteLastPaymentGroup(long long
             {}
         };
 
-        pqxx::result recordRes = txn.exec(
-            "SELECT record_id, group_id, trip_id, amount, currency, from_user_id, to_user_id, gmt_created "
-            "FROM payment_records WHERE group_id = $1 ORDER BY gmt_created DESC",
-            pqxx::params{groupId}
-        );
-
-        for (const auto& row : recordRes) {
+        for (const auto& row : res) {
+            if (row["record_id"].is_null()) continue;  // group without records
             group.records.emplace_back(PaymentRecord{
                 row["record_id"].as<long long>(),
                 groupId,
-                row["trip_id"].as<long long>(),
-                MoneyAmount(row["currency"].c_str(), row["amount"].as<long long>()),
+                row["record_trip_id"].as<long long>(),
+                MoneyAmount(row["record_currency"].c_str(), row["record_amount"].as<long long>()),
                 row["from_user_id"].as<long long>(),
                 row["to_user_id"].as<long long>(),
-                utils::parseTimestamp(row["gmt_created"].c_str())
+                utils::parseTimestamp(row["record_gmt_created"].c_str())
             });
         }
 
-        txn.exec("DELETE FROM payment_records WHERE group_id = $1", pqxx::params{groupId});
-        txn.exec("DELETE FROM payment_groups WHERE group_id = $1", pqxx::params{groupId});
-
+        auto write = settlementEngine_.beginWrite(tripId);
         txn.commit();
-        spdlog::info("Deleted last payment group: group_id={}, trip_id={}, name='{}', total_amount={} {}, payer_user_id={}, records={}",
-                     group.payment_group_id, group.trip_id, group.name, group.total_amount.minorAmount(),
-                     group.total_amount.currency(), group.payer_user_id, group.records.size());
+        write.revert(group);
+        logging::repo().info("Deleted last payment group: group_id={}, trip_id={}, name='{}', total_amount={} {}, payer_user_id={}, records={}",
+                             group.payment_group_id, group.trip_id, group.name, group.total_amount.minorAmount(),
+                             group.total_amount.currency(), group.payer_user_id, group.records.size());
         return group;
     } catch (const std::exception& e) {
-        std::cerr << "Error deleting last payment group: " << e.what() << std::endl;
+        logging::repo().error("Error deleting last payment group: {}", e.what());
         return std::nullopt;
     }
 }
 
 bool PaymentRepository::deletePaymentGroup(long long paymentGroupId) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("payment_group_delete");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "payment_group_delete");
+
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error deleting payment group: database connection unavailable" << std::endl;
+        logging::repo().error("Error deleting payment group: database connection unavailable");
         return false;
     }
 
     try {
         pqxx::work txn(*conn);
         pqxx::result res = txn.exec(
-            "DELETE FROM payment_groups WHERE group_id = $1",
+            "DELETE FROM payment_groups WHERE group_id = $1 RETURNING trip_id",
             pqxx::params{paymentGroupId}
         );
         txn.commit();
-        if (res.affected_rows() > 0) {
-            spdlog::info("Deleted payment group: group_id={}", paymentGroupId);
-        }
-        return res.affected_rows() > 0;
+        if (res.empty()) return false;
+        // The group's records are not at hand; rebuild the trip's settlement state on next use
+        settlementEngine_.evict(res[0][0].as<long long>());
+        logging::repo().info("Deleted payment group: group_id={}", paymentGroupId);
+        return true;
     } catch (const std::exception& e) {
-        std::cerr << "Error deleting payment group: " << e.what() << std::endl;
+        logging::repo().error("Error deleting payment group: {}", e.what());
     }
 
     return false;
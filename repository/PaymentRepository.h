@@ -8,6 +8,7 @@
 #include "../utils/MoneyAmount.h"
 
 class DatabaseManager;
+class SettlementEngine;
 
 struct PaymentRecord {
     long long payment_record_id;
@@ -31,7 +32,7 @@ struct PaymentGroup {
 
 class PaymentRepository {
 public:
-    explicit PaymentRepository(DatabaseManager& dbManager);
+    PaymentRepository(DatabaseManager& dbManager, SettlementEngine& settlementEngine);
 
     bool createPaymentGroup(const PaymentGroup& group);
 
@@ -49,6 +50,7 @@ public:
 
 private:
     DatabaseManager& dbManager_;
+    SettlementEngine& settlementEngine_;
 };
 
 #endif // PAYMENT_REPOSITORY_H
\ No newline at end of file
@@ -0,0 +1,225 @@
+#ifndef FRIENDS_TRIP_BOT_READTHROUGHCACHE_H
+#define FRIENDS_TRIP_BOT_READTHROUGHCACHE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <parallel_hashmap/phmap.h>
+
+// Concurrent read-through cache bounded by entry count and approximate bytes.
+//
+// get() returns the cached value or runs the loader on a miss; a loader returning
+// std::nullopt (e.g. a database error) is passed through and not cached. Writers call
+// invalidate() after committing. A load that overlaps an invalidation of the same key
+// is dropped rather than cached, so a stale read can never outlive the write.
+// When over budget, entries are evicted in CLOCK order (recently read entries get a
+// second chance).
+template<typename Key, typename Value, typename Hash = phmap::priv::hash_default_hash<Key>>
+class ReadThroughCache {
+public:
+    using SizeOf = std::size_t (*)(const Value&);
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t invalidations;
+        std::size_t entries;
+        std::size_t bytes;
+    };
+
+    ReadThroughCache(std::size_t maxEntries, std::size_t maxBytes, SizeOf sizeOf)
+        : maxEntries_(maxEntries), maxBytes_(maxBytes), sizeOf_(sizeOf) {}
+
+    template<typename Loader>
+    std::optional<Value> get(const Key& key, Loader&& loader) {
+        std::shared_ptr<Entry> entry;
+        entries_.if_contains(key, [&entry](const auto& kv) { entry = kv.second; });
+        if (entry) {
+            entry->referenced.store(true, std::memory_order_relaxed);
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return entry->value;
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+
+        uint64_t epoch = epochFor(key).load(std::memory_order_acquire);
+        std::optional<Value> loaded = loader();
+        if (loaded) {
+            admit(key, *loaded, epoch);
+        }
+        return loaded;
+    }
+
+    void invalidate(const Key& key) {
+        // Bump first: a load that started before this point will not keep its result
+        epochFor(key).fetch_add(1, std::memory_order_acq_rel);
+        if (remove(key)) {
+            invalidations_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Invalidates every key, e.g. after missing invalidations from elsewhere
+    void clear() {
+        for (auto& epoch : epochs_) {
+            epoch.fetch_add(1, std::memory_order_acq_rel);
+        }
+        std::vector<Key> keys;
+        entries_.for_each([&keys](const auto& kv) { keys.push_back(kv.first); });
+        for (const auto& key : keys) {
+            if (remove(key)) {
+                invalidations_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    Stats stats() const {
+        return {hits_.load(std::memory_order_relaxed),
+                misses_.load(std::memory_order_relaxed),
+                evictions_.load(std::memory_order_relaxed),
+                invalidations_.load(std::memory_order_relaxed),
+                static_cast<std::size_t>(std::max<long long>(0, entryCount_.load(std::memory_order_relaxed))),
+                static_cast<std::size_t>(std::max<long long>(0, bytes_.load(std::memory_order_relaxed)))};
+    }
+
+private:
+    struct Entry {
+        Value value;
+        std::size_t bytes;
+        uint64_t serial;
+        std::atomic<bool> referenced{false};
+    };
+
+    static constexpr std::size_t EPOCH_STRIPES = 64;
+
+    std::atomic<uint64_t>& epochFor(const Key& key) {
+        return epochs_[Hash{}(key) % EPOCH_STRIPES];
+    }
+
+    void admit(const Key& key, const Value& value, uint64_t epoch) {
+        auto entry = std::make_shared<Entry>();
+        entry->value = value;
+        entry->bytes = sizeof(Key) + sizeof(Entry) + sizeOf_(value);
+        entry->serial = nextSerial_.fetch_add(1, std::memory_order_relaxed);
+
+        std::shared_ptr<Entry> replaced;
+        entries_.lazy_emplace_l(key,
+            [&](auto& kv) { replaced = std::exchange(kv.second, entry); },
+            [&](const auto& ctor) { ctor(key, entry); });
+        if (replaced) {
+            bytes_.fetch_sub(static_cast<long long>(replaced->bytes), std::memory_order_relaxed);
+        } else {
+            entryCount_.fetch_add(1, std::memory_order_relaxed);
+        }
+        bytes_.fetch_add(static_cast<long long>(entry->bytes), std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(clockMutex_);
+            clock_.emplace_back(key, entry->serial);
+        }
+
+        // An invalidation raced the load; take the possibly stale value back out
+        if (epochFor(key).load(std::memory_order_acquire) != epoch) {
+            remove(key);
+            return;
+        }
+        evictOverBudget();
+    }
+
+    bool remove(const Key& key) {
+        std::shared_ptr<Entry> removed;
+        entries_.erase_if(key, [&removed](auto& kv) {
+            removed = kv.second;
+            return true;
+        });
+        if (!removed) return false;
+        entryCount_.fetch_sub(1, std::memory_order_relaxed);
+        bytes_.fetch_sub(static_cast<long long>(removed->bytes), std::memory_order_relaxed);
+        return true;
+    }
+
+    bool overBudget() const {
+        return entryCount_.load(std::memory_order_relaxed) > static_cast<long long>(maxEntries_)
+            || bytes_.load(std::memory_order_relaxed) > static_cast<long long>(maxBytes_);
+    }
+
+    bool isCurrent(const Key& key, uint64_t serial) const {
+        bool current = false;
+        entries_.if_contains(key, [&](const auto& kv) { current = kv.second->serial == serial; });
+        return current;
+    }
+
+    void evictOverBudget() {
+        std::lock_guard<std::mutex> lock(clockMutex_);
+        // Drop slots left behind by replaced or invalidated entries once they dominate
+        if (clock_.size() > 2 * static_cast<std::size_t>(std::max<long long>(0, entryCount_.load())) + 64) {
+            std::erase_if(clock_, [this](const auto& slot) { return !isCurrent(slot.first, slot.second); });
+        }
+
+        // Bounded so a burst of hot entries cannot keep the sweep spinning
+        std::size_t budget = clock_.size() * 2;
+        while (overBudget() && !clock_.empty() && budget-- > 0) {
+            auto [key, serial] = clock_.front();
+            clock_.pop_front();
+
+            std::shared_ptr<Entry> evicted;
+            bool secondChance = false;
+            entries_.erase_if(key, [&](auto& kv) {
+                // Skip clock slots left behind by replaced or invalidated entries
+                if (kv.second->serial != serial) return false;
+                if (kv.second->referenced.exchange(false, std::memory_order_relaxed)) {
+                    secondChance = true;
+                    return false;
+                }
+                evicted = kv.second;
+                return true;
+            });
+            if (secondChance) {
+                clock_.emplace_back(key, serial);
+            } else if (evicted) {
+                entryCount_.fetch_sub(1, std::memory_order_relaxed);
+                bytes_.fetch_sub(static_cast<long long>(evicted->bytes), std::memory_order_relaxed);
+                evictions_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    const std::size_t maxEntries_;
+    const std::size_t maxBytes_;
+    const SizeOf sizeOf_;
+
+    phmap::parallel_flat_hash_map<
+        Key,
+        std::shared_ptr<Entry>,
+        Hash,
+        phmap::priv::hash_default_eq<Key>,
+        std::allocator<std::pair<const Key, std::shared_ptr<Entry>>>,
+        4,
+        std::mutex
+    > entries_;
+
+    std::array<std::atomic<uint64_t>, EPOCH_STRIPES> epochs_{};
+    std::atomic<uint64_t> nextSerial_{0};
+
+    // CLOCK ring of (key, serial) in admission order
+    std::mutex clockMutex_;
+    std::deque<std::pair<Key, uint64_t>> clock_;
+
+    // Signed: an invalidation may briefly be counted before the admission it removes
+    std::atomic<long long> entryCount_{0};
+    std::atomic<long long> bytes_{0};
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> evictions_{0};
+    std::atomic<uint64_t> invalidations_{0};
+};
+
+#endif //FRIENDS_TRIP_BOT_READTHROUGHCACHE_H
@@ -1,57 +1,68 @@
 #include "TripRepository.h"
+#include "../logging/Logging.h"
+#include "../metrics/Metrics.h"
+#include "../tracing/Tracing.h"
+#include "ChatCache.h"
 #include "../database/DatabaseManager.h"
-#include <iostream>
 #include <pqxx/pqxx>
-#include <spdlog/spdlog.h>
 
-TripRepository::TripRepository(DatabaseManager& dbManager) : dbManager_(dbManager) {}
+TripRepository::TripRepository(DatabaseManager& dbManager, ChatCache& chatCache)
+    : dbManager_(dbManager), chatCache_(chatCache) {}
 
 bool TripRepository::createDefaultChatAndTrip(long long chatId, long long threadId) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("trip_create_default");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "trip_create_default");
+
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error creating default chat and trip: database connection unavailable" << std::endl;
+        logging::repo().error("Error creating default chat and trip: database connection unavailable");
         return false;
     }
 
     try {
         pqxx::work txn(*conn);
 
-        pqxx::result res = txn.exec(
-            "SELECT 1 FROM trips WHERE chat_id = $1 AND thread_id = $2 LIMIT 1",
+        // One statement: create the default trip unless the chat has trips, and make it active
+        pqxx::result tripRes = txn.exec(
+            "WITH new_trip AS ("
+            "    INSERT INTO trips (chat_id, thread_id, name) "
+            "    SELECT $1::bigint, $2::bigint, 'default' "
+            "    WHERE NOT EXISTS (SELECT 1 FROM trips WHERE chat_id = $1 AND thread_id = $2) "
+            "    RETURNING trip_id"
+            "), active AS ("
+            "    INSERT INTO chats (chat_id, thread_id, active_trip_id) "
+            "    SELECT $1::bigint, $2::bigint, trip_id FROM new_trip "
+            "    ON CONFLICT (chat_id, thread_id) DO UPDATE SET active_trip_id = EXCLUDED.active_trip_id"
+            ") "
+            "SELECT trip_id FROM new_trip",
             pqxx::params{chatId, threadId}
         );
 
-        if (!res.empty()) {
+        if (tripRes.empty()) {
             return false;
         }
-
-        pqxx::result tripRes = txn.exec(
-            "INSERT INTO trips (chat_id, thread_id, name) VALUES ($1, $2, 'default') RETURNING trip_id",
-            pqxx::params{chatId, threadId}
-        );
-
-        if (tripRes.empty()) return false;
         long long newTripId = tripRes[0][0].as<long long>();
 
-        txn.exec(
-            "INSERT INTO chats (chat_id, thread_id, active_trip_id) VALUES ($1, $2, $3) "
-            "ON CONFLICT (chat_id, thread_id) DO UPDATE SET active_trip_id = $3",
-            pqxx::params{chatId, threadId, newTripId}
-        );
-
         txn.commit();
-        spdlog::info("Created default chat and trip: chat_id={}, thread_id={}, trip_id={}", chatId, threadId, newTripId);
+        chatCache_.trips.invalidate({chatId, threadId});
+        chatCache_.activeTrips.invalidate({chatId, threadId});
+        logging::repo().info("Created default chat and trip: chat_id={}, thread_id={}, trip_id={}", chatId, threadId, newTripId);
         return true;
     } catch (const std::exception& e) {
-        std::cerr << "Error in createDefaultChatAndTrip: " << e.what() << std::endl;
+        logging::repo().error("Error in createDefaultChatAndTrip: {}", e.what());
         return false;
     }
 }
 
 long long TripRepository::createTrip(long long chatId, long long threadId, const std::string& name) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("trip_create");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "trip_create");
+
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error creating trip: database connection unavailable" << std::endl;
+        logging::repo().error("Error creating trip: database connection unavailable");
         return -1;
     }
 
@@ -62,21 +73,26 @@ long long TripRepository::createTrip(long long chatId, long long threadId, const
             pqxx::params{chatId, threadId, name}
         );
         txn.commit();
+        chatCache_.trips.invalidate({chatId, threadId});
 
         if (res.empty()) return -1;
         long long tripId = res[0][0].as<long long>();
-        spdlog::info("Created trip: trip_id={}, chat_id={}, thread_id={}, name='{}'", tripId, chatId, threadId, name);
+        logging::repo().info("Created trip: trip_id={}, chat_id={}, thread_id={}, name='{}'", tripId, chatId, threadId, name);
         return tripId;
     } catch (const std::exception& e) {
-        std::cerr << "Error creating trip: " << e.what() << std::endl;
+        logging::repo().error("Error creating trip: {}", e.what());
         return -1;
     }
 }
 
 std::optional<Trip> TripRepository::getTrip(long long tripId) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("trip_get");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "trip_get");
+
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error getting trip: database connection unavailable" << std::endl;
+        logging::repo().error("Error getting trip: database connection unavailable");
         return std::nullopt;
     }
 
@@ -98,17 +114,28 @@ std::optional<Trip> TripRepository::getTrip(long long tripId) {
             row["gmt_created"].c_str()
         };
     } catch (const std::exception& e) {
-        std::cerr << "Error getting trip: " << e.what() << std::endl;
+        logging::repo().error("Error getting trip: {}", e.what());
         return std::nullopt;
     }
 }
 
 std::vector<Trip> TripRepository::getAllTrips(long long chatId, long long threadId) {
+    auto trips = chatCache_.trips.get({chatId, threadId}, [&] {
+        return loadAllTrips(chatId, threadId);
+    });
+    return trips ? std::move(*trips) : std::vector<Trip>{};
+}
+
+std::optional<std::vector<Trip>> TripRepository::loadAllTrips(long long chatId, long long threadId) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("trip_list");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "trip_list");
+
     std::vector<Trip> trips;
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error getting all trips: database connection unavailable" << std::endl;
-        return trips;
+        logging::repo().error("Error getting all trips: database connection unavailable");
+        return std::nullopt;
     }
 
     try {
@@ -128,63 +155,87 @@ std::vector<Trip> TripRepository::getAllTrips(long long chatId, long long thread
             });
         }
     } catch (const std::exception& e) {
-        std::cerr << "Error getting all trips: " << e.what() << std::endl;
+        logging::repo().error("Error getting all trips: {}", e.what());
+        return std::nullopt;
     }
     return trips;
 }
 
 bool TripRepository::updateTrip(const Trip& trip) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("trip_update");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "trip_update");
+
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error updating trip: database connection unavailable" << std::endl;
+        logging::repo().error("Error updating trip: database connection unavailable");
         return false;
     }
 
     try {
         pqxx::work txn(*conn);
         pqxx::result res = txn.exec(
-            "UPDATE trips SET name = $2 WHERE trip_id = $1",
+            "UPDATE trips SET name = $2 WHERE trip_id = $1 RETURNING chat_id, thread_id",
             pqxx::params{trip.trip_id, trip.name}
         );
         txn.commit();
+        if (!res.empty()) {
+            ChatCache::ChatKey key{res[0]["chat_id"].as<long long>(), res[0]["thread_id"].as<long long>()};
+            chatCache_.trips.invalidate(key);
+            chatCache_.activeTrips.invalidate(key);
+        }
         if (res.affected_rows() > 0) {
-            spdlog::info("Updated trip: trip_id={}, name='{}'", trip.trip_id, trip.name);
+            logging::repo().info("Updated trip: trip_id={}, name='{}'", trip.trip_id, trip.name);
         }
         return res.affected_rows() > 0;
     } catch (const std::exception& e) {
-        std::cerr << "Error updating trip: " << e.what() << std::endl;
+        logging::repo().error("Error updating trip: {}", e.what());
         return false;
     }
 }
 
 bool TripRepository::deleteTrip(long long tripId) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("trip_delete");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "trip_delete");
+
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error deleting trip: database connection unavailable" << std::endl;
+        logging::repo().error("Error deleting trip: database connection unavailable");
         return false;
     }
 
     try {
         pqxx::work txn(*conn);
         pqxx::result res = txn.exec(
-            "DELETE FROM trips WHERE trip_id = $1",
+            "DELETE FROM trips WHERE trip_id = $1 RETURNING chat_id, thread_id",
             pqxx::params{tripId}
         );
         txn.commit();
+        if (!res.empty()) {
+            // The chat's active_trip_id may have been nulled by the foreign key
+            ChatCache::ChatKey key{res[0]["chat_id"].as<long long>(), res[0]["thread_id"].as<long long>()};
+            chatCache_.trips.invalidate(key);
+            chatCache_.activeTrips.invalidate(key);
+        }
         if (res.affected_rows() > 0) {
-            spdlog::info("Deleted trip: trip_id={}", tripId);
+            logging::repo().info("Deleted trip: trip_id={}", tripId);
         }
         return res.affected_rows() > 0;
     } catch (const std::exception& e) {
-        std::cerr << "Error deleting trip: " << e.what() << std::endl;
+        logging::repo().error("Error deleting trip: {}", e.what());
         return false;
     }
 }
 
 bool TripRepository::updateActiveTrip(long long chatId, long long threadId, long long tripId) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("chat_update_active_trip");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "chat_update_active_trip");
+
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error updating active trip: database connection unavailable" << std::endl;
+        logging::repo().error("Error updating active trip: database connection unavailable");
         return false;
     }
 
@@ -195,20 +246,32 @@ bool TripRepository::updateActiveTrip(long long chatId, long long threadId, long
             pqxx::params{chatId, threadId, tripId}
         );
         txn.commit();
+        chatCache_.activeTrips.invalidate({chatId, threadId});
         if (res.affected_rows() > 0) {
-            spdlog::info("Updated active trip: chat_id={}, thread_id={}, trip_id={}", chatId, threadId, tripId);
+            logging::repo().info("Updated active trip: chat_id={}, thread_id={}, trip_id={}", chatId, threadId, tripId);
         }
         return res.affected_rows() > 0;
     } catch (const std::exception& e) {
-        std::cerr << "Error updating active trip: " << e.what() << std::endl;
+        logging::repo().error("Error updating active trip: {}", e.what());
         return false;
     }
 }
 
 std::optional<Trip> TripRepository::getActiveTrip(long long chatId, long long threadId) {
+    auto activeTrip = chatCache_.activeTrips.get({chatId, threadId}, [&] {
+        return loadActiveTrip(chatId, threadId);
+    });
+    return activeTrip ? std::move(*activeTrip) : std::nullopt;
+}
+
+std::optional<std::optional<Trip>> TripRepository::loadActiveTrip(long long chatId, long long threadId) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("trip_get_active");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "trip_get_active");
+
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error getting active trip: database connection unavailable" << std::endl;
+        logging::repo().error("Error getting active trip: database connection unavailable");
         return std::nullopt;
     }
 
@@ -222,18 +285,19 @@ std::optional<Trip> TripRepository::getActiveTrip(long long chatId, long long th
             pqxx::params{chatId, threadId}
         );
 
-        if (res.empty()) return std::nullopt;
+        // A chat without an active trip is a result too, and is cached as such
+        if (res.empty()) return std::optional<Trip>{};
 
         const auto& row = res[0];
-        return Trip{
+        return std::optional<Trip>{Trip{
             row["trip_id"].as<long long>(),
             row["chat_id"].as<long long>(),
             row["thread_id"].as<long long>(),
             row["name"].c_str(),
             row["gmt_created"].c_str()
-        };
+        }};
     } catch (const std::exception& e) {
-        std::cerr << "Error getting active trip: " << e.what() << std::endl;
+        logging::repo().error("Error getting active trip: {}", e.what());
         return std::nullopt;
     }
 }
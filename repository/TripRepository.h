@@ -7,6 +7,7 @@
 
 // Forward declaration
 class DatabaseManager;
+class ChatCache;
 
 struct Trip {
     long long trip_id;
@@ -18,7 +19,7 @@ struct Trip {
 
 class TripRepository {
 public:
-    explicit TripRepository(DatabaseManager& dbManager);
+    TripRepository(DatabaseManager& dbManager, ChatCache& chatCache);
 
     bool createDefaultChatAndTrip(long long chatId, long long threadId);
 
@@ -37,7 +38,12 @@ public:
     std::optional<Trip> getActiveTrip(long long chatId, long long threadId);
 
 private:
+    // Uncached queries; std::nullopt on database errors so failures are not cached
+    std::optional<std::vector<Trip>> loadAllTrips(long long chatId, long long threadId);
+    std::optional<std::optional<Trip>> loadActiveTrip(long long chatId, long long threadId);
+
     DatabaseManager& dbManager_;
+    ChatCache& chatCache_;
 };
 
 #endif // TRIP_REPOSITORY_H
@@ -0,0 +1,175 @@
+#include "TripSnapshotRepository.h"
+#include "../logging/Logging.h"
+#include "../metrics/Metrics.h"
+#include "../tracing/Tracing.h"
+#include "../database/AsyncDatabase.h"
+#include "../database/DatabaseManager.h"
+#include "../utils/utils.h"
+#include <pqxx/pqxx>
+#include <nlohmann/json.hpp>
+
+namespace {
+
+// Payment rows are aggregated per group from the trip_id-indexed records table and
+// nested into the group objects, so the whole trip comes back as one row.
+// Timestamps are cast to text to keep the format the other repositories read.
+constexpr const char* SNAPSHOT_QUERY = R"(
+    WITH active AS (
+        SELECT t.trip_id, t.chat_id, t.thread_id, t.name, t.gmt_created
+        FROM chats c
+        JOIN trips t ON t.trip_id = c.active_trip_id
+        WHERE c.chat_id = $1 AND c.thread_id = $2
+    ), roster AS (
+        SELECT COALESCE(json_agg(json_build_object(
+                   'user_id', u.user_id,
+                   'name', u.name,
+                   'gmt_created', u.gmt_created::text,
+                   'gmt_modified', u.gmt_modified::text)), '[]'::json) AS users
+        FROM users u
+        WHERE u.chat_id = $1 AND u.thread_id = $2
+    ), records AS (
+        SELECT r.group_id,
+               json_agg(json_build_object(
+                   'record_id', r.record_id,
+                   'amount', r.amount,
+                   'currency', r.currency,
+                   'from_user_id', r.from_user_id,
+                   'to_user_id', r.to_user_id,
+                   'gmt_created', r.gmt_created::text) ORDER BY r.gmt_created DESC) AS records
+        FROM payment_records r
+        JOIN active a ON r.trip_id = a.trip_id
+        WHERE $3
+        GROUP BY r.group_id
+    ), groups AS (
+        SELECT COALESCE(json_agg(json_build_object(
+                   'group_id', g.group_id,
+                   'name', g.name,
+                   'total_amount', g.total_amount,
+                   'currency', g.currency,
+                   'payer_user_id', g.payer_user_id,
+                   'gmt_created', g.gmt_created::text,
+                   'records', COALESCE(rec.records, '[]'::json)) ORDER BY g.gmt_created DESC), '[]'::json) AS groups
+        FROM payment_groups g
+        JOIN active a ON g.trip_id = a.trip_id
+        LEFT JOIN records rec ON rec.group_id = g.group_id
+        WHERE $3
+    )
+    SELECT a.trip_id, a.chat_id, a.thread_id, a.name, a.gmt_created, roster.users, groups.groups
+    FROM active a CROSS JOIN roster CROSS JOIN groups
+)";
+
+std::string jsonString(const nlohmann::json& value) {
+    return value.is_null() ? std::string() : value.get<std::string>();
+}
+
+// Builds the snapshot from the query's single row; throws on malformed JSON
+TripSnapshot buildSnapshot(long long chatId, long long threadId, long long tripId, long long tripChatId,
+                           long long tripThreadId, std::string_view name, std::string_view gmtCreated,
+                           std::string_view usersJson, std::string_view groupsJson) {
+    TripSnapshot snapshot;
+    snapshot.trip = Trip{tripId, tripChatId, tripThreadId, std::string(name), std::string(gmtCreated)};
+
+    for (const auto& u : nlohmann::json::parse(usersJson)) {
+        snapshot.users.push_back(User{
+            u["user_id"].get<long long>(),
+            chatId,
+            threadId,
+            jsonString(u["name"]),
+            jsonString(u["gmt_created"]),
+            jsonString(u["gmt_modified"])
+        });
+    }
+
+    auto groups = nlohmann::json::parse(groupsJson);
+    snapshot.paymentGroups.reserve(groups.size());
+    for (const auto& g : groups) {
+        long long groupId = g["group_id"].get<long long>();
+        PaymentGroup group{
+            groupId,
+            snapshot.trip.trip_id,
+            jsonString(g["name"]),
+            MoneyAmount(jsonString(g["currency"]), g["total_amount"].get<long long>()),
+            g["payer_user_id"].get<long long>(),
+            utils::parseTimestamp(jsonString(g["gmt_created"])),
+            {}
+        };
+        const auto& records = g["records"];
+        group.records.reserve(records.size());
+        for (const auto& r : records) {
+            group.records.push_back(PaymentRecord{
+                r["record_id"].get<long long>(),
+                groupId,
+                snapshot.trip.trip_id,
+                MoneyAmount(jsonString(r["currency"]), r["amount"].get<long long>()),
+                r["from_user_id"].get<long long>(),
+                r["to_user_id"].get<long long>(),
+                utils::parseTimestamp(jsonString(r["gmt_created"]))
+            });
+        }
+        snapshot.paymentGroups.push_back(std::move(group));
+    }
+    return snapshot;
+}
+
+} // namespace
+
+TripSnapshotRepository::TripSnapshotRepository(DatabaseManager& dbManager, AsyncDatabase& asyncDb)
+    : dbManager_(dbManager), asyncDb_(asyncDb) {}
+
+std::optional<TripSnapshot> TripSnapshotRepository::load(long long chatId, long long threadId, bool includePayments) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("trip_snapshot");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "trip_snapshot");
+
+    pqxx::connection* conn = dbManager_.getConnection();
+    if (!conn || !conn->is_open()) {
+        logging::repo().error("Error loading trip snapshot: database connection unavailable");
+        return std::nullopt;
+    }
+
+    try {
+        pqxx::work txn(*conn);
+        pqxx::result res = txn.exec(SNAPSHOT_QUERY, pqxx::params{chatId, threadId, includePayments});
+        if (res.empty()) return std::nullopt;
+
+        const auto& row = res[0];
+        return buildSnapshot(chatId, threadId, row["trip_id"].as<long long>(), row["chat_id"].as<long long>(),
+                             row["thread_id"].as<long long>(), row["name"].view(), row["gmt_created"].view(),
+                             row["users"].view(), row["groups"].view());
+    } catch (const std::exception& e) {
+        logging::repo().error("Error loading trip snapshot: {}", e.what());
+        return std::nullopt;
+    }
+}
+
+void TripSnapshotRepository::loadAsync(long long chatId, long long threadId, bool includePayments,
+                                       LoadedCallback onDone) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("trip_snapshot_async");
+    auto start = std::chrono::steady_clock::now();
+    tracing::AsyncSpan span("db", "trip_snapshot_async");
+    asyncDb_.query(SNAPSHOT_QUERY, AsyncParams(chatId, threadId, includePayments),
+        [chatId, threadId, start, span, onDone = std::move(onDone)](AsyncResult res) {
+            latency.observe(std::chrono::steady_clock::now() - start);
+            span.end();
+            if (!res.ok()) {
+                logging::repo().error("Error loading trip snapshot: {}", res.error());
+                onDone(std::nullopt);
+                return;
+            }
+            if (res.rows() == 0) {
+                onDone(std::nullopt);
+                return;
+            }
+            std::optional<TripSnapshot> snapshot;
+            try {
+                snapshot = buildSnapshot(chatId, threadId, res.getLongLong(0, res.column("trip_id")),
+                                         res.getLongLong(0, res.column("chat_id")),
+                                         res.getLongLong(0, res.column("thread_id")),
+                                         res.get(0, res.column("name")), res.get(0, res.column("gmt_created")),
+                                         res.get(0, res.column("users")), res.get(0, res.column("groups")));
+            } catch (const std::exception& e) {
+                logging::repo().error("Error loading trip snapshot: {}", e.what());
+            }
+            onDone(std::move(snapshot));
+        });
+}
@@ -0,0 +1,40 @@
+#ifndef FRIENDS_TRIP_BOT_TRIPSNAPSHOTREPOSITORY_H
+#define FRIENDS_TRIP_BOT_TRIPSNAPSHOTREPOSITORY_H
+
+#include "PaymentRepository.h"
+#include "TripRepository.h"
+#include "UserRepository.h"
+#include <functional>
+#include <optional>
+#include <vector>
+
+class AsyncDatabase;
+class DatabaseManager;
+
+// Everything a conversation about the chat's active trip starts from
+struct TripSnapshot {
+    Trip trip;
+    std::vector<User> users;
+    std::vector<PaymentGroup> paymentGroups;  // newest first, each with its records
+};
+
+// Reads a trip snapshot in a single statement (one round trip) instead of separate
+// queries for the active trip, the roster, the payment groups and their records.
+class TripSnapshotRepository {
+public:
+    using LoadedCallback = std::function<void(std::optional<TripSnapshot>)>;
+
+    TripSnapshotRepository(DatabaseManager& dbManager, AsyncDatabase& asyncDb);
+
+    // std::nullopt if the chat has no active trip or the query failed
+    std::optional<TripSnapshot> load(long long chatId, long long threadId, bool includePayments = true);
+
+    // Same, on the non-blocking AsyncDatabase; onDone runs on a bot worker
+    void loadAsync(long long chatId, long long threadId, bool includePayments, LoadedCallback onDone);
+
+private:
+    DatabaseManager& dbManager_;
+    AsyncDatabase& asyncDb_;
+};
+
+#endif //FRIENDS_TRIP_BOT_TRIPSNAPSHOTREPOSITORY_H
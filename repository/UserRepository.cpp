@@ -1,14 +1,21 @@
 #include "UserRepository.h"
-#include <iostream>
+#include "../logging/Logging.h"
+#include "../metrics/Metrics.h"
+#include "../tracing/Tracing.h"
+#include "ChatCache.h"
 #include <pqxx/pqxx>
-#include <spdlog/spdlog.h>
 
-UserRepository::UserRepository(DatabaseManager& dbManager) : dbManager_(dbManager) {}
+UserRepository::UserRepository(DatabaseManager& dbManager, ChatCache& chatCache)
+    : dbManager_(dbManager), chatCache_(chatCache) {}
 
 bool UserRepository::createUser(const User& user) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("user_create");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "user_create");
+
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error creating user: database connection unavailable" << std::endl;
+        logging::repo().error("Error creating user: database connection unavailable");
         return false;
     }
 
@@ -19,73 +26,76 @@ bool UserRepository::createUser(const User& user) {
             pqxx::params{user.user_id, user.chat_id, user.thread_id, user.name}
         );
         txn.commit();
-        spdlog::info("Created user: user_id={}, chat_id={}, thread_id={}, name='{}'",
-                     user.user_id, user.chat_id, user.thread_id, user.name);
+        chatCache_.rosters.invalidate({user.chat_id, user.thread_id});
+        logging::repo().info("Created user: user_id={}, chat_id={}, thread_id={}, name='{}'",
+                             user.user_id, user.chat_id, user.thread_id, user.name);
         return true;
     } catch (const std::exception& e) {
-        std::cerr << "Error creating user: " << e.what() << std::endl;
+        logging::repo().error("Error creating user: {}", e.what());
         return false;
     }
 }
 
 bool UserRepository::registerUserWithDefaultTrip(const User& user) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("user_register_with_default_trip");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "user_register_with_default_trip");
+
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error registering user with default trip: database connection unavailable" << std::endl;
+        logging::repo().error("Error registering user with default trip: database connection unavailable");
         return false;
     }
 
     try {
         pqxx::work txn(*conn);
 
-        // 1. Insert user
-        txn.exec(
-            "INSERT INTO users (user_id, chat_id, thread_id, name) VALUES ($1, $2, $3, $4) "
-            "ON CONFLICT (user_id, chat_id, thread_id) DO NOTHING",
+        // One statement: insert the user, and if the chat has no trip yet, create the
+        // default trip and make it the chat's active trip
+        pqxx::result res = txn.exec(
+            "WITH new_user AS ("
+            "    INSERT INTO users (user_id, chat_id, thread_id, name) VALUES ($1, $2, $3, $4) "
+            "    ON CONFLICT (user_id, chat_id, thread_id) DO NOTHING"
+            "), new_trip AS ("
+            "    INSERT INTO trips (chat_id, thread_id, name) "
+            "    SELECT $2::bigint, $3::bigint, 'default' "
+            "    WHERE NOT EXISTS (SELECT 1 FROM trips WHERE chat_id = $2 AND thread_id = $3) "
+            "    RETURNING trip_id"
+            "), active AS ("
+            "    INSERT INTO chats (chat_id, thread_id, active_trip_id) "
+            "    SELECT $2::bigint, $3::bigint, trip_id FROM new_trip "
+            "    ON CONFLICT (chat_id, thread_id) DO UPDATE SET active_trip_id = EXCLUDED.active_trip_id "
+            "    WHERE chats.active_trip_id IS NULL"
+            ") "
+            "SELECT trip_id FROM new_trip",
             pqxx::params{user.user_id, user.chat_id, user.thread_id, user.name}
         );
 
-        spdlog::info("Registering user with default trip: user_id={}, chat_id={}, thread_id={}, name='{}'",
-                     user.user_id, user.chat_id, user.thread_id, user.name);
-
-        // 2. Check if a trip already exists for this chat/thread
-        pqxx::result tripRes = txn.exec(
-            "SELECT trip_id FROM trips WHERE chat_id = $1 AND thread_id = $2 LIMIT 1",
-            pqxx::params{user.chat_id, user.thread_id}
-        );
-
-        long long tripId;
-        if (tripRes.empty()) {
-            // 3. Create default trip if none exists
-            pqxx::result newTripRes = txn.exec(
-                "INSERT INTO trips (chat_id, thread_id, name) VALUES ($1, $2, 'default') RETURNING trip_id",
-                pqxx::params{user.chat_id, user.thread_id}
-            );
-            tripId = newTripRes[0][0].as<long long>();
-
-            spdlog::info("Created default trip: trip_id={}, chat_id={}, thread_id={}", tripId, user.chat_id, user.thread_id);
-
-            // 4. Create/Update chat with active trip
-            txn.exec(
-                "INSERT INTO chats (chat_id, thread_id, active_trip_id) VALUES ($1, $2, $3) "
-                "ON CONFLICT (chat_id, thread_id) DO UPDATE SET active_trip_id = EXCLUDED.active_trip_id "
-                "WHERE chats.active_trip_id IS NULL",
-                pqxx::params{user.chat_id, user.thread_id, tripId}
-            );
+        logging::repo().info("Registering user with default trip: user_id={}, chat_id={}, thread_id={}, name='{}'",
+                             user.user_id, user.chat_id, user.thread_id, user.name);
+        if (!res.empty()) {
+            logging::repo().info("Created default trip: trip_id={}, chat_id={}, thread_id={}",
+                                 res[0][0].as<long long>(), user.chat_id, user.thread_id);
         }
 
         txn.commit();
+        // May have added the user, a default trip and the chat's active trip
+        chatCache_.invalidateChat(user.chat_id, user.thread_id);
         return true;
     } catch (const std::exception& e) {
-        std::cerr << "Error in registerUserWithDefaultTrip: " << e.what() << std::endl;
+        logging::repo().error("Error in registerUserWithDefaultTrip: {}", e.what());
         return false;
     }
 }
 
 std::optional<User> UserRepository::getUser(long long userId, long long chatId, long long threadId) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("user_get");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "user_get");
+
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error getting user: database connection unavailable" << std::endl;
+        logging::repo().error("Error getting user: database connection unavailable");
         return std::nullopt;
     }
 
@@ -108,17 +118,28 @@ std::optional<User> UserRepository::getUser(long long userId, long long chatId,
             row["gmt_modified"].c_str()
         };
     } catch (const std::exception& e) {
-        std::cerr << "Error getting user: " << e.what() << std::endl;
+        logging::repo().error("Error getting user: {}", e.what());
         return std::nullopt;
     }
 }
 
 std::vector<User> UserRepository::getUsersByChatAndThread(long long chatId, long long threadId) {
+    auto users = chatCache_.rosters.get({chatId, threadId}, [&] {
+        return loadUsersByChatAndThread(chatId, threadId);
+    });
+    return users ? std::move(*users) : std::vector<User>{};
+}
+
+std::optional<std::vector<User>> UserRepository::loadUsersByChatAndThread(long long chatId, long long threadId) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("user_list");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "user_list");
+
     std::vector<User> users;
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error getting users by chat and thread: database connection unavailable" << std::endl;
-        return users;
+        logging::repo().error("Error getting users by chat and thread: database connection unavailable");
+        return std::nullopt;
     }
 
     try {
@@ -139,15 +160,20 @@ std::vector<User> UserRepository::getUsersByChatAndThread(long long chatId, long
             });
         }
     } catch (const std::exception& e) {
-        std::cerr << "Error getting users by chat and thread: " << e.what() << std::endl;
+        logging::repo().error("Error getting users by chat and thread: {}", e.what());
+        return std::nullopt;
     }
     return users;
 }
 
 bool UserRepository::updateUser(const User& user) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("user_update");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "user_update");
+
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error updating user: database connection unavailable" << std::endl;
+        logging::repo().error("Error updating user: database connection unavailable");
         return false;
     }
 
@@ -158,21 +184,26 @@ bool UserRepository::updateUser(const User& user) {
             pqxx::params{user.user_id, user.chat_id, user.thread_id, user.name}
         );
         txn.commit();
+        chatCache_.rosters.invalidate({user.chat_id, user.thread_id});
         if (res.affected_rows() > 0) {
-            spdlog::info("Updated user: user_id={}, chat_id={}, thread_id={}, name='{}'",
-                         user.user_id, user.chat_id, user.thread_id, user.name);
+            logging::repo().info("Updated user: user_id={}, chat_id={}, thread_id={}, name='{}'",
+                                 user.user_id, user.chat_id, user.thread_id, user.name);
         }
         return res.affected_rows() > 0;
     } catch (const std::exception& e) {
-        std::cerr << "Error updating user: " << e.what() << std::endl;
+        logging::repo().error("Error updating user: {}", e.what());
         return false;
     }
 }
 
 bool UserRepository::deleteUser(long long userId, long long chatId, long long threadId) {
+    static metrics::Histogram& latency = metrics::dbQueryLatency("user_delete");
+    metrics::ScopedTimer timer(latency);
+    tracing::Span span("db", "user_delete");
+
     pqxx::connection* conn = dbManager_.getConnection();
     if (!conn || !conn->is_open()) {
-        std::cerr << "Error deleting user: database connection unavailable" << std::endl;
+        logging::repo().error("Error deleting user: database connection unavailable");
         return false;
     }
 
@@ -183,12 +214,13 @@ bool UserRepository::deleteUser(long long userId, long long chatId, long long th
             pqxx::params{userId, chatId, threadId}
         );
         txn.commit();
+        chatCache_.rosters.invalidate({chatId, threadId});
         if (res.affected_rows() > 0) {
-            spdlog::info("Deleted user: user_id={}, chat_id={}, thread_id={}", userId, chatId, threadId);
+            logging::repo().info("Deleted user: user_id={}, chat_id={}, thread_id={}", userId, chatId, threadId);
         }
         return res.affected_rows() > 0;
     } catch (const std::exception& e) {
-        std::cerr << "Error deleting user: " << e.what() << std::endl;
+        logging::repo().error("Error deleting user: {}", e.what());
         return false;
     }
 }
@@ -15,9 +15,11 @@ struct User {
     std::string gmt_modified;
 };
 
+class ChatCache;
+
 class UserRepository {
 public:
-    explicit UserRepository(DatabaseManager& dbManager);
+    UserRepository(DatabaseManager& dbManager, ChatCache& chatCache);
 
     bool createUser(const User& user);
     bool registerUserWithDefaultTrip(const User& user);
@@ -27,7 +29,11 @@ public:
     bool deleteUser(long long userId, long long chatId, long long threadId);
 
 private:
+    // Uncached query; std::nullopt on database errors so failures are not cached
+    std::optional<std::vector<User>> loadUsersByChatAndThread(long long chatId, long long threadId);
+
     DatabaseManager& dbManager_;
+    ChatCache& chatCache_;
 };
 
 #endif // USER_REPOSITORY_H
@@ -3,38 +3,69 @@
 //
 
 #include "PaymentService.h"
-#include <iostream>
+#include "../logging/Logging.h"
 #include <sstream>
 
-PaymentService::PaymentService(PaymentRepository& paymentRepository, TripRepository& tripRepository,
-                               UserRepository& userRepository, bot::Bot& bot)
-    : paymentRepository_(paymentRepository), tripRepository_(tripRepository),
-      userRepository_(userRepository), bot_(bot) {}
+PaymentService::PaymentService(PaymentRepository& paymentRepository, AsyncPaymentRepository& asyncPaymentRepository,
+                               TripRepository& tripRepository, UserRepository& userRepository,
+                               CallbackRepository& callbackRepository, bot::Bot& bot)
+    : paymentRepository_(paymentRepository), asyncPaymentRepository_(asyncPaymentRepository),
+      tripRepository_(tripRepository),
+      userRepository_(userRepository), callbackRepository_(callbackRepository), bot_(bot) {}
 
-std::optional<PaymentGroup> PaymentService::undoLastPaymentInActiveTrip(long long chatId, long long threadId) {
-    auto activeTrip = tripRepository_.getActiveTrip(chatId, threadId);
-    if (!activeTrip.has_value()) {
-        std::cerr << "No active trip found for chatId=" << chatId << " threadId=" << threadId << std::endl;
-        return std::nullopt;
-    }
-    auto deleted = paymentRepository_.deleteLastPaymentGroup(activeTrip->trip_id);
-    if (deleted.has_value()) {
-        bot_.sendMessage(chatId, "Deleted payment: " + deleted->name);
-    } else {
-        bot_.sendMessage(chatId, "There are no payments in this group yet.");
-    }
-    return deleted;
+void PaymentService::undoLastPaymentInActiveTrip(long long chatId, long long threadId) {
+    asyncPaymentRepository_.deleteLastPaymentGroupInActiveTrip(chatId, threadId,
+        [this, chatId](std::optional<PaymentGroup> deleted) {
+            if (deleted.has_value()) {
+                bot_.sendMessage(chatId, "Deleted payment: " + deleted->name);
+            } else {
+                bot_.sendMessage(chatId, "There are no payments in this group yet.");
+            }
+        });
 }
 
-void PaymentService::logSimplifiedPayment(const PaymentGroup& paymentGroup, const std::string& fromName,
-                                           const std::string& toName, long long groupChatId) {
+std::string PaymentService::offerSimplifiedPayment(const LogSimplifiedPayment& payment) {
+    return callbackRepository_.store(payment);
+}
+
+LogPaymentResult PaymentService::logOfferedPayment(const std::string& key) {
+    auto taken = callbackRepository_.take(key);
+    if (!taken.has_value()) {
+        return LogPaymentResult::Expired;
+    }
+    const auto& payment = std::get<LogSimplifiedPayment>(taken->payload);
+
+    PaymentGroup paymentGroup;
+    paymentGroup.payment_group_id = 0;
+    paymentGroup.trip_id = payment.trip_id;
+    paymentGroup.name = "Simplified Repayment";
+    paymentGroup.total_amount = payment.amount;
+    paymentGroup.payer_user_id = payment.from_user_id;
+    paymentGroup.gmt_created = {};
+
+    PaymentRecord record;
+    record.payment_record_id = 0;
+    record.payment_group_id = 0;
+    record.trip_id = payment.trip_id;
+    record.amount = payment.amount;
+    record.from_user_id = payment.from_user_id;
+    record.to_user_id = payment.to_user_id;
+    record.gmt_created = {};
+    paymentGroup.records.push_back(record);
+
     if (!paymentRepository_.createPaymentGroup(paymentGroup)) {
-        std::cerr << "Failed to log simplified payment for trip " << paymentGroup.trip_id << std::endl;
-        return;
+        logging::service().error("Failed to log simplified payment for trip {}", payment.trip_id);
+        if (!callbackRepository_.restore(key, *taken)) {
+            logging::service().error("Could not restore Log Payment button: callback_id={}", key);
+        }
+        return LogPaymentResult::Failed;
     }
 
+    auto from = userRepository_.getUser(payment.from_user_id, payment.chat_id, payment.thread_id);
+    auto to = userRepository_.getUser(payment.to_user_id, payment.chat_id, payment.thread_id);
     std::stringstream groupMsg;
-    groupMsg << "\xf0\x9f\x92\xb8 <b>" << fromName << "</b> paid <b>" << toName
-             << "</b>: <b>" << paymentGroup.total_amount.toHumanReadable() << "</b>";
-    bot_.sendMessage(groupChatId, groupMsg.str(), nullptr, "HTML");
-}
\ No newline at end of file
+    groupMsg << "\xf0\x9f\x92\xb8 <b>" << (from ? from->name : "Someone") << "</b> paid <b>"
+             << (to ? to->name : "someone") << "</b>: <b>" << payment.amount << "</b>";
+    bot_.sendMessage(payment.chat_id, groupMsg.str(), nullptr, "HTML");
+    return LogPaymentResult::Logged;
+}
@@ -2,24 +2,37 @@
 #define FRIENDS_TRIP_BOT_PAYMENTSERVICE_H
 
 #include <optional>
+#include "../repository/AsyncPaymentRepository.h"
+#include "../repository/CallbackRepository.h"
 #include "../repository/PaymentRepository.h"
 #include "../repository/TripRepository.h"
 #include "../repository/UserRepository.h"
 #include "../bot/Bot.h"
 
+enum class LogPaymentResult { Logged, Expired, Failed };
+
 class PaymentService {
 public:
-    explicit PaymentService(PaymentRepository& paymentRepository, TripRepository& tripRepository,
-                            UserRepository& userRepository, bot::Bot& bot);
+    explicit PaymentService(PaymentRepository& paymentRepository, AsyncPaymentRepository& asyncPaymentRepository,
+                            TripRepository& tripRepository, UserRepository& userRepository,
+                            CallbackRepository& callbackRepository, bot::Bot& bot);
+
+    // Returns once the delete is queued; the chat is told the outcome when it completes
+    void undoLastPaymentInActiveTrip(long long chatId, long long threadId);
 
-    std::optional<PaymentGroup> undoLastPaymentInActiveTrip(long long chatId, long long threadId);
-    void logSimplifiedPayment(const PaymentGroup& paymentGroup, const std::string& fromName,
-                              const std::string& toName, long long groupChatId);
+    // Key for the "Log Payment" button's callback_data; empty if it could not be stored
+    std::string offerSimplifiedPayment(const LogSimplifiedPayment& payment);
+    // Logs the payment behind a pressed button. Expired if the button expired or was
+    // used; Failed if the payment could not be written, in which case the button is
+    // left working so it can be pressed again.
+    LogPaymentResult logOfferedPayment(const std::string& key);
 
 private:
     PaymentRepository& paymentRepository_;
+    AsyncPaymentRepository& asyncPaymentRepository_;
     TripRepository& tripRepository_;
     UserRepository& userRepository_;
+    CallbackRepository& callbackRepository_;
     bot::Bot& bot_;
 };
 
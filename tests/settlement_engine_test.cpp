@@ -0,0 +1,252 @@
+// SettlementEngine against a full recompute: random payment inserts and undos applied
+// as deltas must leave the same balances as rebuilding the trip from its history, and
+// loads that overlap a write must never count it twice.
+//
+// Usage: settlement_engine_test [--seed N] [--steps N]
+//
+// Prints each failed check to stderr; exits non-zero if any failed.
+
+#include "../algorithm/GreedyDebtSimplifier.h"
+#include "../algorithm/SettlementEngine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (ok) return;
+    std::cerr << "FAILED: " << what << std::endl;
+    failures++;
+}
+
+const std::vector<std::string> kCurrencies = {"USD", "EUR", "JPY"};
+// Binary fractions, so converted sums are exact whatever order they are added in
+const std::unordered_map<std::string, double> kRates = {{"USD", 1.0}, {"EUR", 1.25}, {"JPY", 0.0078125}};
+constexpr long long kTripId = 1;
+// Enough that most payments touch only a few of them, as on a real trip
+constexpr int kParticipants = 16;
+constexpr int kMaxRecords = 4;
+
+PaymentGroup makeGroup(std::mt19937_64& rng, long long groupId) {
+    std::uniform_int_distribution<int> userDist(0, kParticipants - 1);
+    std::uniform_int_distribution<std::size_t> currencyDist(0, kCurrencies.size() - 1);
+    std::uniform_int_distribution<long long> amountDist(1, 50000);
+
+    const std::string& currency = kCurrencies[currencyDist(rng)];
+    long long payer = userDist(rng);
+    PaymentGroup group{groupId, kTripId, "test", MoneyAmount(currency, 0), payer, {}, {}};
+    long long total = 0;
+    int count = std::uniform_int_distribution<int>(1, kMaxRecords)(rng);
+    for (int i = 0; i < count; ++i) {
+        long long amount = amountDist(rng);
+        total += amount;
+        group.records.push_back({0, groupId, kTripId, MoneyAmount(currency, amount), payer, userDist(rng), {}});
+    }
+    group.total_amount = MoneyAmount(currency, total);
+    return group;
+}
+
+// What each user is left owing (or owed) per currency once the payments are made
+std::map<std::pair<long long, std::string>, long long> residual(const CurrencyBalances& balances,
+                                                                const std::vector<SimplifiedPayment>& payments) {
+    std::map<std::pair<long long, std::string>, long long> result;
+    for (const auto& [userId, perCurrency] : balances) {
+        for (const auto& [currency, amount] : perCurrency) {
+            if (amount != 0) result[{userId, currency}] += amount;
+        }
+    }
+    for (const auto& p : payments) {
+        result[{p.from_user_id, p.amount.currency()}] += p.amount.minorAmount();
+        result[{p.to_user_id, p.amount.currency()}] -= p.amount.minorAmount();
+    }
+    std::erase_if(result, [](const auto& kv) { return kv.second == 0; });
+    return result;
+}
+
+// Net balances in target minor units, converted and rounded per user as simplify() does
+std::unordered_map<long long, long long> convertedBalances(const std::vector<PaymentGroup>& history,
+                                                           const std::string& target) {
+    std::unordered_map<long long, long long> converted;
+    for (const auto& [userId, perCurrency] : DebtSimplifier::computeNetBalances(history)) {
+        double balance = 0;
+        for (const auto& [currency, amount] : perCurrency) {
+            balance += amount * kRates.at(currency) * MoneyAmount::minorUnitsPerMajor(target)
+                     / MoneyAmount::minorUnitsPerMajor(currency);
+        }
+        long long rounded = static_cast<long long>(std::round(balance));
+        if (rounded != 0) converted[userId] = rounded;
+    }
+    return converted;
+}
+
+std::map<long long, long long> residual(const std::unordered_map<long long, long long>& balances,
+                                        const std::vector<SimplifiedPayment>& payments) {
+    std::map<long long, long long> result(balances.begin(), balances.end());
+    for (const auto& p : payments) {
+        result[p.from_user_id] += p.amount.minorAmount();
+        result[p.to_user_id] -= p.amount.minorAmount();
+    }
+    std::erase_if(result, [](const auto& kv) { return kv.second == 0; });
+    return result;
+}
+
+void randomInsertUndo(unsigned seed, int steps) {
+    std::mt19937_64 rng(seed);
+    GreedyDebtSimplifier simplifier;
+    SettlementEngine engine;
+    std::vector<PaymentGroup> history;
+    check(engine.load(kTripId, history, engine.beginLoad(kTripId)), "initial load");
+
+    for (int step = 0; step < steps; ++step) {
+        auto write = engine.beginWrite(kTripId);
+        if (!history.empty() && rng() % 3 == 0) {
+            write.revert(history.back());
+            history.pop_back();
+        } else {
+            history.push_back(makeGroup(rng, step + 1));
+            write.apply(history.back());
+        }
+
+        std::string at = " at step " + std::to_string(step) + " (seed " + std::to_string(seed) + ")";
+        auto summary = engine.summary(kTripId);
+        check(summary && summary->paymentGroupCount == history.size(), "payment group count" + at);
+
+        // The engine's plan must settle the balances recomputed from the history exactly
+        auto payments = engine.simplifyPerCurrency(kTripId, simplifier);
+        check(payments.has_value(), "trip still loaded" + at);
+        if (!payments) return;
+        check(residual(DebtSimplifier::computeNetBalances(history), *payments).empty(),
+              "incremental balances match a full recompute" + at);
+
+        // Settling in one currency: the (possibly cached) plan must settle the balances
+        // of a full recompute, with no more transfers than solving them from scratch
+        const std::string& target = kCurrencies[step / 100 % 2];
+        auto plan = engine.simplify(kTripId, simplifier, kRates, target);
+        check(plan.has_value(), "simplify in " + target + at);
+        if (!plan) return;
+        auto converted = convertedBalances(history, target);
+        auto fullSolve = simplifier.settle(converted, target);
+        // Rounded balances need not sum to zero, so compare what each plan leaves open
+        check(residual(converted, *plan) == residual(converted, fullSolve),
+              "simplify settles the recomputed balances" + at);
+        check(plan->size() <= fullSolve.size(), "simplify needs no more transfers than a full solve" + at);
+    }
+}
+
+void overlappingWrites() {
+    std::mt19937_64 rng(7);
+    GreedyDebtSimplifier simplifier;
+    std::vector<PaymentGroup> history = {makeGroup(rng, 1)};
+    PaymentGroup written = makeGroup(rng, 2);
+    auto withWrite = history;
+    withWrite.push_back(written);
+
+    {
+        // History read before the write began, installed after it committed
+        SettlementEngine engine;
+        uint64_t epoch = engine.beginLoad(kTripId);
+        engine.beginWrite(kTripId).apply(written);
+        check(!engine.load(kTripId, withWrite, epoch), "load overlapping a finished write is discarded");
+        check(!engine.isLoaded(kTripId), "discarded load leaves the trip unloaded");
+    }
+    {
+        // History read while the write is in flight
+        SettlementEngine engine;
+        engine.beginLoad(kTripId);
+        auto write = engine.beginWrite(kTripId);
+        uint64_t epoch = engine.beginLoad(kTripId);
+        check(!engine.load(kTripId, withWrite, epoch), "load during a pending write is discarded");
+        write.apply(written);
+        check(!engine.isLoaded(kTripId), "delta is not applied to an unloaded trip");
+        check(engine.load(kTripId, withWrite, engine.beginLoad(kTripId)), "reload after the write");
+        check(engine.summary(kTripId)->paymentGroupCount == 2, "reloaded trip counts the write once");
+    }
+    {
+        // A trip nobody loaded gets no state, and a load racing the write is thrown away
+        SettlementEngine engine;
+        auto write = engine.beginWrite(kTripId);
+        check(!engine.isLoaded(kTripId), "write does not create trip state");
+        check(engine.load(kTripId, withWrite, engine.beginLoad(kTripId)), "load with no state at write start");
+        write.apply(written);
+        check(!engine.isLoaded(kTripId), "load racing a write on a new trip is evicted");
+    }
+    {
+        // Loaded before the write began: the delta is applied on top
+        SettlementEngine engine;
+        check(engine.load(kTripId, history, engine.beginLoad(kTripId)), "load before the write");
+        engine.beginWrite(kTripId).apply(written);
+        auto payments = engine.simplifyPerCurrency(kTripId, simplifier);
+        check(payments && residual(DebtSimplifier::computeNetBalances(withWrite), *payments).empty(),
+              "delta applied to a loaded trip");
+    }
+    {
+        // A write abandoned before commit (or whose commit threw) evicts the trip
+        SettlementEngine engine;
+        check(engine.load(kTripId, history, engine.beginLoad(kTripId)), "load before the failed write");
+        { auto write = engine.beginWrite(kTripId); }
+        check(!engine.isLoaded(kTripId), "unfinished write evicts the trip");
+    }
+    {
+        // A write that learns its trip from the statement holds off loads of every trip
+        SettlementEngine engine;
+        check(engine.load(kTripId, withWrite, engine.beginLoad(kTripId)), "load before the any-trip write");
+        uint64_t otherEpoch = engine.beginLoad(kTripId + 1);
+        auto write = engine.beginWrite();
+        check(!engine.load(kTripId + 1, {}, otherEpoch), "load overlapping an any-trip write is discarded");
+        check(!engine.load(kTripId + 1, {}, engine.beginLoad(kTripId + 1)), "load during an any-trip write is discarded");
+        write.revert(written);
+        auto payments = engine.simplifyPerCurrency(kTripId, simplifier);
+        check(payments && residual(DebtSimplifier::computeNetBalances(history), *payments).empty(),
+              "any-trip delta applied to the trip it names");
+        check(engine.load(kTripId + 1, {}, engine.beginLoad(kTripId + 1)), "loads resume after the any-trip write");
+    }
+    {
+        SettlementEngine engine;
+        check(engine.load(kTripId, history, engine.beginLoad(kTripId)), "load before the empty any-trip write");
+        engine.beginWrite().unchanged();
+        check(engine.isLoaded(kTripId), "a write that changed nothing keeps the trip");
+        { auto write = engine.beginWrite(); }
+        check(!engine.isLoaded(kTripId), "an unfinished any-trip write evicts every trip");
+    }
+    {
+        // A payment in a currency the caller has no rate for, e.g. recorded mid-conversation
+        SettlementEngine engine;
+        check(engine.load(kTripId, withWrite, engine.beginLoad(kTripId)), "load before the rate check");
+        std::unordered_map<std::string, double> usdOnly = {{"USD", 1.0}};
+        bool foreign = false;
+        for (const auto& group : withWrite) foreign |= group.total_amount.currency() != "USD";
+        check(!foreign || !engine.simplify(kTripId, simplifier, usdOnly, "USD").has_value(),
+              "simplify without a rate for every currency returns nothing");
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    unsigned seed = 42;
+    int steps = 2000;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--seed") seed = static_cast<unsigned>(std::stoul(argv[i + 1]));
+        else if (arg == "--steps") steps = std::max(1, std::stoi(argv[i + 1]));
+    }
+
+    for (unsigned s = seed; s < seed + 5; ++s) randomInsertUndo(s, steps);
+    overlappingWrites();
+
+    if (failures) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "settlement_engine_test: all checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,223 @@
+#include "Tracing.h"
+#include "../logging/Logging.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace tracing {
+
+namespace {
+
+// Events held between flushes; past this they are dropped and counted, so a stalled
+// flush cannot grow the heap without bound
+constexpr std::size_t kMaxBufferedEvents = 100000;
+
+struct Event {
+    char phase;  // 'X' complete, 'b'/'e' async begin/end
+    const char* category;
+    std::string name;
+    uint64_t traceId;
+    uint64_t asyncId;
+    uint32_t threadId;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+};
+
+struct Tracer {
+    std::atomic<bool> enabled{false};
+    std::atomic<bool> sampleAll{false};
+    std::atomic<uint64_t> sampleThreshold{0};
+    std::atomic<uint64_t> nextTraceId{1};
+    std::atomic<uint64_t> nextAsyncId{1};
+
+    std::mutex bufferMutex;
+    std::vector<Event> buffer;
+    uint64_t dropped = 0;
+
+    // Lock order: fileMutex, then bufferMutex
+    std::mutex fileMutex;
+    std::ofstream out;
+    std::chrono::steady_clock::time_point origin;
+};
+
+Tracer& tracer() {
+    static Tracer instance;
+    return instance;
+}
+
+thread_local TraceContext currentContext;
+
+uint32_t threadId() {
+    static std::atomic<uint32_t> next{1};
+    thread_local uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+// splitmix64 finaliser; spreads sequential ids evenly for sampling
+uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+void append(Event event) {
+    Tracer& t = tracer();
+    std::lock_guard<std::mutex> lock(t.bufferMutex);
+    if (t.buffer.size() >= kMaxBufferedEvents) {
+        ++t.dropped;
+        return;
+    }
+    t.buffer.push_back(std::move(event));
+}
+
+std::string hex(uint64_t value) {
+    char buffer[19];
+    std::snprintf(buffer, sizeof(buffer), "0x%llx", static_cast<unsigned long long>(value));
+    return buffer;
+}
+
+long long micros(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+nlohmann::json toJson(const Event& event, std::chrono::steady_clock::time_point origin) {
+    nlohmann::json j = {
+        {"ph", std::string(1, event.phase)},
+        {"cat", event.category},
+        {"name", event.name},
+        {"pid", ::getpid()},
+        {"tid", event.threadId},
+    };
+    if (event.phase == 'e') {
+        j["ts"] = micros(event.end - origin);
+    } else {
+        j["ts"] = micros(event.start - origin);
+    }
+    if (event.phase == 'X') {
+        j["dur"] = micros(event.end - event.start);
+    } else {
+        j["id"] = hex(event.asyncId);
+    }
+    if (event.phase != 'e') {
+        j["args"] = {{"trace_id", hex(event.traceId)}};
+    }
+    return j;
+}
+
+} // namespace
+
+bool start(const std::string& path, double sampleRate) {
+    Tracer& t = tracer();
+    std::lock_guard<std::mutex> lock(t.fileMutex);
+    t.out.open(path, std::ios::trunc);
+    if (!t.out) {
+        logging::metrics().error("Cannot open trace file {}", path);
+        return false;
+    }
+    t.origin = std::chrono::steady_clock::now();
+    nlohmann::json process = {{"ph", "M"}, {"name", "process_name"}, {"pid", ::getpid()},
+                              {"args", {{"name", "friends_trip_bot"}}}};
+    t.out << "[" << process.dump();
+    t.out.flush();
+
+    sampleRate = std::clamp(sampleRate, 0.0, 1.0);
+    t.sampleAll = sampleRate >= 1.0;
+    t.sampleThreshold = static_cast<uint64_t>(sampleRate * static_cast<double>(std::numeric_limits<uint64_t>::max()));
+    t.enabled = true;
+    logging::metrics().info("Tracing {}% of updates to {}", sampleRate * 100, path);
+    return true;
+}
+
+void flush() {
+    Tracer& t = tracer();
+    std::lock_guard<std::mutex> fileLock(t.fileMutex);
+    std::vector<Event> events;
+    uint64_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(t.bufferMutex);
+        events.swap(t.buffer);
+        std::swap(dropped, t.dropped);
+    }
+    if (!t.out.is_open()) return;
+
+    for (const auto& event : events) {
+        t.out << ",\n" << toJson(event, t.origin).dump();
+    }
+    t.out.flush();
+    if (dropped > 0) {
+        logging::metrics().warn("Dropped {} trace event(s); flush more often or lower the sample rate", dropped);
+    }
+}
+
+void stop() {
+    Tracer& t = tracer();
+    t.enabled = false;
+    flush();
+    std::lock_guard<std::mutex> lock(t.fileMutex);
+    if (t.out.is_open()) {
+        t.out << "\n]\n";
+        t.out.close();
+    }
+}
+
+TraceContext startTrace() {
+    Tracer& t = tracer();
+    if (!t.enabled.load(std::memory_order_relaxed)) return {};
+    uint64_t id = t.nextTraceId.fetch_add(1, std::memory_order_relaxed);
+    bool sampled = t.sampleAll.load(std::memory_order_relaxed)
+                || mix(id) < t.sampleThreshold.load(std::memory_order_relaxed);
+    return {id, sampled};
+}
+
+TraceContext current() {
+    return currentContext;
+}
+
+ScopedContext::ScopedContext(TraceContext context) : previous_(currentContext) {
+    currentContext = context;
+}
+
+ScopedContext::~ScopedContext() {
+    currentContext = previous_;
+}
+
+Span::Span(const char* category, std::string_view name) : context_(currentContext), category_(category) {
+    if (!context_.sampled) return;
+    name_ = name;
+    start_ = std::chrono::steady_clock::now();
+}
+
+Span::~Span() {
+    if (!context_.sampled) return;
+    append({'X', category_, std::move(name_), context_.traceId, 0, threadId(), start_,
+            std::chrono::steady_clock::now()});
+}
+
+AsyncSpan::AsyncSpan(const char* category, const char* name)
+    : context_(currentContext), category_(category), name_(name) {
+    if (context_.sampled) start_ = std::chrono::steady_clock::now();
+}
+
+void AsyncSpan::end() const {
+    if (!context_.sampled) return;
+    auto now = std::chrono::steady_clock::now();
+    uint64_t asyncId = tracer().nextAsyncId.fetch_add(1, std::memory_order_relaxed);
+    append({'b', category_, name_, context_.traceId, asyncId, threadId(), start_, start_});
+    append({'e', category_, name_, context_.traceId, asyncId, threadId(), now, now});
+}
+
+void record(const char* category, std::string_view name, std::chrono::steady_clock::time_point start,
+            std::chrono::steady_clock::time_point end) {
+    if (!currentContext.sampled) return;
+    append({'X', category, std::string(name), currentContext.traceId, 0, threadId(), start, end});
+}
+
+} // namespace tracing
@@ -0,0 +1,87 @@
+#ifndef FRIENDS_TRIP_BOT_TRACING_H
+#define FRIENDS_TRIP_BOT_TRACING_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Per-update tracing. Bot::poll starts a trace for each update and the task carries it
+// to the worker; spans opened on a thread while one of its traces is current are
+// recorded against it. Only a sampled fraction of traces records anything: for the
+// rest a span is a thread-local read and a branch, so tracing can stay on.
+//
+// Events are buffered in memory and written by flush() as Chrome trace-event JSON,
+// which chrome://tracing and ui.perfetto.dev open directly; filter by args.trace_id to
+// follow one update across threads.
+namespace tracing {
+
+struct TraceContext {
+    uint64_t traceId = 0;
+    bool sampled = false;
+};
+
+// Starts writing to path, keeping sampleRate (0 to 1) of traces. False if the file
+// cannot be created.
+bool start(const std::string& path, double sampleRate);
+// Writes what has been buffered; call periodically
+void flush();
+// Flushes and terminates the file; later events are dropped
+void stop();
+
+// Context for a new update; never sampled while tracing is off
+TraceContext startTrace();
+
+// The context of the trace this thread is working for, if any
+TraceContext current();
+
+// Makes context current on this thread until destroyed
+class ScopedContext {
+public:
+    explicit ScopedContext(TraceContext context);
+    ~ScopedContext();
+
+    ScopedContext(const ScopedContext&) = delete;
+    ScopedContext& operator=(const ScopedContext&) = delete;
+
+private:
+    TraceContext previous_;
+};
+
+// Records the time from construction to destruction on this thread
+class Span {
+public:
+    Span(const char* category, std::string_view name);
+    ~Span();
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    TraceContext context_;
+    const char* category_;
+    std::string name_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// A span that ends in a continuation, possibly on another thread: copy it into the
+// callback and call end() there. Drawn as an async slice rather than on a thread.
+class AsyncSpan {
+public:
+    AsyncSpan(const char* category, const char* name);
+    void end() const;
+
+private:
+    TraceContext context_;
+    const char* category_;
+    const char* name_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Records an interval measured elsewhere, on this thread, against the current trace
+void record(const char* category, std::string_view name, std::chrono::steady_clock::time_point start,
+            std::chrono::steady_clock::time_point end);
+
+} // namespace tracing
+
+#endif //FRIENDS_TRIP_BOT_TRACING_H
@@ -1,30 +1,36 @@
 #ifndef FRIENDS_TRIP_BOT_MONEYAMOUNT_H
 #define FRIENDS_TRIP_BOT_MONEYAMOUNT_H
 
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <limits>
+#include <ostream>
 #include <string>
-#include <unordered_set>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
 #include <cmath>
-#include <sstream>
-#include <iomanip>
 
 // Currencies that have no subunit (1 unit = 1 minor unit, no decimal places)
 // e.g. JPY: 1 yen = 1 minor unit, vs USD: 1 dollar = 100 cents (minor units)
 enum class AmountValidation { Positive, NonNegative };
 
-struct AmountParseResult {
-    bool success;
-    double amount;
-    std::string error;
-};
+struct AmountParseResult;
 
+// Trivially copyable 16-byte value: the amount in minor units plus the ISO 4217 code
+// stored inline (codes longer than 3 characters are truncated, as in the database).
 class MoneyAmount {
 public:
-    MoneyAmount() : currency_(""), amount_minor_(0) {}
-    MoneyAmount(std::string currency, long long minorAmount)
-        : currency_(std::move(currency)), amount_minor_(minorAmount) {}
+    constexpr MoneyAmount() : amount_minor_(0), currency_{}, currencyLength_(0) {}
+    constexpr MoneyAmount(std::string_view currency, long long minorAmount)
+        : amount_minor_(minorAmount), currency_{}, currencyLength_(0) {
+        currencyLength_ = static_cast<std::uint8_t>(currency.size() < currency_.size() ? currency.size() : currency_.size());
+        for (std::uint8_t i = 0; i < currencyLength_; ++i) currency_[i] = currency[i];
+    }
 
     // Construct from a user-entered major-unit value (e.g. 12.34 for USD, 1234 for JPY)
-    static MoneyAmount fromMajorUnits(const std::string& currency, double amount) {
+    static MoneyAmount fromMajorUnits(std::string_view currency, double amount) {
         long long minor;
         if (isZeroDecimal(currency)) {
             minor = static_cast<long long>(std::round(amount));
@@ -35,73 +41,176 @@ public:
     }
 
     // Returns the factor for converting major units to minor units
-    static double minorUnitsPerMajor(const std::string& currency) {
+    static constexpr double minorUnitsPerMajor(std::string_view currency) {
         return isZeroDecimal(currency) ? 1.0 : 100.0;
     }
 
     // Arithmetic operators — both operands must share the same currency
-    MoneyAmount operator+(const MoneyAmount& other) const {
-        return MoneyAmount(currency_, amount_minor_ + other.amount_minor_);
+    constexpr MoneyAmount operator+(const MoneyAmount& other) const {
+        return withMinor(amount_minor_ + other.amount_minor_);
     }
-    MoneyAmount operator-(const MoneyAmount& other) const {
-        return MoneyAmount(currency_, amount_minor_ - other.amount_minor_);
+    constexpr MoneyAmount operator-(const MoneyAmount& other) const {
+        return withMinor(amount_minor_ - other.amount_minor_);
     }
     // Scale by a floating-point factor (e.g. exchange rate)
     MoneyAmount operator*(double factor) const {
-        return MoneyAmount(currency_, static_cast<long long>(std::round(amount_minor_ * factor)));
+        return withMinor(static_cast<long long>(std::round(amount_minor_ * factor)));
     }
     // Integer division (e.g. equal split among N people)
-    MoneyAmount operator/(long long divisor) const {
-        return MoneyAmount(currency_, amount_minor_ / divisor);
+    constexpr MoneyAmount operator/(long long divisor) const {
+        return withMinor(amount_minor_ / divisor);
     }
 
-    long long minorAmount() const { return amount_minor_; }
-    const std::string& currency() const { return currency_; }
+    constexpr long long minorAmount() const { return amount_minor_; }
+    constexpr std::string_view currencyView() const { return {currency_.data(), currencyLength_}; }
+    // Returned by value; three characters always fit the small-string buffer
+    std::string currency() const { return std::string(currencyView()); }
 
-    // Format as a human-readable string, e.g. "12.34 USD" or "1234 JPY"
-    std::string toHumanReadable() const {
-        std::ostringstream ss;
-        if (isZeroDecimal(currency_)) {
-            ss << amount_minor_ << " " << currency_;
-        } else {
-            double major = static_cast<double>(amount_minor_) / 100.0;
-            ss << std::fixed << std::setprecision(2) << major << " " << currency_;
+    // Longest output of toChars: sign, 19 digits, decimal point, space and code
+    static constexpr std::size_t MAX_CHARS = 26;
+
+    // Write e.g. "12.34 USD" or "1234 JPY" into [first, last) without allocating.
+    // Returns ec == std::errc::value_too_large if the buffer is too small.
+    std::to_chars_result toChars(char* first, char* last) const {
+        // Work on the magnitude in unsigned so the most negative amount is not UB
+        unsigned long long magnitude = amount_minor_ < 0
+            ? 0ULL - static_cast<unsigned long long>(amount_minor_)
+            : static_cast<unsigned long long>(amount_minor_);
+        char* out = first;
+        if (amount_minor_ < 0) {
+            if (out == last) return {last, std::errc::value_too_large};
+            *out++ = '-';
         }
-        return ss.str();
-    }
-
-    static AmountParseResult parseAndValidateAmount(const std::string& input,
-                                                    AmountValidation validation = AmountValidation::Positive) {
-        try {
-            double amount = std::stod(input);
-            if (validation == AmountValidation::Positive && amount <= 0) {
-                return {false, 0, "Amount should be positive. Please enter a valid amount:"};
-            }
-            if (validation == AmountValidation::NonNegative && amount < 0) {
-                return {false, 0, "Amount cannot be negative. Please enter a valid amount:"};
-            }
-            if (std::isinf(amount)) {
-                return {false, 0, "Amount is too large. Please enter a valid amount:"};
-            }
-            return {true, amount, ""};
-        } catch (const std::out_of_range&) {
-            return {false, 0, "Amount is too large. Please enter a valid amount:"};
-        } catch (...) {
-            return {false, 0, "Invalid amount. Please enter a number (e.g. 123 or 123.00)."};
+        if (isZeroDecimal(currencyView())) {
+            auto [ptr, ec] = std::to_chars(out, last, magnitude);
+            if (ec != std::errc()) return {last, ec};
+            out = ptr;
+        } else {
+            auto [ptr, ec] = std::to_chars(out, last, magnitude / 100);
+            if (ec != std::errc() || last - ptr < 3) return {last, std::errc::value_too_large};
+            unsigned cents = static_cast<unsigned>(magnitude % 100);
+            ptr[0] = '.';
+            ptr[1] = static_cast<char>('0' + cents / 10);
+            ptr[2] = static_cast<char>('0' + cents % 10);
+            out = ptr + 3;
         }
+        if (last - out < 1 + currencyLength_) return {last, std::errc::value_too_large};
+        *out++ = ' ';
+        for (std::uint8_t i = 0; i < currencyLength_; ++i) *out++ = currency_[i];
+        return {out, std::errc()};
+    }
+
+    // Format as a human-readable string, e.g. "12.34 USD" or "1234 JPY"
+    std::string toHumanReadable() const {
+        std::array<char, MAX_CHARS> buffer;
+        auto [end, ec] = toChars(buffer.data(), buffer.data() + buffer.size());
+        return std::string(buffer.data(), end);
     }
 
-    static bool isZeroDecimal(const std::string& currency) {
-        static const std::unordered_set<std::string> zeroDecimalCurrencies = {
+    // Exact parse of a user-entered major-unit amount (e.g. "123", "123.4", "1234.567")
+    // straight into minor units of the given currency, without going through double.
+    // Surrounding whitespace and a leading sign are accepted; digits beyond the
+    // currency's decimal places are rounded half away from zero.
+    static AmountParseResult parseAndValidateAmount(std::string_view input,
+                                                    std::string_view currency,
+                                                    AmountValidation validation = AmountValidation::Positive);
+
+    static constexpr bool isZeroDecimal(std::string_view currency) {
+        constexpr std::array<std::string_view, 13> zeroDecimalCurrencies = {
             "JPY", "KRW", "VND", "IDR", "ISK", "CLP",
             "UGX", "RWF", "BIF", "GNF", "XAF", "XOF", "XPF"
         };
-        return zeroDecimalCurrencies.count(currency) > 0;
+        for (std::string_view code : zeroDecimalCurrencies) {
+            if (code == currency) return true;
+        }
+        return false;
     }
 
 private:
-    std::string currency_;
+    constexpr MoneyAmount withMinor(long long minorAmount) const {
+        MoneyAmount result = *this;
+        result.amount_minor_ = minorAmount;
+        return result;
+    }
+
     long long amount_minor_;
+    std::array<char, 3> currency_;
+    std::uint8_t currencyLength_;
 };
 
+inline std::ostream& operator<<(std::ostream& os, const MoneyAmount& amount) {
+    std::array<char, MoneyAmount::MAX_CHARS> buffer;
+    auto [end, ec] = amount.toChars(buffer.data(), buffer.data() + buffer.size());
+    return os.write(buffer.data(), end - buffer.data());
+}
+
+struct AmountParseResult {
+    bool success;
+    MoneyAmount amount;
+    std::string_view error;  // static message for the user, empty on success
+};
+
+inline AmountParseResult MoneyAmount::parseAndValidateAmount(std::string_view input,
+                                                             std::string_view currency,
+                                                             AmountValidation validation) {
+    constexpr std::string_view invalid = "Invalid amount. Please enter a number (e.g. 123 or 123.00).";
+    constexpr std::string_view tooLarge = "Amount is too large. Please enter a valid amount:";
+
+    constexpr std::string_view whitespace = " \t\r\n";
+    auto begin = input.find_first_not_of(whitespace);
+    if (begin == std::string_view::npos) return {false, {}, invalid};
+    input = input.substr(begin, input.find_last_not_of(whitespace) - begin + 1);
+
+    bool negative = false;
+    if (input.front() == '+' || input.front() == '-') {
+        negative = input.front() == '-';
+        input.remove_prefix(1);
+    }
+
+    std::string_view whole = input.substr(0, input.find('.'));
+    std::string_view fraction;
+    if (whole.size() < input.size()) {
+        fraction = input.substr(whole.size() + 1);
+    }
+    if (whole.empty() && fraction.empty()) return {false, {}, invalid};
+
+    unsigned long long major = 0;
+    if (!whole.empty()) {
+        auto [ptr, ec] = std::from_chars(whole.data(), whole.data() + whole.size(), major);
+        if (ec == std::errc::result_out_of_range) return {false, {}, tooLarge};
+        if (ec != std::errc() || ptr != whole.data() + whole.size()) return {false, {}, invalid};
+    }
+    for (char c : fraction) {
+        if (c < '0' || c > '9') return {false, {}, invalid};
+    }
+
+    int decimals = isZeroDecimal(currency) ? 0 : 2;
+    unsigned long long minor = major;
+    for (int i = 0; i < decimals; ++i) {
+        int digit = static_cast<std::size_t>(i) < fraction.size() ? fraction[i] - '0' : 0;
+        if (minor > (std::numeric_limits<unsigned long long>::max() - digit) / 10) return {false, {}, tooLarge};
+        minor = minor * 10 + digit;
+    }
+    if (static_cast<std::size_t>(decimals) < fraction.size() && fraction[decimals] >= '5') {
+        // A zero-decimal amount can be the full range of unsigned long long here
+        if (minor == std::numeric_limits<unsigned long long>::max()) return {false, {}, tooLarge};
+        ++minor;
+    }
+    if (minor > static_cast<unsigned long long>(std::numeric_limits<long long>::max())) {
+        return {false, {}, tooLarge};
+    }
+
+    long long signedMinor = negative ? -static_cast<long long>(minor) : static_cast<long long>(minor);
+    if (validation == AmountValidation::Positive && signedMinor <= 0) {
+        return {false, {}, "Amount should be positive. Please enter a valid amount:"};
+    }
+    if (validation == AmountValidation::NonNegative && signedMinor < 0) {
+        return {false, {}, "Amount cannot be negative. Please enter a valid amount:"};
+    }
+    return {true, MoneyAmount(currency, signedMinor), {}};
+}
+
+static_assert(sizeof(MoneyAmount) == 16, "MoneyAmount should stay two words");
+static_assert(std::is_trivially_copyable_v<MoneyAmount>, "MoneyAmount should be trivially copyable");
+
 #endif // FRIENDS_TRIP_BOT_MONEYAMOUNT_H
\ No newline at end of file
@@ -1,43 +1,156 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <array>
 #include <chrono>
+#include <cstddef>
+#include <ostream>
 #include <string>
-#include <ctime>
-#include <cstdio>
-#include <memory>
+#include <string_view>
 
 namespace utils {
+    namespace detail {
+        // Days since 1970-01-01 of a proleptic Gregorian date (Howard Hinnant's days_from_civil)
+        constexpr long long daysFromCivil(long long y, unsigned m, unsigned d) {
+            y -= m <= 2;
+            const long long era = (y >= 0 ? y : y - 399) / 400;
+            const unsigned yoe = static_cast<unsigned>(y - era * 400);
+            const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+            const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+            return era * 146097 + static_cast<long long>(doe) - 719468;
+        }
+
+        struct CivilDate {
+            long long year;
+            unsigned month;
+            unsigned day;
+        };
+
+        // Inverse of daysFromCivil
+        constexpr CivilDate civilFromDays(long long z) {
+            z += 719468;
+            const long long era = (z >= 0 ? z : z - 146096) / 146097;
+            const unsigned doe = static_cast<unsigned>(z - era * 146097);
+            const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+            const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+            const unsigned mp = (5 * doy + 2) / 153;
+            const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+            const unsigned m = mp < 10 ? mp + 3 : mp - 9;
+            return {static_cast<long long>(yoe) + era * 400 + (m <= 2), m, d};
+        }
+
+        // Reads exactly n digits at s[pos]; returns -1 if any of them is not a digit
+        constexpr int fixedDigits(std::string_view s, std::size_t pos, std::size_t n) {
+            int value = 0;
+            for (std::size_t i = pos; i < pos + n; ++i) {
+                unsigned digit = static_cast<unsigned char>(s[i]) - '0';
+                if (digit > 9) return -1;
+                value = value * 10 + static_cast<int>(digit);
+            }
+            return value;
+        }
+
+        static_assert(daysFromCivil(1970, 1, 1) == 0);
+        static_assert(daysFromCivil(2000, 3, 1) == 11017);
+        static_assert(civilFromDays(11017).year == 2000 && civilFromDays(11017).month == 3);
+    }
+
+    // Parses a Postgres timestamp in text form, "YYYY-MM-DD HH:MM:SS[.ffffff][+HH[:MM]]"
+    // ('T' is accepted as the separator). Values without an offset are taken as UTC, the
+    // database's timezone. Returns the epoch for null or malformed input.
+    inline std::chrono::system_clock::time_point parseTimestamp(std::string_view text) {
+        using namespace std::chrono;
+        if (text.size() < 19 || text[4] != '-' || text[7] != '-' || (text[10] != ' ' && text[10] != 'T')
+            || text[13] != ':' || text[16] != ':') {
+            return system_clock::time_point{};
+        }
+        int year = detail::fixedDigits(text, 0, 4);
+        int month = detail::fixedDigits(text, 5, 2);
+        int day = detail::fixedDigits(text, 8, 2);
+        int hour = detail::fixedDigits(text, 11, 2);
+        int minute = detail::fixedDigits(text, 14, 2);
+        int second = detail::fixedDigits(text, 17, 2);
+        if ((year | month | day | hour | minute | second) < 0 || month < 1 || month > 12 || day < 1 || day > 31
+            || hour > 23 || minute > 59 || second > 60) {
+            return system_clock::time_point{};
+        }
+
+        std::size_t pos = 19;
+        long long micros = 0;
+        if (pos < text.size() && text[pos] == '.') {
+            int scale = 6;
+            for (++pos; pos < text.size() && static_cast<unsigned>(text[pos] - '0') <= 9; ++pos) {
+                if (scale > 0) {
+                    micros = micros * 10 + (text[pos] - '0');
+                    --scale;
+                }
+            }
+            while (scale-- > 0) micros *= 10;
+        }
+
+        long long offsetSeconds = 0;
+        if (pos < text.size() && (text[pos] == '+' || text[pos] == '-') && pos + 3 <= text.size()) {
+            int offsetHours = detail::fixedDigits(text, pos + 1, 2);
+            int offsetMinutes = 0;
+            if (pos + 6 <= text.size() && text[pos + 3] == ':') {
+                offsetMinutes = detail::fixedDigits(text, pos + 4, 2);
+            }
+            if (offsetHours < 0 || offsetMinutes < 0) return system_clock::time_point{};
+            offsetSeconds = (offsetHours * 3600LL + offsetMinutes * 60LL) * (text[pos] == '-' ? -1 : 1);
+        }
+
+        long long days = detail::daysFromCivil(year, static_cast<unsigned>(month), static_cast<unsigned>(day));
+        long long seconds = days * 86400 + hour * 3600LL + minute * 60LL + second - offsetSeconds;
+        return system_clock::time_point{duration_cast<system_clock::duration>(microseconds{seconds * 1'000'000 + micros})};
+    }
+
     inline std::chrono::system_clock::time_point parseTimestamp(const char* timestampStr) {
         if (timestampStr == nullptr) {
             return std::chrono::system_clock::time_point{};
         }
-        int year, month, day, hour, minute, second;
-        if (std::sscanf(timestampStr, "%d-%d-%d %d:%d:%d", &year, &month, &day, &hour, &minute, &second) == 6) {
-            std::tm tm = {};
-            tm.tm_year = year - 1900;
-            tm.tm_mon = month - 1;
-            tm.tm_mday = day;
-            tm.tm_hour = hour;
-            tm.tm_min = minute;
-            tm.tm_sec = second;
-            tm.tm_isdst = -1;
-            std::time_t t = std::mktime(&tm);
-            auto tp = std::chrono::system_clock::from_time_t(t);
-            return tp;
-        }
-        return std::chrono::system_clock::time_point{};
+        return parseTimestamp(std::string_view(timestampStr));
     }
 
-    inline std::unique_ptr<char[]> formatTimestamp(const std::chrono::system_clock::time_point& timestamp, int gmtOffsetHours = 0) {
-        auto adjustedTime = timestamp + std::chrono::hours(gmtOffsetHours);
-        std::time_t t = std::chrono::system_clock::to_time_t(adjustedTime);
-        std::tm* tm_ptr = std::gmtime(&t);
-        if (!tm_ptr) return nullptr;
-        const size_t bufSize = 64;
-        auto buffer = std::make_unique<char[]>(bufSize);
-        std::strftime(buffer.get(), bufSize, "%d %b %H:%M", tm_ptr);
-        return buffer;
+    // Fixed-size formatted timestamp held on the stack; streams like a string
+    struct TimestampText {
+        std::array<char, 16> data{};
+        std::size_t size = 0;
+
+        std::string_view view() const { return {data.data(), size}; }
+        const char* c_str() const { return data.data(); }
+        std::string str() const { return std::string(view()); }
+    };
+
+    inline std::ostream& operator<<(std::ostream& os, const TimestampText& text) {
+        return os.write(text.data.data(), static_cast<std::streamsize>(text.size));
+    }
+
+    // Formats as "%d %b %H:%M" (e.g. "05 Jan 14:30") in UTC shifted by gmtOffsetHours
+    inline TimestampText formatTimestamp(const std::chrono::system_clock::time_point& timestamp, int gmtOffsetHours = 0) {
+        using namespace std::chrono;
+        static constexpr std::string_view months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+        auto adjusted = floor<minutes>(timestamp + hours(gmtOffsetHours));
+        auto days = floor<std::chrono::days>(adjusted);
+        long long minuteOfDay = (adjusted - days).count();
+        auto date = detail::civilFromDays(days.time_since_epoch().count());
+
+        TimestampText text;
+        char* out = text.data.data();
+        auto twoDigits = [&out](unsigned value) {
+            *out++ = static_cast<char>('0' + value / 10);
+            *out++ = static_cast<char>('0' + value % 10);
+        };
+        twoDigits(date.day);
+        *out++ = ' ';
+        for (std::size_t i = 0; i < 3; ++i) *out++ = months[(date.month - 1) * 3 + i];
+        *out++ = ' ';
+        twoDigits(static_cast<unsigned>(minuteOfDay / 60));
+        *out++ = ':';
+        twoDigits(static_cast<unsigned>(minuteOfDay % 60));
+        *out = '\0';
+        text.size = static_cast<std::size_t>(out - text.data.data());
+        return text;
     }
 }
 